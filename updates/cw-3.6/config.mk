@@ -160,6 +160,7 @@ endif #CONFIG_COMPAT_KERNEL_2_6_33
 # export CONFIG_MAC80211_VERBOSE_MHWMP_DEBUG=y
 # export CONFIG_MAC80211_VERBOSE_TDLS_DEBUG
 # export CONFIG_MAC80211_DEBUG_COUNTERS=y
+# export CONFIG_MAC80211_CRYPTO_TEST=y
 
 # choose between pid and minstrel as default rate control algorithm
 export CONFIG_MAC80211_RC_DEFAULT=minstrel_ht
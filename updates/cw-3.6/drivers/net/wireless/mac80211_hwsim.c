@@ -18,6 +18,12 @@
 #include <linux/list.h>
 #include <linux/slab.h>
 #include <linux/spinlock.h>
+#include <linux/rcupdate.h>
+#include <linux/vmalloc.h>
+#include <linux/hrtimer.h>
+#include <linux/net.h>
+#include <linux/interrupt.h>
+#include <linux/random.h>
 #include <net/dst.h>
 #include <net/xfrm.h>
 #include <net/mac80211.h>
@@ -33,12 +39,20 @@
 
 #define WARN_QUEUE 100
 #define MAX_QUEUE 200
+#define HWSIM_MAX_RADIOS 1024
+
+#define HWSIM_AMPDU_MAX_FRAMES 64
+#define HWSIM_AMPDU_MAX_LEN 65535
+
+#define HWSIM_NL_BATCH_FRAMES 64
+#define HWSIM_NL_BATCH_SIZE (32 * 1024)
 
 MODULE_AUTHOR("Jouni Malinen");
 MODULE_DESCRIPTION("Software simulator of 802.11 radio(s) for mac80211");
 MODULE_LICENSE("GPL");
 
 static u32 wmediumd_pid;
+static bool wmediumd_batch;
 
 static int radios = 2;
 module_param(radios, int, 0444);
@@ -48,6 +62,14 @@ static bool fake_hw_scan;
 module_param(fake_hw_scan, bool, 0444);
 MODULE_PARM_DESC(fake_hw_scan, "Install fake (no-op) hw-scan handler");
 
+static bool rx_napi;
+module_param(rx_napi, bool, 0444);
+MODULE_PARM_DESC(rx_napi, "Receive frames from a NAPI poll and deliver them through GRO");
+
+static bool virtual_time;
+module_param(virtual_time, bool, 0444);
+MODULE_PARM_DESC(virtual_time, "Drive TSF, beacons and airtime from a simulated clock");
+
 /**
  * enum hwsim_regtest - the type of regulatory tests we offer
  *
@@ -183,6 +205,7 @@ static inline void hwsim_clear_magic(struct ieee80211_vif *vif)
 
 struct hwsim_sta_priv {
 	u32 magic;
+	u8 ampdu_buf_size[IEEE80211_QOS_CTL_TID_MASK + 1];
 };
 
 #define HWSIM_STA_MAGIC	0x6d537748
@@ -288,8 +311,50 @@ static const struct ieee80211_rate hwsim_rates[] = {
 static spinlock_t hwsim_radio_lock;
 static struct list_head hwsim_radios;
 
+#define HWSIM_NUM_CHANNELS \
+	(ARRAY_SIZE(hwsim_channels_2ghz) + ARRAY_SIZE(hwsim_channels_5ghz))
+
+/*
+ * In-kernel medium model
+ *
+ * Every channel has an RCU protected array of the started radios tuned
+ * to it, so a transmitted frame only visits the radios that can hear it
+ * and the TX path never takes hwsim_radio_lock. The arrays are rebuilt
+ * under hwsim_medium_mutex whenever a radio starts, stops or changes
+ * channel.
+ *
+ * hwsim_links is a radios x radios matrix, indexed by the transmitter
+ * and receiver index, that userspace fills with HWSIM_CMD_SET_LINK. It
+ * is only allocated once the first link is configured; until then the
+ * medium is perfect. Link fields are updated in place, a frame racing
+ * with an update may see a mix of old and new values.
+ */
+struct hwsim_chan_radios {
+	struct rcu_head rcu_head;
+	unsigned int n;
+	struct mac80211_hwsim_data *radios[];
+};
+
+#define HWSIM_LINK_SIGNAL	BIT(0)
+
+struct hwsim_link {
+	u16 loss;	/* frame loss, in 1/1000 */
+	u16 max_rate;	/* highest usable bitrate in 100 kbps, 0 for any */
+	u16 delay;	/* propagation delay, in usecs */
+	s8 signal;	/* RX signal in dBm, if HWSIM_LINK_SIGNAL is set */
+	u8 flags;
+};
+
+static DEFINE_MUTEX(hwsim_medium_mutex);
+static struct hwsim_chan_radios __rcu *hwsim_chan_radios[HWSIM_NUM_CHANNELS];
+/* channels whose radio array still has to be rebuilt */
+static DECLARE_BITMAP(hwsim_chan_stale, HWSIM_NUM_CHANNELS);
+static struct hwsim_link __rcu *hwsim_links;
+
 struct mac80211_hwsim_data {
 	struct list_head list;
+	unsigned int idx;	/* index into hwsim_links */
+	int chan_idx;		/* hwsim_chan_radios entry, -1 for none */
 	struct ieee80211_hw *hw;
 	struct device *dev;
 	struct ieee80211_supported_band bands[IEEE80211_NUM_BANDS];
@@ -301,6 +366,8 @@ struct mac80211_hwsim_data {
 
 	struct ieee80211_channel *channel;
 	unsigned long beacon_int; /* in jiffies unit */
+	u32 beacon_int_us;
+	u64 next_tbtt;	/* virtual time of the next beacon, 0 for none */
 	unsigned int rx_filter;
 	bool started, idle, scanning;
 	struct mutex mutex;
@@ -313,6 +380,16 @@ struct mac80211_hwsim_data {
 	struct dentry *debugfs_ps;
 
 	struct sk_buff_head pending;	/* packets pending */
+	struct sk_buff_head rx_queue;	/* frames waiting for the NAPI poll */
+	struct sk_buff_head delay_queue; /* frames still in flight to us */
+	struct hrtimer delay_timer;
+
+	struct sk_buff_head ampdu_queue; /* subframes of the next A-MPDU */
+	struct tasklet_struct ampdu_tasklet;
+	unsigned int ampdu_limit, ampdu_bytes;
+	u32 ampdu_count, ampdu_subframes, ampdu_acked;
+	u64 tx_airtime;	/* in usecs */
+	struct dentry *debugfs_tx_stats;
 	/*
 	 * Only radios in the same group can communicate together (the
 	 * channel has to match too). Each bit represents a group. A
@@ -320,6 +397,14 @@ struct mac80211_hwsim_data {
 	 */
 	u64 group;
 	struct dentry *debugfs_group;
+	struct dentry *debugfs_nl_stats;
+
+	/* wmediumd transport */
+	bool nl_stopped;	/* queues stopped, too many frames pending */
+	u64 nl_tx_frames, nl_tx_bytes;
+	u64 nl_rx_frames, nl_rx_bytes;
+	u64 nl_tx_status, nl_drops;
+	u32 nl_queue_stops;
 
 	int power_level;
 
@@ -362,6 +447,14 @@ static struct nla_policy hwsim_genl_policy[HWSIM_ATTR_MAX + 1] = {
 				 .len = IEEE80211_TX_MAX_RATES*sizeof(
 					struct hwsim_tx_rate)},
 	[HWSIM_ATTR_COOKIE] = { .type = NLA_U64 },
+	[HWSIM_ATTR_LINK_LOSS] = { .type = NLA_U32 },
+	[HWSIM_ATTR_LINK_DELAY] = { .type = NLA_U32 },
+	[HWSIM_ATTR_LINK_MAX_RATE] = { .type = NLA_U32 },
+	[HWSIM_ATTR_LINK_SYMMETRIC] = { .type = NLA_FLAG },
+	[HWSIM_ATTR_FRAMES] = { .type = NLA_NESTED },
+	[HWSIM_ATTR_BATCH] = { .type = NLA_FLAG },
+	[HWSIM_ATTR_TIME] = { .type = NLA_U64 },
+	[HWSIM_ATTR_SEED] = { .type = NLA_U64 },
 };
 
 static netdev_tx_t hwsim_mon_xmit(struct sk_buff *skb,
@@ -372,11 +465,60 @@ static netdev_tx_t hwsim_mon_xmit(struct sk_buff *skb,
 	return NETDEV_TX_OK;
 }
 
+/*
+ * With virtual_time the radios don't look at the real clock: TSF and
+ * beacons follow hwsim_vtime, in usecs, which moves forward by the
+ * airtime of every frame the in-kernel medium carries and whenever
+ * userspace sends HWSIM_CMD_ADVANCE_TIME. The medium also draws its
+ * losses from a seedable generator then, so runs can be repeated.
+ */
+static atomic64_t hwsim_vtime = ATOMIC64_INIT(0);
+/* longest HWSIM_CMD_ADVANCE_TIME step, so beacon catch-up stays short */
+#define HWSIM_VTIME_MAX_STEP	(10 * USEC_PER_SEC)
+static DEFINE_SPINLOCK(hwsim_rnd_lock);
+static struct rnd_state hwsim_rnd;
+
+static u64 hwsim_now(void)
+{
+	struct timeval tv;
+
+	if (virtual_time)
+		return atomic64_read(&hwsim_vtime);
+
+	tv = ktime_to_timeval(ktime_get_real());
+	return tv.tv_sec * USEC_PER_SEC + tv.tv_usec;
+}
+
+/* move the virtual clock forward to @t, it never goes back */
+static void hwsim_vtime_forward(u64 t)
+{
+	u64 old;
+
+	do {
+		old = atomic64_read(&hwsim_vtime);
+		if (old >= t)
+			return;
+	} while (atomic64_cmpxchg(&hwsim_vtime, old, t) != old);
+}
+
+static u32 hwsim_random(void)
+{
+	unsigned long flags;
+	u32 r;
+
+	if (!virtual_time)
+		return net_random();
+
+	spin_lock_irqsave(&hwsim_rnd_lock, flags);
+	r = prandom32(&hwsim_rnd);
+	spin_unlock_irqrestore(&hwsim_rnd_lock, flags);
+
+	return r;
+}
+
 static __le64 __mac80211_hwsim_get_tsf(struct mac80211_hwsim_data *data)
 {
-	struct timeval tv = ktime_to_timeval(ktime_get_real());
-	u64 now = tv.tv_sec * USEC_PER_SEC + tv.tv_usec;
-	return cpu_to_le64(now + data->tsf_offset);
+	return cpu_to_le64(hwsim_now() + data->tsf_offset);
 }
 
 static u64 mac80211_hwsim_get_tsf(struct ieee80211_hw *hw,
@@ -390,9 +532,7 @@ static void mac80211_hwsim_set_tsf(struct ieee80211_hw *hw,
 		struct ieee80211_vif *vif, u64 tsf)
 {
 	struct mac80211_hwsim_data *data = hw->priv;
-	struct timeval tv = ktime_to_timeval(ktime_get_real());
-	u64 now = tv.tv_sec * USEC_PER_SEC + tv.tv_usec;
-	data->tsf_offset = tsf - now;
+	data->tsf_offset = tsf - hwsim_now();
 }
 
 static void mac80211_hwsim_monitor_rx(struct ieee80211_hw *hw,
@@ -543,18 +683,239 @@ static bool mac80211_hwsim_addr_match(struct mac80211_hwsim_data *data,
 	return md.ret;
 }
 
+/*
+ * Frames for wmediumd are collected into one HWSIM_CMD_FRAMES message
+ * when it registered with %HWSIM_ATTR_BATCH, the message goes out when
+ * it is full or from a tasklet once the current burst of transmissions
+ * is over. Older wmediumd get one HWSIM_CMD_FRAME message per frame.
+ */
+struct hwsim_nl_batch {
+	spinlock_t lock;
+	struct sk_buff *msg;
+	void *hdr;
+	struct nlattr *frames;
+	u32 pid;
+	unsigned int n;
+	struct {
+		struct mac80211_hwsim_data *data;
+		struct sk_buff *skb;
+	} entries[HWSIM_NL_BATCH_FRAMES];
+	struct tasklet_struct tasklet;
+
+	u64 msgs, errors;
+};
+
+static struct hwsim_nl_batch hwsim_nl_batch;
+
+/* take the frame with the given cookie off the pending queue */
+static struct sk_buff *hwsim_pending_get(struct mac80211_hwsim_data *data,
+					 unsigned long cookie)
+{
+	struct sk_buff *skb, *ret = NULL;
+	unsigned long flags;
+
+	spin_lock_irqsave(&data->pending.lock, flags);
+	skb_queue_walk(&data->pending, skb) {
+		if ((unsigned long)skb == cookie) {
+			__skb_unlink(skb, &data->pending);
+			ret = skb;
+			break;
+		}
+	}
+	spin_unlock_irqrestore(&data->pending.lock, flags);
+
+	return ret;
+}
+
+static void hwsim_pending_done(struct mac80211_hwsim_data *data)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&data->pending.lock, flags);
+	if (data->nl_stopped &&
+	    skb_queue_len(&data->pending) < WARN_QUEUE / 2) {
+		data->nl_stopped = false;
+		ieee80211_wake_queues(data->hw);
+	}
+	spin_unlock_irqrestore(&data->pending.lock, flags);
+}
+
+static void hwsim_pending_purge(struct mac80211_hwsim_data *data)
+{
+	struct sk_buff *skb;
+
+	while ((skb = skb_dequeue(&data->pending))) {
+		data->nl_drops++;
+		ieee80211_free_txskb(data->hw, skb);
+	}
+	hwsim_pending_done(data);
+}
+
+static void hwsim_nl_batch_flush(struct hwsim_nl_batch *b)
+{
+	struct mac80211_hwsim_data *data;
+	struct sk_buff *skb;
+	unsigned int i;
+	int err;
+
+	if (!b->msg)
+		return;
+
+	if (b->frames)
+		nla_nest_end(b->msg, b->frames);
+	genlmsg_end(b->msg, b->hdr);
+
+	err = genlmsg_unicast(&init_net, b->msg, b->pid);
+	if (err) {
+		b->errors++;
+		/* wmediumd will never answer, fail the frames now */
+		for (i = 0; i < b->n; i++) {
+			data = b->entries[i].data;
+			skb = hwsim_pending_get(data,
+					(unsigned long)b->entries[i].skb);
+			if (!skb)
+				continue;
+			data->nl_drops++;
+			ieee80211_free_txskb(data->hw, skb);
+			hwsim_pending_done(data);
+		}
+	} else {
+		b->msgs++;
+	}
+
+	b->msg = NULL;
+	b->frames = NULL;
+	b->n = 0;
+}
+
+static void hwsim_nl_batch_tasklet(unsigned long arg)
+{
+	struct hwsim_nl_batch *b = (struct hwsim_nl_batch *) arg;
+
+	spin_lock_bh(&b->lock);
+	hwsim_nl_batch_flush(b);
+	spin_unlock_bh(&b->lock);
+}
+
+static int hwsim_nl_put_frame(struct sk_buff *msg,
+			      struct mac80211_hwsim_data *data,
+			      struct sk_buff *my_skb)
+{
+	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(my_skb);
+	struct hwsim_tx_rate tx_attempts[IEEE80211_TX_MAX_RATES];
+	unsigned int hwsim_flags = 0;
+	int i;
+
+	if (nla_put(msg, HWSIM_ATTR_ADDR_TRANSMITTER,
+		    sizeof(struct mac_address), data->addresses[1].addr))
+		return -EMSGSIZE;
+
+	/* We get the skb->data */
+	if (nla_put(msg, HWSIM_ATTR_FRAME, my_skb->len, my_skb->data))
+		return -EMSGSIZE;
+
+	/* We get the flags for this transmission, and we translate them to
+	   wmediumd flags  */
+
+	if (info->flags & IEEE80211_TX_CTL_REQ_TX_STATUS)
+		hwsim_flags |= HWSIM_TX_CTL_REQ_TX_STATUS;
+
+	if (info->flags & IEEE80211_TX_CTL_NO_ACK)
+		hwsim_flags |= HWSIM_TX_CTL_NO_ACK;
+
+	if (nla_put_u32(msg, HWSIM_ATTR_FLAGS, hwsim_flags))
+		return -EMSGSIZE;
+
+	/* We get the tx control (rate and retries) info*/
+
+	for (i = 0; i < IEEE80211_TX_MAX_RATES; i++) {
+		tx_attempts[i].idx = info->status.rates[i].idx;
+		tx_attempts[i].count = info->status.rates[i].count;
+	}
+
+	if (nla_put(msg, HWSIM_ATTR_TX_INFO,
+		    sizeof(struct hwsim_tx_rate)*IEEE80211_TX_MAX_RATES,
+		    tx_attempts))
+		return -EMSGSIZE;
+
+	/* We create a cookie to identify this skb */
+	if (nla_put_u64(msg, HWSIM_ATTR_COOKIE, (unsigned long) my_skb))
+		return -EMSGSIZE;
+
+	return 0;
+}
+
+static int hwsim_nl_batch_add(struct hwsim_nl_batch *b,
+			      struct mac80211_hwsim_data *data,
+			      struct sk_buff *my_skb, u32 dst_pid)
+{
+	struct nlattr *entry;
+
+	if (!b->msg) {
+		if (wmediumd_batch)
+			b->msg = genlmsg_new(HWSIM_NL_BATCH_SIZE, GFP_ATOMIC);
+		if (!b->msg)
+			b->msg = genlmsg_new(GENLMSG_DEFAULT_SIZE, GFP_ATOMIC);
+		if (!b->msg)
+			return -ENOMEM;
+
+		b->hdr = genlmsg_put(b->msg, 0, 0, &hwsim_genl_family, 0,
+				     wmediumd_batch ? HWSIM_CMD_FRAMES :
+						      HWSIM_CMD_FRAME);
+		if (!b->hdr) {
+			nlmsg_free(b->msg);
+			b->msg = NULL;
+			return -ENOMEM;
+		}
+		b->pid = dst_pid;
+
+		if (wmediumd_batch) {
+			b->frames = nla_nest_start(b->msg, HWSIM_ATTR_FRAMES);
+			if (!b->frames) {
+				nlmsg_free(b->msg);
+				b->msg = NULL;
+				return -ENOMEM;
+			}
+		}
+	}
+
+	if (!b->frames) {
+		/* unbatched, the single frame goes to the top level */
+		if (hwsim_nl_put_frame(b->msg, data, my_skb))
+			return -EMSGSIZE;
+	} else {
+		entry = nla_nest_start(b->msg, b->n + 1);
+		if (!entry)
+			return -EMSGSIZE;
+		if (hwsim_nl_put_frame(b->msg, data, my_skb)) {
+			nla_nest_cancel(b->msg, entry);
+			return -EMSGSIZE;
+		}
+		nla_nest_end(b->msg, entry);
+	}
+
+	b->entries[b->n].data = data;
+	b->entries[b->n].skb = my_skb;
+	b->n++;
+
+	/* Enqueue the packet */
+	skb_queue_tail(&data->pending, my_skb);
+	data->nl_tx_frames++;
+	data->nl_tx_bytes += my_skb->len;
+
+	return 0;
+}
+
 static void mac80211_hwsim_tx_frame_nl(struct ieee80211_hw *hw,
 				       struct sk_buff *my_skb,
 				       int dst_pid)
 {
-	struct sk_buff *skb;
+	struct hwsim_nl_batch *b = &hwsim_nl_batch;
 	struct mac80211_hwsim_data *data = hw->priv;
 	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *) my_skb->data;
-	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(my_skb);
-	void *msg_head;
-	unsigned int hwsim_flags = 0;
-	int i;
-	struct hwsim_tx_rate tx_attempts[IEEE80211_TX_MAX_RATES];
+	struct sk_buff *skb;
+	unsigned long flags;
+	int err;
 
 	if (data->idle) {
 		wiphy_debug(hw->wiphy, "Trying to TX when idle - reject\n");
@@ -567,153 +928,722 @@ static void mac80211_hwsim_tx_frame_nl(struct ieee80211_hw *hw,
 	/* If the queue contains MAX_QUEUE skb's drop some */
 	if (skb_queue_len(&data->pending) >= MAX_QUEUE) {
 		/* Droping until WARN_QUEUE level */
-		while (skb_queue_len(&data->pending) >= WARN_QUEUE)
-			skb_dequeue(&data->pending);
+		while (skb_queue_len(&data->pending) >= WARN_QUEUE &&
+		       (skb = skb_dequeue(&data->pending))) {
+			data->nl_drops++;
+			ieee80211_free_txskb(hw, skb);
+		}
 	}
 
-	skb = genlmsg_new(GENLMSG_DEFAULT_SIZE, GFP_ATOMIC);
-	if (skb == NULL)
-		goto nla_put_failure;
+	spin_lock_bh(&b->lock);
+	if (b->msg && b->pid != dst_pid)
+		hwsim_nl_batch_flush(b);
+
+	err = hwsim_nl_batch_add(b, data, my_skb, dst_pid);
+	if (err == -EMSGSIZE && b->n) {
+		/* no room left, send what we have and start over */
+		hwsim_nl_batch_flush(b);
+		err = hwsim_nl_batch_add(b, data, my_skb, dst_pid);
+	}
+
+	if (err) {
+		/* nothing of the frame made it into the message */
+		if (b->msg && !b->n) {
+			nlmsg_free(b->msg);
+			b->msg = NULL;
+			b->frames = NULL;
+		}
+		spin_unlock_bh(&b->lock);
+		printk(KERN_DEBUG "mac80211_hwsim: error occurred in %s\n",
+		       __func__);
+		data->nl_drops++;
+		ieee80211_free_txskb(hw, my_skb);
+		return;
+	}
+
+	if (!b->frames || b->n == HWSIM_NL_BATCH_FRAMES)
+		hwsim_nl_batch_flush(b);
+	else
+		tasklet_schedule(&b->tasklet);
+	spin_unlock_bh(&b->lock);
+
+	/*
+	 * let wmediumd catch up before mac80211 gives us more; this
+	 * pairs with hwsim_pending_done() under the pending lock
+	 */
+	spin_lock_irqsave(&data->pending.lock, flags);
+	if (!data->nl_stopped &&
+	    skb_queue_len(&data->pending) >= WARN_QUEUE) {
+		data->nl_stopped = true;
+		data->nl_queue_stops++;
+		ieee80211_stop_queues(hw);
+	}
+	spin_unlock_irqrestore(&data->pending.lock, flags);
+}
+
+static void mac80211_hwsim_rx(struct mac80211_hwsim_data *data,
+			      struct sk_buff *skb)
+{
+	if (!rx_napi) {
+		ieee80211_rx_irqsafe(data->hw, skb);
+		return;
+	}
+
+	skb_queue_tail(&data->rx_queue, skb);
+	ieee80211_napi_schedule(data->hw);
+}
+
+static int mac80211_hwsim_napi_poll(struct ieee80211_hw *hw, int budget)
+{
+	struct mac80211_hwsim_data *data = hw->priv;
+	struct sk_buff_head frames;
+	struct sk_buff *skb;
+	int done = 0;
+
+	__skb_queue_head_init(&frames);
+	while (done < budget && (skb = skb_dequeue(&data->rx_queue))) {
+		__skb_queue_tail(&frames, skb);
+		done++;
+	}
+
+	ieee80211_rx_napi(hw, &frames);
+
+	if (done < budget) {
+		ieee80211_napi_complete(hw);
+		/* catch frames queued while we were still scheduled */
+		if (!skb_queue_empty(&data->rx_queue))
+			ieee80211_napi_schedule(hw);
+	}
+
+	return done;
+}
+
+static int hwsim_chan_index(struct mac80211_hwsim_data *data,
+			    struct ieee80211_channel *chan)
+{
+	if (chan->band == IEEE80211_BAND_2GHZ)
+		return chan - data->channels_2ghz;
+	return ARRAY_SIZE(hwsim_channels_2ghz) + (chan - data->channels_5ghz);
+}
+
+static int hwsim_medium_rebuild(int chan_idx)
+{
+	struct hwsim_chan_radios *new, *old;
+	struct mac80211_hwsim_data *data;
+
+	lockdep_assert_held(&hwsim_medium_mutex);
+
+	new = kmalloc(sizeof(*new) + radios * sizeof(new->radios[0]),
+		      GFP_KERNEL);
+	if (!new) {
+		printk(KERN_DEBUG "mac80211_hwsim: failed to update the "
+		       "radios of channel %d\n", chan_idx);
+		return -ENOMEM;
+	}
+
+	new->n = 0;
+	spin_lock_bh(&hwsim_radio_lock);
+	list_for_each_entry(data, &hwsim_radios, list)
+		if (data->chan_idx == chan_idx)
+			new->radios[new->n++] = data;
+	spin_unlock_bh(&hwsim_radio_lock);
+
+	old = rcu_dereference_protected(hwsim_chan_radios[chan_idx],
+				lockdep_is_held(&hwsim_medium_mutex));
+	rcu_assign_pointer(hwsim_chan_radios[chan_idx], new);
+	if (old)
+		kfree_rcu(old, rcu_head);
+	return 0;
+}
+
+/*
+ * Move the radio to the channel list it now belongs to, if any. A list
+ * that couldn't be rebuilt is retried on the next update of any radio;
+ * until then a radio left on a list it no longer belongs to is skipped
+ * by the TX path, but one missing from its new channel hears nothing,
+ * so that is reported back.
+ */
+static int hwsim_medium_update(struct mac80211_hwsim_data *data)
+{
+	int chan_idx = -1, old_idx, i, err = 0;
+
+	if (data->started && data->channel)
+		chan_idx = hwsim_chan_index(data, data->channel);
+
+	mutex_lock(&hwsim_medium_mutex);
+	old_idx = data->chan_idx;
+	if (old_idx != chan_idx) {
+		data->chan_idx = chan_idx;
+		if (old_idx >= 0)
+			set_bit(old_idx, hwsim_chan_stale);
+		if (chan_idx >= 0)
+			set_bit(chan_idx, hwsim_chan_stale);
+	}
+
+	for_each_set_bit(i, hwsim_chan_stale, HWSIM_NUM_CHANNELS)
+		if (!hwsim_medium_rebuild(i))
+			clear_bit(i, hwsim_chan_stale);
+
+	if (chan_idx >= 0 && test_bit(chan_idx, hwsim_chan_stale))
+		err = -ENOMEM;
+	mutex_unlock(&hwsim_medium_mutex);
+
+	return err;
+}
+
+static struct hwsim_link *hwsim_link(struct hwsim_link *links,
+				     struct mac80211_hwsim_data *tx,
+				     struct mac80211_hwsim_data *rx)
+{
+	if (!links)
+		return NULL;
+	return &links[tx->idx * radios + rx->idx];
+}
+
+/* decide whether a single transmission over the link gets through */
+static bool hwsim_link_ok(struct hwsim_link *link, u16 bitrate)
+{
+	if (!link)
+		return true;
+	if (link->max_rate && bitrate > link->max_rate)
+		return false;
+	if (link->loss && hwsim_random() % 1000 < link->loss)
+		return false;
+	return true;
+}
+
+/* bitrate of a TX rate entry in 100 kbps */
+static u16 hwsim_tx_bitrate(struct ieee80211_hw *hw,
+			    struct ieee80211_tx_info *info, int i)
+{
+	static const u16 mcs_bitrates[8] = {
+		65, 130, 195, 260, 390, 520, 585, 650
+	};
+	struct ieee80211_tx_rate *rate = &info->control.rates[i];
+	u16 bitrate;
+
+	if (!(rate->flags & IEEE80211_TX_RC_MCS))
+		return hw->wiphy->bands[info->band]->bitrates[rate->idx].bitrate;
+
+	bitrate = mcs_bitrates[rate->idx % 8] * (rate->idx / 8 + 1);
+	if (rate->flags & IEEE80211_TX_RC_40_MHZ_WIDTH)
+		bitrate = bitrate * 27 / 13;
+	if (rate->flags & IEEE80211_TX_RC_SHORT_GI)
+		bitrate = bitrate * 10 / 9;
+	return bitrate;
+}
+
+/* PLCP preamble and header of an OFDM frame */
+#define HWSIM_PREAMBLE_US 20
+
+static void hwsim_fill_rx_status(struct mac80211_hwsim_data *data,
+				 struct ieee80211_tx_info *info, int i,
+				 struct ieee80211_rx_status *rx_status)
+{
+	struct ieee80211_tx_rate *rate = &info->control.rates[i];
+
+	memset(rx_status, 0, sizeof(*rx_status));
+	rx_status->flag |= RX_FLAG_MACTIME_MPDU;
+	rx_status->freq = data->channel->center_freq;
+	rx_status->band = data->channel->band;
+	rx_status->rate_idx = rate->idx;
+	if (rate->flags & IEEE80211_TX_RC_MCS)
+		rx_status->flag |= RX_FLAG_HT;
+	if (rate->flags & IEEE80211_TX_RC_40_MHZ_WIDTH)
+		rx_status->flag |= RX_FLAG_40MHZ;
+	if (rate->flags & IEEE80211_TX_RC_SHORT_GI)
+		rx_status->flag |= RX_FLAG_SHORT_GI;
+	rx_status->signal = data->power_level - 50;
+}
+
+static enum hrtimer_restart hwsim_delay_timer(struct hrtimer *timer)
+{
+	struct mac80211_hwsim_data *data =
+		container_of(timer, struct mac80211_hwsim_data, delay_timer);
+	struct sk_buff_head frames;
+	struct sk_buff *skb;
+	unsigned long flags;
+	ktime_t now = ktime_get();
+
+	__skb_queue_head_init(&frames);
+
+	spin_lock_irqsave(&data->delay_queue.lock, flags);
+	while ((skb = skb_peek(&data->delay_queue)) &&
+	       skb->tstamp.tv64 <= now.tv64) {
+		__skb_unlink(skb, &data->delay_queue);
+		__skb_queue_tail(&frames, skb);
+	}
+	/*
+	 * Re-arm from here rather than returning HRTIMER_RESTART, the
+	 * TX path may have started the timer again in the meantime.
+	 */
+	if (skb)
+		hrtimer_start(timer, skb->tstamp, HRTIMER_MODE_ABS);
+	spin_unlock_irqrestore(&data->delay_queue.lock, flags);
+
+	while ((skb = __skb_dequeue(&frames))) {
+		skb->tstamp.tv64 = 0;
+		mac80211_hwsim_rx(data, skb);
+	}
+
+	return HRTIMER_NORESTART;
+}
+
+/* hand the frame to the receiver once the link delay has passed */
+static void hwsim_rx_delayed(struct mac80211_hwsim_data *data,
+			     struct sk_buff *skb, u16 delay)
+{
+	struct sk_buff_head *q = &data->delay_queue;
+	struct sk_buff *pos;
+	unsigned long flags;
+
+	skb->tstamp = ktime_add_us(ktime_get(), delay);
+
+	/* links differ in delay, keep the queue sorted by arrival time */
+	spin_lock_irqsave(&q->lock, flags);
+	if (!data->started) {
+		spin_unlock_irqrestore(&q->lock, flags);
+		dev_kfree_skb_any(skb);
+		return;
+	}
+	skb_queue_reverse_walk(q, pos)
+		if (pos->tstamp.tv64 <= skb->tstamp.tv64)
+			break;
+	__skb_queue_after(q, pos, skb);
+	if (skb_peek(q) == skb)
+		hrtimer_start(&data->delay_timer, skb->tstamp,
+			      HRTIMER_MODE_ABS);
+	spin_unlock_irqrestore(&q->lock, flags);
+}
+
+static bool hwsim_deliver(struct mac80211_hwsim_data *data,
+			  struct mac80211_hwsim_data *data2,
+			  struct sk_buff *skb,
+			  struct ieee80211_rx_status *rx_status,
+			  struct hwsim_link *link, u16 bitrate)
+{
+	struct ieee80211_rx_status *rxs;
+	struct ieee80211_mgmt *mgmt;
+	struct sk_buff *nskb;
+	u16 delay = link ? link->delay : 0;
+
+	nskb = skb_copy(skb, GFP_ATOMIC);
+	if (nskb == NULL)
+		return false;
+
+	rxs = IEEE80211_SKB_RXCB(nskb);
+	memcpy(rxs, rx_status, sizeof(*rxs));
+	if (link && (link->flags & HWSIM_LINK_SIGNAL))
+		rxs->signal = link->signal;
+
+	/* set bcn timestamp relative to receiver mactime */
+	rxs->mactime = le64_to_cpu(__mac80211_hwsim_get_tsf(data2)) + delay;
+	mgmt = (struct ieee80211_mgmt *) nskb->data;
+	if (ieee80211_is_beacon(mgmt->frame_control) ||
+	    ieee80211_is_probe_resp(mgmt->frame_control))
+		mgmt->u.beacon.timestamp = cpu_to_le64(
+			rxs->mactime +
+			(data->tsf_offset - data2->tsf_offset) +
+			24 * 8 * 10 / bitrate);
+
+	/* in virtual time the delay only shows in the mactime */
+	if (delay && !virtual_time)
+		hwsim_rx_delayed(data2, nskb, delay);
+	else
+		mac80211_hwsim_rx(data2, nskb);
+
+	return true;
+}
+
+static u32 hwsim_airtime(unsigned int len, u16 bitrate)
+{
+	return HWSIM_PREAMBLE_US + len * 80 / bitrate;
+}
+
+/* the medium is busy for the duration of every transmission */
+static void hwsim_account_airtime(struct mac80211_hwsim_data *data, u32 us)
+{
+	data->tx_airtime += us;
+	if (virtual_time)
+		atomic64_add(us, &hwsim_vtime);
+}
+
+static void hwsim_tx_prepare(struct mac80211_hwsim_data *data,
+			     struct sk_buff *skb)
+{
+	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *) skb->data;
+
+	if (data->ps != PS_DISABLED)
+		hdr->frame_control |= cpu_to_le16(IEEE80211_FCTL_PM);
+
+	/* release the skb's source info */
+	skb_orphan(skb);
+	skb_dst_drop(skb);
+	skb->mark = 0;
+	secpath_reset(skb);
+	nf_reset(skb);
+}
+
+/*
+ * Put one transmission of the frame, at the given entry of its rate
+ * chain, on the medium. Returns whether the addressed receiver, which
+ * is stored in @target if it is around, got the frame. Must be called
+ * under rcu_read_lock().
+ */
+static bool hwsim_medium_tx(struct ieee80211_hw *hw, struct sk_buff *skb,
+			    int rate, struct hwsim_link *links,
+			    struct mac80211_hwsim_data **target)
+{
+	struct mac80211_hwsim_data *data = hw->priv, *data2;
+	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *) skb->data;
+	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
+	struct ieee80211_rx_status rx_status;
+	struct hwsim_chan_radios *chan_radios;
+	bool got = false;
+	unsigned int i;
+	u16 bitrate;
+
+	hwsim_fill_rx_status(data, info, rate, &rx_status);
+	bitrate = hwsim_tx_bitrate(hw, info, rate);
+
+	/* Copy skb to all enabled radios that are on the current frequency */
+	chan_radios = rcu_dereference(
+		hwsim_chan_radios[hwsim_chan_index(data, data->channel)]);
+
+	for (i = 0; chan_radios && i < chan_radios->n; i++) {
+		struct hwsim_link *link;
+		bool dst;
+
+		data2 = chan_radios->radios[i];
+		if (data == data2)
+			continue;
+
+		if (data2->idle || !data2->started ||
+		    !hwsim_ps_rx_ok(data2, skb) || !data2->channel ||
+		    data->channel->center_freq != data2->channel->center_freq ||
+		    !(data->group & data2->group))
+			continue;
+
+		dst = !*target && mac80211_hwsim_addr_match(data2, hdr->addr1);
+		if (dst)
+			*target = data2;
+		else if (data2 == *target)
+			dst = true;
+
+		link = hwsim_link(links, data, data2);
+		if (!hwsim_link_ok(link, bitrate))
+			continue;
+
+		if (hwsim_deliver(data, data2, skb, &rx_status, link,
+				  bitrate) && dst)
+			got = true;
+	}
+
+	return got;
+}
+
+/*
+ * The addressed receiver missed the frame or its ACK got lost: walk the
+ * rest of the rate chain like hardware would, until an attempt is ACKed.
+ */
+static bool hwsim_tx_retry(struct ieee80211_hw *hw,
+			   struct mac80211_hwsim_data *target,
+			   struct sk_buff *skb, struct hwsim_link *links,
+			   u8 *tries)
+{
+	struct mac80211_hwsim_data *data = hw->priv;
+	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
+	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *) skb->data;
+	struct hwsim_link *link = hwsim_link(links, data, target);
+	struct hwsim_link *back = hwsim_link(links, target, data);
+	struct ieee80211_rx_status rx_status;
+	u16 bitrate;
+	int i;
+
+	hdr->frame_control |= cpu_to_le16(IEEE80211_FCTL_RETRY);
+
+	for (i = 0; i < IEEE80211_TX_MAX_RATES; i++) {
+		struct ieee80211_tx_rate *rate = &info->control.rates[i];
+
+		if (rate->idx < 0 || !rate->count)
+			break;
+
+		hwsim_fill_rx_status(data, info, i, &rx_status);
+		bitrate = hwsim_tx_bitrate(hw, info, i);
+
+		while (tries[i] < rate->count) {
+			tries[i]++;
+			hwsim_account_airtime(data,
+					      hwsim_airtime(skb->len, bitrate));
+			if (!hwsim_link_ok(link, bitrate))
+				continue;
+			if (hwsim_deliver(data, target, skb, &rx_status,
+					  link, bitrate) &&
+			    hwsim_link_ok(back, 0))
+				return true;
+		}
+	}
+
+	return false;
+}
+
+static bool mac80211_hwsim_tx_frame_no_nl(struct ieee80211_hw *hw,
+					  struct sk_buff *skb, u8 *tries)
+{
+	struct mac80211_hwsim_data *data = hw->priv;
+	struct mac80211_hwsim_data *target = NULL;
+	bool ack = false;
+	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
+	struct hwsim_link *links;
+
+	if (tries) {
+		memset(tries, 0, IEEE80211_TX_MAX_RATES);
+		tries[0] = 1;
+	}
+
+	if (data->idle) {
+		wiphy_debug(hw->wiphy, "Trying to TX when idle - reject\n");
+		return false;
+	}
+
+	hwsim_tx_prepare(data, skb);
+	hwsim_account_airtime(data,
+		hwsim_airtime(skb->len, hwsim_tx_bitrate(hw, info, 0)));
 
-	msg_head = genlmsg_put(skb, 0, 0, &hwsim_genl_family, 0,
-			       HWSIM_CMD_FRAME);
-	if (msg_head == NULL) {
-		printk(KERN_DEBUG "mac80211_hwsim: problem with msg_head\n");
-		goto nla_put_failure;
-	}
+	rcu_read_lock();
+	links = rcu_dereference(hwsim_links);
 
-	if (nla_put(skb, HWSIM_ATTR_ADDR_TRANSMITTER,
-		    sizeof(struct mac_address), data->addresses[1].addr))
-		goto nla_put_failure;
+	if (hwsim_medium_tx(hw, skb, 0, links, &target))
+		ack = hwsim_link_ok(hwsim_link(links, target, data), 0);
 
-	/* We get the skb->data */
-	if (nla_put(skb, HWSIM_ATTR_FRAME, my_skb->len, my_skb->data))
-		goto nla_put_failure;
+	if (tries && target && !ack &&
+	    !(info->flags & IEEE80211_TX_CTL_NO_ACK))
+		ack = hwsim_tx_retry(hw, target, skb, links, tries);
+	rcu_read_unlock();
 
-	/* We get the flags for this transmission, and we translate them to
-	   wmediumd flags  */
+	return ack;
+}
 
-	if (info->flags & IEEE80211_TX_CTL_REQ_TX_STATUS)
-		hwsim_flags |= HWSIM_TX_CTL_REQ_TX_STATUS;
+/*
+ * A-MPDU emulation
+ *
+ * Frames mac80211 marks for aggregation are collected per radio while
+ * they share receiver, TID and rate, up to the BlockAck window of the
+ * session, and go out as one A-MPDU when the window is full, a frame
+ * that doesn't fit comes along or the current burst of transmissions
+ * is over. Every attempt of the A-MPDU costs a single preamble, each
+ * subframe that is still outstanding gets its own loss draw, and the
+ * BlockAck, when the receiver got anything and it makes it back,
+ * acknowledges what arrived. Attempts walk the rate chain of the first
+ * subframe like a single frame's retries do.
+ */
+static bool hwsim_ampdu_match(struct sk_buff *head, struct sk_buff *skb)
+{
+	struct ieee80211_hdr *hdr1 = (struct ieee80211_hdr *) head->data;
+	struct ieee80211_hdr *hdr2 = (struct ieee80211_hdr *) skb->data;
+	struct ieee80211_tx_info *info1 = IEEE80211_SKB_CB(head);
+	struct ieee80211_tx_info *info2 = IEEE80211_SKB_CB(skb);
+
+	return ether_addr_equal(hdr1->addr1, hdr2->addr1) &&
+	       ether_addr_equal(hdr1->addr2, hdr2->addr2) &&
+	       (*ieee80211_get_qos_ctl(hdr1) & IEEE80211_QOS_CTL_TID_MASK) ==
+	       (*ieee80211_get_qos_ctl(hdr2) & IEEE80211_QOS_CTL_TID_MASK) &&
+	       info1->control.rates[0].idx == info2->control.rates[0].idx &&
+	       info1->control.rates[0].flags == info2->control.rates[0].flags;
+}
 
-	if (info->flags & IEEE80211_TX_CTL_NO_ACK)
-		hwsim_flags |= HWSIM_TX_CTL_NO_ACK;
+static unsigned int hwsim_ampdu_limit(struct sk_buff *skb)
+{
+	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
+	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *) skb->data;
+	struct hwsim_sta_priv *sp;
+	u8 tid;
 
-	if (nla_put_u32(skb, HWSIM_ATTR_FLAGS, hwsim_flags))
-		goto nla_put_failure;
+	if (!info->control.sta)
+		return 1;
 
-	/* We get the tx control (rate and retries) info*/
+	sp = (void *)info->control.sta->drv_priv;
+	tid = *ieee80211_get_qos_ctl(hdr) & IEEE80211_QOS_CTL_TID_MASK;
+	return clamp_t(unsigned int, sp->ampdu_buf_size[tid], 1,
+		       HWSIM_AMPDU_MAX_FRAMES);
+}
 
-	for (i = 0; i < IEEE80211_TX_MAX_RATES; i++) {
-		tx_attempts[i].idx = info->status.rates[i].idx;
-		tx_attempts[i].count = info->status.rates[i].count;
+static void hwsim_ampdu_tx(struct ieee80211_hw *hw,
+			   struct sk_buff_head *frames)
+{
+	struct mac80211_hwsim_data *data = hw->priv;
+	struct mac80211_hwsim_data *target = NULL;
+	struct sk_buff *first = skb_peek(frames), *skb, *last_lost = NULL;
+	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(first);
+	struct ieee80211_tx_info *txi;
+	struct ieee80211_hdr *hdr;
+	DECLARE_BITMAP(acked, HWSIM_AMPDU_MAX_FRAMES);
+	DECLARE_BITMAP(got, HWSIM_AMPDU_MAX_FRAMES);
+	u8 tries[IEEE80211_TX_MAX_RATES] = {};
+	unsigned int n = skb_queue_len(frames), n_acked = 0, len, i;
+	struct hwsim_link *links;
+	__le16 retry_bit = cpu_to_le16(IEEE80211_FCTL_RETRY);
+	bool retry;
+	u16 bitrate;
+	int r;
+
+	bitmap_zero(acked, HWSIM_AMPDU_MAX_FRAMES);
+
+	/* the whole A-MPDU goes out on the rate chain of the first one */
+	skb_queue_walk(frames, skb) {
+		hwsim_tx_prepare(data, skb);
+		txi = IEEE80211_SKB_CB(skb);
+		memcpy(txi->control.rates, info->control.rates,
+		       sizeof(txi->control.rates));
 	}
 
-	if (nla_put(skb, HWSIM_ATTR_TX_INFO,
-		    sizeof(struct hwsim_tx_rate)*IEEE80211_TX_MAX_RATES,
-		    tx_attempts))
-		goto nla_put_failure;
+	rcu_read_lock();
+	links = rcu_dereference(hwsim_links);
 
-	/* We create a cookie to identify this skb */
-	if (nla_put_u64(skb, HWSIM_ATTR_COOKIE, (unsigned long) my_skb))
-		goto nla_put_failure;
+	for (r = 0; r < IEEE80211_TX_MAX_RATES && n_acked < n; r++) {
+		struct ieee80211_tx_rate *rate = &info->control.rates[r];
+
+		if (rate->idx < 0 || !rate->count)
+			break;
 
-	genlmsg_end(skb, msg_head);
-	genlmsg_unicast(&init_net, skb, dst_pid);
+		bitrate = hwsim_tx_bitrate(hw, info, r);
+
+		while (tries[r] < rate->count && n_acked < n) {
+			tries[r]++;
+			bitmap_zero(got, HWSIM_AMPDU_MAX_FRAMES);
+
+			retry = r || tries[r] > 1;
+			len = 0;
+			i = 0;
+			skb_queue_walk(frames, skb) {
+				if (test_bit(i++, acked))
+					continue;
+				hdr = (struct ieee80211_hdr *) skb->data;
+				if (retry)
+					hdr->frame_control |= retry_bit;
+				len += skb->len;
+				if (hwsim_medium_tx(hw, skb, r, links, &target))
+					set_bit(i - 1, got);
+			}
+			hwsim_account_airtime(data,
+					      hwsim_airtime(len, bitrate));
 
-	/* Enqueue the packet */
-	skb_queue_tail(&data->pending, my_skb);
-	return;
+			/* no BlockAck without a subframe to answer for */
+			if (bitmap_empty(got, HWSIM_AMPDU_MAX_FRAMES) ||
+			    !hwsim_link_ok(hwsim_link(links, target, data), 0))
+				continue;
 
-nla_put_failure:
-	printk(KERN_DEBUG "mac80211_hwsim: error occurred in %s\n", __func__);
-}
+			bitmap_or(acked, acked, got, HWSIM_AMPDU_MAX_FRAMES);
+			n_acked = bitmap_weight(acked, HWSIM_AMPDU_MAX_FRAMES);
+		}
+	}
+	rcu_read_unlock();
 
-static bool mac80211_hwsim_tx_frame_no_nl(struct ieee80211_hw *hw,
-					  struct sk_buff *skb)
-{
-	struct mac80211_hwsim_data *data = hw->priv, *data2;
-	bool ack = false;
-	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *) skb->data;
-	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
-	struct ieee80211_rx_status rx_status;
-	struct ieee80211_rate *txrate = ieee80211_get_tx_rate(hw, info);
+	data->ampdu_count++;
+	data->ampdu_subframes += n;
+	data->ampdu_acked += n_acked;
 
-	if (data->idle) {
-		wiphy_debug(hw->wiphy, "Trying to TX when idle - reject\n");
-		return false;
+	i = 0;
+	skb_queue_walk(frames, skb) {
+		if (!test_bit(i++, acked))
+			last_lost = skb;
 	}
 
-	memset(&rx_status, 0, sizeof(rx_status));
-	rx_status.flag |= RX_FLAG_MACTIME_MPDU;
-	rx_status.freq = data->channel->center_freq;
-	rx_status.band = data->channel->band;
-	rx_status.rate_idx = info->control.rates[0].idx;
-	if (info->control.rates[0].flags & IEEE80211_TX_RC_MCS)
-		rx_status.flag |= RX_FLAG_HT;
-	if (info->control.rates[0].flags & IEEE80211_TX_RC_40_MHZ_WIDTH)
-		rx_status.flag |= RX_FLAG_40MHZ;
-	if (info->control.rates[0].flags & IEEE80211_TX_RC_SHORT_GI)
-		rx_status.flag |= RX_FLAG_SHORT_GI;
-	/* TODO: simulate real signal strength (and optional packet loss) */
-	rx_status.signal = data->power_level - 50;
+	i = 0;
+	while ((skb = __skb_dequeue(frames))) {
+		txi = IEEE80211_SKB_CB(skb);
+		ieee80211_tx_info_clear_status(txi);
+
+		if (test_bit(i++, acked))
+			txi->flags |= IEEE80211_TX_STAT_ACK;
+
+		/* the first subframe carries the status of the A-MPDU */
+		if (skb == first) {
+			txi->flags |= IEEE80211_TX_STAT_AMPDU;
+			txi->status.ampdu_len = n;
+			txi->status.ampdu_ack_len = n_acked;
+			for (r = 0; r < IEEE80211_TX_MAX_RATES; r++) {
+				if (!tries[r]) {
+					txi->status.rates[r].idx = -1;
+					break;
+				}
+				txi->status.rates[r].count = tries[r];
+			}
+		}
 
-	if (data->ps != PS_DISABLED)
-		hdr->frame_control |= cpu_to_le16(IEEE80211_FCTL_PM);
+		/* have mac80211 move the receiver's window past the losses */
+		if (skb == last_lost)
+			txi->flags |= IEEE80211_TX_STAT_AMPDU_NO_BACK;
 
-	/* release the skb's source info */
-	skb_orphan(skb);
-	skb_dst_drop(skb);
-	skb->mark = 0;
-	secpath_reset(skb);
-	nf_reset(skb);
+		ieee80211_tx_status_irqsafe(hw, skb);
+	}
+}
 
-	/* Copy skb to all enabled radios that are on the current frequency */
-	spin_lock(&hwsim_radio_lock);
-	list_for_each_entry(data2, &hwsim_radios, list) {
-		struct sk_buff *nskb;
-		struct ieee80211_mgmt *mgmt;
+static void hwsim_ampdu_flush(struct ieee80211_hw *hw)
+{
+	struct mac80211_hwsim_data *data = hw->priv;
+	struct sk_buff_head frames;
 
-		if (data == data2)
-			continue;
+	if (skb_queue_empty(&data->ampdu_queue))
+		return;
 
-		if (data2->idle || !data2->started ||
-		    !hwsim_ps_rx_ok(data2, skb) || !data2->channel ||
-		    data->channel->center_freq != data2->channel->center_freq ||
-		    !(data->group & data2->group))
-			continue;
+	__skb_queue_head_init(&frames);
+	spin_lock_bh(&data->ampdu_queue.lock);
+	skb_queue_splice_init(&data->ampdu_queue, &frames);
+	spin_unlock_bh(&data->ampdu_queue.lock);
 
-		nskb = skb_copy(skb, GFP_ATOMIC);
-		if (nskb == NULL)
-			continue;
+	if (!skb_queue_empty(&frames))
+		hwsim_ampdu_tx(hw, &frames);
+}
+
+static void hwsim_ampdu_tasklet(unsigned long arg)
+{
+	hwsim_ampdu_flush((struct ieee80211_hw *) arg);
+}
 
-		if (mac80211_hwsim_addr_match(data2, hdr->addr1))
-			ack = true;
+static void hwsim_ampdu_queue(struct ieee80211_hw *hw, struct sk_buff *skb)
+{
+	struct mac80211_hwsim_data *data = hw->priv;
+	struct sk_buff_head *q = &data->ampdu_queue;
+	struct sk_buff_head prev, cur;
+	struct sk_buff *head;
 
-		/* set bcn timestamp relative to receiver mactime */
-		rx_status.mactime =
-				le64_to_cpu(__mac80211_hwsim_get_tsf(data2));
-		mgmt = (struct ieee80211_mgmt *) nskb->data;
-		if (ieee80211_is_beacon(mgmt->frame_control) ||
-		    ieee80211_is_probe_resp(mgmt->frame_control))
-			mgmt->u.beacon.timestamp = cpu_to_le64(
-				rx_status.mactime +
-				(data->tsf_offset - data2->tsf_offset) +
-				24 * 8 * 10 / txrate->bitrate);
+	__skb_queue_head_init(&prev);
+	__skb_queue_head_init(&cur);
 
-		memcpy(IEEE80211_SKB_RXCB(nskb), &rx_status, sizeof(rx_status));
-		ieee80211_rx_irqsafe(data2->hw, nskb);
-	}
-	spin_unlock(&hwsim_radio_lock);
+	spin_lock_bh(&q->lock);
+	head = skb_peek(q);
+	if (head && !hwsim_ampdu_match(head, skb))
+		skb_queue_splice_init(q, &prev);
 
-	return ack;
+	if (skb_queue_empty(q)) {
+		data->ampdu_limit = hwsim_ampdu_limit(skb);
+		data->ampdu_bytes = 0;
+	}
+	__skb_queue_tail(q, skb);
+	data->ampdu_bytes += skb->len;
+
+	if (skb_queue_len(q) >= data->ampdu_limit ||
+	    data->ampdu_bytes >= HWSIM_AMPDU_MAX_LEN)
+		skb_queue_splice_init(q, &cur);
+	spin_unlock_bh(&q->lock);
+
+	if (!skb_queue_empty(&prev))
+		hwsim_ampdu_tx(hw, &prev);
+	if (!skb_queue_empty(&cur))
+		hwsim_ampdu_tx(hw, &cur);
+	else
+		tasklet_schedule(&data->ampdu_tasklet);
 }
 
 static void mac80211_hwsim_tx(struct ieee80211_hw *hw, struct sk_buff *skb)
 {
+	struct mac80211_hwsim_data *data = hw->priv;
 	bool ack;
 	struct ieee80211_tx_info *txi;
+	u8 tries[IEEE80211_TX_MAX_RATES];
 	u32 _pid;
+	int i;
 
 	mac80211_hwsim_monitor_rx(hw, skb);
 
@@ -729,21 +1659,33 @@ static void mac80211_hwsim_tx(struct ieee80211_hw *hw, struct sk_buff *skb)
 	if (_pid)
 		return mac80211_hwsim_tx_frame_nl(hw, skb, _pid);
 
-	/* NO wmediumd detected, perfect medium simulation */
-	ack = mac80211_hwsim_tx_frame_no_nl(hw, skb);
+	/* NO wmediumd detected, use the in-kernel medium */
+	txi = IEEE80211_SKB_CB(skb);
+	if ((txi->flags & IEEE80211_TX_CTL_AMPDU) && !data->idle) {
+		hwsim_ampdu_queue(hw, skb);
+		return;
+	}
+
+	/* keep the order with respect to a pending A-MPDU */
+	hwsim_ampdu_flush(hw);
+
+	ack = mac80211_hwsim_tx_frame_no_nl(hw, skb, tries);
 
 	if (ack && skb->len >= 16) {
 		struct ieee80211_hdr *hdr = (struct ieee80211_hdr *) skb->data;
 		mac80211_hwsim_monitor_ack(hw, hdr->addr2);
 	}
 
-	txi = IEEE80211_SKB_CB(skb);
-
 	ieee80211_tx_info_clear_status(txi);
 
-	/* frame was transmitted at most favorable rate at first attempt */
-	txi->control.rates[0].count = 1;
-	txi->control.rates[1].idx = -1;
+	/* report the attempts the medium made */
+	for (i = 0; i < IEEE80211_TX_MAX_RATES; i++) {
+		if (!tries[i]) {
+			txi->status.rates[i].idx = -1;
+			break;
+		}
+		txi->status.rates[i].count = tries[i];
+	}
 
 	if (!(txi->flags & IEEE80211_TX_CTL_NO_ACK) && ack)
 		txi->flags |= IEEE80211_TX_STAT_ACK;
@@ -751,12 +1693,35 @@ static void mac80211_hwsim_tx(struct ieee80211_hw *hw, struct sk_buff *skb)
 }
 
 
+static void hwsim_beacon_schedule(struct mac80211_hwsim_data *data)
+{
+	if (!data->started || !data->beacon_int) {
+		del_timer(&data->beacon_timer);
+		data->next_tbtt = 0;
+		return;
+	}
+
+	/* beacons are sent from HWSIM_CMD_ADVANCE_TIME instead */
+	if (virtual_time) {
+		data->next_tbtt = hwsim_now() + data->beacon_int_us;
+		return;
+	}
+
+	mod_timer(&data->beacon_timer, jiffies + data->beacon_int);
+}
+
+
 static int mac80211_hwsim_start(struct ieee80211_hw *hw)
 {
 	struct mac80211_hwsim_data *data = hw->priv;
+	int err;
+
 	wiphy_debug(hw->wiphy, "%s\n", __func__);
 	data->started = true;
-	return 0;
+	err = hwsim_medium_update(data);
+	if (err)
+		data->started = false;
+	return err;
 }
 
 
@@ -764,7 +1729,12 @@ static void mac80211_hwsim_stop(struct ieee80211_hw *hw)
 {
 	struct mac80211_hwsim_data *data = hw->priv;
 	data->started = false;
-	del_timer(&data->beacon_timer);
+	hwsim_medium_update(data);
+	hwsim_beacon_schedule(data);
+	hwsim_ampdu_flush(hw);
+	hrtimer_cancel(&data->delay_timer);
+	skb_queue_purge(&data->delay_queue);
+	skb_queue_purge(&data->rx_queue);
 	wiphy_debug(hw->wiphy, "%s\n", __func__);
 }
 
@@ -834,7 +1804,7 @@ static void mac80211_hwsim_beacon_tx(void *arg, u8 *mac,
 	if (_pid)
 		return mac80211_hwsim_tx_frame_nl(hw, skb, _pid);
 
-	mac80211_hwsim_tx_frame_no_nl(hw, skb);
+	mac80211_hwsim_tx_frame_no_nl(hw, skb, NULL);
 	dev_kfree_skb(skb);
 }
 
@@ -871,6 +1841,7 @@ static int mac80211_hwsim_config(struct ieee80211_hw *hw, u32 changed)
 		[IEEE80211_SMPS_STATIC] = "static",
 		[IEEE80211_SMPS_DYNAMIC] = "dynamic",
 	};
+	int err;
 
 	wiphy_debug(hw->wiphy,
 		    "%s (freq=%d/%s idle=%d ps=%d smps=%s)\n",
@@ -885,12 +1856,10 @@ static int mac80211_hwsim_config(struct ieee80211_hw *hw, u32 changed)
 
 	data->channel = conf->channel;
 	data->power_level = conf->power_level;
-	if (!data->started || !data->beacon_int)
-		del_timer(&data->beacon_timer);
-	else
-		mod_timer(&data->beacon_timer, jiffies + data->beacon_int);
+	err = hwsim_medium_update(data);
+	hwsim_beacon_schedule(data);
 
-	return 0;
+	return err;
 }
 
 
@@ -941,9 +1910,9 @@ static void mac80211_hwsim_bss_info_changed(struct ieee80211_hw *hw,
 		data->beacon_int = 1024 * info->beacon_int / 1000 * HZ / 1000;
 		if (WARN_ON(!data->beacon_int))
 			data->beacon_int = 1;
+		data->beacon_int_us = 1024 * info->beacon_int;
 		if (data->started)
-			mod_timer(&data->beacon_timer,
-				  jiffies + data->beacon_int);
+			hwsim_beacon_schedule(data);
 	}
 
 	if (changed & BSS_CHANGED_ERP_CTS_PROT) {
@@ -1140,14 +2109,18 @@ static int mac80211_hwsim_ampdu_action(struct ieee80211_hw *hw,
 				       struct ieee80211_sta *sta, u16 tid, u16 *ssn,
 				       u8 buf_size)
 {
+	struct hwsim_sta_priv *sp = (void *)sta->drv_priv;
+
 	switch (action) {
 	case IEEE80211_AMPDU_TX_START:
 		ieee80211_start_tx_ba_cb_irqsafe(vif, sta->addr, tid);
 		break;
 	case IEEE80211_AMPDU_TX_STOP:
+		sp->ampdu_buf_size[tid] = 0;
 		ieee80211_stop_tx_ba_cb_irqsafe(vif, sta->addr, tid);
 		break;
 	case IEEE80211_AMPDU_TX_OPERATIONAL:
+		sp->ampdu_buf_size[tid] = buf_size;
 		break;
 	case IEEE80211_AMPDU_RX_START:
 	case IEEE80211_AMPDU_RX_STOP:
@@ -1262,24 +2235,50 @@ static struct ieee80211_ops mac80211_hwsim_ops =
 
 static void mac80211_hwsim_free(void)
 {
-	struct list_head tmplist, *i, *tmp;
+	struct list_head tmplist, *l, *tmp;
 	struct mac80211_hwsim_data *data, *tmpdata;
+	int i;
 
 	INIT_LIST_HEAD(&tmplist);
 
 	spin_lock_bh(&hwsim_radio_lock);
-	list_for_each_safe(i, tmp, &hwsim_radios)
-		list_move(i, &tmplist);
+	list_for_each_safe(l, tmp, &hwsim_radios)
+		list_move(l, &tmplist);
 	spin_unlock_bh(&hwsim_radio_lock);
 
-	list_for_each_entry_safe(data, tmpdata, &tmplist, list) {
+	list_for_each_entry(data, &tmplist, list) {
+		debugfs_remove(data->debugfs_tx_stats);
+		debugfs_remove(data->debugfs_nl_stats);
 		debugfs_remove(data->debugfs_group);
 		debugfs_remove(data->debugfs_ps);
 		debugfs_remove(data->debugfs);
 		ieee80211_unregister_hw(data->hw);
+	}
+
+	/* the medium may still be delivering to the radios */
+	synchronize_rcu();
+
+	list_for_each_entry_safe(data, tmpdata, &tmplist, list) {
+		/* a TX that raced with stop may have queued frames again */
+		hrtimer_cancel(&data->delay_timer);
+		skb_queue_purge(&data->delay_queue);
+		skb_queue_purge(&data->pending);
+		tasklet_kill(&data->ampdu_tasklet);
 		device_unregister(data->dev);
 		ieee80211_free_hw(data->hw);
 	}
+
+	mutex_lock(&hwsim_medium_mutex);
+	for (i = 0; i < HWSIM_NUM_CHANNELS; i++) {
+		kfree(rcu_dereference_protected(hwsim_chan_radios[i],
+				lockdep_is_held(&hwsim_medium_mutex)));
+		rcu_assign_pointer(hwsim_chan_radios[i], NULL);
+	}
+	vfree(rcu_dereference_protected(hwsim_links,
+				lockdep_is_held(&hwsim_medium_mutex)));
+	rcu_assign_pointer(hwsim_links, NULL);
+	mutex_unlock(&hwsim_medium_mutex);
+
 	class_destroy(hwsim_class);
 }
 
@@ -1339,7 +2338,7 @@ static void hwsim_send_ps_poll(void *dat, u8 *mac, struct ieee80211_vif *vif)
 	if (_pid)
 		return mac80211_hwsim_tx_frame_nl(data->hw, skb, _pid);
 
-	if (!mac80211_hwsim_tx_frame_no_nl(data->hw, skb))
+	if (!mac80211_hwsim_tx_frame_no_nl(data->hw, skb, NULL))
 		printk(KERN_DEBUG "%s: PS-poll frame not ack'ed\n", __func__);
 	dev_kfree_skb(skb);
 }
@@ -1378,7 +2377,7 @@ static void hwsim_send_nullfunc(struct mac80211_hwsim_data *data, u8 *mac,
 	if (_pid)
 		return mac80211_hwsim_tx_frame_nl(data->hw, skb, _pid);
 
-	if (!mac80211_hwsim_tx_frame_no_nl(data->hw, skb))
+	if (!mac80211_hwsim_tx_frame_no_nl(data->hw, skb, NULL))
 		printk(KERN_DEBUG "%s: nullfunc frame not ack'ed\n", __func__);
 	dev_kfree_skb(skb);
 }
@@ -1458,6 +2457,63 @@ DEFINE_SIMPLE_ATTRIBUTE(hwsim_fops_group,
 			hwsim_fops_group_read, hwsim_fops_group_write,
 			"%llx\n");
 
+static ssize_t hwsim_fops_nl_stats_read(struct file *file,
+					char __user *user_buf,
+					size_t count, loff_t *ppos)
+{
+	struct mac80211_hwsim_data *data = file->private_data;
+	char buf[384];
+	int len;
+
+	len = scnprintf(buf, sizeof(buf),
+			"tx frames: %llu\ntx bytes: %llu\n"
+			"tx status: %llu\nrx frames: %llu\nrx bytes: %llu\n"
+			"pending: %u\ndrops: %llu\nqueue stops: %u\n"
+			"messages: %llu\nsend errors: %llu\n",
+			(unsigned long long)data->nl_tx_frames,
+			(unsigned long long)data->nl_tx_bytes,
+			(unsigned long long)data->nl_tx_status,
+			(unsigned long long)data->nl_rx_frames,
+			(unsigned long long)data->nl_rx_bytes,
+			skb_queue_len(&data->pending),
+			(unsigned long long)data->nl_drops,
+			data->nl_queue_stops,
+			(unsigned long long)hwsim_nl_batch.msgs,
+			(unsigned long long)hwsim_nl_batch.errors);
+
+	return simple_read_from_buffer(user_buf, count, ppos, buf, len);
+}
+
+static const struct file_operations hwsim_fops_nl_stats = {
+	.read = hwsim_fops_nl_stats_read,
+	.open = simple_open,
+	.llseek = default_llseek,
+};
+
+static ssize_t hwsim_fops_tx_stats_read(struct file *file,
+					char __user *user_buf,
+					size_t count, loff_t *ppos)
+{
+	struct mac80211_hwsim_data *data = file->private_data;
+	char buf[160];
+	int len;
+
+	len = scnprintf(buf, sizeof(buf),
+			"airtime: %llu us\nampdus: %u\nampdu subframes: %u\n"
+			"ampdu subframes acked: %u\n",
+			(unsigned long long)data->tx_airtime,
+			data->ampdu_count, data->ampdu_subframes,
+			data->ampdu_acked);
+
+	return simple_read_from_buffer(user_buf, count, ppos, buf, len);
+}
+
+static const struct file_operations hwsim_fops_tx_stats = {
+	.read = hwsim_fops_tx_stats_read,
+	.open = simple_open,
+	.llseek = default_llseek,
+};
+
 static struct mac80211_hwsim_data *get_hwsim_data_ref_from_addr(
 			     struct mac_address *addr)
 {
@@ -1480,8 +2536,7 @@ static struct mac80211_hwsim_data *get_hwsim_data_ref_from_addr(
 	return data;
 }
 
-static int hwsim_tx_info_frame_received_nl(struct sk_buff *skb_2,
-					   struct genl_info *info)
+static int hwsim_tx_info_frame(struct nlattr **attrs)
 {
 
 	struct ieee80211_hdr *hdr;
@@ -1489,24 +2544,23 @@ static int hwsim_tx_info_frame_received_nl(struct sk_buff *skb_2,
 	struct ieee80211_tx_info *txi;
 	struct hwsim_tx_rate *tx_attempts;
 	unsigned long ret_skb_ptr;
-	struct sk_buff *skb, *tmp;
+	struct sk_buff *skb;
 	struct mac_address *src;
 	unsigned int hwsim_flags;
 
 	int i;
-	bool found = false;
 
-	if (!info->attrs[HWSIM_ATTR_ADDR_TRANSMITTER] ||
-	   !info->attrs[HWSIM_ATTR_FLAGS] ||
-	   !info->attrs[HWSIM_ATTR_COOKIE] ||
-	   !info->attrs[HWSIM_ATTR_TX_INFO])
+	if (!attrs[HWSIM_ATTR_ADDR_TRANSMITTER] ||
+	   !attrs[HWSIM_ATTR_FLAGS] ||
+	   !attrs[HWSIM_ATTR_COOKIE] ||
+	   !attrs[HWSIM_ATTR_TX_INFO])
 		goto out;
 
 	src = (struct mac_address *)nla_data(
-				   info->attrs[HWSIM_ATTR_ADDR_TRANSMITTER]);
-	hwsim_flags = nla_get_u32(info->attrs[HWSIM_ATTR_FLAGS]);
+				   attrs[HWSIM_ATTR_ADDR_TRANSMITTER]);
+	hwsim_flags = nla_get_u32(attrs[HWSIM_ATTR_FLAGS]);
 
-	ret_skb_ptr = nla_get_u64(info->attrs[HWSIM_ATTR_COOKIE]);
+	ret_skb_ptr = nla_get_u64(attrs[HWSIM_ATTR_COOKIE]);
 
 	data2 = get_hwsim_data_ref_from_addr(src);
 
@@ -1514,23 +2568,20 @@ static int hwsim_tx_info_frame_received_nl(struct sk_buff *skb_2,
 		goto out;
 
 	/* look for the skb matching the cookie passed back from user */
-	skb_queue_walk_safe(&data2->pending, skb, tmp) {
-		if ((unsigned long)skb == ret_skb_ptr) {
-			skb_unlink(skb, &data2->pending);
-			found = true;
-			break;
-		}
-	}
+	skb = hwsim_pending_get(data2, ret_skb_ptr);
 
 	/* not found */
-	if (!found)
+	if (!skb)
 		goto out;
 
+	data2->nl_tx_status++;
+	hwsim_pending_done(data2);
+
 	/* Tx info received because the frame was broadcasted on user space,
 	 so we get all the necessary info: tx attempts and skb control buff */
 
 	tx_attempts = (struct hwsim_tx_rate *)nla_data(
-		       info->attrs[HWSIM_ATTR_TX_INFO]);
+		       attrs[HWSIM_ATTR_TX_INFO]);
 
 	/* now send back TX status */
 	txi = IEEE80211_SKB_CB(skb);
@@ -1543,7 +2594,8 @@ static int hwsim_tx_info_frame_received_nl(struct sk_buff *skb_2,
 		/*txi->status.rates[i].flags = 0;*/
 	}
 
-	txi->status.ack_signal = nla_get_u32(info->attrs[HWSIM_ATTR_SIGNAL]);
+	if (attrs[HWSIM_ATTR_SIGNAL])
+		txi->status.ack_signal = nla_get_u32(attrs[HWSIM_ATTR_SIGNAL]);
 
 	if (!(hwsim_flags & HWSIM_TX_CTL_NO_ACK) &&
 	   (hwsim_flags & HWSIM_TX_STAT_ACK)) {
@@ -1560,8 +2612,7 @@ out:
 
 }
 
-static int hwsim_cloned_frame_received_nl(struct sk_buff *skb_2,
-					  struct genl_info *info)
+static int hwsim_cloned_frame(struct nlattr **attrs)
 {
 
 	struct mac80211_hwsim_data  *data2;
@@ -1571,17 +2622,17 @@ static int hwsim_cloned_frame_received_nl(struct sk_buff *skb_2,
 	char *frame_data;
 	struct sk_buff *skb = NULL;
 
-	if (!info->attrs[HWSIM_ATTR_ADDR_RECEIVER] ||
-	   !info->attrs[HWSIM_ATTR_FRAME] ||
-	   !info->attrs[HWSIM_ATTR_RX_RATE] ||
-	   !info->attrs[HWSIM_ATTR_SIGNAL])
+	if (!attrs[HWSIM_ATTR_ADDR_RECEIVER] ||
+	   !attrs[HWSIM_ATTR_FRAME] ||
+	   !attrs[HWSIM_ATTR_RX_RATE] ||
+	   !attrs[HWSIM_ATTR_SIGNAL])
 		goto out;
 
 	dst = (struct mac_address *)nla_data(
-				   info->attrs[HWSIM_ATTR_ADDR_RECEIVER]);
+				   attrs[HWSIM_ATTR_ADDR_RECEIVER]);
 
-	frame_data_len = nla_len(info->attrs[HWSIM_ATTR_FRAME]);
-	frame_data = (char *)nla_data(info->attrs[HWSIM_ATTR_FRAME]);
+	frame_data_len = nla_len(attrs[HWSIM_ATTR_FRAME]);
+	frame_data = (char *)nla_data(attrs[HWSIM_ATTR_FRAME]);
 
 	/* Allocate new skb here */
 	skb = alloc_skb(frame_data_len, GFP_KERNEL);
@@ -1605,15 +2656,21 @@ static int hwsim_cloned_frame_received_nl(struct sk_buff *skb_2,
 	if (data2->idle || !data2->started || !data2->channel)
 		goto out;
 
+	data2->nl_rx_frames++;
+	data2->nl_rx_bytes += frame_data_len;
+
 	/*A frame is received from user space*/
 	memset(&rx_status, 0, sizeof(rx_status));
 	rx_status.freq = data2->channel->center_freq;
 	rx_status.band = data2->channel->band;
-	rx_status.rate_idx = nla_get_u32(info->attrs[HWSIM_ATTR_RX_RATE]);
-	rx_status.signal = nla_get_u32(info->attrs[HWSIM_ATTR_SIGNAL]);
+	rx_status.rate_idx = nla_get_u32(attrs[HWSIM_ATTR_RX_RATE]);
+	rx_status.signal = nla_get_u32(attrs[HWSIM_ATTR_SIGNAL]);
 
 	memcpy(IEEE80211_SKB_RXCB(skb), &rx_status, sizeof(rx_status));
-	ieee80211_rx_irqsafe(data2->hw, skb);
+	/* let the NAPI poll run as soon as we're done here */
+	local_bh_disable();
+	mac80211_hwsim_rx(data2, skb);
+	local_bh_enable();
 
 	return 0;
 err:
@@ -1624,16 +2681,67 @@ out:
 	return -EINVAL;
 }
 
+static int hwsim_tx_info_frame_received_nl(struct sk_buff *skb_2,
+					   struct genl_info *info)
+{
+	return hwsim_tx_info_frame(info->attrs);
+}
+
+static int hwsim_cloned_frame_received_nl(struct sk_buff *skb_2,
+					  struct genl_info *info)
+{
+	return hwsim_cloned_frame(info->attrs);
+}
+
+/*
+ * Batched variants of the two commands above, every entry nested in
+ * %HWSIM_ATTR_FRAMES carries the attributes of one single command.
+ * Entries that fail don't stop the rest of the batch.
+ */
+static int hwsim_batch_received_nl(struct genl_info *info,
+				   int (*handler)(struct nlattr **attrs))
+{
+	struct nlattr *attrs[HWSIM_ATTR_MAX + 1];
+	struct nlattr *entry;
+	int rem, err = 0;
+
+	if (!info->attrs[HWSIM_ATTR_FRAMES])
+		return -EINVAL;
+
+	nla_for_each_nested(entry, info->attrs[HWSIM_ATTR_FRAMES], rem) {
+		if (nla_parse_nested(attrs, HWSIM_ATTR_MAX, entry,
+				     hwsim_genl_policy) ||
+		    handler(attrs))
+			err = -EINVAL;
+	}
+
+	return err;
+}
+
+static int hwsim_tx_info_frames_received_nl(struct sk_buff *skb_2,
+					    struct genl_info *info)
+{
+	return hwsim_batch_received_nl(info, hwsim_tx_info_frame);
+}
+
+static int hwsim_cloned_frames_received_nl(struct sk_buff *skb_2,
+					   struct genl_info *info)
+{
+	return hwsim_batch_received_nl(info, hwsim_cloned_frame);
+}
+
 static int hwsim_register_received_nl(struct sk_buff *skb_2,
 				      struct genl_info *info)
 {
 	if (info == NULL)
 		goto out;
 
+	wmediumd_batch = !!info->attrs[HWSIM_ATTR_BATCH];
 	wmediumd_pid = info->snd_pid;
 
 	printk(KERN_DEBUG "mac80211_hwsim: received a REGISTER, "
-	       "switching to wmediumd mode with pid %d\n", info->snd_pid);
+	       "switching to wmediumd mode with pid %d%s\n", info->snd_pid,
+	       wmediumd_batch ? " (batched)" : "");
 
 	return 0;
 out:
@@ -1641,6 +2749,131 @@ out:
 	return -EINVAL;
 }
 
+static void hwsim_set_link(struct hwsim_link *link, struct genl_info *info)
+{
+	if (info->attrs[HWSIM_ATTR_LINK_LOSS])
+		link->loss = min_t(u32, 1000,
+			nla_get_u32(info->attrs[HWSIM_ATTR_LINK_LOSS]));
+	if (info->attrs[HWSIM_ATTR_LINK_DELAY])
+		link->delay = min_t(u32, USHRT_MAX,
+			nla_get_u32(info->attrs[HWSIM_ATTR_LINK_DELAY]));
+	if (info->attrs[HWSIM_ATTR_LINK_MAX_RATE])
+		link->max_rate = min_t(u32, USHRT_MAX,
+			nla_get_u32(info->attrs[HWSIM_ATTR_LINK_MAX_RATE]));
+	if (info->attrs[HWSIM_ATTR_SIGNAL]) {
+		link->signal = clamp_t(s32,
+			(s32) nla_get_u32(info->attrs[HWSIM_ATTR_SIGNAL]),
+			-128, 127);
+		link->flags |= HWSIM_LINK_SIGNAL;
+	}
+}
+
+static int hwsim_set_link_nl(struct sk_buff *skb_2, struct genl_info *info)
+{
+	struct mac80211_hwsim_data *tx, *rx;
+	struct hwsim_link *links;
+
+	if (!info->attrs[HWSIM_ATTR_ADDR_TRANSMITTER] ||
+	    !info->attrs[HWSIM_ATTR_ADDR_RECEIVER])
+		return -EINVAL;
+
+	tx = get_hwsim_data_ref_from_addr(
+		nla_data(info->attrs[HWSIM_ATTR_ADDR_TRANSMITTER]));
+	rx = get_hwsim_data_ref_from_addr(
+		nla_data(info->attrs[HWSIM_ATTR_ADDR_RECEIVER]));
+	if (!tx || !rx || tx == rx)
+		return -EINVAL;
+
+	mutex_lock(&hwsim_medium_mutex);
+	links = rcu_dereference_protected(hwsim_links,
+				lockdep_is_held(&hwsim_medium_mutex));
+	if (!links) {
+		links = vzalloc(radios * radios * sizeof(*links));
+		if (!links) {
+			mutex_unlock(&hwsim_medium_mutex);
+			return -ENOMEM;
+		}
+		rcu_assign_pointer(hwsim_links, links);
+	}
+
+	hwsim_set_link(hwsim_link(links, tx, rx), info);
+	if (info->attrs[HWSIM_ATTR_LINK_SYMMETRIC])
+		hwsim_set_link(hwsim_link(links, rx, tx), info);
+	mutex_unlock(&hwsim_medium_mutex);
+
+	return 0;
+}
+
+/* the radio with the earliest beacon due by @until, if any */
+static struct mac80211_hwsim_data *hwsim_next_beacon(u64 until)
+{
+	struct mac80211_hwsim_data *data, *next = NULL;
+
+	spin_lock_bh(&hwsim_radio_lock);
+	list_for_each_entry(data, &hwsim_radios, list) {
+		if (!data->started || !data->next_tbtt ||
+		    data->next_tbtt > until)
+			continue;
+		if (!next || data->next_tbtt < next->next_tbtt)
+			next = data;
+	}
+	spin_unlock_bh(&hwsim_radio_lock);
+
+	return next;
+}
+
+static int hwsim_advance_time_nl(struct sk_buff *skb_2,
+				 struct genl_info *info)
+{
+	struct mac80211_hwsim_data *data;
+	struct sk_buff *msg;
+	void *hdr;
+	u64 until;
+
+	if (!virtual_time)
+		return -EOPNOTSUPP;
+
+	if (info->attrs[HWSIM_ATTR_SEED]) {
+		spin_lock_bh(&hwsim_rnd_lock);
+		prandom32_seed(&hwsim_rnd,
+			       nla_get_u64(info->attrs[HWSIM_ATTR_SEED]));
+		spin_unlock_bh(&hwsim_rnd_lock);
+	}
+
+	until = hwsim_now();
+	if (info->attrs[HWSIM_ATTR_TIME])
+		until += min_t(u64, nla_get_u64(info->attrs[HWSIM_ATTR_TIME]),
+			       HWSIM_VTIME_MAX_STEP);
+
+	/* play the beacons due on the way, in order */
+	while ((data = hwsim_next_beacon(until))) {
+		hwsim_vtime_forward(data->next_tbtt);
+		data->next_tbtt += data->beacon_int_us;
+
+		local_bh_disable();
+		ieee80211_iterate_active_interfaces_atomic(
+			data->hw, mac80211_hwsim_beacon_tx, data->hw);
+		local_bh_enable();
+
+		cond_resched();
+	}
+	hwsim_vtime_forward(until);
+
+	msg = genlmsg_new(GENLMSG_DEFAULT_SIZE, GFP_KERNEL);
+	if (!msg)
+		return -ENOMEM;
+
+	hdr = genlmsg_put(msg, info->snd_pid, info->snd_seq,
+			  &hwsim_genl_family, 0, HWSIM_CMD_ADVANCE_TIME);
+	if (!hdr || nla_put_u64(msg, HWSIM_ATTR_TIME, hwsim_now())) {
+		nlmsg_free(msg);
+		return -ENOBUFS;
+	}
+	genlmsg_end(msg, hdr);
+
+	return genlmsg_reply(msg, info);
+}
+
 /* Generic Netlink operations array */
 static struct genl_ops hwsim_ops[] = {
 	{
@@ -1659,8 +2892,53 @@ static struct genl_ops hwsim_ops[] = {
 		.policy = hwsim_genl_policy,
 		.doit = hwsim_tx_info_frame_received_nl,
 	},
+	{
+		.cmd = HWSIM_CMD_FRAMES,
+		.policy = hwsim_genl_policy,
+		.doit = hwsim_cloned_frames_received_nl,
+	},
+	{
+		.cmd = HWSIM_CMD_TX_INFO_FRAMES,
+		.policy = hwsim_genl_policy,
+		.doit = hwsim_tx_info_frames_received_nl,
+	},
+	{
+		.cmd = HWSIM_CMD_ADVANCE_TIME,
+		.policy = hwsim_genl_policy,
+		.doit = hwsim_advance_time_nl,
+		.flags = GENL_ADMIN_PERM,
+	},
+	{
+		.cmd = HWSIM_CMD_SET_LINK,
+		.policy = hwsim_genl_policy,
+		.doit = hwsim_set_link_nl,
+		.flags = GENL_ADMIN_PERM,
+	},
 };
 
+static void hwsim_nl_release(void)
+{
+	struct hwsim_nl_batch *b = &hwsim_nl_batch;
+	struct mac80211_hwsim_data *data;
+
+	wmediumd_pid = 0;
+
+	/* nobody is left to report on the frames in flight */
+	spin_lock_bh(&b->lock);
+	if (b->msg) {
+		nlmsg_free(b->msg);
+		b->msg = NULL;
+		b->frames = NULL;
+		b->n = 0;
+	}
+	spin_unlock_bh(&b->lock);
+
+	spin_lock_bh(&hwsim_radio_lock);
+	list_for_each_entry(data, &hwsim_radios, list)
+		hwsim_pending_purge(data);
+	spin_unlock_bh(&hwsim_radio_lock);
+}
+
 static int mac80211_hwsim_netlink_notify(struct notifier_block *nb,
 					 unsigned long state,
 					 void *_notify)
@@ -1673,7 +2951,7 @@ static int mac80211_hwsim_netlink_notify(struct notifier_block *nb,
 	if (notify->pid == wmediumd_pid) {
 		printk(KERN_INFO "mac80211_hwsim: wmediumd released netlink"
 		       " socket, switching to perfect channel medium\n");
-		wmediumd_pid = 0;
+		hwsim_nl_release();
 	}
 	return NOTIFY_DONE;
 
@@ -1688,6 +2966,10 @@ static int hwsim_init_netlink(void)
 	int rc;
 	printk(KERN_INFO "mac80211_hwsim: initializing netlink\n");
 
+	spin_lock_init(&hwsim_nl_batch.lock);
+	tasklet_init(&hwsim_nl_batch.tasklet, hwsim_nl_batch_tasklet,
+		     (unsigned long) &hwsim_nl_batch);
+
 	rc = genl_register_family_with_ops(&hwsim_genl_family,
 		hwsim_ops, ARRAY_SIZE(hwsim_ops));
 	if (rc)
@@ -1716,6 +2998,7 @@ static void hwsim_exit_netlink(void)
 	if (ret)
 		printk(KERN_DEBUG "mac80211_hwsim: "
 		       "unregister family %i\n", ret);
+	hwsim_nl_release();
 }
 
 static const struct ieee80211_iface_limit hwsim_if_limits[] = {
@@ -1744,7 +3027,7 @@ static int __init init_mac80211_hwsim(void)
 	struct ieee80211_hw *hw;
 	enum ieee80211_band band;
 
-	if (radios < 1 || radios > 100)
+	if (radios < 1 || radios > HWSIM_MAX_RADIOS)
 		return -EINVAL;
 
 	if (fake_hw_scan) {
@@ -1753,8 +3036,12 @@ static int __init init_mac80211_hwsim(void)
 		mac80211_hwsim_ops.sw_scan_complete = NULL;
 	}
 
+	if (rx_napi)
+		mac80211_hwsim_ops.napi_poll = mac80211_hwsim_napi_poll;
+
 	spin_lock_init(&hwsim_radio_lock);
 	INIT_LIST_HEAD(&hwsim_radios);
+	prandom32_seed(&hwsim_rnd, 0);
 
 	hwsim_class = class_create(THIS_MODULE, "mac80211_hwsim");
 	if (IS_ERR(hwsim_class))
@@ -1775,6 +3062,8 @@ static int __init init_mac80211_hwsim(void)
 		}
 		data = hw->priv;
 		data->hw = hw;
+		data->idx = i;
+		data->chan_idx = -1;
 
 		data->dev = device_create(hwsim_class, NULL, 0, hw,
 					  "hwsim%d", i);
@@ -1787,6 +3076,14 @@ static int __init init_mac80211_hwsim(void)
 		}
 		data->dev->driver = &mac80211_hwsim_driver;
 		skb_queue_head_init(&data->pending);
+		skb_queue_head_init(&data->rx_queue);
+		skb_queue_head_init(&data->delay_queue);
+		hrtimer_init(&data->delay_timer, CLOCK_MONOTONIC,
+			     HRTIMER_MODE_ABS);
+		data->delay_timer.function = hwsim_delay_timer;
+		skb_queue_head_init(&data->ampdu_queue);
+		tasklet_init(&data->ampdu_tasklet, hwsim_ampdu_tasklet,
+			     (unsigned long) hw);
 
 		SET_IEEE80211_DEV(hw, data->dev);
 		addr[3] = i >> 8;
@@ -1821,6 +3118,10 @@ static int __init init_mac80211_hwsim(void)
 			    IEEE80211_HW_SUPPORTS_DYNAMIC_SMPS |
 			    IEEE80211_HW_AMPDU_AGGREGATION |
 			    IEEE80211_HW_WANT_MONITOR_VIF;
+		if (rx_napi) {
+			hw->flags |= IEEE80211_HW_RX_GRO;
+			hw->napi_weight = 64;
+		}
 
 		hw->wiphy->flags |= WIPHY_FLAG_SUPPORTS_TDLS |
 				    WIPHY_FLAG_HAS_REMAIN_ON_CHANNEL;
@@ -2004,6 +3305,12 @@ static int __init init_mac80211_hwsim(void)
 		data->debugfs_group = debugfs_create_file("group", 0666,
 							data->debugfs, data,
 							&hwsim_fops_group);
+		data->debugfs_nl_stats = debugfs_create_file("nl_stats", 0444,
+							data->debugfs, data,
+							&hwsim_fops_nl_stats);
+		data->debugfs_tx_stats = debugfs_create_file("tx_stats", 0444,
+							data->debugfs, data,
+							&hwsim_fops_tx_stats);
 
 		setup_timer(&data->beacon_timer, mac80211_hwsim_beacon,
 			    (unsigned long) hw);
@@ -2061,6 +3368,8 @@ static void __exit exit_mac80211_hwsim(void)
 	hwsim_exit_netlink();
 
 	mac80211_hwsim_free();
+	/* the radios are gone, nothing can schedule a batch any more */
+	tasklet_kill(&hwsim_nl_batch.tasklet);
 	unregister_netdev(hwsim_mon);
 }
 
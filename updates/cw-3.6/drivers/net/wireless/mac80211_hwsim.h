@@ -55,7 +55,7 @@ enum hwsim_tx_control_flags {
  * @HWSIM_CMD_UNSPEC: unspecified command to catch errors
  *
  * @HWSIM_CMD_REGISTER: request to register and received all broadcasted
- *	frames by any mac80211_hwsim radio device.
+ *	frames by any mac80211_hwsim radio device, uses: %HWSIM_ATTR_BATCH
  * @HWSIM_CMD_FRAME: send/receive a broadcasted frame from/to kernel/user
  * space, uses:
  *	%HWSIM_ATTR_ADDR_TRANSMITTER, %HWSIM_ATTR_ADDR_RECEIVER,
@@ -65,6 +65,26 @@ enum hwsim_tx_control_flags {
  * kernel, uses:
  *	%HWSIM_ATTR_ADDR_TRANSMITTER, %HWSIM_ATTR_FLAGS,
  *	%HWSIM_ATTR_TX_INFO, %HWSIM_ATTR_SIGNAL, %HWSIM_ATTR_COOKIE
+ * @HWSIM_CMD_FRAMES: batched %HWSIM_CMD_FRAME, in both directions. Each
+ *	entry nested in %HWSIM_ATTR_FRAMES holds the attributes of one
+ *	%HWSIM_CMD_FRAME. The kernel only sends it to a wmediumd that
+ *	registered with %HWSIM_ATTR_BATCH.
+ * @HWSIM_CMD_TX_INFO_FRAMES: batched %HWSIM_CMD_TX_INFO_FRAME from user
+ *	space to kernel, each entry nested in %HWSIM_ATTR_FRAMES holds the
+ *	attributes of one %HWSIM_CMD_TX_INFO_FRAME.
+ * @HWSIM_CMD_ADVANCE_TIME: with the virtual_time module parameter, move
+ *	the simulated clock forward by %HWSIM_ATTR_TIME usecs, sending the
+ *	beacons due in between. %HWSIM_ATTR_SEED reseeds the loss generator
+ *	of the in-kernel medium. Steps are capped at 10 seconds, userspace
+ *	has to send further commands for more; the reply carries the new
+ *	time in %HWSIM_ATTR_TIME.
+ * @HWSIM_CMD_SET_LINK: configure the in-kernel medium for the link from
+ *	the transmitter to the receiver radio, uses:
+ *	%HWSIM_ATTR_ADDR_TRANSMITTER, %HWSIM_ATTR_ADDR_RECEIVER,
+ *	%HWSIM_ATTR_LINK_LOSS, %HWSIM_ATTR_LINK_DELAY,
+ *	%HWSIM_ATTR_LINK_MAX_RATE, %HWSIM_ATTR_SIGNAL,
+ *	%HWSIM_ATTR_LINK_SYMMETRIC. Link parameters that are not given keep
+ *	their current value. Only used while no wmediumd is registered.
  * @__HWSIM_CMD_MAX: enum limit
  */
 enum {
@@ -72,6 +92,10 @@ enum {
 	HWSIM_CMD_REGISTER,
 	HWSIM_CMD_FRAME,
 	HWSIM_CMD_TX_INFO_FRAME,
+	HWSIM_CMD_SET_LINK,
+	HWSIM_CMD_FRAMES,
+	HWSIM_CMD_TX_INFO_FRAMES,
+	HWSIM_CMD_ADVANCE_TIME,
 	__HWSIM_CMD_MAX,
 };
 #define HWSIM_CMD_MAX (_HWSIM_CMD_MAX - 1)
@@ -94,6 +118,17 @@ enum {
 	space
  * @HWSIM_ATTR_TX_INFO: ieee80211_tx_rate array
  * @HWSIM_ATTR_COOKIE: sk_buff cookie to identify the frame
+ * @HWSIM_ATTR_LINK_LOSS: frame loss rate of a link, in 1/1000 (u32)
+ * @HWSIM_ATTR_LINK_DELAY: propagation delay of a link, in usecs (u32)
+ * @HWSIM_ATTR_LINK_MAX_RATE: highest bitrate, in 100 kbps, that still
+ *	gets through a link, 0 for no limit (u32)
+ * @HWSIM_ATTR_LINK_SYMMETRIC: apply the link parameters to the reverse
+ *	direction as well (flag)
+ * @HWSIM_ATTR_FRAMES: nested list of the frames of a batched command
+ * @HWSIM_ATTR_BATCH: given with %HWSIM_CMD_REGISTER, wmediumd wants the
+ *	frames batched in %HWSIM_CMD_FRAMES messages (flag)
+ * @HWSIM_ATTR_TIME: virtual time or time step, in usecs (u64)
+ * @HWSIM_ATTR_SEED: seed for the in-kernel medium's loss generator (u64)
  * @__HWSIM_ATTR_MAX: enum limit
  */
 
@@ -108,6 +143,14 @@ enum {
 	HWSIM_ATTR_SIGNAL,
 	HWSIM_ATTR_TX_INFO,
 	HWSIM_ATTR_COOKIE,
+	HWSIM_ATTR_LINK_LOSS,
+	HWSIM_ATTR_LINK_DELAY,
+	HWSIM_ATTR_LINK_MAX_RATE,
+	HWSIM_ATTR_LINK_SYMMETRIC,
+	HWSIM_ATTR_FRAMES,
+	HWSIM_ATTR_BATCH,
+	HWSIM_ATTR_TIME,
+	HWSIM_ATTR_SEED,
 	__HWSIM_ATTR_MAX,
 };
 #define HWSIM_ATTR_MAX (__HWSIM_ATTR_MAX - 1)
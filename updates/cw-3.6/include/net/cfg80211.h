@@ -785,6 +785,25 @@ struct mpath_info {
 	int generation;
 };
 
+/**
+ * struct cfg80211_dump_cursor - position of a station or mesh path dump
+ *
+ * Passed to the dump_station_next() and dump_mpath_next() callbacks,
+ * which return the entry following it. It is all zeroes at the start
+ * of a dump and updated by cfg80211 after each entry sent to userspace.
+ *
+ * @idx: number of entries dumped so far
+ * @addr: address of the last entry dumped
+ * @generation: the generation reported with the last entry dumped, if
+ *	it changed the driver may not be able to resume at @addr and
+ *	should fall back to skipping @idx entries
+ */
+struct cfg80211_dump_cursor {
+	int idx;
+	u8 addr[ETH_ALEN];
+	int generation;
+};
+
 /**
  * struct bss_parameters - BSS parameters
  *
@@ -1479,12 +1498,16 @@ struct cfg80211_gtk_rekey_data {
  *	for anything but TDLS peers.
  * @get_station: get station information for the station identified by @mac
  * @dump_station: dump station callback -- resume dump at index @idx
+ * @dump_station_next: dump station callback -- return the station following
+ *	the one at @cursor, used instead of @dump_station if present
  *
  * @add_mpath: add a fixed mesh path
  * @del_mpath: delete a given mesh path
  * @change_mpath: change a given mesh path
  * @get_mpath: get a mesh path for the given parameters
  * @dump_mpath: dump mesh path callback -- resume dump at index @idx
+ * @dump_mpath_next: dump mesh path callback -- return the mesh path
+ *	following the one at @cursor, used instead of @dump_mpath if present
  * @join_mesh: join the mesh network with the specified parameters
  * @leave_mesh: leave the current mesh network
  *
@@ -1669,6 +1692,10 @@ struct cfg80211_ops {
 			       u8 *mac, struct station_info *sinfo);
 	int	(*dump_station)(struct wiphy *wiphy, struct net_device *dev,
 			       int idx, u8 *mac, struct station_info *sinfo);
+	int	(*dump_station_next)(struct wiphy *wiphy,
+				     struct net_device *dev,
+				     const struct cfg80211_dump_cursor *cursor,
+				     u8 *mac, struct station_info *sinfo);
 
 	int	(*add_mpath)(struct wiphy *wiphy, struct net_device *dev,
 			       u8 *dst, u8 *next_hop);
@@ -1682,6 +1709,10 @@ struct cfg80211_ops {
 	int	(*dump_mpath)(struct wiphy *wiphy, struct net_device *dev,
 			       int idx, u8 *dst, u8 *next_hop,
 			       struct mpath_info *pinfo);
+	int	(*dump_mpath_next)(struct wiphy *wiphy, struct net_device *dev,
+				   const struct cfg80211_dump_cursor *cursor,
+				   u8 *dst, u8 *next_hop,
+				   struct mpath_info *pinfo);
 	int	(*get_mesh_config)(struct wiphy *wiphy,
 				struct net_device *dev,
 				struct mesh_config *conf);
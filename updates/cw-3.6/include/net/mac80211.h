@@ -1203,6 +1203,11 @@ enum sta_notify_cmd {
  *	queue mapping in order to use different queues (not just one per AC)
  *	for different virtual interfaces. See the doc section on HW queue
  *	control for more details.
+ *
+ * @IEEE80211_HW_RX_GRO: Data frames handed to mac80211 with
+ *	ieee80211_rx_napi() are passed up to the network stack through GRO
+ *	on mac80211's NAPI context, so that e.g. TCP segments are coalesced
+ *	before reaching the protocol layers. Requires the napi_poll callback.
  */
 enum ieee80211_hw_flags {
 	IEEE80211_HW_HAS_RATE_CONTROL			= 1<<0,
@@ -1230,6 +1235,7 @@ enum ieee80211_hw_flags {
 	IEEE80211_HW_AP_LINK_PS				= 1<<22,
 	IEEE80211_HW_TX_AMPDU_SETUP_IN_HW		= 1<<23,
 	IEEE80211_HW_SCAN_WHILE_IDLE			= 1<<24,
+	IEEE80211_HW_RX_GRO				= 1<<25,
 };
 
 /**
@@ -2262,6 +2268,14 @@ enum ieee80211_rate_control_changed {
  *	The callback will be called before each transmission and upon return
  *	mac80211 will transmit the frame right away.
  *	The callback is optional and can (should!) sleep.
+ *
+ * @wake_tx_queue: Called when data frames for stations were added to the
+ *	intermediate queues of a hardware queue. Drivers implementing this
+ *	pull those frames with ieee80211_tx_dequeue() whenever they have
+ *	room, instead of getting them through @tx, and need not stop
+ *	queues for them. Without it, mac80211 passes them to @tx in the
+ *	same fair order while the queue isn't stopped.
+ *	Must be atomic.
  */
 struct ieee80211_ops {
 	void (*tx)(struct ieee80211_hw *hw, struct sk_buff *skb);
@@ -2408,6 +2422,7 @@ struct ieee80211_ops {
 
 	void	(*mgd_prepare_tx)(struct ieee80211_hw *hw,
 				  struct ieee80211_vif *vif);
+	void	(*wake_tx_queue)(struct ieee80211_hw *hw, int queue);
 };
 
 /**
@@ -2642,6 +2657,24 @@ void ieee80211_napi_complete(struct ieee80211_hw *hw);
  */
 void ieee80211_rx(struct ieee80211_hw *hw, struct sk_buff *skb);
 
+/**
+ * ieee80211_rx_napi - receive a batch of frames from the NAPI poll
+ *
+ * Like ieee80211_rx(), but takes all frames on @skbs, which the driver
+ * collected in its napi_poll callback. If the hardware sets
+ * %IEEE80211_HW_RX_GRO the data frames are delivered through GRO, to be
+ * flushed to the network stack by ieee80211_napi_complete().
+ *
+ * This function may only be called from the napi_poll callback. Calls to
+ * this function, ieee80211_rx(), ieee80211_rx_ni() and
+ * ieee80211_rx_irqsafe() may not be mixed for a single hardware.
+ *
+ * @hw: the hardware the frames came in on
+ * @skbs: the frames to receive, the list is empty after this call and
+ *	the buffers are owned by mac80211
+ */
+void ieee80211_rx_napi(struct ieee80211_hw *hw, struct sk_buff_head *skbs);
+
 /**
  * ieee80211_rx_irqsafe - receive frame
  *
@@ -3205,6 +3238,22 @@ void ieee80211_stop_queues(struct ieee80211_hw *hw);
  */
 void ieee80211_wake_queues(struct ieee80211_hw *hw);
 
+/**
+ * ieee80211_tx_dequeue - get the next frame for a hardware queue
+ * @hw: pointer as obtained from ieee80211_alloc_hw().
+ * @queue: queue number (counted from zero).
+ *
+ * Returns the next station data frame for @queue, or %NULL if there is
+ * none. Frames are taken from the per-station, per-TID intermediate
+ * queues in deficit round robin order, so that every station gets its
+ * share of the queue. The frame is ready for transmission as if it had
+ * been passed to the @tx callback.
+ *
+ * Drivers implementing the wake_tx_queue() callback call this in atomic
+ * context whenever they have room for more frames.
+ */
+struct sk_buff *ieee80211_tx_dequeue(struct ieee80211_hw *hw, int queue);
+
 /**
  * ieee80211_scan_completed - completed hardware scan
  *
@@ -3704,6 +3753,9 @@ struct rate_control_ops {
 	void (*add_sta_debugfs)(void *priv, void *priv_sta,
 				struct dentry *dir);
 	void (*remove_sta_debugfs)(void *priv, void *priv_sta);
+
+	/* expected throughput to the station in kbps, 0 if unknown */
+	u32 (*get_expected_throughput)(void *priv_sta);
 };
 
 static inline int rate_supported(struct ieee80211_sta *sta,
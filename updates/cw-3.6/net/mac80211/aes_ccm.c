@@ -11,140 +11,164 @@
 #include <linux/types.h>
 #include <linux/crypto.h>
 #include <linux/err.h>
+#include <linux/scatterlist.h>
+#include <asm/unaligned.h>
 #include <crypto/aes.h>
 
 #include <net/mac80211.h>
 #include "key.h"
 #include "aes_ccm.h"
 
-static void aes_ccm_prepare(struct crypto_cipher *tfm, u8 *scratch, u8 *a)
+/*
+ * The CCMP payload is handled in place: @sg covers the data followed by
+ * room for (or, when decrypting, the received) MIC, and may be spread
+ * over the pages of a non-linear frame. The ccm(aes) AEAD processes it
+ * in as large chunks as the underlying AES implementation likes.
+ */
+int ieee80211_aes_ccm_encrypt(struct crypto_aead *tfm, u8 *b_0, u8 *aad,
+			      struct scatterlist *sg, size_t data_len)
 {
-	int i;
-	u8 *b_0, *aad, *b, *s_0;
+	struct scatterlist assoc;
+	struct {
+		struct aead_request	req;
+		u8			priv[crypto_aead_reqsize(tfm)];
+	} aead_req;
 
-	b_0 = scratch + 3 * AES_BLOCK_SIZE;
-	aad = scratch + 4 * AES_BLOCK_SIZE;
-	b = scratch;
-	s_0 = scratch + AES_BLOCK_SIZE;
+	memset(&aead_req, 0, sizeof(aead_req));
 
-	crypto_cipher_encrypt_one(tfm, b, b_0);
+	sg_init_one(&assoc, &aad[2], get_unaligned_be16(aad));
 
-	/* Extra Authenticate-only data (always two AES blocks) */
-	for (i = 0; i < AES_BLOCK_SIZE; i++)
-		aad[i] ^= b[i];
-	crypto_cipher_encrypt_one(tfm, b, aad);
+	aead_request_set_tfm(&aead_req.req, tfm);
+	aead_request_set_assoc(&aead_req.req, &assoc, assoc.length);
+	aead_request_set_crypt(&aead_req.req, sg, sg, data_len, b_0);
 
-	aad += AES_BLOCK_SIZE;
+	return crypto_aead_encrypt(&aead_req.req);
+}
 
-	for (i = 0; i < AES_BLOCK_SIZE; i++)
-		aad[i] ^= b[i];
-	crypto_cipher_encrypt_one(tfm, a, aad);
+int ieee80211_aes_ccm_decrypt(struct crypto_aead *tfm, u8 *b_0, u8 *aad,
+			      struct scatterlist *sg, size_t data_len)
+{
+	struct scatterlist assoc;
+	struct {
+		struct aead_request	req;
+		u8			priv[crypto_aead_reqsize(tfm)];
+	} aead_req;
 
-	/* Mask out bits from auth-only-b_0 */
-	b_0[0] &= 0x07;
+	memset(&aead_req, 0, sizeof(aead_req));
 
-	/* S_0 is used to encrypt T (= MIC) */
-	b_0[14] = 0;
-	b_0[15] = 0;
-	crypto_cipher_encrypt_one(tfm, s_0, b_0);
-}
+	sg_init_one(&assoc, &aad[2], get_unaligned_be16(aad));
 
+	aead_request_set_tfm(&aead_req.req, tfm);
+	aead_request_set_assoc(&aead_req.req, &assoc, assoc.length);
+	aead_request_set_crypt(&aead_req.req, sg, sg,
+			       data_len + CCMP_MIC_LEN, b_0);
 
-void ieee80211_aes_ccm_encrypt(struct crypto_cipher *tfm, u8 *scratch,
-			       u8 *data, size_t data_len,
-			       u8 *cdata, u8 *mic)
-{
-	int i, j, last_len, num_blocks;
-	u8 *pos, *cpos, *b, *s_0, *e, *b_0;
-
-	b = scratch;
-	s_0 = scratch + AES_BLOCK_SIZE;
-	e = scratch + 2 * AES_BLOCK_SIZE;
-	b_0 = scratch + 3 * AES_BLOCK_SIZE;
-
-	num_blocks = DIV_ROUND_UP(data_len, AES_BLOCK_SIZE);
-	last_len = data_len % AES_BLOCK_SIZE;
-	aes_ccm_prepare(tfm, scratch, b);
-
-	/* Process payload blocks */
-	pos = data;
-	cpos = cdata;
-	for (j = 1; j <= num_blocks; j++) {
-		int blen = (j == num_blocks && last_len) ?
-			last_len : AES_BLOCK_SIZE;
-
-		/* Authentication followed by encryption */
-		for (i = 0; i < blen; i++)
-			b[i] ^= pos[i];
-		crypto_cipher_encrypt_one(tfm, b, b);
-
-		b_0[14] = (j >> 8) & 0xff;
-		b_0[15] = j & 0xff;
-		crypto_cipher_encrypt_one(tfm, e, b_0);
-		for (i = 0; i < blen; i++)
-			*cpos++ = *pos++ ^ e[i];
-	}
-
-	for (i = 0; i < CCMP_MIC_LEN; i++)
-		mic[i] = b[i] ^ s_0[i];
+	return crypto_aead_decrypt(&aead_req.req);
 }
 
-
-int ieee80211_aes_ccm_decrypt(struct crypto_cipher *tfm, u8 *scratch,
-			      u8 *cdata, size_t data_len, u8 *mic, u8 *data)
+struct crypto_aead *ieee80211_aes_key_setup_encrypt(const u8 key[])
 {
-	int i, j, last_len, num_blocks;
-	u8 *pos, *cpos, *b, *s_0, *a, *b_0;
-
-	b = scratch;
-	s_0 = scratch + AES_BLOCK_SIZE;
-	a = scratch + 2 * AES_BLOCK_SIZE;
-	b_0 = scratch + 3 * AES_BLOCK_SIZE;
-
-	num_blocks = DIV_ROUND_UP(data_len, AES_BLOCK_SIZE);
-	last_len = data_len % AES_BLOCK_SIZE;
-	aes_ccm_prepare(tfm, scratch, a);
-
-	/* Process payload blocks */
-	cpos = cdata;
-	pos = data;
-	for (j = 1; j <= num_blocks; j++) {
-		int blen = (j == num_blocks && last_len) ?
-			last_len : AES_BLOCK_SIZE;
-
-		/* Decryption followed by authentication */
-		b_0[14] = (j >> 8) & 0xff;
-		b_0[15] = j & 0xff;
-		crypto_cipher_encrypt_one(tfm, b, b_0);
-		for (i = 0; i < blen; i++) {
-			*pos = *cpos++ ^ b[i];
-			a[i] ^= *pos++;
-		}
-		crypto_cipher_encrypt_one(tfm, a, a);
-	}
-
-	for (i = 0; i < CCMP_MIC_LEN; i++) {
-		if ((mic[i] ^ s_0[i]) != a[i])
-			return -1;
-	}
-
-	return 0;
-}
+	struct crypto_aead *tfm;
+	int err;
 
+	tfm = crypto_alloc_aead("ccm(aes)", 0, CRYPTO_ALG_ASYNC);
+	if (IS_ERR(tfm))
+		return tfm;
 
-struct crypto_cipher *ieee80211_aes_key_setup_encrypt(const u8 key[])
-{
-	struct crypto_cipher *tfm;
-
-	tfm = crypto_alloc_cipher("aes", 0, CRYPTO_ALG_ASYNC);
-	if (!IS_ERR(tfm))
-		crypto_cipher_setkey(tfm, key, ALG_CCMP_KEY_LEN);
+	err = crypto_aead_setkey(tfm, key, ALG_CCMP_KEY_LEN);
+	if (!err)
+		err = crypto_aead_setauthsize(tfm, CCMP_MIC_LEN);
+	if (!err)
+		return tfm;
 
-	return tfm;
+	crypto_free_aead(tfm);
+	return ERR_PTR(err);
 }
 
 
-void ieee80211_aes_key_free(struct crypto_cipher *tfm)
+void ieee80211_aes_key_free(struct crypto_aead *tfm)
+{
+	crypto_free_aead(tfm);
+}
+
+#ifdef CONFIG_MAC80211_CRYPTO_TEST
+/*
+ * CCMP test vector from IEEE Std 802.11-2012, M.6.4: a non-QoS data
+ * frame, with the nonce and AAD derived from its header as
+ * ccmp_special_blocks() would.
+ */
+static const u8 ccm_tv_key[ALG_CCMP_KEY_LEN] = {
+	0xc9, 0x7c, 0x1f, 0x67, 0xce, 0x37, 0x11, 0x85,
+	0x51, 0x4a, 0x8a, 0x19, 0xf2, 0xbd, 0xd5, 0x2f
+};
+
+static const u8 ccm_tv_b_0[AES_BLOCK_SIZE] = {
+	0x01, 0x00, 0x50, 0x30, 0xf1, 0x84, 0x44, 0x08,
+	0xb5, 0x03, 0x97, 0x76, 0xe7, 0x0c, 0x00, 0x00
+};
+
+static const u8 ccm_tv_aad[2 * AES_BLOCK_SIZE] = {
+	0x00, 0x16, 0x08, 0x40, 0x0f, 0xd2, 0xe1, 0x28,
+	0xa5, 0x7c, 0x50, 0x30, 0xf1, 0x84, 0x44, 0x08,
+	0xab, 0xae, 0xa5, 0xb8, 0xfc, 0xba, 0x00, 0x00
+};
+
+static const u8 ccm_tv_plain[] = {
+	0xf8, 0xba, 0x1a, 0x55, 0xd0, 0x2f, 0x85, 0xae,
+	0x96, 0x7b, 0xb6, 0x2f, 0xb6, 0xcd, 0xa8, 0xeb,
+	0x7e, 0x78, 0xa0, 0x50
+};
+
+static const u8 ccm_tv_cipher[sizeof(ccm_tv_plain) + CCMP_MIC_LEN] = {
+	0xf3, 0xd0, 0xa2, 0xfe, 0x9a, 0x3d, 0xbf, 0x23,
+	0x42, 0xa6, 0x43, 0xe4, 0x32, 0x46, 0xe8, 0x0c,
+	0x3c, 0x04, 0xd0, 0x19,
+	/* MIC */
+	0x78, 0x45, 0xce, 0x0b, 0x16, 0xf9, 0x76, 0x23
+};
+
+int ieee80211_aes_ccm_selftest(void)
 {
-	crypto_free_cipher(tfm);
+	struct crypto_aead *tfm;
+	struct scatterlist sg;
+	u8 b_0[AES_BLOCK_SIZE], aad[2 * AES_BLOCK_SIZE];
+	u8 buf[sizeof(ccm_tv_cipher)];
+	int err;
+
+	tfm = ieee80211_aes_key_setup_encrypt(ccm_tv_key);
+	if (IS_ERR(tfm))
+		return PTR_ERR(tfm);
+
+	/* the AEAD may modify the IV, use copies */
+	memcpy(b_0, ccm_tv_b_0, sizeof(b_0));
+	memcpy(aad, ccm_tv_aad, sizeof(aad));
+	memcpy(buf, ccm_tv_plain, sizeof(ccm_tv_plain));
+	sg_init_one(&sg, buf, sizeof(buf));
+
+	err = ieee80211_aes_ccm_encrypt(tfm, b_0, aad, &sg,
+					sizeof(ccm_tv_plain));
+	if (!err && memcmp(buf, ccm_tv_cipher, sizeof(buf)))
+		err = -EINVAL;
+	if (err)
+		goto out;
+
+	memcpy(b_0, ccm_tv_b_0, sizeof(b_0));
+	err = ieee80211_aes_ccm_decrypt(tfm, b_0, aad, &sg,
+					sizeof(ccm_tv_plain));
+	if (!err && memcmp(buf, ccm_tv_plain, sizeof(ccm_tv_plain)))
+		err = -EINVAL;
+	if (err)
+		goto out;
+
+	/* a corrupted MIC must be caught */
+	memcpy(b_0, ccm_tv_b_0, sizeof(b_0));
+	memcpy(buf, ccm_tv_cipher, sizeof(buf));
+	buf[sizeof(buf) - 1] ^= 0x01;
+	if (ieee80211_aes_ccm_decrypt(tfm, b_0, aad, &sg,
+				      sizeof(ccm_tv_plain)) != -EBADMSG)
+		err = -EINVAL;
+ out:
+	ieee80211_aes_key_free(tfm);
+	return err;
 }
+#endif
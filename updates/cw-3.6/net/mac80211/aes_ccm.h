@@ -12,13 +12,17 @@
 
 #include <linux/crypto.h>
 
-struct crypto_cipher *ieee80211_aes_key_setup_encrypt(const u8 key[]);
-void ieee80211_aes_ccm_encrypt(struct crypto_cipher *tfm, u8 *scratch,
-			       u8 *data, size_t data_len,
-			       u8 *cdata, u8 *mic);
-int ieee80211_aes_ccm_decrypt(struct crypto_cipher *tfm, u8 *scratch,
-			      u8 *cdata, size_t data_len,
-			      u8 *mic, u8 *data);
-void ieee80211_aes_key_free(struct crypto_cipher *tfm);
+struct scatterlist;
+
+struct crypto_aead *ieee80211_aes_key_setup_encrypt(const u8 key[]);
+int ieee80211_aes_ccm_encrypt(struct crypto_aead *tfm, u8 *b_0, u8 *aad,
+			      struct scatterlist *sg, size_t data_len);
+int ieee80211_aes_ccm_decrypt(struct crypto_aead *tfm, u8 *b_0, u8 *aad,
+			      struct scatterlist *sg, size_t data_len);
+void ieee80211_aes_key_free(struct crypto_aead *tfm);
+
+#ifdef CONFIG_MAC80211_CRYPTO_TEST
+int ieee80211_aes_ccm_selftest(void);
+#endif
 
 #endif /* AES_CCM_H */
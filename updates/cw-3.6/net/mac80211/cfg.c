@@ -65,8 +65,10 @@ static int ieee80211_change_iface(struct wiphy *wiphy,
 	    params && params->use_4addr == 0)
 		RCU_INIT_POINTER(sdata->u.vlan.sta, NULL);
 	else if (type == NL80211_IFTYPE_STATION &&
-		 params && params->use_4addr >= 0)
+		 params && params->use_4addr >= 0) {
 		sdata->u.mgd.use_4addr = params->use_4addr;
+		ieee80211_update_netdev_room(sdata);
+	}
 
 	if (sdata->vif.type == NL80211_IFTYPE_MONITOR && flags) {
 		struct ieee80211_local *local = sdata->local;
@@ -354,6 +356,7 @@ static void sta_set_sinfo(struct sta_info *sta, struct station_info *sinfo)
 {
 	struct ieee80211_sub_if_data *sdata = sta->sdata;
 	struct ieee80211_local *local = sdata->local;
+	struct sta_pcpu_stats stats;
 	struct timespec uptime;
 
 	sinfo->generation = sdata->local->sta_generation;
@@ -377,13 +380,15 @@ static void sta_set_sinfo(struct sta_info *sta, struct station_info *sinfo)
 	sinfo->connected_time = uptime.tv_sec - sta->last_connected;
 
 	sinfo->inactive_time = jiffies_to_msecs(jiffies - sta->last_rx);
-	sinfo->rx_bytes = sta->rx_bytes;
-	sinfo->tx_bytes = sta->tx_bytes;
-	sinfo->rx_packets = sta->rx_packets;
-	sinfo->tx_packets = sta->tx_packets;
-	sinfo->tx_retries = sta->tx_retry_count;
-	sinfo->tx_failed = sta->tx_retry_failed;
-	sinfo->rx_dropped_misc = sta->rx_dropped;
+
+	sta_get_stats(sta, &stats);
+	sinfo->rx_bytes = stats.rx_bytes;
+	sinfo->tx_bytes = stats.tx_bytes;
+	sinfo->rx_packets = stats.rx_packets;
+	sinfo->tx_packets = stats.tx_packets;
+	sinfo->tx_retries = stats.tx_retry_count;
+	sinfo->tx_failed = stats.tx_retry_failed;
+	sinfo->rx_dropped_misc = stats.rx_dropped;
 	sinfo->beacon_loss_count = sta->beacon_loss_count;
 
 	if ((sta->local->hw.flags & IEEE80211_HW_SIGNAL_DBM) ||
@@ -491,6 +496,7 @@ static void ieee80211_get_et_stats(struct wiphy *wiphy,
 	struct ieee80211_local *local = sdata->local;
 	struct station_info sinfo;
 	struct survey_info survey;
+	struct sta_pcpu_stats sstats;
 	int i, q;
 #define STA_STATS_SURVEY_LEN 7
 
@@ -498,19 +504,20 @@ static void ieee80211_get_et_stats(struct wiphy *wiphy,
 
 #define ADD_STA_STATS(sta)				\
 	do {						\
-		data[i++] += sta->rx_packets;		\
-		data[i++] += sta->rx_bytes;		\
+		sta_get_stats(sta, &sstats);		\
+		data[i++] += sstats.rx_packets;		\
+		data[i++] += sstats.rx_bytes;		\
 		data[i++] += sta->wep_weak_iv_count;	\
-		data[i++] += sta->num_duplicates;	\
-		data[i++] += sta->rx_fragments;		\
-		data[i++] += sta->rx_dropped;		\
+		data[i++] += sstats.num_duplicates;	\
+		data[i++] += sstats.rx_fragments;	\
+		data[i++] += sstats.rx_dropped;		\
 							\
-		data[i++] += sta->tx_packets;		\
-		data[i++] += sta->tx_bytes;		\
-		data[i++] += sta->tx_fragments;		\
-		data[i++] += sta->tx_filtered_count;	\
-		data[i++] += sta->tx_retry_failed;	\
-		data[i++] += sta->tx_retry_count;	\
+		data[i++] += sstats.tx_packets;		\
+		data[i++] += sstats.tx_bytes;		\
+		data[i++] += sstats.tx_fragments;	\
+		data[i++] += sstats.tx_filtered_count;	\
+		data[i++] += sstats.tx_retry_failed;	\
+		data[i++] += sstats.tx_retry_count;	\
 		data[i++] += sta->beacon_loss_count;	\
 	} while (0)
 
@@ -628,8 +635,10 @@ static void ieee80211_get_et_strings(struct wiphy *wiphy,
 	drv_get_et_strings(sdata, sset, &(data[sz_sta_stats]));
 }
 
-static int ieee80211_dump_station(struct wiphy *wiphy, struct net_device *dev,
-				 int idx, u8 *mac, struct station_info *sinfo)
+static int
+ieee80211_dump_station_next(struct wiphy *wiphy, struct net_device *dev,
+			    const struct cfg80211_dump_cursor *cursor,
+			    u8 *mac, struct station_info *sinfo)
 {
 	struct ieee80211_sub_if_data *sdata = IEEE80211_DEV_TO_SUB_IF(dev);
 	struct ieee80211_local *local = sdata->local;
@@ -638,7 +647,7 @@ static int ieee80211_dump_station(struct wiphy *wiphy, struct net_device *dev,
 
 	mutex_lock(&local->sta_mtx);
 
-	sta = sta_info_get_by_idx(sdata, idx);
+	sta = sta_info_get_next(sdata, cursor);
 	if (sta) {
 		ret = 0;
 		memcpy(mac, sta->sta.addr, ETH_ALEN);
@@ -1380,7 +1389,7 @@ static void mpath_set_pinfo(struct mesh_path *mpath, u8 *next_hop,
 
 	memset(pinfo, 0, sizeof(*pinfo));
 
-	pinfo->generation = mesh_paths_generation;
+	pinfo->generation = mpath->sdata->u.mesh.mesh_paths_generation;
 
 	pinfo->filled = MPATH_INFO_FRAME_QLEN |
 			MPATH_INFO_SN |
@@ -1431,9 +1440,10 @@ static int ieee80211_get_mpath(struct wiphy *wiphy, struct net_device *dev,
 	return 0;
 }
 
-static int ieee80211_dump_mpath(struct wiphy *wiphy, struct net_device *dev,
-				 int idx, u8 *dst, u8 *next_hop,
-				 struct mpath_info *pinfo)
+static int
+ieee80211_dump_mpath_next(struct wiphy *wiphy, struct net_device *dev,
+			  const struct cfg80211_dump_cursor *cursor,
+			  u8 *dst, u8 *next_hop, struct mpath_info *pinfo)
 {
 	struct ieee80211_sub_if_data *sdata;
 	struct mesh_path *mpath;
@@ -1441,7 +1451,7 @@ static int ieee80211_dump_mpath(struct wiphy *wiphy, struct net_device *dev,
 	sdata = IEEE80211_DEV_TO_SUB_IF(dev);
 
 	rcu_read_lock();
-	mpath = mesh_path_lookup_by_idx(idx, sdata);
+	mpath = mesh_path_lookup_next(cursor, sdata);
 	if (!mpath) {
 		rcu_read_unlock();
 		return -ENOENT;
@@ -1625,9 +1635,7 @@ static int ieee80211_join_mesh(struct wiphy *wiphy, struct net_device *dev,
 	if (err)
 		return err;
 
-	ieee80211_start_mesh(sdata);
-
-	return 0;
+	return ieee80211_start_mesh(sdata);
 }
 
 static int ieee80211_leave_mesh(struct wiphy *wiphy, struct net_device *dev)
@@ -3016,14 +3024,14 @@ struct cfg80211_ops mac80211_config_ops = {
 	.del_station = ieee80211_del_station,
 	.change_station = ieee80211_change_station,
 	.get_station = ieee80211_get_station,
-	.dump_station = ieee80211_dump_station,
+	.dump_station_next = ieee80211_dump_station_next,
 	.dump_survey = ieee80211_dump_survey,
 #ifdef CONFIG_MAC80211_MESH
 	.add_mpath = ieee80211_add_mpath,
 	.del_mpath = ieee80211_del_mpath,
 	.change_mpath = ieee80211_change_mpath,
 	.get_mpath = ieee80211_get_mpath,
-	.dump_mpath = ieee80211_dump_mpath,
+	.dump_mpath_next = ieee80211_dump_mpath_next,
 	.update_mesh_config = ieee80211_update_mesh_config,
 	.get_mesh_config = ieee80211_get_mesh_config,
 	.join_mesh = ieee80211_join_mesh,
@@ -0,0 +1,666 @@
+/*
+ * Known-answer tests and benchmark for the mac80211 software ciphers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Everything here runs on plain buffers and skbs, so no radio or
+ * interface is needed. The known-answer tests run once when mac80211
+ * is loaded and again whenever "selftest" is read; reading "bench"
+ * times encryption and decryption of each cipher for a few payload
+ * sizes:
+ *
+ *   /sys/kernel/debug/mac80211_crypto/selftest
+ *   /sys/kernel/debug/mac80211_crypto/bench
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/types.h>
+#include <linux/slab.h>
+#include <linux/debugfs.h>
+#include <linux/crypto.h>
+#include <linux/err.h>
+#include <linux/scatterlist.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/timex.h>
+#include <linux/sched.h>
+#include <linux/skbuff.h>
+#include <linux/gfp.h>
+#include <linux/ieee80211.h>
+#include <crypto/aes.h>
+
+#include <net/mac80211.h>
+#include "key.h"
+#include "wep.h"
+#include "tkip.h"
+#include "michael.h"
+#include "aes_ccm.h"
+#include "aes_cmac.h"
+#include "wpa.h"
+#include "crypto_test.h"
+
+#define CRYPTO_TEST_ITERATIONS	2000
+#define CRYPTO_TEST_MAX_LEN	2304
+/* room for the largest trailer: TKIP MIC + ICV, CCMP MIC or the MMIE */
+#define CRYPTO_TEST_TAILROOM	32
+
+static const size_t crypto_test_lens[] = { 64, 256, 576, 1500 };
+
+/*
+ * The frame shared by the WEP and TKIP vectors: a non-QoS data frame
+ * from 02:03:04:05:06:08 to 02:03:04:05:06:07 carrying an LLC/SNAP
+ * header and 24 octets of payload. The expected results were computed
+ * with independent RC4, CRC-32 and Michael implementations.
+ */
+static const u8 tv_hdr[24] __aligned(2) = {
+	0x08, 0x00, 0x00, 0x00, 0x02, 0x03, 0x04, 0x05,
+	0x06, 0x07, 0x02, 0x03, 0x04, 0x05, 0x06, 0x08,
+	0x02, 0x03, 0x04, 0x05, 0x06, 0x09, 0x00, 0x00
+};
+
+static const u8 tv_plain[32] = {
+	0xaa, 0xaa, 0x03, 0x00, 0x00, 0x00, 0x08, 0x00,
+	0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27,
+	0x28, 0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f,
+	0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37
+};
+
+/* IV 01:02:03 followed by a WEP-40 key */
+static const u8 wep_tv_key[3 + WLAN_KEY_LEN_WEP40] = {
+	0x01, 0x02, 0x03, 0x11, 0x22, 0x33, 0x44, 0x55
+};
+
+static const u8 wep_tv_cipher[sizeof(tv_plain) + WEP_ICV_LEN] = {
+	0x41, 0x13, 0xce, 0xb6, 0x08, 0x63, 0x4e, 0xfa,
+	0x43, 0xab, 0xff, 0xfd, 0x5b, 0xd0, 0xff, 0x5f,
+	0x67, 0x0a, 0xcb, 0xd0, 0x43, 0xd1, 0x68, 0xa8,
+	0x85, 0xc0, 0x6e, 0xdf, 0x21, 0xda, 0x60, 0x8d,
+	/* ICV */
+	0x91, 0x01, 0xcf, 0x4b
+};
+
+static const u8 tkip_tv_tk[16] = {
+	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+	0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f
+};
+
+static const u8 tkip_tv_mic_key[8] = {
+	0xd5, 0x5e, 0x10, 0x05, 0x10, 0x12, 0x89, 0x86
+};
+
+#define TKIP_TV_IV32	0x00000001
+#define TKIP_TV_IV16	0x0203
+
+static const u8 tkip_tv_rc4key[16] = {
+	0x02, 0x22, 0x03, 0xa5, 0x93, 0x26, 0x25, 0xfd,
+	0xf3, 0xd3, 0xdb, 0xd5, 0x03, 0xf9, 0x4a, 0x04
+};
+
+static const u8 tkip_tv_mic[MICHAEL_MIC_LEN] = {
+	0x4e, 0x0c, 0x85, 0x99, 0x11, 0x74, 0xae, 0xc6
+};
+
+static const u8 tkip_tv_cipher[sizeof(tv_plain) + MICHAEL_MIC_LEN +
+			       TKIP_ICV_LEN] = {
+	0xc5, 0x6b, 0x80, 0x20, 0x74, 0x18, 0x3f, 0x03,
+	0xe4, 0x97, 0x68, 0x4b, 0x59, 0x8d, 0x5c, 0x43,
+	0xe6, 0xc3, 0x53, 0x52, 0x55, 0x4a, 0x53, 0xe4,
+	0x96, 0x61, 0x6a, 0x50, 0x76, 0x44, 0x46, 0x82,
+	/* MIC */
+	0x71, 0x60, 0xf6, 0xcc, 0x6e, 0x91, 0x66, 0x92,
+	/* ICV */
+	0xcb, 0xd5, 0x69, 0x1b
+};
+
+/*
+ * BIP over a broadcast deauthentication frame with key ID 4 and IPN 1,
+ * using the RFC 4493 key; the MIC was computed with an independent
+ * AES-CMAC implementation.
+ */
+static const u8 bip_tv_key[16] = {
+	0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+	0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c
+};
+
+static const u8 bip_tv_aad[20] = {
+	0xc0, 0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0x02, 0x03, 0x04, 0x05, 0x06, 0x08, 0x02, 0x03,
+	0x04, 0x05, 0x06, 0x08
+};
+
+static const u8 bip_tv_body[2 + sizeof(struct ieee80211_mmie)] = {
+	/* reason code */
+	0x02, 0x00,
+	/* MMIE, MIC left zero */
+	0x4c, 0x10, 0x04, 0x00, 0x01, 0x00, 0x00, 0x00,
+	0x00, 0x00
+};
+
+static const u8 bip_tv_mic[8] = {
+	0x56, 0x7d, 0x66, 0x65, 0x14, 0x38, 0x2b, 0x9f
+};
+
+struct crypto_test_ctx {
+	struct crypto_cipher *arc4;
+	struct crypto_aead *ccmp;
+	struct crypto_cipher *bip;
+	struct ieee80211_hdr hdr;
+	struct tkip_ctx tkip;
+	u16 iv16;
+	u8 *buf;
+};
+
+struct crypto_test_cipher {
+	const char *name;
+	int (*selftest)(struct crypto_test_ctx *ctx);
+	int (*encrypt)(struct crypto_test_ctx *ctx, size_t len);
+	int (*decrypt)(struct crypto_test_ctx *ctx, size_t len);
+};
+
+static struct dentry *crypto_test_dir;
+
+static int wep_selftest(struct crypto_test_ctx *ctx)
+{
+	u8 rc4key[sizeof(wep_tv_key)];
+	u8 *buf = ctx->buf;
+
+	memcpy(buf, tv_plain, sizeof(tv_plain));
+	memcpy(rc4key, wep_tv_key, sizeof(rc4key));
+	if (ieee80211_wep_encrypt_data(ctx->arc4, rc4key, sizeof(rc4key),
+				       buf, sizeof(tv_plain)) ||
+	    memcmp(buf, wep_tv_cipher, sizeof(wep_tv_cipher)))
+		return -EINVAL;
+
+	if (ieee80211_wep_decrypt_data(ctx->arc4, rc4key, sizeof(rc4key),
+				       buf, sizeof(tv_plain)) ||
+	    memcmp(buf, tv_plain, sizeof(tv_plain)))
+		return -EINVAL;
+
+	/* a corrupted ICV must be caught */
+	memcpy(buf, wep_tv_cipher, sizeof(wep_tv_cipher));
+	buf[sizeof(wep_tv_cipher) - 1] ^= 0x01;
+	if (!ieee80211_wep_decrypt_data(ctx->arc4, rc4key, sizeof(rc4key),
+					buf, sizeof(tv_plain)))
+		return -EINVAL;
+
+	return 0;
+}
+
+static int wep_encrypt(struct crypto_test_ctx *ctx, size_t len)
+{
+	u8 rc4key[sizeof(wep_tv_key)];
+
+	memcpy(rc4key, wep_tv_key, sizeof(rc4key));
+	return ieee80211_wep_encrypt_data(ctx->arc4, rc4key, sizeof(rc4key),
+					  ctx->buf, len);
+}
+
+static int wep_decrypt(struct crypto_test_ctx *ctx, size_t len)
+{
+	u8 rc4key[sizeof(wep_tv_key)];
+
+	memcpy(rc4key, wep_tv_key, sizeof(rc4key));
+	return ieee80211_wep_decrypt_data(ctx->arc4, rc4key, sizeof(rc4key),
+					  ctx->buf, len);
+}
+
+/*
+ * The RX path runs Michael over the skb, so check the vector with the
+ * received MIC still trailing the data, once in the linear part and
+ * once with the tail of the frame (and the MIC) in a page fragment.
+ */
+static int michael_skb_selftest(bool paged)
+{
+	unsigned int hdrlen = sizeof(tv_hdr), head = sizeof(tv_plain);
+	struct sk_buff *skb;
+	struct page *page;
+	u8 mic[MICHAEL_MIC_LEN];
+	u8 *frag;
+
+	if (paged)
+		head /= 2;
+
+	skb = alloc_skb(hdrlen + sizeof(tv_plain) + MICHAEL_MIC_LEN,
+			GFP_KERNEL);
+	if (!skb)
+		return -ENOMEM;
+
+	memcpy(skb_put(skb, hdrlen), tv_hdr, hdrlen);
+	memcpy(skb_put(skb, head), tv_plain, head);
+
+	if (paged) {
+		page = alloc_page(GFP_KERNEL);
+		if (!page) {
+			kfree_skb(skb);
+			return -ENOMEM;
+		}
+		frag = page_address(page);
+		memcpy(frag, tv_plain + head, sizeof(tv_plain) - head);
+		memcpy(frag + sizeof(tv_plain) - head, tkip_tv_mic,
+		       MICHAEL_MIC_LEN);
+		skb_fill_page_desc(skb, 0, page, 0, sizeof(tv_plain) - head +
+				   MICHAEL_MIC_LEN);
+		skb->len += sizeof(tv_plain) - head + MICHAEL_MIC_LEN;
+		skb->data_len += sizeof(tv_plain) - head + MICHAEL_MIC_LEN;
+		skb->truesize += PAGE_SIZE;
+	} else {
+		memcpy(skb_put(skb, MICHAEL_MIC_LEN), tkip_tv_mic,
+		       MICHAEL_MIC_LEN);
+	}
+
+	ieee80211_michael_mic_skb(tkip_tv_mic_key, skb, hdrlen,
+				  sizeof(tv_plain), mic);
+	kfree_skb(skb);
+
+	return memcmp(mic, tkip_tv_mic, MICHAEL_MIC_LEN) ? -EINVAL : 0;
+}
+
+static int tkip_selftest(struct crypto_test_ctx *ctx)
+{
+	struct ieee80211_hdr *hdr = &ctx->hdr;
+	u8 rc4key[16], mic[MICHAEL_MIC_LEN];
+	u8 *buf = ctx->buf;
+	size_t len = sizeof(tv_plain) + MICHAEL_MIC_LEN;
+	int err;
+
+	memset(&ctx->tkip, 0, sizeof(ctx->tkip));
+
+	ieee80211_tkip_mix(tkip_tv_tk, hdr->addr2, &ctx->tkip,
+			   TKIP_TV_IV32, TKIP_TV_IV16, rc4key);
+	if (memcmp(rc4key, tkip_tv_rc4key, sizeof(rc4key)))
+		return -EINVAL;
+
+	memcpy(buf, tv_plain, sizeof(tv_plain));
+	michael_mic(tkip_tv_mic_key, hdr, buf, sizeof(tv_plain),
+		    buf + sizeof(tv_plain));
+	if (memcmp(buf + sizeof(tv_plain), tkip_tv_mic, MICHAEL_MIC_LEN))
+		return -EINVAL;
+
+	if (ieee80211_wep_encrypt_data(ctx->arc4, rc4key, sizeof(rc4key),
+				       buf, len) ||
+	    memcmp(buf, tkip_tv_cipher, sizeof(tkip_tv_cipher)))
+		return -EINVAL;
+
+	/* the phase 1 key cached above must give the same result */
+	ieee80211_tkip_mix(tkip_tv_tk, hdr->addr2, &ctx->tkip,
+			   TKIP_TV_IV32, TKIP_TV_IV16, rc4key);
+	if (ieee80211_wep_decrypt_data(ctx->arc4, rc4key, sizeof(rc4key),
+				       buf, len))
+		return -EINVAL;
+
+	michael_mic(tkip_tv_mic_key, hdr, buf, sizeof(tv_plain), mic);
+	if (memcmp(mic, buf + sizeof(tv_plain), MICHAEL_MIC_LEN) ||
+	    memcmp(buf, tv_plain, sizeof(tv_plain)))
+		return -EINVAL;
+
+	err = michael_skb_selftest(false);
+	if (!err)
+		err = michael_skb_selftest(true);
+	return err;
+}
+
+/*
+ * Roughly what a TKIP MPDU costs on TX: Michael over the MSDU, phase 2
+ * key mixing (phase 1 stays cached as IV32 does not change) and RC4
+ * with the ICV.
+ */
+static int tkip_encrypt(struct crypto_test_ctx *ctx, size_t len)
+{
+	struct ieee80211_hdr *hdr = &ctx->hdr;
+	u8 rc4key[16];
+
+	ieee80211_tkip_mix(tkip_tv_tk, hdr->addr2, &ctx->tkip,
+			   TKIP_TV_IV32, ++ctx->iv16, rc4key);
+	michael_mic(tkip_tv_mic_key, hdr, ctx->buf, len, ctx->buf + len);
+
+	return ieee80211_wep_encrypt_data(ctx->arc4, rc4key, sizeof(rc4key),
+					  ctx->buf, len + MICHAEL_MIC_LEN);
+}
+
+static int tkip_decrypt(struct crypto_test_ctx *ctx, size_t len)
+{
+	struct ieee80211_hdr *hdr = &ctx->hdr;
+	u8 rc4key[16], mic[MICHAEL_MIC_LEN];
+	int err;
+
+	ieee80211_tkip_mix(tkip_tv_tk, hdr->addr2, &ctx->tkip,
+			   TKIP_TV_IV32, ctx->iv16, rc4key);
+	err = ieee80211_wep_decrypt_data(ctx->arc4, rc4key, sizeof(rc4key),
+					 ctx->buf, len + MICHAEL_MIC_LEN);
+	michael_mic(tkip_tv_mic_key, hdr, ctx->buf, len, mic);
+	if (memcmp(mic, ctx->buf + len, MICHAEL_MIC_LEN))
+		err = -EBADMSG;
+
+	return err;
+}
+
+static int ccmp_selftest(struct crypto_test_ctx *ctx)
+{
+	return ieee80211_aes_ccm_selftest();
+}
+
+static void ccmp_blocks(u8 *b_0, u8 *aad)
+{
+	memset(b_0, 0, AES_BLOCK_SIZE);
+	b_0[0] = 0x1;
+	memcpy(&b_0[2], &tv_hdr[10], ETH_ALEN);
+
+	memset(aad, 0, 2 * AES_BLOCK_SIZE);
+	aad[1] = 22;
+	memcpy(&aad[2], tv_hdr, 22);
+}
+
+static int ccmp_encrypt(struct crypto_test_ctx *ctx, size_t len)
+{
+	u8 b_0[AES_BLOCK_SIZE], aad[2 * AES_BLOCK_SIZE];
+	struct scatterlist sg;
+
+	ccmp_blocks(b_0, aad);
+	sg_init_one(&sg, ctx->buf, len + CCMP_MIC_LEN);
+
+	return ieee80211_aes_ccm_encrypt(ctx->ccmp, b_0, aad, &sg, len);
+}
+
+static int ccmp_decrypt(struct crypto_test_ctx *ctx, size_t len)
+{
+	u8 b_0[AES_BLOCK_SIZE], aad[2 * AES_BLOCK_SIZE];
+	struct scatterlist sg;
+
+	ccmp_blocks(b_0, aad);
+	sg_init_one(&sg, ctx->buf, len + CCMP_MIC_LEN);
+
+	return ieee80211_aes_ccm_decrypt(ctx->ccmp, b_0, aad, &sg, len);
+}
+
+static int bip_selftest(struct crypto_test_ctx *ctx)
+{
+	struct crypto_cipher *tfm;
+	u8 *buf = ctx->buf;
+	u8 mic[8];
+	int err = 0;
+
+	tfm = ieee80211_aes_cmac_key_setup(bip_tv_key);
+	if (IS_ERR(tfm))
+		return PTR_ERR(tfm);
+
+	memcpy(buf, bip_tv_body, sizeof(bip_tv_body));
+	ieee80211_aes_cmac(tfm, bip_tv_aad, buf, sizeof(bip_tv_body), mic);
+	if (memcmp(mic, bip_tv_mic, sizeof(mic)))
+		err = -EINVAL;
+
+	/* the MIC field itself must not be covered */
+	memcpy(buf + sizeof(bip_tv_body) - sizeof(mic), mic, sizeof(mic));
+	ieee80211_aes_cmac(tfm, bip_tv_aad, buf, sizeof(bip_tv_body), mic);
+	if (memcmp(mic, bip_tv_mic, sizeof(mic)))
+		err = -EINVAL;
+
+	ieee80211_aes_cmac_key_free(tfm);
+	return err;
+}
+
+static int bip_encrypt(struct crypto_test_ctx *ctx, size_t len)
+{
+	size_t data_len = len + sizeof(struct ieee80211_mmie);
+
+	ieee80211_aes_cmac(ctx->bip, bip_tv_aad, ctx->buf, data_len,
+			   ctx->buf + data_len - 8);
+	return 0;
+}
+
+static int bip_decrypt(struct crypto_test_ctx *ctx, size_t len)
+{
+	size_t data_len = len + sizeof(struct ieee80211_mmie);
+	u8 mic[8];
+
+	ieee80211_aes_cmac(ctx->bip, bip_tv_aad, ctx->buf, data_len, mic);
+	if (memcmp(mic, ctx->buf + data_len - 8, sizeof(mic)))
+		return -EBADMSG;
+	return 0;
+}
+
+static const struct crypto_test_cipher crypto_test_ciphers[] = {
+	{ "wep", wep_selftest, wep_encrypt, wep_decrypt },
+	{ "tkip", tkip_selftest, tkip_encrypt, tkip_decrypt },
+	{ "ccmp", ccmp_selftest, ccmp_encrypt, ccmp_decrypt },
+	{ "bip", bip_selftest, bip_encrypt, bip_decrypt },
+};
+
+static void crypto_test_free(struct crypto_test_ctx *ctx)
+{
+	if (!IS_ERR_OR_NULL(ctx->arc4))
+		crypto_free_cipher(ctx->arc4);
+	if (!IS_ERR_OR_NULL(ctx->ccmp))
+		ieee80211_aes_key_free(ctx->ccmp);
+	if (!IS_ERR_OR_NULL(ctx->bip))
+		ieee80211_aes_cmac_key_free(ctx->bip);
+	kfree(ctx->buf);
+}
+
+static int crypto_test_alloc(struct crypto_test_ctx *ctx)
+{
+	int err;
+
+	memset(ctx, 0, sizeof(*ctx));
+	memcpy(&ctx->hdr, tv_hdr, sizeof(tv_hdr));
+
+	ctx->buf = kzalloc(CRYPTO_TEST_MAX_LEN + CRYPTO_TEST_TAILROOM,
+			   GFP_KERNEL);
+	if (!ctx->buf)
+		return -ENOMEM;
+
+	ctx->arc4 = crypto_alloc_cipher("arc4", 0, CRYPTO_ALG_ASYNC);
+	if (IS_ERR(ctx->arc4)) {
+		err = PTR_ERR(ctx->arc4);
+		goto err;
+	}
+	ctx->ccmp = ieee80211_aes_key_setup_encrypt(tkip_tv_tk);
+	if (IS_ERR(ctx->ccmp)) {
+		err = PTR_ERR(ctx->ccmp);
+		goto err;
+	}
+	ctx->bip = ieee80211_aes_cmac_key_setup(bip_tv_key);
+	if (IS_ERR(ctx->bip)) {
+		err = PTR_ERR(ctx->bip);
+		goto err;
+	}
+
+	return 0;
+ err:
+	crypto_test_free(ctx);
+	return err;
+}
+
+static int crypto_test_selftest(char *buf, size_t size)
+{
+	struct crypto_test_ctx ctx;
+	int i, err, res = 0;
+
+	err = crypto_test_alloc(&ctx);
+	if (err)
+		return err;
+
+	for (i = 0; i < ARRAY_SIZE(crypto_test_ciphers); i++) {
+		const struct crypto_test_cipher *c = &crypto_test_ciphers[i];
+
+		err = c->selftest(&ctx);
+		if (err)
+			pr_err("mac80211: %s self-test failed (%d)\n",
+			       c->name, err);
+		if (buf)
+			res += scnprintf(buf + res, size - res, "%-5s %s\n",
+					 c->name, err ? "FAILED" : "passed");
+	}
+
+	crypto_test_free(&ctx);
+	return res;
+}
+
+/*
+ * Decryption runs over whatever the previous iteration left in the
+ * buffer and so mostly fails the integrity check; that costs the same
+ * as a successful one.
+ */
+static void crypto_test_time(struct crypto_test_ctx *ctx,
+			     int (*op)(struct crypto_test_ctx *ctx, size_t len),
+			     size_t len, u64 *cycles, u64 *ns)
+{
+	ktime_t start;
+	cycles_t start_cycles;
+	unsigned int i;
+
+	start = ktime_get();
+	start_cycles = get_cycles();
+	for (i = 0; i < CRYPTO_TEST_ITERATIONS; i++)
+		op(ctx, len);
+	*cycles = get_cycles() - start_cycles;
+	*ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+}
+
+static int crypto_test_format(char *buf, size_t size, size_t len,
+			      u64 cycles, u64 ns)
+{
+	u64 fps, cpb;
+	u32 cpb_frac;
+
+	fps = div64_u64((u64)CRYPTO_TEST_ITERATIONS * NSEC_PER_SEC,
+			max_t(u64, ns, 1));
+	/* cycles per byte, in hundredths */
+	cpb = div64_u64(cycles * 100, (u64)CRYPTO_TEST_ITERATIONS * len);
+	cpb_frac = do_div(cpb, 100);
+
+	return scnprintf(buf, size, " %11llu %6llu.%02u",
+			 (unsigned long long)fps,
+			 (unsigned long long)cpb, cpb_frac);
+}
+
+static int crypto_test_bench(char *buf, size_t size)
+{
+	struct crypto_test_ctx ctx;
+	u64 cycles, ns;
+	int i, j, err, res;
+
+	err = crypto_test_alloc(&ctx);
+	if (err)
+		return err;
+
+	res = scnprintf(buf, size, "%d iterations\n"
+			"cipher  len   enc frame/s enc cyc/B"
+			"  dec frame/s dec cyc/B\n", CRYPTO_TEST_ITERATIONS);
+
+	for (i = 0; i < ARRAY_SIZE(crypto_test_ciphers); i++) {
+		const struct crypto_test_cipher *c = &crypto_test_ciphers[i];
+
+		for (j = 0; j < ARRAY_SIZE(crypto_test_lens); j++) {
+			size_t len = crypto_test_lens[j];
+
+			memset(&ctx.tkip, 0, sizeof(ctx.tkip));
+			ctx.iv16 = 0;
+			res += scnprintf(buf + res, size - res, "%-6s %5zu",
+					 c->name, len);
+
+			crypto_test_time(&ctx, c->encrypt, len, &cycles, &ns);
+			res += crypto_test_format(buf + res, size - res, len,
+						  cycles, ns);
+			crypto_test_time(&ctx, c->decrypt, len, &cycles, &ns);
+			res += crypto_test_format(buf + res, size - res, len,
+						  cycles, ns);
+			res += scnprintf(buf + res, size - res, "\n");
+
+			cond_resched();
+		}
+	}
+
+	crypto_test_free(&ctx);
+	return res;
+}
+
+struct crypto_test_debugfs_info {
+	size_t len;
+	char buf[];
+};
+
+static int crypto_test_open(struct inode *inode, struct file *file,
+			    int (*fn)(char *buf, size_t size))
+{
+	struct crypto_test_debugfs_info *info;
+	size_t size = 4096;
+	int res;
+
+	info = kmalloc(sizeof(*info) + size, GFP_KERNEL);
+	if (!info)
+		return -ENOMEM;
+
+	res = fn(info->buf, size);
+	if (res < 0) {
+		kfree(info);
+		return res;
+	}
+
+	info->len = res;
+	file->private_data = info;
+	return 0;
+}
+
+static int selftest_open(struct inode *inode, struct file *file)
+{
+	return crypto_test_open(inode, file, crypto_test_selftest);
+}
+
+static int bench_open(struct inode *inode, struct file *file)
+{
+	return crypto_test_open(inode, file, crypto_test_bench);
+}
+
+static ssize_t crypto_test_read(struct file *file, char __user *userbuf,
+				size_t count, loff_t *ppos)
+{
+	struct crypto_test_debugfs_info *info = file->private_data;
+
+	return simple_read_from_buffer(userbuf, count, ppos,
+				       info->buf, info->len);
+}
+
+static int crypto_test_release(struct inode *inode, struct file *file)
+{
+	kfree(file->private_data);
+	return 0;
+}
+
+static const struct file_operations selftest_ops = {
+	.owner = THIS_MODULE,
+	.open = selftest_open,
+	.read = crypto_test_read,
+	.release = crypto_test_release,
+	.llseek = default_llseek,
+};
+
+static const struct file_operations bench_ops = {
+	.owner = THIS_MODULE,
+	.open = bench_open,
+	.read = crypto_test_read,
+	.release = crypto_test_release,
+	.llseek = default_llseek,
+};
+
+void ieee80211_crypto_test_init(void)
+{
+	crypto_test_selftest(NULL, 0);
+
+	crypto_test_dir = debugfs_create_dir("mac80211_crypto", NULL);
+	if (!crypto_test_dir)
+		return;
+
+	debugfs_create_file("selftest", 0400, crypto_test_dir, NULL,
+			    &selftest_ops);
+	debugfs_create_file("bench", 0400, crypto_test_dir, NULL,
+			    &bench_ops);
+}
+
+void ieee80211_crypto_test_exit(void)
+{
+	debugfs_remove_recursive(crypto_test_dir);
+	crypto_test_dir = NULL;
+}
@@ -0,0 +1,16 @@
+#ifndef __MAC80211_CRYPTO_TEST_H
+#define __MAC80211_CRYPTO_TEST_H
+
+#ifdef CONFIG_MAC80211_CRYPTO_TEST
+void ieee80211_crypto_test_init(void);
+void ieee80211_crypto_test_exit(void);
+#else
+static inline void ieee80211_crypto_test_init(void)
+{
+}
+static inline void ieee80211_crypto_test_exit(void)
+{
+}
+#endif
+
+#endif /* __MAC80211_CRYPTO_TEST_H */
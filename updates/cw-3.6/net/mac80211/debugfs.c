@@ -204,9 +204,92 @@ static ssize_t queues_read(struct file *file, char __user *user_buf,
 	return simple_read_from_buffer(user_buf, count, ppos, buf, res);
 }
 
+#define STA_HASH_CHAIN_HIST 8
+
+static ssize_t sta_hash_read(struct file *file, char __user *user_buf,
+			     size_t count, loff_t *ppos)
+{
+	struct ieee80211_local *local = file->private_data;
+	struct sta_hash_table *tbl;
+	struct sta_info *sta;
+	unsigned int hist[STA_HASH_CHAIN_HIST + 1] = {};
+	unsigned int i, len, buckets, entries = 0, max_len = 0, load;
+	char buf[200 + 20 * (STA_HASH_CHAIN_HIST + 1)];
+	int res;
+
+	rcu_read_lock();
+	tbl = rcu_dereference(local->sta_hash);
+	buckets = tbl->mask + 1;
+	for (i = 0; i < buckets; i++) {
+		len = 0;
+		for (sta = rcu_dereference(tbl->buckets[i]); sta;
+		     sta = rcu_dereference(sta->hnext[tbl->link]))
+			len++;
+		entries += len;
+		max_len = max(max_len, len);
+		hist[min_t(unsigned int, len, STA_HASH_CHAIN_HIST)]++;
+	}
+	rcu_read_unlock();
+
+	load = entries * 100 / buckets;
+	res = scnprintf(buf, sizeof(buf),
+			"buckets: %u\nentries: %u\nload factor: %u.%02u\n"
+			"max chain: %u\ngrows: %u\nshrinks: %u\n",
+			buckets, entries, load / 100, load % 100, max_len,
+			local->sta_hash_grows, local->sta_hash_shrinks);
+	for (i = 0; i <= STA_HASH_CHAIN_HIST; i++)
+		res += scnprintf(buf + res, sizeof(buf) - res,
+				 "chain %u%s: %u\n", i,
+				 i == STA_HASH_CHAIN_HIST ? "+" : "", hist[i]);
+
+	return simple_read_from_buffer(user_buf, count, ppos, buf, res);
+}
+
+static ssize_t tx_batch_read(struct file *file, char __user *user_buf,
+			     size_t count, loff_t *ppos)
+{
+	struct ieee80211_local *local = file->private_data;
+	char buf[100 + 30 * IEEE80211_TX_BATCH_HIST];
+	unsigned int i;
+	int res;
+
+	res = scnprintf(buf, sizeof(buf),
+			"shared: %u\nsplit: %u\n",
+			local->tx_batch_shared, local->tx_batch_split);
+	for (i = 0; i < IEEE80211_TX_BATCH_HIST - 1; i++)
+		res += scnprintf(buf + res, sizeof(buf) - res,
+				 "batch <= %3u: %u\n", 1 << i,
+				 local->tx_batch_hist[i]);
+	res += scnprintf(buf + res, sizeof(buf) - res, "batch >  %3u: %u\n",
+			 1 << (i - 1), local->tx_batch_hist[i]);
+
+	return simple_read_from_buffer(user_buf, count, ppos, buf, res);
+}
+
+static ssize_t sta_stats_read(struct file *file, char __user *user_buf,
+			      size_t count, loff_t *ppos)
+{
+	struct ieee80211_local *local = file->private_data;
+	unsigned int folds = atomic_read(&local->sta_stats_folds);
+	u64 ns = atomic64_read(&local->sta_stats_fold_ns);
+	char buf[100];
+	int res;
+
+	res = scnprintf(buf, sizeof(buf),
+			"cpus: %u\nfolds: %u\nfold ns: %llu\n"
+			"ns per fold: %llu\n",
+			num_possible_cpus(), folds, (unsigned long long)ns,
+			(unsigned long long)(folds ? div_u64(ns, folds) : 0));
+
+	return simple_read_from_buffer(user_buf, count, ppos, buf, res);
+}
+
 DEBUGFS_READONLY_FILE_OPS(hwflags);
 DEBUGFS_READONLY_FILE_OPS(channel_type);
 DEBUGFS_READONLY_FILE_OPS(queues);
+DEBUGFS_READONLY_FILE_OPS(sta_hash);
+DEBUGFS_READONLY_FILE_OPS(tx_batch);
+DEBUGFS_READONLY_FILE_OPS(sta_stats);
 
 /* statistics stuff */
 
@@ -276,6 +359,9 @@ void debugfs_hw_add(struct ieee80211_local *local)
 	DEBUGFS_ADD(total_ps_buffered);
 	DEBUGFS_ADD(wep_iv);
 	DEBUGFS_ADD(queues);
+	DEBUGFS_ADD(sta_hash);
+	DEBUGFS_ADD(tx_batch);
+	DEBUGFS_ADD(sta_stats);
 	DEBUGFS_ADD_MODE(reset, 0200);
 	DEBUGFS_ADD(channel_type);
 	DEBUGFS_ADD(hwflags);
@@ -22,6 +22,7 @@
 #include "debugfs.h"
 #include "debugfs_netdev.h"
 #include "driver-ops.h"
+#include "mesh.h"
 
 static ssize_t ieee80211_if_read(
 	struct ieee80211_sub_if_data *sdata,
@@ -393,6 +394,90 @@ static ssize_t ieee80211_if_parse_uapsd_max_sp_len(
 }
 __IEEE80211_IF_FILE_W(uapsd_max_sp_len);
 
+IEEE80211_IF_FILE(codel_drops, codel_drops, DEC);
+IEEE80211_IF_FILE(codel_marks, codel_marks, DEC);
+IEEE80211_IF_FILE(crypto_tx_headroom, crypto_tx_headroom, DEC);
+IEEE80211_IF_FILE(crypto_tx_tailroom, crypto_tx_tailroom, DEC);
+IEEE80211_IF_FILE(tx_expand_head, tx_expand_head, DEC);
+IEEE80211_IF_FILE(tx_expand_tail, tx_expand_tail, DEC);
+IEEE80211_IF_FILE(tx_expand_cloned, tx_expand_cloned, DEC);
+
+static ssize_t ieee80211_if_fmt_codel_target(
+	const struct ieee80211_sub_if_data *sdata, char *buf, int buflen)
+{
+	return snprintf(buf, buflen, "%u\n", sdata->codel.target);
+}
+
+static ssize_t ieee80211_if_parse_codel_target(
+	struct ieee80211_sub_if_data *sdata, const char *buf, int buflen)
+{
+	u32 val;
+	int ret;
+
+	ret = kstrtou32(buf, 0, &val);
+	if (ret)
+		return ret;
+
+	if (!val || val > INT_MAX)
+		return -ERANGE;
+
+	sdata->codel.target = val;
+
+	return buflen;
+}
+__IEEE80211_IF_FILE_W(codel_target);
+
+static ssize_t ieee80211_if_fmt_codel_interval(
+	const struct ieee80211_sub_if_data *sdata, char *buf, int buflen)
+{
+	return snprintf(buf, buflen, "%u\n", sdata->codel.interval);
+}
+
+static ssize_t ieee80211_if_parse_codel_interval(
+	struct ieee80211_sub_if_data *sdata, const char *buf, int buflen)
+{
+	u32 val;
+	int ret;
+
+	ret = kstrtou32(buf, 0, &val);
+	if (ret)
+		return ret;
+
+	/* 16 intervals must fit in the signed time comparisons */
+	if (!val || val > INT_MAX / 16)
+		return -ERANGE;
+
+	sdata->codel.interval = val;
+
+	return buflen;
+}
+__IEEE80211_IF_FILE_W(codel_interval);
+
+static ssize_t ieee80211_if_fmt_codel_ecn(
+	const struct ieee80211_sub_if_data *sdata, char *buf, int buflen)
+{
+	return snprintf(buf, buflen, "%d\n", sdata->codel.ecn);
+}
+
+static ssize_t ieee80211_if_parse_codel_ecn(
+	struct ieee80211_sub_if_data *sdata, const char *buf, int buflen)
+{
+	u8 val;
+	int ret;
+
+	ret = kstrtou8(buf, 0, &val);
+	if (ret)
+		return ret;
+
+	if (val > 1)
+		return -ERANGE;
+
+	sdata->codel.ecn = val;
+
+	return buflen;
+}
+__IEEE80211_IF_FILE_W(codel_ecn);
+
 /* AP attributes */
 IEEE80211_IF_FILE(num_mcast_sta, u.ap.num_mcast_sta, ATOMIC);
 IEEE80211_IF_FILE(num_sta_ps, u.ap.num_sta_ps, ATOMIC);
@@ -473,6 +558,73 @@ IEEE80211_IF_FILE(dropped_frames_no_route,
 		  u.mesh.mshstats.dropped_frames_no_route, DEC);
 IEEE80211_IF_FILE(estab_plinks, u.mesh.mshstats.estab_plinks, ATOMIC);
 
+static ssize_t path_table_read(struct file *file, char __user *userbuf,
+			       size_t count, loff_t *ppos)
+{
+	struct ieee80211_sub_if_data *sdata = file->private_data;
+	int buflen = 2048, len;
+	ssize_t ret;
+	char *buf;
+
+	buf = kmalloc(buflen, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	len = mesh_pathtbl_stats_format(sdata, buf, buflen);
+	ret = simple_read_from_buffer(userbuf, count, ppos, buf, len);
+	kfree(buf);
+
+	return ret;
+}
+
+static const struct file_operations path_table_ops = {
+	.read = path_table_read,
+	.open = simple_open,
+	.llseek = generic_file_llseek,
+};
+
+static ssize_t hwmp_read(struct file *file, char __user *userbuf,
+			 size_t count, loff_t *ppos)
+{
+	struct ieee80211_sub_if_data *sdata = file->private_data;
+	int buflen = 1024, len;
+	ssize_t ret;
+	char *buf;
+
+	buf = kmalloc(buflen, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	len = mesh_hwmp_stats_format(sdata, buf, buflen);
+	ret = simple_read_from_buffer(userbuf, count, ppos, buf, len);
+	kfree(buf);
+
+	return ret;
+}
+
+static const struct file_operations hwmp_ops = {
+	.read = hwmp_read,
+	.open = simple_open,
+	.llseek = generic_file_llseek,
+};
+
+static ssize_t rmc_read(struct file *file, char __user *userbuf,
+			size_t count, loff_t *ppos)
+{
+	struct ieee80211_sub_if_data *sdata = file->private_data;
+	char buf[128];
+	int len;
+
+	len = mesh_rmc_stats_format(sdata, buf, sizeof(buf));
+	return simple_read_from_buffer(userbuf, count, ppos, buf, len);
+}
+
+static const struct file_operations rmc_ops = {
+	.read = rmc_read,
+	.open = simple_open,
+	.llseek = generic_file_llseek,
+};
+
 /* Mesh parameters */
 IEEE80211_IF_FILE(dot11MeshMaxRetries,
 		  u.mesh.mshcfg.dot11MeshMaxRetries, DEC);
@@ -531,6 +683,16 @@ static void add_common_files(struct ieee80211_sub_if_data *sdata)
 	DEBUGFS_ADD(rc_rateidx_mask_5ghz);
 	DEBUGFS_ADD(rc_rateidx_mcs_mask_2ghz);
 	DEBUGFS_ADD(rc_rateidx_mcs_mask_5ghz);
+	DEBUGFS_ADD_MODE(codel_target, 0600);
+	DEBUGFS_ADD_MODE(codel_interval, 0600);
+	DEBUGFS_ADD_MODE(codel_ecn, 0600);
+	DEBUGFS_ADD(codel_drops);
+	DEBUGFS_ADD(codel_marks);
+	DEBUGFS_ADD(crypto_tx_headroom);
+	DEBUGFS_ADD(crypto_tx_tailroom);
+	DEBUGFS_ADD(tx_expand_head);
+	DEBUGFS_ADD(tx_expand_tail);
+	DEBUGFS_ADD(tx_expand_cloned);
 }
 
 static void add_sta_files(struct ieee80211_sub_if_data *sdata)
@@ -585,6 +747,9 @@ static void add_mesh_stats(struct ieee80211_sub_if_data *sdata)
 	MESHSTATS_ADD(dropped_frames_no_route);
 	MESHSTATS_ADD(dropped_frames_congestion);
 	MESHSTATS_ADD(estab_plinks);
+	MESHSTATS_ADD(path_table);
+	MESHSTATS_ADD(rmc);
+	MESHSTATS_ADD(hwmp);
 #undef MESHSTATS_ADD
 }
 
@@ -53,6 +53,32 @@ STA_FILE(aid, sta.aid, D);
 STA_FILE(dev, sdata->name, S);
 STA_FILE(last_signal, last_signal, D);
 
+#define STA_STATS_FILE(name, field)					\
+static ssize_t sta_ ##name## _read(struct file *file,			\
+				   char __user *userbuf,		\
+				   size_t count, loff_t *ppos)		\
+{									\
+	struct sta_info *sta = file->private_data;			\
+	struct sta_pcpu_stats stats;					\
+									\
+	sta_get_stats(sta, &stats);					\
+	return mac80211_format_buffer(userbuf, count, ppos, "%llu\n",	\
+				(unsigned long long)stats.field);	\
+}									\
+STA_OPS(name)
+
+STA_STATS_FILE(rx_packets, rx_packets);
+STA_STATS_FILE(tx_packets, tx_packets);
+STA_STATS_FILE(rx_bytes, rx_bytes);
+STA_STATS_FILE(tx_bytes, tx_bytes);
+STA_STATS_FILE(rx_duplicates, num_duplicates);
+STA_STATS_FILE(rx_fragments, rx_fragments);
+STA_STATS_FILE(rx_dropped, rx_dropped);
+STA_STATS_FILE(tx_fragments, tx_fragments);
+STA_STATS_FILE(tx_filtered, tx_filtered_count);
+STA_STATS_FILE(tx_retry_failed, tx_retry_failed);
+STA_STATS_FILE(tx_retry_count, tx_retry_count);
+
 static ssize_t sta_flags_read(struct file *file, char __user *userbuf,
 			      size_t count, loff_t *ppos)
 {
@@ -238,6 +264,98 @@ static ssize_t sta_agg_status_write(struct file *file, const char __user *userbu
 }
 STA_OPS_RW(agg_status);
 
+static ssize_t sta_agg_reorder_read(struct file *file, char __user *userbuf,
+				    size_t count, loff_t *ppos)
+{
+	int bufsz = 80 + STA_TID_NUM * (60 + IEEE80211_REORDER_DEPTH_HIST * 11);
+	char *buf, *p;
+	int i, j;
+	ssize_t rv;
+	struct sta_info *sta = file->private_data;
+	struct tid_ampdu_rx *tid_rx;
+
+	buf = kmalloc(bufsz, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+	p = buf;
+
+	p += scnprintf(p, bufsz + buf - p,
+		       "TID\tstored\tmax\tbuffered\treleased\ttimeout\tbatches\t"
+		       "depth histogram\n");
+
+	rcu_read_lock();
+	for (i = 0; i < STA_TID_NUM; i++) {
+		tid_rx = rcu_dereference(sta->ampdu_mlme.tid_rx[i]);
+		if (!tid_rx)
+			continue;
+
+		spin_lock_bh(&tid_rx->reorder_lock);
+		p += scnprintf(p, bufsz + buf - p,
+			       "%02d\t%u\t%u\t%u\t\t%u\t\t%u\t%u\t",
+			       i, tid_rx->stored_mpdu_num,
+			       tid_rx->stats.max_depth, tid_rx->stats.buffered,
+			       tid_rx->stats.released,
+			       tid_rx->stats.released_timeout,
+			       tid_rx->stats.batches);
+		for (j = 0; j < IEEE80211_REORDER_DEPTH_HIST; j++)
+			p += scnprintf(p, bufsz + buf - p, " %u",
+				       tid_rx->stats.depth_hist[j]);
+		spin_unlock_bh(&tid_rx->reorder_lock);
+		p += scnprintf(p, bufsz + buf - p, "\n");
+	}
+	rcu_read_unlock();
+
+	rv = simple_read_from_buffer(userbuf, count, ppos, buf, p - buf);
+	kfree(buf);
+	return rv;
+}
+STA_OPS(agg_reorder);
+
+static ssize_t sta_txqs_read(struct file *file, char __user *userbuf,
+			     size_t count, loff_t *ppos)
+{
+	int bufsz = 140 + STA_TID_NUM * 130;
+	char *buf, *p;
+	int i;
+	ssize_t rv;
+	struct sta_info *sta = file->private_data;
+	struct ieee80211_local *local = sta->local;
+	struct txq_info *txqi;
+
+	buf = kmalloc(bufsz, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+	p = buf;
+
+	p += scnprintf(p, bufsz + buf - p,
+		       "TID\tqueue\tframes\tbytes\tdeficit\tenqueued\t"
+		       "dequeued\tdrops\tcodel drops\tcodel marks\t"
+		       "avg sojourn\tmax sojourn (usec)\n");
+
+	spin_lock_bh(&local->txq_lock);
+	for (i = 0; i < STA_TID_NUM; i++) {
+		txqi = &sta->txq[i];
+		if (!txqi->enqueued && !txqi->drops)
+			continue;
+
+		p += scnprintf(p, bufsz + buf - p,
+			       "%02d\t%u\t%u\t%u\t%d\t%lu\t\t%lu\t\t%lu\t%u\t\t%u\t\t"
+			       "%lu\t\t%u\n",
+			       i, txqi->hw_queue, skb_queue_len(&txqi->queue),
+			       txqi->backlog_bytes, txqi->deficit,
+			       txqi->enqueued, txqi->dequeued, txqi->drops,
+			       txqi->codel_drops, txqi->codel_marks,
+			       ewma_read(&txqi->avg_sojourn),
+			       txqi->max_sojourn);
+	}
+	spin_unlock_bh(&local->txq_lock);
+
+	rv = simple_read_from_buffer(userbuf, count, ppos, buf, p - buf);
+	kfree(buf);
+	return rv;
+}
+STA_OPS(txqs);
+
 static ssize_t sta_ht_capa_read(struct file *file, char __user *userbuf,
 				size_t count, loff_t *ppos)
 {
@@ -363,21 +481,23 @@ void ieee80211_sta_debugfs_add(struct sta_info *sta)
 	DEBUGFS_ADD(connected_time);
 	DEBUGFS_ADD(last_seq_ctrl);
 	DEBUGFS_ADD(agg_status);
+	DEBUGFS_ADD(agg_reorder);
+	DEBUGFS_ADD(txqs);
 	DEBUGFS_ADD(dev);
 	DEBUGFS_ADD(last_signal);
 	DEBUGFS_ADD(ht_capa);
 
-	DEBUGFS_ADD_COUNTER(rx_packets, rx_packets);
-	DEBUGFS_ADD_COUNTER(tx_packets, tx_packets);
-	DEBUGFS_ADD_COUNTER(rx_bytes, rx_bytes);
-	DEBUGFS_ADD_COUNTER(tx_bytes, tx_bytes);
-	DEBUGFS_ADD_COUNTER(rx_duplicates, num_duplicates);
-	DEBUGFS_ADD_COUNTER(rx_fragments, rx_fragments);
-	DEBUGFS_ADD_COUNTER(rx_dropped, rx_dropped);
-	DEBUGFS_ADD_COUNTER(tx_fragments, tx_fragments);
-	DEBUGFS_ADD_COUNTER(tx_filtered, tx_filtered_count);
-	DEBUGFS_ADD_COUNTER(tx_retry_failed, tx_retry_failed);
-	DEBUGFS_ADD_COUNTER(tx_retry_count, tx_retry_count);
+	DEBUGFS_ADD(rx_packets);
+	DEBUGFS_ADD(tx_packets);
+	DEBUGFS_ADD(rx_bytes);
+	DEBUGFS_ADD(tx_bytes);
+	DEBUGFS_ADD(rx_duplicates);
+	DEBUGFS_ADD(rx_fragments);
+	DEBUGFS_ADD(rx_dropped);
+	DEBUGFS_ADD(tx_fragments);
+	DEBUGFS_ADD(tx_filtered);
+	DEBUGFS_ADD(tx_retry_failed);
+	DEBUGFS_ADD(tx_retry_count);
 	DEBUGFS_ADD_COUNTER(wep_weak_iv_count, wep_weak_iv_count);
 }
 
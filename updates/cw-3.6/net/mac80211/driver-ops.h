@@ -880,4 +880,11 @@ static inline void drv_mgd_prepare_tx(struct ieee80211_local *local,
 		local->ops->mgd_prepare_tx(&local->hw, &sdata->vif);
 	trace_drv_return_void(local);
 }
+
+static inline void drv_wake_tx_queue(struct ieee80211_local *local, int queue)
+{
+	trace_drv_wake_tx_queue(local, queue);
+	local->ops->wake_tx_queue(&local->hw, queue);
+	trace_drv_return_void(local);
+}
 #endif /* __MAC80211_DRIVER_OPS */
@@ -47,6 +47,13 @@ struct ieee80211_local;
 #define IEEE80211_ENCRYPT_HEADROOM 8
 #define IEEE80211_ENCRYPT_TAILROOM 18
 
+/*
+ * Netdev features of the data interfaces that mac80211 implements itself,
+ * GSO frames are segmented in ieee80211_subif_start_xmit().
+ */
+#define IEEE80211_SW_NETDEV_FEATURES	(NETIF_F_SG | NETIF_F_TSO | \
+					 NETIF_F_TSO_ECN | NETIF_F_TSO6)
+
 /* IEEE 802.11 (Ch. 9.5 Defragmentation) requires support for concurrent
  * reception of at least three fragmented frames. This limit can be increased
  * by changing this define, at the cost of slower frame reassembly and
@@ -185,6 +192,9 @@ typedef unsigned __bitwise__ ieee80211_tx_result;
 #define IEEE80211_TX_UNICAST		BIT(1)
 #define IEEE80211_TX_PS_BUFFERED	BIT(2)
 
+/* number of buckets in the TX batch size histogram */
+#define IEEE80211_TX_BATCH_HIST	8
+
 struct ieee80211_tx_data {
 	struct sk_buff *skb;
 	struct sk_buff_head skbs;
@@ -246,6 +256,8 @@ struct ieee80211_rx_data {
 	struct ieee80211_sub_if_data *sdata;
 	struct sta_info *sta;
 	struct ieee80211_key *key;
+	/* set when data frames can be delivered through GRO on this NAPI */
+	struct napi_struct *napi;
 
 	unsigned int flags;
 
@@ -303,6 +315,16 @@ struct ieee80211_if_vlan {
 	struct sta_info __rcu *sta;
 };
 
+/* PREQ queue classes, served in this order */
+enum mesh_preq_prio {
+	MESH_PREQ_PRIO_HIGH,	/* discovery retries, gates and roots */
+	MESH_PREQ_PRIO_NORMAL,	/* new path discoveries */
+	MESH_PREQ_PRIO_LOW,	/* refreshes of paths still in use */
+
+	/* keep last */
+	NUM_MESH_PREQ_PRIO
+};
+
 struct mesh_stats {
 	__u32 fwded_mcast;		/* Mesh forwarded multicast frames */
 	__u32 fwded_unicast;		/* Mesh forwarded unicast frames */
@@ -313,6 +335,42 @@ struct mesh_stats {
 	atomic_t estab_plinks;
 };
 
+/* Discovery latency histogram, in log2 ms buckets */
+#define MESH_DISC_HIST_BUCKETS	10
+#define MESH_DISC_HIST_SHIFT	3
+
+/**
+ * struct mesh_hwmp_stats - HWMP path discovery statistics
+ *
+ * Protected by the mesh PREQ queue lock.
+ *
+ * @preq_queued: PREQs queued, per &enum mesh_preq_prio
+ * @preq_queue_full: PREQs dropped because the queue was full
+ * @preq_queue_max: highest PREQ queue depth seen
+ * @preq_frames: PREQ frames originated from the queue
+ * @preq_targets: targets carried by those frames
+ * @disc_started: path discoveries started
+ * @disc_resolved: path discoveries that resolved the path
+ * @disc_failed: path discoveries given up after the last retry
+ * @disc_latency_sum: sum of the latencies of resolved discoveries, in ms
+ * @disc_latency_max: highest latency of a resolved discovery, in ms
+ * @disc_latency_hist: latency histogram, bucket 0 counts discoveries below
+ *	2^(MESH_DISC_HIST_SHIFT + 1) ms and every following bucket doubles that
+ */
+struct mesh_hwmp_stats {
+	u32 preq_queued[NUM_MESH_PREQ_PRIO];
+	u32 preq_queue_full;
+	u32 preq_queue_max;
+	u32 preq_frames;
+	u32 preq_targets;
+	u32 disc_started;
+	u32 disc_resolved;
+	u32 disc_failed;
+	u64 disc_latency_sum;
+	u32 disc_latency_max;
+	u32 disc_latency_hist[MESH_DISC_HIST_BUCKETS];
+};
+
 #define PREQ_Q_F_START		0x1
 #define PREQ_Q_F_REFRESH	0x2
 struct mesh_preq_queue {
@@ -587,13 +645,23 @@ struct ieee80211_if_mesh {
 	unsigned long last_preq;
 	struct mesh_rmc *rmc;
 	spinlock_t mesh_preq_queue_lock;
-	struct mesh_preq_queue preq_queue;
+	struct list_head preq_queue[NUM_MESH_PREQ_PRIO];
 	int preq_queue_len;
+	struct mesh_hwmp_stats hwmp_stats;
 	struct mesh_stats mshstats;
 	struct mesh_config mshcfg;
 	u32 mesh_seqnum;
 	bool accepting_plinks;
 	int num_gates;
+	struct hlist_head known_gates;
+	spinlock_t gates_lock;
+	/* Mesh path and mesh portal tables, see mesh_pathtbl.c */
+	struct mesh_table __rcu *mesh_paths;
+	struct mesh_table __rcu *mpp_paths;
+	int mesh_paths_generation;
+#ifdef CONFIG_MAC80211_DEBUGFS
+	struct mesh_tbl_stats __percpu *tbl_stats;
+#endif
 	const u8 *ie;
 	u8 ie_len;
 	enum {
@@ -660,6 +728,10 @@ struct ieee80211_sub_if_data {
 
 	/* count for keys needing tailroom space allocation */
 	int crypto_tx_tailroom_needed_cnt;
+	/* room the TX path leaves for the keys, see key.c */
+	u8 crypto_tx_headroom, crypto_tx_tailroom;
+	/* frames the TX path had to reallocate for head- or tailroom */
+	u32 tx_expand_head, tx_expand_tail, tx_expand_cloned;
 
 	struct net_device *dev;
 	struct ieee80211_local *local;
@@ -712,6 +784,10 @@ struct ieee80211_sub_if_data {
 	u32 rc_rateidx_mask[IEEE80211_NUM_BANDS];
 	u8  rc_rateidx_mcs_mask[IEEE80211_NUM_BANDS][IEEE80211_HT_MCS_MASK_LEN];
 
+	/* AQM of the intermediate TX queues of this interface's stations */
+	struct ieee80211_codel_params codel;
+	u32 codel_drops, codel_marks;
+
 	union {
 		struct ieee80211_if_ap ap;
 		struct ieee80211_if_wds wds;
@@ -929,13 +1005,37 @@ struct ieee80211_local {
 	spinlock_t tim_lock;
 	unsigned long num_sta;
 	struct list_head sta_list;
-	struct sta_info __rcu *sta_hash[STA_HASH_SIZE];
+	struct sta_hash_table __rcu *sta_hash;
+	unsigned int sta_hash_grows, sta_hash_shrinks;
+	/*
+	 * sta_get_stats() calls and time spent summing up per-CPU counters,
+	 * atomic as nl80211, ethtool and debugfs may fold concurrently
+	 */
+	atomic_t sta_stats_folds;
+	atomic64_t sta_stats_fold_ns;
 	struct timer_list sta_cleanup;
 	int sta_generation;
 
 	struct sk_buff_head pending[IEEE80211_MAX_QUEUES];
 	struct tasklet_struct tx_pending_tasklet;
 
+	/*
+	 * Per-station intermediate TX queues with frames, per hardware
+	 * queue, in DRR order; see struct txq_info.
+	 */
+	spinlock_t txq_lock;
+	struct list_head active_txqs[IEEE80211_MAX_QUEUES];
+	unsigned int txq_backlog[IEEE80211_MAX_QUEUES];
+	unsigned long txq_pushing;
+
+	/*
+	 * Batched transmission, see ieee80211_xmit_list(): bucket i > 0
+	 * of the histogram counts batches of 2^(i-1) + 1 to 2^i frames,
+	 * the last one all larger batches.
+	 */
+	unsigned int tx_batch_hist[IEEE80211_TX_BATCH_HIST];
+	unsigned int tx_batch_shared, tx_batch_split;
+
 	atomic_t agg_queue_stop[IEEE80211_MAX_QUEUES];
 
 	/* number of interfaces with corresponding IFF_ flags */
@@ -1293,6 +1393,7 @@ int ieee80211_if_change_type(struct ieee80211_sub_if_data *sdata,
 			     enum nl80211_iftype type);
 void ieee80211_if_remove(struct ieee80211_sub_if_data *sdata);
 void ieee80211_remove_interfaces(struct ieee80211_local *local);
+void ieee80211_update_netdev_room(struct ieee80211_sub_if_data *sdata);
 void ieee80211_recalc_idle(struct ieee80211_local *local);
 void ieee80211_adjust_monitor_flags(struct ieee80211_sub_if_data *sdata,
 				    const int offset);
@@ -1305,6 +1406,21 @@ static inline bool ieee80211_sdata_running(struct ieee80211_sub_if_data *sdata)
 /* tx handling */
 void ieee80211_clear_tx_pending(struct ieee80211_local *local);
 void ieee80211_tx_pending(unsigned long data);
+void ieee80211_crypto_tx_room(struct ieee80211_sub_if_data *sdata,
+			      int *headroom, int *tailroom);
+void ieee80211_txq_init(struct sta_info *sta);
+void ieee80211_txq_purge(struct ieee80211_local *local, struct sta_info *sta);
+void ieee80211_txq_ps_buffer(struct ieee80211_local *local,
+			     struct sta_info *sta);
+void ieee80211_txq_agg_stop(struct ieee80211_local *local,
+			    struct sta_info *sta, int tid);
+
+/* queued frames that mac80211 has to pass to the driver itself */
+static inline bool ieee80211_txq_needs_push(struct ieee80211_local *local,
+					    int queue)
+{
+	return !local->ops->wake_tx_queue && local->txq_backlog[queue];
+}
 netdev_tx_t ieee80211_monitor_start_xmit(struct sk_buff *skb,
 					 struct net_device *dev);
 netdev_tx_t ieee80211_subif_start_xmit(struct sk_buff *skb,
@@ -1402,6 +1518,8 @@ void mac80211_ev_michael_mic_failure(struct ieee80211_sub_if_data *sdata, int ke
 void ieee80211_set_wmm_default(struct ieee80211_sub_if_data *sdata,
 			       bool bss_notify);
 void ieee80211_xmit(struct ieee80211_sub_if_data *sdata, struct sk_buff *skb);
+void ieee80211_xmit_list(struct ieee80211_sub_if_data *sdata,
+			 struct sk_buff_head *skbs);
 
 void ieee80211_tx_skb_tid(struct ieee80211_sub_if_data *sdata,
 			  struct sk_buff *skb, int tid);
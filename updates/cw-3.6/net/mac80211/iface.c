@@ -426,7 +426,11 @@ static int ieee80211_do_open(struct net_device *dev, bool coming_up)
 		if (!sdata->bss)
 			return -ENOLINK;
 
+		mutex_lock(&local->key_mtx);
 		list_add(&sdata->u.vlan.list, &sdata->bss->vlans);
+		mutex_unlock(&local->key_mtx);
+		/* the AP's keys may be used on the VLAN as well */
+		ieee80211_update_netdev_room(sdata);
 
 		master = container_of(sdata->bss,
 				      struct ieee80211_sub_if_data, u.ap);
@@ -611,8 +615,11 @@ static int ieee80211_do_open(struct net_device *dev, bool coming_up)
 		drv_stop(local);
  err_del_bss:
 	sdata->bss = NULL;
-	if (sdata->vif.type == NL80211_IFTYPE_AP_VLAN)
+	if (sdata->vif.type == NL80211_IFTYPE_AP_VLAN) {
+		mutex_lock(&local->key_mtx);
 		list_del(&sdata->u.vlan.list);
+		mutex_unlock(&local->key_mtx);
+	}
 	/* might already be clear but that doesn't matter */
 	clear_bit(SDATA_STATE_RUNNING, &sdata->state);
 	return res;
@@ -745,7 +752,9 @@ static void ieee80211_do_stop(struct ieee80211_sub_if_data *sdata,
 
 	switch (sdata->vif.type) {
 	case NL80211_IFTYPE_AP_VLAN:
+		mutex_lock(&local->key_mtx);
 		list_del(&sdata->u.vlan.list);
+		mutex_unlock(&local->key_mtx);
 		/* no need to tell driver */
 		break;
 	case NL80211_IFTYPE_MONITOR:
@@ -908,6 +917,10 @@ static void ieee80211_teardown_sdata(struct net_device *dev)
 
 	flushed = sta_info_flush(local, sdata);
 	WARN_ON(flushed);
+
+	/* stations are gone, nothing can reference the paths anymore */
+	if (ieee80211_vif_is_mesh(&sdata->vif))
+		mesh_pathtbl_unregister(sdata);
 }
 
 static u16 ieee80211_netdev_select_queue(struct net_device *dev,
@@ -1102,6 +1115,56 @@ static void ieee80211_iface_work(struct work_struct *work)
 }
 
 
+/*
+ * Set the head- and tailroom the stack should leave in frames for this
+ * interface, so that ieee80211_subif_start_xmit() and the TX handlers
+ * can add the 802.11, mesh and LLC headers, and whatever the keys need,
+ * without reallocating the frame: the worst case for the interface type
+ * and the current keys. An AP passes its key room on to its VLANs; the
+ * VLAN list only changes under both the RTNL and the key mutex, so
+ * either protects the walk.
+ */
+void ieee80211_update_netdev_room(struct ieee80211_sub_if_data *sdata)
+{
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,26))
+	struct ieee80211_local *local = sdata->local;
+	struct ieee80211_sub_if_data *vlan;
+	int hdrlen, crypto_head, crypto_tail;
+
+	switch (sdata->vif.type) {
+	case NL80211_IFTYPE_AP_VLAN:
+	case NL80211_IFTYPE_WDS:
+		hdrlen = 30;
+		break;
+	case NL80211_IFTYPE_STATION:
+		hdrlen = sdata->u.mgd.use_4addr ? 30 : 24;
+		break;
+	case NL80211_IFTYPE_MESH_POINT:
+		/* four addresses, mesh header with two extra addresses */
+		hdrlen = 30 + 6 + 2 * ETH_ALEN;
+		break;
+	default:
+		hdrlen = 24;
+		break;
+	}
+
+	if (local->hw.queues >= IEEE80211_NUM_ACS)
+		hdrlen += 2; /* QoS control */
+
+	ieee80211_crypto_tx_room(sdata, &crypto_head, &crypto_tail);
+
+	sdata->dev->needed_headroom = local->tx_headroom + hdrlen
+				      + 8 /* rfc1042/bridge tunnel */
+				      - ETH_HLEN /* ethernet hard_header_len */
+				      + crypto_head;
+	sdata->dev->needed_tailroom = crypto_tail;
+
+	if (sdata->vif.type == NL80211_IFTYPE_AP)
+		list_for_each_entry(vlan, &sdata->u.ap.vlans, u.vlan.list)
+			ieee80211_update_netdev_room(vlan);
+#endif
+}
+
 /*
  * Helper function to initialise an interface to a specific type.
  */
@@ -1168,6 +1231,7 @@ static void ieee80211_setup_sdata(struct ieee80211_sub_if_data *sdata,
 		break;
 	}
 
+	ieee80211_update_netdev_room(sdata);
 	ieee80211_debugfs_add_netdev(sdata);
 }
 
@@ -1261,9 +1325,31 @@ static int ieee80211_runtime_change_iftype(struct ieee80211_sub_if_data *sdata,
 	return ret;
 }
 
+/*
+ * Injected frames are passed on as they are, only the data interfaces
+ * segment GSO frames. TSO needs checksum offload, which is then done in
+ * software if the HW can't.
+ */
+static void ieee80211_set_netdev_features(struct ieee80211_sub_if_data *sdata,
+					  enum nl80211_iftype type)
+{
+	struct ieee80211_local *local = sdata->local;
+	struct net_device *dev = sdata->dev;
+
+	dev->features &= ~(IEEE80211_SW_NETDEV_FEATURES | NETIF_F_HW_CSUM);
+	dev->features |= local->hw.netdev_features;
+
+	if (type != NL80211_IFTYPE_MONITOR) {
+		dev->features |= IEEE80211_SW_NETDEV_FEATURES;
+		if (!(local->hw.netdev_features & NETIF_F_ALL_CSUM))
+			dev->features |= NETIF_F_HW_CSUM;
+	}
+}
+
 int ieee80211_if_change_type(struct ieee80211_sub_if_data *sdata,
 			     enum nl80211_iftype type)
 {
+	netdev_features_t features = sdata->dev->features;
 	int ret;
 
 	ASSERT_RTNL();
@@ -1294,6 +1380,10 @@ int ieee80211_if_change_type(struct ieee80211_sub_if_data *sdata,
 	if (type == NL80211_IFTYPE_STATION)
 		sdata->u.mgd.use_4addr = false;
 
+	ieee80211_set_netdev_features(sdata, type);
+	if (sdata->dev->features != features)
+		netdev_features_change(sdata->dev);
+
 	return 0;
 }
 
@@ -1429,17 +1519,6 @@ int ieee80211_if_add(struct ieee80211_local *local, const char *name,
 		return -ENOMEM;
 	dev_net_set(ndev, wiphy_net(local->hw.wiphy));
 
-#if (LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,26))
-	ndev->needed_headroom = local->tx_headroom +
-				4*6 /* four MAC addresses */
-				+ 2 + 2 + 2 + 2 /* ctl, dur, seq, qos */
-				+ 6 /* mesh */
-				+ 8 /* rfc1042/bridge tunnel */
-				- ETH_HLEN /* ethernet hard_header_len */
-				+ IEEE80211_ENCRYPT_HEADROOM;
-	ndev->needed_tailroom = IEEE80211_ENCRYPT_TAILROOM;
-#endif
-
 	ret = dev_alloc_name(ndev, ndev->name);
 	if (ret < 0)
 		goto fail;
@@ -1481,6 +1560,10 @@ int ieee80211_if_add(struct ieee80211_local *local, const char *name,
 			       sizeof(sdata->rc_rateidx_mcs_mask[i]));
 	}
 
+	sdata->codel.target = IEEE80211_CODEL_TARGET;
+	sdata->codel.interval = IEEE80211_CODEL_INTERVAL;
+	sdata->codel.ecn = true;
+
 	ieee80211_set_default_queues(sdata);
 
 	/* setup type-dependent data */
@@ -1490,9 +1573,10 @@ int ieee80211_if_add(struct ieee80211_local *local, const char *name,
 		ndev->ieee80211_ptr->use_4addr = params->use_4addr;
 		if (type == NL80211_IFTYPE_STATION)
 			sdata->u.mgd.use_4addr = params->use_4addr;
+		ieee80211_update_netdev_room(sdata);
 	}
 
-	ndev->features |= local->hw.netdev_features;
+	ieee80211_set_netdev_features(sdata, type);
 
 	ret = register_netdevice(ndev);
 	if (ret)
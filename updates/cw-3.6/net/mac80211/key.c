@@ -23,6 +23,7 @@
 #include "debugfs_key.h"
 #include "aes_ccm.h"
 #include "aes_cmac.h"
+#include "michael.h"
 
 #if (LINUX_VERSION_CODE < KERNEL_VERSION(2,6,29))
 #include <asm/unaligned.h>
@@ -58,8 +59,84 @@ static void assert_key_lock(struct ieee80211_local *local)
 	lockdep_assert_held(&local->key_mtx);
 }
 
-static void increment_tailroom_need_count(struct ieee80211_sub_if_data *sdata)
+/*
+ * Head- and tailroom the TX path has to leave for @key if it's handled
+ * in software (@sw), or otherwise for what the hardware wants mac80211
+ * to do: IV, ICV and the TKIP Michael MIC.
+ */
+static void ieee80211_key_tx_room(struct ieee80211_key *key, bool sw,
+				  int *headroom, int *tailroom)
+{
+	u32 flags = key->conf.flags;
+
+	*headroom = 0;
+	*tailroom = 0;
+
+	if (sw || flags & (IEEE80211_KEY_FLAG_GENERATE_IV |
+			   IEEE80211_KEY_FLAG_PUT_IV_SPACE))
+		*headroom = key->conf.iv_len;
+	/* ieee80211_wep_add_iv() insists on ICV room whenever it adds the IV */
+	if (sw || (flags & IEEE80211_KEY_FLAG_GENERATE_IV &&
+		   (key->conf.cipher == WLAN_CIPHER_SUITE_WEP40 ||
+		    key->conf.cipher == WLAN_CIPHER_SUITE_WEP104)))
+		*tailroom = key->conf.icv_len;
+	if (key->conf.cipher == WLAN_CIPHER_SUITE_TKIP &&
+	    (sw || flags & IEEE80211_KEY_FLAG_GENERATE_MMIC))
+		*tailroom += MICHAEL_MIC_LEN;
+}
+
+/*
+ * Recalculate the crypto head- and tailroom of @sdata from its keys, called
+ * after a key no longer needs (as much) room.
+ */
+static void
+ieee80211_update_crypto_tx_room(struct ieee80211_sub_if_data *sdata)
 {
+	struct ieee80211_key *key;
+	int headroom = 0, tailroom = 0, head, tail;
+
+	assert_key_lock(sdata->local);
+
+	list_for_each_entry(key, &sdata->key_list, list) {
+		ieee80211_key_tx_room(key,
+			!(key->flags & KEY_FLAG_UPLOADED_TO_HARDWARE),
+			&head, &tail);
+		headroom = max(headroom, head);
+		tailroom = max(tailroom, tail);
+	}
+
+	sdata->crypto_tx_headroom = headroom;
+	sdata->crypto_tx_tailroom = tailroom;
+	ieee80211_update_netdev_room(sdata);
+}
+
+/*
+ * Make room for @key being handled in software, returns true if that's more
+ * than before.
+ */
+static bool ieee80211_grow_crypto_tx_room(struct ieee80211_sub_if_data *sdata,
+					  struct ieee80211_key *key)
+{
+	int headroom, tailroom;
+
+	ieee80211_key_tx_room(key, true, &headroom, &tailroom);
+	if (headroom <= sdata->crypto_tx_headroom &&
+	    tailroom <= sdata->crypto_tx_tailroom)
+		return false;
+
+	sdata->crypto_tx_headroom = max_t(int, headroom,
+					  sdata->crypto_tx_headroom);
+	sdata->crypto_tx_tailroom = max_t(int, tailroom,
+					  sdata->crypto_tx_tailroom);
+	ieee80211_update_netdev_room(sdata);
+	return true;
+}
+
+static void increment_tailroom_need_count(struct ieee80211_sub_if_data *sdata,
+					  struct ieee80211_key *key)
+{
+	bool grown;
+
 	/*
 	 * When this count is zero, SKB resizing for allocating tailroom
 	 * for IV or MMIC is skipped. But, this check has created two race
@@ -77,12 +154,18 @@ static void increment_tailroom_need_count(struct ieee80211_sub_if_data *sdata)
 	 *
 	 * Solution has been explained at
 	 * http://mid.gmane.org/1308590980.4322.19.camel@jlt3.sipsolutions.net
+	 *
+	 * The same applies when the key needs more room than the keys
+	 * before it.
 	 */
 
-	if (!sdata->crypto_tx_tailroom_needed_cnt++) {
+	grown = ieee80211_grow_crypto_tx_room(sdata, key);
+
+	if (!sdata->crypto_tx_tailroom_needed_cnt++ || grown) {
 		/*
 		 * Flush all XMIT packets currently using HW encryption or no
-		 * encryption at all if the count transition is from 0 -> 1.
+		 * encryption at all if the count transition is from 0 -> 1,
+		 * or that were allocated with less room.
 		 */
 		synchronize_net();
 	}
@@ -134,6 +217,7 @@ static int ieee80211_key_enable_hw_accel(struct ieee80211_key *key)
 		      (key->conf.flags & IEEE80211_KEY_FLAG_GENERATE_IV) ||
 		      (key->conf.flags & IEEE80211_KEY_FLAG_PUT_IV_SPACE)))
 			sdata->crypto_tx_tailroom_needed_cnt--;
+		ieee80211_update_crypto_tx_room(sdata);
 
 		WARN_ON((key->conf.flags & IEEE80211_KEY_FLAG_PUT_IV_SPACE) &&
 			(key->conf.flags & IEEE80211_KEY_FLAG_GENERATE_IV));
@@ -183,7 +267,9 @@ static void ieee80211_key_disable_hw_accel(struct ieee80211_key *key)
 	if (!((key->conf.flags & IEEE80211_KEY_FLAG_GENERATE_MMIC) ||
 	      (key->conf.flags & IEEE80211_KEY_FLAG_GENERATE_IV) ||
 	      (key->conf.flags & IEEE80211_KEY_FLAG_PUT_IV_SPACE)))
-		increment_tailroom_need_count(sdata);
+		increment_tailroom_need_count(sdata, key);
+	else if (ieee80211_grow_crypto_tx_room(sdata, key))
+		synchronize_net();
 
 	ret = drv_set_key(key->local, DISABLE_KEY, sdata,
 			  sta ? &sta->sta : NULL, &key->conf);
@@ -417,6 +503,7 @@ static void __ieee80211_key_destroy(struct ieee80211_key *key)
 	if (key->local) {
 		ieee80211_debugfs_key_remove(key);
 		key->sdata->crypto_tx_tailroom_needed_cnt--;
+		ieee80211_update_crypto_tx_room(key->sdata);
 	}
 
 	kfree(key);
@@ -474,7 +561,7 @@ int ieee80211_key_link(struct ieee80211_key *key,
 	else
 		old_key = key_mtx_dereference(sdata->local, sdata->keys[idx]);
 
-	increment_tailroom_need_count(sdata);
+	increment_tailroom_need_count(sdata, key);
 
 	__ieee80211_key_replace(sdata, sta, pairwise, old_key, key);
 	__ieee80211_key_destroy(old_key);
@@ -523,9 +610,11 @@ void ieee80211_enable_keys(struct ieee80211_sub_if_data *sdata)
 	mutex_lock(&sdata->local->key_mtx);
 
 	sdata->crypto_tx_tailroom_needed_cnt = 0;
+	sdata->crypto_tx_headroom = 0;
+	sdata->crypto_tx_tailroom = 0;
 
 	list_for_each_entry(key, &sdata->key_list, list) {
-		increment_tailroom_need_count(sdata);
+		increment_tailroom_need_count(sdata, key);
 		ieee80211_key_enable_hw_accel(key);
 	}
 
@@ -32,6 +32,7 @@
 #include "led.h"
 #include "cfg.h"
 #include "debugfs.h"
+#include "crypto_test.h"
 
 static struct lock_class_key ieee80211_rx_skb_queue_class;
 
@@ -278,6 +279,7 @@ u32 ieee80211_reset_erp_info(struct ieee80211_sub_if_data *sdata)
 static void ieee80211_tasklet_handler(unsigned long data)
 {
 	struct ieee80211_local *local = (struct ieee80211_local *) data;
+	struct sta_hash_table *tbl;
 	struct sta_info *sta, *tmp;
 	struct skb_eosp_msg_data *eosp_data;
 	struct sk_buff *skb;
@@ -297,7 +299,7 @@ static void ieee80211_tasklet_handler(unsigned long data)
 			break;
 		case IEEE80211_EOSP_MSG:
 			eosp_data = (void *)skb->cb;
-			for_each_sta_info(local, eosp_data->sta, sta, tmp) {
+			for_each_sta_info(local, tbl, eosp_data->sta, sta, tmp) {
 				/* skip wrong virtual interface */
 				if (memcmp(eosp_data->iface,
 					   sta->sdata->vif.addr, ETH_ALEN))
@@ -662,10 +664,16 @@ struct ieee80211_hw *ieee80211_alloc_hw(size_t priv_data_len,
 	/* preallocate at least one entry */
 	idr_pre_get(&local->ack_status_frames, GFP_KERNEL);
 
-	sta_info_init(local);
+	if (sta_info_init(local)) {
+		idr_destroy(&local->ack_status_frames);
+		wiphy_free(wiphy);
+		return NULL;
+	}
 
+	spin_lock_init(&local->txq_lock);
 	for (i = 0; i < IEEE80211_MAX_QUEUES; i++) {
 		skb_queue_head_init(&local->pending[i]);
+		INIT_LIST_HEAD(&local->active_txqs[i]);
 		atomic_set(&local->agg_queue_stop[i], 0);
 	}
 	tasklet_init(&local->tx_pending_tasklet, ieee80211_tx_pending,
@@ -722,6 +730,9 @@ int ieee80211_register_hw(struct ieee80211_hw *hw)
 	if ((hw->flags & IEEE80211_HW_SCAN_WHILE_IDLE) && !local->ops->hw_scan)
 		return -EINVAL;
 
+	if ((hw->flags & IEEE80211_HW_RX_GRO) && !local->ops->napi_poll)
+		return -EINVAL;
+
 	/* Only HW csum features are currently compatible with mac80211 */
 	feature_whitelist = NETIF_F_IP_CSUM | NETIF_F_IPV6_CSUM |
 			    NETIF_F_HW_CSUM;
@@ -1078,6 +1089,8 @@ void ieee80211_free_hw(struct ieee80211_hw *hw)
 		     ieee80211_free_ack_frame, NULL);
 	idr_destroy(&local->ack_status_frames);
 
+	sta_info_deinit(local);
+
 	wiphy_free(local->hw.wiphy);
 }
 EXPORT_SYMBOL(ieee80211_free_hw);
@@ -1107,6 +1120,8 @@ static int __init ieee80211_init(void)
 	if (ret)
 		goto err_netdev;
 
+	ieee80211_crypto_test_init();
+
 	return 0;
  err_netdev:
 	rc80211_pid_exit();
@@ -1120,6 +1135,8 @@ static int __init ieee80211_init(void)
 
 static void __exit ieee80211_exit(void)
 {
+	ieee80211_crypto_test_exit();
+
 	rc80211_pid_exit();
 	rc80211_minstrel_ht_exit();
 	rc80211_minstrel_exit();
@@ -1128,9 +1145,6 @@ static void __exit ieee80211_exit(void)
 	flush_scheduled_work();
 #endif
 
-	if (mesh_allocated)
-		ieee80211s_stop();
-
 	ieee80211_iface_exit();
 
 	rcu_barrier();
@@ -9,6 +9,11 @@
  */
 
 #include <linux/slab.h>
+#include <linux/jhash.h>
+#include <linux/log2.h>
+#include <linux/moduleparam.h>
+#include <linux/random.h>
+#include <linux/vmalloc.h>
 #include <asm/unaligned.h>
 #include "ieee80211_i.h"
 #include "mesh.h"
@@ -17,8 +22,10 @@
 #define TMR_RUNNING_MP	1
 #define TMR_RUNNING_MPR	2
 
-int mesh_allocated;
-static struct kmem_cache *rm_cache;
+static unsigned int rmc_entries = RMC_DEFAULT_ENTRIES;
+module_param(rmc_entries, uint, 0644);
+MODULE_PARM_DESC(rmc_entries,
+		 "Size of the mesh recent multicast cache of new interfaces.");
 
 #ifdef CONFIG_MAC80211_MESH
 bool mesh_action_is_path_sel(struct ieee80211_mgmt *mgmt)
@@ -31,20 +38,6 @@ bool mesh_action_is_path_sel(struct ieee80211_mgmt *mgmt)
 { return false; }
 #endif
 
-void ieee80211s_init(void)
-{
-	mesh_pathtbl_init();
-	mesh_allocated = 1;
-	rm_cache = kmem_cache_create("mesh_rmc", sizeof(struct rmc_entry),
-				     0, 0, NULL);
-}
-
-void ieee80211s_stop(void)
-{
-	mesh_pathtbl_unregister();
-	kmem_cache_destroy(rm_cache);
-}
-
 static void ieee80211_mesh_housekeeping_timer(unsigned long data)
 {
 	struct ieee80211_sub_if_data *sdata = (void *) data;
@@ -155,34 +148,43 @@ void mesh_accept_plinks_update(struct ieee80211_sub_if_data *sdata)
 
 int mesh_rmc_init(struct ieee80211_sub_if_data *sdata)
 {
+	struct mesh_rmc *rmc;
+	unsigned int entries;
 	int i;
 
-	sdata->u.mesh.rmc = kmalloc(sizeof(struct mesh_rmc), GFP_KERNEL);
-	if (!sdata->u.mesh.rmc)
+	entries = clamp_t(unsigned int, rmc_entries,
+			  RMC_MIN_ENTRIES, RMC_MAX_ENTRIES);
+	entries = roundup_pow_of_two(entries);
+
+	rmc = vzalloc(sizeof(*rmc) + entries * sizeof(struct rmc_entry));
+	if (!rmc)
 		return -ENOMEM;
-	sdata->u.mesh.rmc->idx_mask = RMC_BUCKETS - 1;
-	for (i = 0; i < RMC_BUCKETS; i++)
-		INIT_LIST_HEAD(&sdata->u.mesh.rmc->bucket[i].list);
+
+	get_random_bytes(&rmc->hash_rnd, sizeof(rmc->hash_rnd));
+	rmc->set_mask = entries / RMC_WAYS - 1;
+	/* start out with every entry expired */
+	for (i = 0; i < entries; i++)
+		rmc->entry[i].exp_time = jiffies;
+
+	sdata->u.mesh.rmc = rmc;
 	return 0;
 }
 
 void mesh_rmc_free(struct ieee80211_sub_if_data *sdata)
 {
-	struct mesh_rmc *rmc = sdata->u.mesh.rmc;
-	struct rmc_entry *p, *n;
-	int i;
-
-	if (!sdata->u.mesh.rmc)
-		return;
+	vfree(sdata->u.mesh.rmc);
+	sdata->u.mesh.rmc = NULL;
+}
 
-	for (i = 0; i < RMC_BUCKETS; i++)
-		list_for_each_entry_safe(p, n, &rmc->bucket[i].list, list) {
-			list_del(&p->list);
-			kmem_cache_free(rm_cache, p);
-		}
+static struct rmc_entry *mesh_rmc_set(struct mesh_rmc *rmc, u32 seqnum,
+				      const u8 *sa)
+{
+	u32 set;
 
-	kfree(rmc);
-	sdata->u.mesh.rmc = NULL;
+	set = jhash_3words(seqnum, get_unaligned((const u32 *)sa),
+			   get_unaligned((const u16 *)(sa + 4)),
+			   rmc->hash_rnd) & rmc->set_mask;
+	return &rmc->entry[set * RMC_WAYS];
 }
 
 /**
@@ -195,43 +197,64 @@ void mesh_rmc_free(struct ieee80211_sub_if_data *sdata)
  *
  * Checks using the source address and the mesh sequence number if we have
  * received this frame lately. If the frame is not in the cache, it is added to
- * it.
+ * it, replacing an expired entry of the same set or, if there is none, the
+ * oldest one.
  */
 int mesh_rmc_check(u8 *sa, struct ieee80211s_hdr *mesh_hdr,
 		   struct ieee80211_sub_if_data *sdata)
 {
 	struct mesh_rmc *rmc = sdata->u.mesh.rmc;
+	struct rmc_entry *set, *p, *victim = NULL;
 	u32 seqnum = 0;
-	int entries = 0;
-	u8 idx;
-	struct rmc_entry *p, *n;
+	int i;
+
+	if (!rmc)
+		return 0;
 
 	/* Don't care about endianness since only match matters */
 	memcpy(&seqnum, &mesh_hdr->seqnum, sizeof(mesh_hdr->seqnum));
-	idx = le32_to_cpu(mesh_hdr->seqnum) & rmc->idx_mask;
-	list_for_each_entry_safe(p, n, &rmc->bucket[idx].list, list) {
-		++entries;
-		if (time_after(jiffies, p->exp_time) ||
-				(entries == RMC_QUEUE_MAX_LEN)) {
-			list_del(&p->list);
-			kmem_cache_free(rm_cache, p);
-			--entries;
-		} else if ((seqnum == p->seqnum) &&
-			   (ether_addr_equal(sa, p->sa)))
+	set = mesh_rmc_set(rmc, seqnum, sa);
+
+	for (i = 0; i < RMC_WAYS; i++) {
+		p = &set[i];
+		if (!time_after(p->exp_time, jiffies)) {
+			if (!victim || time_after(victim->exp_time, jiffies))
+				victim = p;
+			continue;
+		}
+		if (seqnum == p->seqnum && ether_addr_equal(sa, p->sa)) {
+			rmc->hits++;
 			return -1;
+		}
+		if (!victim || time_before(p->exp_time, victim->exp_time))
+			victim = p;
 	}
 
-	p = kmem_cache_alloc(rm_cache, GFP_ATOMIC);
-	if (!p)
-		return 0;
+	rmc->misses++;
+	if (time_after(victim->exp_time, jiffies))
+		rmc->evictions++;
 
-	p->seqnum = seqnum;
-	p->exp_time = jiffies + RMC_TIMEOUT;
-	memcpy(p->sa, sa, ETH_ALEN);
-	list_add(&p->list, &rmc->bucket[idx].list);
+	victim->seqnum = seqnum;
+	victim->exp_time = jiffies + RMC_TIMEOUT;
+	memcpy(victim->sa, sa, ETH_ALEN);
 	return 0;
 }
 
+int mesh_rmc_stats_format(struct ieee80211_sub_if_data *sdata,
+			  char *buf, int buflen)
+{
+	struct mesh_rmc *rmc = sdata->u.mesh.rmc;
+
+	if (!rmc)
+		return scnprintf(buf, buflen, "not allocated\n");
+
+	return scnprintf(buf, buflen,
+			 "entries: %u (%u sets of %u)\n"
+			 "hits: %lu\nmisses: %lu\nevictions: %lu\n",
+			 (rmc->set_mask + 1) * RMC_WAYS, rmc->set_mask + 1,
+			 RMC_WAYS, rmc->hits, rmc->misses, rmc->evictions);
+}
+
 int
 mesh_add_meshconf_ie(struct sk_buff *skb, struct ieee80211_sub_if_data *sdata)
 {
@@ -579,10 +602,18 @@ void ieee80211_mesh_restart(struct ieee80211_sub_if_data *sdata)
 }
 #endif
 
-void ieee80211_start_mesh(struct ieee80211_sub_if_data *sdata)
+int ieee80211_start_mesh(struct ieee80211_sub_if_data *sdata)
 {
 	struct ieee80211_if_mesh *ifmsh = &sdata->u.mesh;
 	struct ieee80211_local *local = sdata->local;
+	int err;
+
+	/* the path tables may have failed to allocate with the interface */
+	if (!rcu_access_pointer(ifmsh->mesh_paths)) {
+		err = mesh_pathtbl_init(sdata);
+		if (err)
+			return err;
+	}
 
 	local->fif_other_bss++;
 	/* mesh ifaces must set allmulti to forward mcast traffic */
@@ -609,6 +640,7 @@ void ieee80211_start_mesh(struct ieee80211_sub_if_data *sdata)
 						BSS_CHANGED_HT |
 						BSS_CHANGED_BASIC_RATES |
 						BSS_CHANGED_BEACON_INT);
+	return 0;
 }
 
 void ieee80211_stop_mesh(struct ieee80211_sub_if_data *sdata)
@@ -743,10 +775,10 @@ void ieee80211_mesh_work(struct ieee80211_sub_if_data *sdata)
 		mesh_path_start_discovery(sdata);
 
 	if (test_and_clear_bit(MESH_WORK_GROW_MPATH_TABLE, &ifmsh->wrkq_flags))
-		mesh_mpath_table_grow();
+		mesh_mpath_table_grow(sdata);
 
 	if (test_and_clear_bit(MESH_WORK_GROW_MPP_TABLE, &ifmsh->wrkq_flags))
-		mesh_mpp_table_grow();
+		mesh_mpp_table_grow(sdata);
 
 	if (test_and_clear_bit(MESH_WORK_HOUSEKEEPING, &ifmsh->wrkq_flags))
 		ieee80211_mesh_housekeeping(sdata, ifmsh);
@@ -772,6 +804,7 @@ void ieee80211_mesh_notify_scan_completed(struct ieee80211_local *local)
 void ieee80211_mesh_init_sdata(struct ieee80211_sub_if_data *sdata)
 {
 	struct ieee80211_if_mesh *ifmsh = &sdata->u.mesh;
+	int i;
 
 	setup_timer(&ifmsh->housekeeping_timer,
 		    ieee80211_mesh_housekeeping_timer,
@@ -783,18 +816,18 @@ void ieee80211_mesh_init_sdata(struct ieee80211_sub_if_data *sdata)
 	ifmsh->num_gates = 0;
 	atomic_set(&ifmsh->mpaths, 0);
 	mesh_rmc_init(sdata);
+	if (mesh_pathtbl_init(sdata))
+		sdata_err(sdata, "could not allocate mesh path tables\n");
 	ifmsh->last_preq = jiffies;
 	ifmsh->next_perr = jiffies;
-	/* Allocate all mesh structures when creating the first mesh interface. */
-	if (!mesh_allocated)
-		ieee80211s_init();
 	setup_timer(&ifmsh->mesh_path_timer,
 		    ieee80211_mesh_path_timer,
 		    (unsigned long) sdata);
 	setup_timer(&ifmsh->mesh_path_root_timer,
 		    ieee80211_mesh_path_root_timer,
 		    (unsigned long) sdata);
-	INIT_LIST_HEAD(&ifmsh->preq_queue.list);
+	for (i = 0; i < NUM_MESH_PREQ_PRIO; i++)
+		INIT_LIST_HEAD(&ifmsh->preq_queue[i]);
 	spin_lock_init(&ifmsh->mesh_preq_queue_lock);
 	spin_lock_init(&ifmsh->sync_offset_lock);
 }
@@ -46,6 +46,8 @@ enum mesh_config_capab_flags {
  * @MESH_PATH_RESOLVED: the mesh path can has been resolved
  * @MESH_PATH_REQ_QUEUED: there is an unsent path request for this destination
  * already queued up, waiting for the discovery process to start.
+ * @MESH_PATH_DELETED: the mesh path has been removed from the path table and
+ * 	is waiting for an RCU grace period to be freed
  *
  * MESH_PATH_RESOLVED is used by the mesh path timer to
  * decide when to stop or cancel the mesh path discovery.
@@ -57,6 +59,7 @@ enum mesh_path_flags {
 	MESH_PATH_FIXED	=	BIT(3),
 	MESH_PATH_RESOLVED =	BIT(4),
 	MESH_PATH_REQ_QUEUED =	BIT(5),
+	MESH_PATH_DELETED =	BIT(6),
 };
 
 /**
@@ -66,9 +69,9 @@ enum mesh_path_flags {
  *
  * @MESH_WORK_HOUSEKEEPING: run the periodic mesh housekeeping tasks
  * @MESH_WORK_GROW_MPATH_TABLE: the mesh path table is full and needs
- * to grow.
+ * to grow, or is in the process of growing.
  * @MESH_WORK_GROW_MPP_TABLE: the mesh portals table is full and needs to
- * grow
+ * grow, or is in the process of growing.
  * @MESH_WORK_ROOT: the mesh root station needs to send a frame
  * @MESH_WORK_DRIFT_ADJUST: time to compensate for clock drift relative to other
  * mesh nodes
@@ -85,6 +88,9 @@ enum mesh_deferred_task_flags {
  * struct mesh_path - mac80211 mesh path structure
  *
  * @dst: mesh path destination mac address
+ * @hnode: path table list nodes, see &struct mesh_table's @link
+ * @hlink: index of the @hnode entry that currently links this path into
+ * 	its path table, only changed under the path table lock
  * @sdata: mesh subif
  * @next_hop: mesh neighbor to which frames for this destination will be
  * 	forwarded
@@ -98,6 +104,7 @@ enum mesh_deferred_task_flags {
  * @discovery_timeout: timeout (lapse in jiffies) used for the last discovery
  * 	retry
  * @discovery_retries: number of discovery retries
+ * @discovery_start: in jiffies, when the current path discovery started
  * @flags: mesh path flags, as specified on &enum mesh_path_flags
  * @state_lock: mesh path state lock used to protect changes to the
  * mpath itself.  No need to take this lock when adding or removing
@@ -109,7 +116,7 @@ enum mesh_deferred_task_flags {
  * @is_gate: the destination station of this path is a mesh gate
  *
  *
- * The combination of dst and sdata is unique in the mesh path table. Since the
+ * The dst is unique in the interface's mesh path table. Since the
  * next_hop STA is only protected by RCU as well, deleting the STA must also
  * remove/substitute the mesh_path structure and wait until that is no longer
  * reachable before destroying the STA completely.
@@ -117,6 +124,8 @@ enum mesh_deferred_task_flags {
 struct mesh_path {
 	u8 dst[ETH_ALEN];
 	u8 mpp[ETH_ALEN];	/* used for MPP or MAP */
+	struct hlist_node hnode[2];
+	u8 hlink;
 	struct ieee80211_sub_if_data *sdata;
 	struct sta_info __rcu *next_hop;
 	struct timer_list timer;
@@ -128,6 +137,7 @@ struct mesh_path {
 	unsigned long exp_time;
 	u32 discovery_timeout;
 	u8 discovery_retries;
+	unsigned long discovery_start;
 	enum mesh_path_flags flags;
 	spinlock_t state_lock;
 	u8 rann_snd_addr[ETH_ALEN];
@@ -141,42 +151,67 @@ struct mesh_path {
  * struct mesh_table
  *
  * @hash_buckets: array of hash buckets of the table
- * @hashwlock: array of locks to protect write operations, one per bucket
+ * @hashwlock: array of locks to protect write operations. The locks are
+ *	picked by hash value rather than by bucket and shared between a table
+ *	and the table it grows into, so they protect an entry wherever it is.
  * @hash_mask: 2^size_order - 1, used to compute hash idx
- * @hash_rnd: random value used for hash computations
+ * @hash_rnd: random value used for hash computations, kept when growing
  * @entries: number of entries in the table
- * @free_node: function to free nodes of the table
- * @copy_node: function to copy nodes of the table
  * @size_order: determines size of the table, there will be 2^size_order hash
  *	buckets
  * @mean_chain_len: maximum average length for the hash buckets' list, if it is
  *	reached, the table will grow
- * @known_gates: list of known mesh gates and their mpaths by the station. The
- * gate's mpath may or may not be resolved and active.
+ * @link: which of the &struct mesh_path @hnode nodes this table uses
+ * @future_tbl: while growing, the table entries are being moved to; new
+ *	entries are added there and lookups check both tables
+ * @rehash_idx: next bucket to be moved to @future_tbl
  *
- * rcu_head: RCU head to free the table
+ * A table grows incrementally: the mesh work moves a few buckets at a time
+ * into @future_tbl, linking each path through its other @hnode, and makes
+ * the new table current once the old one is empty.
  */
 struct mesh_table {
 	/* Number of buckets will be 2^N */
 	struct hlist_head *hash_buckets;
-	spinlock_t *hashwlock;		/* One per bucket, for add/del */
+	spinlock_t *hashwlock;		/* For add/del, shared when growing */
 	unsigned int hash_mask;		/* (2^size_order) - 1 */
 	__u32 hash_rnd;			/* Used for hash generation */
 	atomic_t entries;		/* Up to MAX_MESH_NEIGHBOURS */
-	void (*free_node) (struct hlist_node *p, bool free_leafs);
-	int (*copy_node) (struct hlist_node *p, struct mesh_table *newtbl);
 	int size_order;
 	int mean_chain_len;
-	struct hlist_head *known_gates;
-	spinlock_t gates_lock;
+	u8 link;
+	struct mesh_table __rcu *future_tbl;
+	unsigned int rehash_idx;
+};
+
+/* Path table lookup/insert latency histograms, in log2 ns buckets */
+#define MESH_TBL_HIST_BUCKETS	12
+#define MESH_TBL_HIST_SHIFT	6
 
-	struct rcu_head rcu_head;
+enum mesh_tbl_op {
+	MESH_TBL_LOOKUP,
+	MESH_TBL_INSERT,
+
+	/* keep last */
+	NUM_MESH_TBL_OPS
+};
+
+/**
+ * struct mesh_tbl_stats - per-CPU mesh path table statistics
+ *
+ * @hist: latency histogram per operation, bucket 0 counts operations below
+ *	2^(MESH_TBL_HIST_SHIFT + 1) ns and every following bucket doubles that
+ */
+struct mesh_tbl_stats {
+	u32 hist[NUM_MESH_TBL_OPS][MESH_TBL_HIST_BUCKETS];
 };
 
 /* Recent multicast cache */
-/* RMC_BUCKETS must be a power of 2, maximum 256 */
-#define RMC_BUCKETS		256
-#define RMC_QUEUE_MAX_LEN	4
+/* RMC_WAYS must be a power of 2 */
+#define RMC_WAYS		4
+#define RMC_DEFAULT_ENTRIES	1024
+#define RMC_MIN_ENTRIES		RMC_WAYS
+#define RMC_MAX_ENTRIES		65536
 #define RMC_TIMEOUT		(3 * HZ)
 
 /**
@@ -191,15 +226,32 @@ struct mesh_table {
  * that are found in the cache.
  */
 struct rmc_entry {
-	struct list_head list;
 	u32 seqnum;
 	unsigned long exp_time;
 	u8 sa[ETH_ALEN];
 };
 
+/**
+ * struct mesh_rmc - Recent Multicast Cache
+ *
+ * @hash_rnd: random value used to hash (sa, seqnum) pairs
+ * @set_mask: number of sets minus one
+ * @hits: frames found in the cache, i.e. dropped as duplicates
+ * @misses: frames not found in the cache, and thus added to it
+ * @evictions: live entries replaced before they expired
+ * @entry: the cache itself, (@set_mask + 1) sets of RMC_WAYS entries each
+ *
+ * The cache is set associative and allocated once: a lookup only ever
+ * looks at the RMC_WAYS entries of a single set, and a new entry takes
+ * the place of an expired one or of the oldest one in its set.
+ */
 struct mesh_rmc {
-	struct rmc_entry bucket[RMC_BUCKETS];
-	u32 idx_mask;
+	u32 hash_rnd;
+	u32 set_mask;
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long evictions;
+	struct rmc_entry entry[0];
 };
 
 #define IEEE80211_MESH_PEER_INACTIVITY_LIMIT (1800 * HZ)
@@ -245,12 +297,12 @@ int mesh_add_ht_oper_ie(struct sk_buff *skb,
 			struct ieee80211_sub_if_data *sdata);
 void mesh_rmc_free(struct ieee80211_sub_if_data *sdata);
 int mesh_rmc_init(struct ieee80211_sub_if_data *sdata);
-void ieee80211s_init(void);
+int mesh_rmc_stats_format(struct ieee80211_sub_if_data *sdata,
+			  char *buf, int buflen);
 void ieee80211s_update_metric(struct ieee80211_local *local,
 		struct sta_info *sta, struct sk_buff *skb);
-void ieee80211s_stop(void);
 void ieee80211_mesh_init_sdata(struct ieee80211_sub_if_data *sdata);
-void ieee80211_start_mesh(struct ieee80211_sub_if_data *sdata);
+int ieee80211_start_mesh(struct ieee80211_sub_if_data *sdata);
 void ieee80211_stop_mesh(struct ieee80211_sub_if_data *sdata);
 void ieee80211_mesh_root_setup(struct ieee80211_if_mesh *ifmsh);
 struct ieee80211_mesh_sync_ops *ieee80211_mesh_sync_ops_get(u8 method);
@@ -261,6 +313,8 @@ int mesh_nexthop_lookup(struct sk_buff *skb,
 int mesh_nexthop_resolve(struct sk_buff *skb,
 			 struct ieee80211_sub_if_data *sdata);
 void mesh_path_start_discovery(struct ieee80211_sub_if_data *sdata);
+int mesh_hwmp_stats_format(struct ieee80211_sub_if_data *sdata,
+			   char *buf, int buflen);
 struct mesh_path *mesh_path_lookup(u8 *dst,
 		struct ieee80211_sub_if_data *sdata);
 struct mesh_path *mpp_path_lookup(u8 *dst,
@@ -268,6 +322,9 @@ struct mesh_path *mpp_path_lookup(u8 *dst,
 int mpp_path_add(u8 *dst, u8 *mpp, struct ieee80211_sub_if_data *sdata);
 struct mesh_path *mesh_path_lookup_by_idx(int idx,
 		struct ieee80211_sub_if_data *sdata);
+struct mesh_path *
+mesh_path_lookup_next(const struct cfg80211_dump_cursor *cursor,
+		      struct ieee80211_sub_if_data *sdata);
 void mesh_path_fix_nexthop(struct mesh_path *mpath, struct sta_info *next_hop);
 void mesh_path_expire(struct ieee80211_sub_if_data *sdata);
 void mesh_rx_path_sel_frame(struct ieee80211_sub_if_data *sdata,
@@ -293,16 +350,18 @@ void mesh_rx_plink_frame(struct ieee80211_sub_if_data *sdata,
 
 /* Private interfaces */
 /* Mesh tables */
-void mesh_mpath_table_grow(void);
-void mesh_mpp_table_grow(void);
+void mesh_mpath_table_grow(struct ieee80211_sub_if_data *sdata);
+void mesh_mpp_table_grow(struct ieee80211_sub_if_data *sdata);
+int mesh_pathtbl_stats_format(struct ieee80211_sub_if_data *sdata,
+			      char *buf, int buflen);
 /* Mesh paths */
 int mesh_path_error_tx(u8 ttl, u8 *target, __le32 target_sn, __le16 target_rcode,
 		       const u8 *ra, struct ieee80211_sub_if_data *sdata);
 void mesh_path_assign_nexthop(struct mesh_path *mpath, struct sta_info *sta);
 void mesh_path_flush_pending(struct mesh_path *mpath);
 void mesh_path_tx_pending(struct mesh_path *mpath);
-int mesh_pathtbl_init(void);
-void mesh_pathtbl_unregister(void);
+int mesh_pathtbl_init(struct ieee80211_sub_if_data *sdata);
+void mesh_pathtbl_unregister(struct ieee80211_sub_if_data *sdata);
 int mesh_path_del(u8 *addr, struct ieee80211_sub_if_data *sdata);
 void mesh_path_timer(unsigned long data);
 void mesh_path_flush_by_nexthop(struct sta_info *sta);
@@ -313,11 +372,8 @@ void mesh_path_restart(struct ieee80211_sub_if_data *sdata);
 void mesh_path_tx_root_frame(struct ieee80211_sub_if_data *sdata);
 
 bool mesh_action_is_path_sel(struct ieee80211_mgmt *mgmt);
-extern int mesh_paths_generation;
 
 #ifdef CONFIG_MAC80211_MESH
-extern int mesh_allocated;
-
 static inline int mesh_plink_free_count(struct ieee80211_sub_if_data *sdata)
 {
 	return sdata->u.mesh.mshcfg.dot11MeshMaxPeerLinks -
@@ -349,7 +405,6 @@ void mesh_plink_restart(struct sta_info *sta);
 void mesh_path_flush_by_iface(struct ieee80211_sub_if_data *sdata);
 void mesh_sync_adjust_tbtt(struct ieee80211_sub_if_data *sdata);
 #else
-#define mesh_allocated	0
 static inline void
 ieee80211_mesh_notify_scan_completed(struct ieee80211_local *local) {}
 static inline void ieee80211_mesh_quiesce(struct ieee80211_sub_if_data *sdata)
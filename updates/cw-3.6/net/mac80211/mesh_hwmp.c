@@ -9,17 +9,23 @@
 
 #include <linux/slab.h>
 #include <linux/etherdevice.h>
+#include <linux/log2.h>
 #include <asm/unaligned.h>
 #include "wme.h"
 #include "mesh.h"
+#include "rate.h"
 
 #define TEST_FRAME_LEN	8192
 #define MAX_METRIC	0xffffffff
 #define ARITH_SHIFT	8
+/* Minimum time between two updates of a peer's averaged link metric */
+#define MESH_METRIC_UPDATE_INT	(HZ / 10)
 
 /* Number of frames buffered per destination for unresolved destinations */
 #define MESH_FRAME_QUEUE_LEN	10
-#define MAX_PREQ_QUEUE_LEN	64
+#define MAX_PREQ_QUEUE_LEN	256
+/* Most targets a PREQ element can carry without AE (IEEE 802.11s 8.4.2.115) */
+#define MESH_PREQ_MAX_TARGETS	20
 
 /* Destination only */
 #define MP_F_DO	0x1
@@ -57,9 +63,13 @@ static inline u32 u16_field_get(u8 *preq_elem, int offset, bool ae)
 #define PREQ_IE_ORIG_SN(x)	u32_field_get(x, 13, 0)
 #define PREQ_IE_LIFETIME(x)	u32_field_get(x, 17, AE_F_SET(x))
 #define PREQ_IE_METRIC(x) 	u32_field_get(x, 21, AE_F_SET(x))
-#define PREQ_IE_TARGET_F(x)	(*(AE_F_SET(x) ? x + 32 : x + 26))
-#define PREQ_IE_TARGET_ADDR(x) 	(AE_F_SET(x) ? x + 33 : x + 27)
-#define PREQ_IE_TARGET_SN(x) 	u32_field_get(x, 33, AE_F_SET(x))
+#define PREQ_IE_TARGET_COUNT(x)	(*(AE_F_SET(x) ? x + 31 : x + 25))
+#define PREQ_IE_TARGET(x, n)	((AE_F_SET(x) ? x + 32 : x + 26) + 11 * (n))
+#define PREQ_IE_LEN(n)		(26 + 11 * (n))
+
+#define PREQ_TARGET_F(t)	(*(t))
+#define PREQ_TARGET_ADDR(t)	((t) + 1)
+#define PREQ_TARGET_SN(t)	get_unaligned_le32((t) + 7)
 
 
 #define PREP_IE_FLAGS(x)	PREQ_IE_FLAGS(x)
@@ -103,24 +113,31 @@ enum mpath_frame_type {
 
 static const u8 broadcast_addr[ETH_ALEN] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
 
-static int mesh_path_sel_frame_tx(enum mpath_frame_type action, u8 flags,
-		u8 *orig_addr, __le32 orig_sn, u8 target_flags, u8 *target,
-		__le32 target_sn, const u8 *da, u8 hop_count, u8 ttl,
-		__le32 lifetime, __le32 metric, __le32 preq_id,
-		struct ieee80211_sub_if_data *sdata)
+/**
+ * struct hwmp_preq_target - one target of a PREQ element
+ *
+ * @flags: per target flags (MP_F_DO, MP_F_RF, ...)
+ * @addr: target address
+ * @sn: target sequence number
+ */
+struct hwmp_preq_target {
+	u8 flags;
+	u8 addr[ETH_ALEN];
+	__le32 sn;
+};
+
+static struct sk_buff *hwmp_action_alloc(struct ieee80211_sub_if_data *sdata,
+					 const u8 *da, int ie_len)
 {
 	struct ieee80211_local *local = sdata->local;
 	struct sk_buff *skb;
 	struct ieee80211_mgmt *mgmt;
-	u8 *pos, ie_len;
 	int hdr_len = offsetof(struct ieee80211_mgmt, u.action.u.mesh_action) +
 		      sizeof(mgmt->u.action.u.mesh_action);
 
-	skb = dev_alloc_skb(local->tx_headroom +
-			    hdr_len +
-			    2 + 37); /* max HWMP IE */
+	skb = dev_alloc_skb(local->tx_headroom + hdr_len + 2 + ie_len);
 	if (!skb)
-		return -1;
+		return NULL;
 	skb_reserve(skb, local->tx_headroom);
 	mgmt = (struct ieee80211_mgmt *) skb_put(skb, hdr_len);
 	memset(mgmt, 0, hdr_len);
@@ -134,31 +151,97 @@ static int mesh_path_sel_frame_tx(enum mpath_frame_type action, u8 flags,
 	mgmt->u.action.category = WLAN_CATEGORY_MESH_ACTION;
 	mgmt->u.action.u.mesh_action.action_code =
 					WLAN_MESH_ACTION_HWMP_PATH_SELECTION;
+	return skb;
+}
+
+static int mesh_preq_frame_tx(struct ieee80211_sub_if_data *sdata, u8 flags,
+		const u8 *orig_addr, __le32 orig_sn,
+		const struct hwmp_preq_target *targets, int n_targets,
+		const u8 *da, u8 hop_count, u8 ttl, __le32 lifetime,
+		__le32 metric, __le32 preq_id)
+{
+	struct sk_buff *skb;
+	u8 *pos, ie_len;
+	int i;
+
+	if (WARN_ON(!n_targets || n_targets > MESH_PREQ_MAX_TARGETS))
+		return -EINVAL;
+
+	ie_len = PREQ_IE_LEN(n_targets);
+	skb = hwmp_action_alloc(sdata, da, ie_len);
+	if (!skb)
+		return -1;
+
+	mhwmp_dbg(sdata, "sending PREQ to %pM (%d targets)\n",
+		  targets[0].addr, n_targets);
+	pos = skb_put(skb, 2 + ie_len);
+	*pos++ = WLAN_EID_PREQ;
+	*pos++ = ie_len;
+	*pos++ = flags;
+	*pos++ = hop_count;
+	*pos++ = ttl;
+	memcpy(pos, &preq_id, 4);
+	pos += 4;
+	memcpy(pos, orig_addr, ETH_ALEN);
+	pos += ETH_ALEN;
+	memcpy(pos, &orig_sn, 4);
+	pos += 4;
+	memcpy(pos, &lifetime, 4);
+	pos += 4;
+	memcpy(pos, &metric, 4);
+	pos += 4;
+	*pos++ = n_targets; /* destination count */
+	for (i = 0; i < n_targets; i++) {
+		*pos++ = targets[i].flags;
+		memcpy(pos, targets[i].addr, ETH_ALEN);
+		pos += ETH_ALEN;
+		memcpy(pos, &targets[i].sn, 4);
+		pos += 4;
+	}
+
+	ieee80211_tx_skb(sdata, skb);
+	return 0;
+}
+
+static int mesh_path_sel_frame_tx(enum mpath_frame_type action, u8 flags,
+		u8 *orig_addr, __le32 orig_sn, u8 target_flags, u8 *target,
+		__le32 target_sn, const u8 *da, u8 hop_count, u8 ttl,
+		__le32 lifetime, __le32 metric, __le32 preq_id,
+		struct ieee80211_sub_if_data *sdata)
+{
+	struct sk_buff *skb;
+	u8 *pos, ie_len;
+
+	if (action == MPATH_PREQ) {
+		struct hwmp_preq_target t = {
+			.flags = target_flags,
+			.sn = target_sn,
+		};
+
+		memcpy(t.addr, target, ETH_ALEN);
+		return mesh_preq_frame_tx(sdata, flags, orig_addr, orig_sn,
+					  &t, 1, da, hop_count, ttl, lifetime,
+					  metric, preq_id);
+	}
 
 	switch (action) {
-	case MPATH_PREQ:
-		mhwmp_dbg(sdata, "sending PREQ to %pM\n", target);
-		ie_len = 37;
-		pos = skb_put(skb, 2 + ie_len);
-		*pos++ = WLAN_EID_PREQ;
-		break;
 	case MPATH_PREP:
 		mhwmp_dbg(sdata, "sending PREP to %pM\n", target);
 		ie_len = 31;
-		pos = skb_put(skb, 2 + ie_len);
-		*pos++ = WLAN_EID_PREP;
 		break;
 	case MPATH_RANN:
 		mhwmp_dbg(sdata, "sending RANN from %pM\n", orig_addr);
 		ie_len = sizeof(struct ieee80211_rann_ie);
-		pos = skb_put(skb, 2 + ie_len);
-		*pos++ = WLAN_EID_RANN;
 		break;
 	default:
-		kfree_skb(skb);
 		return -ENOTSUPP;
-		break;
 	}
+
+	skb = hwmp_action_alloc(sdata, da, ie_len);
+	if (!skb)
+		return -1;
+	pos = skb_put(skb, 2 + ie_len);
+	*pos++ = action == MPATH_PREP ? WLAN_EID_PREP : WLAN_EID_RANN;
 	*pos++ = ie_len;
 	*pos++ = flags;
 	*pos++ = hop_count;
@@ -169,10 +252,6 @@ static int mesh_path_sel_frame_tx(enum mpath_frame_type action, u8 flags,
 		memcpy(pos, &target_sn, 4);
 		pos += 4;
 	} else {
-		if (action == MPATH_PREQ) {
-			memcpy(pos, &preq_id, 4);
-			pos += 4;
-		}
 		memcpy(pos, orig_addr, ETH_ALEN);
 		pos += ETH_ALEN;
 		memcpy(pos, &orig_sn, 4);
@@ -182,14 +261,7 @@ static int mesh_path_sel_frame_tx(enum mpath_frame_type action, u8 flags,
 	pos += 4;
 	memcpy(pos, &metric, 4);
 	pos += 4;
-	if (action == MPATH_PREQ) {
-		*pos++ = 1; /* destination count */
-		*pos++ = target_flags;
-		memcpy(pos, target, ETH_ALEN);
-		pos += ETH_ALEN;
-		memcpy(pos, &target_sn, 4);
-		pos += 4;
-	} else if (action == MPATH_PREP) {
+	if (action == MPATH_PREP) {
 		memcpy(pos, orig_addr, ETH_ALEN);
 		pos += ETH_ALEN;
 		memcpy(pos, &orig_sn, 4);
@@ -297,6 +369,37 @@ int mesh_path_error_tx(u8 ttl, u8 *target, __le32 target_sn,
 	return 0;
 }
 
+static u32 airtime_link_metric_calc(struct sta_info *sta)
+{
+	struct rate_info rinfo;
+	/* This should be adjusted for each device */
+	int device_constant = 1 << ARITH_SHIFT;
+	int test_frame_len = TEST_FRAME_LEN << ARITH_SHIFT;
+	int s_unit = 1 << ARITH_SHIFT;
+	int rate, err;
+	u32 tx_time, estimated_retx;
+	u64 result;
+
+	/* expected throughput is in kbps, rate in units of 100 kbps */
+	rate = DIV_ROUND_UP(rate_control_get_expected_throughput(sta), 100);
+	if (!rate) {
+		sta_set_rate_info_tx(sta, &sta->last_tx_rate, &rinfo);
+		rate = cfg80211_calculate_bitrate(&rinfo);
+	}
+	if (WARN_ON(!rate))
+		return MAX_METRIC;
+
+	err = (min(sta->fail_avg, 99U) << ARITH_SHIFT) / 100;
+
+	/* bitrate is in units of 100 Kbps, while we need rate in units of
+	 * 1Mbps. This will be corrected on tx_time computation.
+	 */
+	tx_time = (device_constant + 10 * test_frame_len / rate);
+	estimated_retx = ((1 << (2 * ARITH_SHIFT)) / (s_unit - err));
+	result = ((u64)tx_time * estimated_retx) >> (2 * ARITH_SHIFT);
+	return min_t(u64, result, MAX_METRIC);
+}
+
 void ieee80211s_update_metric(struct ieee80211_local *local,
 		struct sta_info *sta, struct sk_buff *skb)
 {
@@ -313,37 +416,57 @@ void ieee80211s_update_metric(struct ieee80211_local *local,
 	sta->fail_avg = ((80 * sta->fail_avg + 5) / 100 + 20 * failed);
 	if (sta->fail_avg > 95)
 		mesh_plink_broken(sta);
+
+	/*
+	 * Rate control statistics don't change per frame either, so
+	 * there's no point in feeding the metric average more often.
+	 */
+	if (ewma_read(&sta->avg_metric) &&
+	    time_before(jiffies, sta->metric_update + MESH_METRIC_UPDATE_INT))
+		return;
+
+	ewma_add(&sta->avg_metric, airtime_link_metric_calc(sta));
+	sta->metric_update = jiffies;
 }
 
 static u32 airtime_link_metric_get(struct ieee80211_local *local,
 				   struct sta_info *sta)
 {
-	struct rate_info rinfo;
-	/* This should be adjusted for each device */
-	int device_constant = 1 << ARITH_SHIFT;
-	int test_frame_len = TEST_FRAME_LEN << ARITH_SHIFT;
-	int s_unit = 1 << ARITH_SHIFT;
-	int rate, err;
-	u32 tx_time, estimated_retx;
-	u64 result;
+	u32 metric;
 
 	if (sta->fail_avg >= 100)
 		return MAX_METRIC;
 
-	sta_set_rate_info_tx(sta, &sta->last_tx_rate, &rinfo);
-	rate = cfg80211_calculate_bitrate(&rinfo);
-	if (WARN_ON(!rate))
-		return MAX_METRIC;
+	/* no data sent to this peer yet, nothing averaged */
+	metric = ewma_read(&sta->avg_metric);
+	if (!metric)
+		metric = airtime_link_metric_calc(sta);
 
-	err = (sta->fail_avg << ARITH_SHIFT) / 100;
+	return metric;
+}
 
-	/* bitrate is in units of 100 Kbps, while we need rate in units of
-	 * 1Mbps. This will be corrected on tx_time computation.
-	 */
-	tx_time = (device_constant + 10 * test_frame_len / rate);
-	estimated_retx = ((1 << (2 * ARITH_SHIFT)) / (s_unit - err));
-	result = (tx_time * estimated_retx) >> (2 * ARITH_SHIFT) ;
-	return (u32)result;
+static bool mesh_path_resolving(struct mesh_path *mpath)
+{
+	return (mpath->flags & (MESH_PATH_RESOLVING | MESH_PATH_RESOLVED)) ==
+	       MESH_PATH_RESOLVING;
+}
+
+static void hwmp_discovery_resolved(struct ieee80211_sub_if_data *sdata,
+				    unsigned long start)
+{
+	struct ieee80211_if_mesh *ifmsh = &sdata->u.mesh;
+	struct mesh_hwmp_stats *stats = &ifmsh->hwmp_stats;
+	unsigned int ms = jiffies_to_msecs(jiffies - start);
+	int idx = ms ? ilog2(ms) : 0;
+
+	idx = clamp(idx - MESH_DISC_HIST_SHIFT, 0, MESH_DISC_HIST_BUCKETS - 1);
+
+	spin_lock_bh(&ifmsh->mesh_preq_queue_lock);
+	stats->disc_resolved++;
+	stats->disc_latency_sum += ms;
+	stats->disc_latency_max = max(stats->disc_latency_max, ms);
+	stats->disc_latency_hist[idx]++;
+	spin_unlock_bh(&ifmsh->mesh_preq_queue_lock);
 }
 
 /**
@@ -372,9 +495,10 @@ static u32 hwmp_route_info_get(struct ieee80211_sub_if_data *sdata,
 	bool fresh_info;
 	u8 *orig_addr, *ta;
 	u32 orig_sn, orig_metric;
-	unsigned long orig_lifetime, exp_time;
+	unsigned long orig_lifetime, exp_time, disc_start;
 	u32 last_hop_metric, new_metric;
 	bool process = true;
+	bool resolved;
 
 	rcu_read_lock();
 	sta = sta_info_get(sdata, mgmt->sa);
@@ -452,8 +576,12 @@ static u32 hwmp_route_info_get(struct ieee80211_sub_if_data *sdata,
 			mpath->sn = orig_sn;
 			mpath->exp_time = time_after(mpath->exp_time, exp_time)
 					  ?  mpath->exp_time : exp_time;
+			resolved = mesh_path_resolving(mpath);
+			disc_start = mpath->discovery_start;
 			mesh_path_activate(mpath);
 			spin_unlock_bh(&mpath->state_lock);
+			if (resolved)
+				hwmp_discovery_resolved(sdata, disc_start);
 			mesh_path_tx_pending(mpath);
 			/* draft says preq_id should be saved to, but there does
 			 * not seem to be any use for it, skipping by now
@@ -491,8 +619,12 @@ static u32 hwmp_route_info_get(struct ieee80211_sub_if_data *sdata,
 			mpath->metric = last_hop_metric;
 			mpath->exp_time = time_after(mpath->exp_time, exp_time)
 					  ?  mpath->exp_time : exp_time;
+			resolved = mesh_path_resolving(mpath);
+			disc_start = mpath->discovery_start;
 			mesh_path_activate(mpath);
 			spin_unlock_bh(&mpath->state_lock);
+			if (resolved)
+				hwmp_discovery_resolved(sdata, disc_start);
 			mesh_path_tx_pending(mpath);
 		} else
 			spin_unlock_bh(&mpath->state_lock);
@@ -503,38 +635,53 @@ static u32 hwmp_route_info_get(struct ieee80211_sub_if_data *sdata,
 	return process ? new_metric : 0;
 }
 
-static void hwmp_preq_frame_process(struct ieee80211_sub_if_data *sdata,
-				    struct ieee80211_mgmt *mgmt,
-				    u8 *preq_elem, u32 metric)
+/**
+ * hwmp_preq_target_process - process one target of a received PREQ
+ *
+ * @sdata: local mesh subif
+ * @mgmt: mesh management frame carrying the PREQ
+ * @preq_elem: PREQ element
+ * @target: target of @preq_elem to process
+ * @fwd: filled in with the target to forward, if any
+ *
+ * Replies to the originator if this MP is the target or knows an active path
+ * to it. Must be called under RCU read lock.
+ *
+ * Returns: the DA the PREQ should be forwarded to for this target, or NULL
+ * if it should not be forwarded.
+ */
+static const u8 *hwmp_preq_target_process(struct ieee80211_sub_if_data *sdata,
+					  struct ieee80211_mgmt *mgmt,
+					  u8 *preq_elem, u8 *target,
+					  struct hwmp_preq_target *fwd)
 {
 	struct ieee80211_if_mesh *ifmsh = &sdata->u.mesh;
 	struct mesh_path *mpath = NULL;
 	u8 *target_addr, *orig_addr;
-	const u8 *da;
 	u8 target_flags, ttl, flags;
-	u32 orig_sn, target_sn, lifetime, orig_metric;
+	u32 orig_sn, target_sn, lifetime, metric = 0;
 	bool reply = false;
 	bool forward = true;
 	bool root_is_gate;
 
 	/* Update target SN, if present */
-	target_addr = PREQ_IE_TARGET_ADDR(preq_elem);
+	target_addr = PREQ_TARGET_ADDR(target);
 	orig_addr = PREQ_IE_ORIG_ADDR(preq_elem);
-	target_sn = PREQ_IE_TARGET_SN(preq_elem);
+	target_sn = PREQ_TARGET_SN(target);
 	orig_sn = PREQ_IE_ORIG_SN(preq_elem);
-	target_flags = PREQ_IE_TARGET_F(preq_elem);
-	orig_metric = metric;
+	target_flags = PREQ_TARGET_F(target);
 	/* Proactive PREQ gate announcements */
 	flags = PREQ_IE_FLAGS(preq_elem);
 	root_is_gate = !!(flags & RANN_FLAG_IS_GATE);
 
-	mhwmp_dbg(sdata, "received PREQ from %pM\n", orig_addr);
+	fwd->flags = target_flags;
+	memcpy(fwd->addr, target_addr, ETH_ALEN);
+	fwd->sn = cpu_to_le32(target_sn);
 
 	if (ether_addr_equal(target_addr, sdata->vif.addr)) {
 		mhwmp_dbg(sdata, "PREQ is for us\n");
 		forward = false;
 		reply = true;
-		metric = 0;
 		if (time_after(jiffies, ifmsh->last_sn_update +
 					net_traversal_jiffies(sdata)) ||
 		    time_before(jiffies, ifmsh->last_sn_update)) {
@@ -543,22 +690,18 @@ static void hwmp_preq_frame_process(struct ieee80211_sub_if_data *sdata,
 		}
 	} else if (is_broadcast_ether_addr(target_addr) &&
 		   (target_flags & IEEE80211_PREQ_TO_FLAG)) {
-		rcu_read_lock();
 		mpath = mesh_path_lookup(orig_addr, sdata);
 		if (mpath) {
 			if (flags & IEEE80211_PREQ_PROACTIVE_PREP_FLAG) {
 				reply = true;
 				target_addr = sdata->vif.addr;
 				target_sn = ++ifmsh->sn;
-				metric = 0;
 				ifmsh->last_sn_update = jiffies;
 			}
 			if (root_is_gate)
 				mesh_path_add_gate(mpath);
 		}
-		rcu_read_unlock();
 	} else {
-		rcu_read_lock();
 		mpath = mesh_path_lookup(target_addr, sdata);
 		if (mpath) {
 			if ((!(mpath->flags & MESH_PATH_SN_VALID)) ||
@@ -570,13 +713,13 @@ static void hwmp_preq_frame_process(struct ieee80211_sub_if_data *sdata,
 				reply = true;
 				metric = mpath->metric;
 				target_sn = mpath->sn;
-				if (target_flags & MP_F_RF)
-					target_flags |= MP_F_DO;
-				else
+				if (target_flags & MP_F_RF) {
+					fwd->flags |= MP_F_DO;
+					fwd->sn = cpu_to_le32(target_sn);
+				} else
 					forward = false;
 			}
 		}
-		rcu_read_unlock();
 	}
 
 	if (reply) {
@@ -594,41 +737,74 @@ static void hwmp_preq_frame_process(struct ieee80211_sub_if_data *sdata,
 		}
 	}
 
-	if (forward && ifmsh->mshcfg.dot11MeshForwarding) {
-		u32 preq_id;
-		u8 hopcount;
+	if (!forward)
+		return NULL;
 
-		ttl = PREQ_IE_TTL(preq_elem);
-		lifetime = PREQ_IE_LIFETIME(preq_elem);
-		if (ttl <= 1) {
-			ifmsh->mshstats.dropped_frames_ttl++;
-			return;
-		}
-		mhwmp_dbg(sdata, "forwarding the PREQ from %pM\n", orig_addr);
-		--ttl;
-		preq_id = PREQ_IE_PREQ_ID(preq_elem);
-		hopcount = PREQ_IE_HOPCOUNT(preq_elem) + 1;
-		da = (mpath && mpath->is_root) ?
-			mpath->rann_snd_addr : broadcast_addr;
-
-		if (flags & IEEE80211_PREQ_PROACTIVE_PREP_FLAG) {
-			target_addr = PREQ_IE_TARGET_ADDR(preq_elem);
-			target_sn = PREQ_IE_TARGET_SN(preq_elem);
-			metric = orig_metric;
-		}
+	return (mpath && mpath->is_root) ? mpath->rann_snd_addr :
+					   broadcast_addr;
+}
 
-		mesh_path_sel_frame_tx(MPATH_PREQ, flags, orig_addr,
-				cpu_to_le32(orig_sn), target_flags, target_addr,
-				cpu_to_le32(target_sn), da,
-				hopcount, ttl, cpu_to_le32(lifetime),
-				cpu_to_le32(metric), cpu_to_le32(preq_id),
-				sdata);
-		if (!is_multicast_ether_addr(da))
-			ifmsh->mshstats.fwded_unicast++;
-		else
-			ifmsh->mshstats.fwded_mcast++;
-		ifmsh->mshstats.fwded_frames++;
+static void hwmp_preq_frame_process(struct ieee80211_sub_if_data *sdata,
+				    struct ieee80211_mgmt *mgmt,
+				    u8 *preq_elem, u32 metric)
+{
+	struct ieee80211_if_mesh *ifmsh = &sdata->u.mesh;
+	struct hwmp_preq_target fwd[MESH_PREQ_MAX_TARGETS];
+	const u8 *da = NULL, *target_da;
+	u8 *orig_addr;
+	u8 ttl, flags, hopcount;
+	u32 orig_sn, lifetime, preq_id;
+	int i, n_targets, n_fwd = 0;
+
+	orig_addr = PREQ_IE_ORIG_ADDR(preq_elem);
+	n_targets = PREQ_IE_TARGET_COUNT(preq_elem);
+
+	mhwmp_dbg(sdata, "received PREQ from %pM (%d targets)\n",
+		  orig_addr, n_targets);
+
+	rcu_read_lock();
+	for (i = 0; i < n_targets; i++) {
+		u8 *target = PREQ_IE_TARGET(preq_elem, i);
+
+		target_da = hwmp_preq_target_process(sdata, mgmt, preq_elem,
+						     target, &fwd[n_fwd]);
+		if (!target_da)
+			continue;
+		/* targets behind different next hops can only be broadcast */
+		if (!da)
+			da = target_da;
+		else if (!ether_addr_equal(da, target_da))
+			da = broadcast_addr;
+		n_fwd++;
 	}
+
+	if (!n_fwd || !ifmsh->mshcfg.dot11MeshForwarding)
+		goto out;
+
+	ttl = PREQ_IE_TTL(preq_elem);
+	if (ttl <= 1) {
+		ifmsh->mshstats.dropped_frames_ttl++;
+		goto out;
+	}
+	mhwmp_dbg(sdata, "forwarding the PREQ from %pM\n", orig_addr);
+	--ttl;
+	flags = PREQ_IE_FLAGS(preq_elem);
+	orig_sn = PREQ_IE_ORIG_SN(preq_elem);
+	lifetime = PREQ_IE_LIFETIME(preq_elem);
+	preq_id = PREQ_IE_PREQ_ID(preq_elem);
+	hopcount = PREQ_IE_HOPCOUNT(preq_elem) + 1;
+
+	mesh_preq_frame_tx(sdata, flags, orig_addr, cpu_to_le32(orig_sn),
+			   fwd, n_fwd, da, hopcount, ttl,
+			   cpu_to_le32(lifetime), cpu_to_le32(metric),
+			   cpu_to_le32(preq_id));
+	if (!is_multicast_ether_addr(da))
+		ifmsh->mshstats.fwded_unicast++;
+	else
+		ifmsh->mshstats.fwded_mcast++;
+	ifmsh->mshstats.fwded_frames++;
+out:
+	rcu_read_unlock();
 }
 
 
@@ -876,8 +1052,10 @@ void mesh_rx_path_sel_frame(struct ieee80211_sub_if_data *sdata,
 			len - baselen, &elems);
 
 	if (elems.preq) {
-		if (elems.preq_len != 37)
-			/* Right now we support just 1 destination and no AE */
+		if (AE_F_SET(elems.preq) || elems.preq_len < PREQ_IE_LEN(1) ||
+		    elems.preq_len !=
+				PREQ_IE_LEN(PREQ_IE_TARGET_COUNT(elems.preq)))
+			/* Right now we support no AE */
 			return;
 		last_hop_metric = hwmp_route_info_get(sdata, mgmt, elems.preq,
 						      MPATH_PREQ);
@@ -905,6 +1083,21 @@ void mesh_rx_path_sel_frame(struct ieee80211_sub_if_data *sdata,
 		hwmp_rann_frame_process(sdata, mgmt, elems.rann);
 }
 
+static enum mesh_preq_prio mesh_preq_prio(struct mesh_path *mpath, u8 flags)
+{
+	if (flags & PREQ_Q_F_REFRESH)
+		return MESH_PREQ_PRIO_LOW;
+	/* retries already have frames waiting for a while */
+	if (!(flags & PREQ_Q_F_START) || mpath->is_gate || mpath->is_root)
+		return MESH_PREQ_PRIO_HIGH;
+	return MESH_PREQ_PRIO_NORMAL;
+}
+
+static const u8 *mesh_preq_da(struct mesh_path *mpath)
+{
+	return mpath->is_root ? mpath->rann_snd_addr : broadcast_addr;
+}
+
 /**
  * mesh_queue_preq - queue a PREQ to a given destination
  *
@@ -918,7 +1111,9 @@ static void mesh_queue_preq(struct mesh_path *mpath, u8 flags)
 {
 	struct ieee80211_sub_if_data *sdata = mpath->sdata;
 	struct ieee80211_if_mesh *ifmsh = &sdata->u.mesh;
+	struct mesh_hwmp_stats *stats = &ifmsh->hwmp_stats;
 	struct mesh_preq_queue *preq_node;
+	enum mesh_preq_prio prio = mesh_preq_prio(mpath, flags);
 
 	preq_node = kmalloc(sizeof(struct mesh_preq_queue), GFP_ATOMIC);
 	if (!preq_node) {
@@ -928,6 +1123,7 @@ static void mesh_queue_preq(struct mesh_path *mpath, u8 flags)
 
 	spin_lock_bh(&ifmsh->mesh_preq_queue_lock);
 	if (ifmsh->preq_queue_len == MAX_PREQ_QUEUE_LEN) {
+		stats->preq_queue_full++;
 		spin_unlock_bh(&ifmsh->mesh_preq_queue_lock);
 		kfree(preq_node);
 		if (printk_ratelimit())
@@ -949,8 +1145,11 @@ static void mesh_queue_preq(struct mesh_path *mpath, u8 flags)
 	mpath->flags |= MESH_PATH_REQ_QUEUED;
 	spin_unlock(&mpath->state_lock);
 
-	list_add_tail(&preq_node->list, &ifmsh->preq_queue.list);
+	list_add_tail(&preq_node->list, &ifmsh->preq_queue[prio]);
 	++ifmsh->preq_queue_len;
+	stats->preq_queued[prio]++;
+	if (ifmsh->preq_queue_len > stats->preq_queue_max)
+		stats->preq_queue_max = ifmsh->preq_queue_len;
 	spin_unlock_bh(&ifmsh->mesh_preq_queue_lock);
 
 	if (time_after(jiffies, ifmsh->last_preq + min_preq_int_jiff(sdata)))
@@ -967,91 +1166,145 @@ static void mesh_queue_preq(struct mesh_path *mpath, u8 flags)
 						min_preq_int_jiff(sdata));
 }
 
+/*
+ * Start or continue the discovery of @mpath as requested by a PREQ queue
+ * entry with @flags, and fill in its PREQ target. Called with the PREQ queue
+ * lock held.
+ *
+ * Returns: false if no PREQ is to be sent for @mpath after all.
+ */
+static bool mesh_preq_target_get(struct ieee80211_sub_if_data *sdata,
+				 struct mesh_path *mpath, u8 flags,
+				 struct hwmp_preq_target *target)
+{
+	struct ieee80211_if_mesh *ifmsh = &sdata->u.mesh;
+
+	spin_lock(&mpath->state_lock);
+	mpath->flags &= ~MESH_PATH_REQ_QUEUED;
+	if (flags & PREQ_Q_F_START) {
+		if (mpath->flags & MESH_PATH_RESOLVING)
+			goto skip;
+		mpath->flags &= ~MESH_PATH_RESOLVED;
+		mpath->flags |= MESH_PATH_RESOLVING;
+		mpath->discovery_retries = 0;
+		mpath->discovery_timeout = disc_timeout_jiff(sdata);
+		mpath->discovery_start = jiffies;
+		ifmsh->hwmp_stats.disc_started++;
+	} else if (!(mpath->flags & MESH_PATH_RESOLVING) ||
+			mpath->flags & MESH_PATH_RESOLVED) {
+		mpath->flags &= ~MESH_PATH_RESOLVING;
+		goto skip;
+	}
+
+	if (ifmsh->mshcfg.element_ttl == 0) {
+		ifmsh->mshstats.dropped_frames_ttl++;
+		goto skip;
+	}
+
+	if (flags & PREQ_Q_F_REFRESH)
+		target->flags = MP_F_DO;
+	else
+		target->flags = MP_F_RF;
+	memcpy(target->addr, mpath->dst, ETH_ALEN);
+	target->sn = cpu_to_le32(mpath->sn);
+	spin_unlock(&mpath->state_lock);
+	return true;
+
+skip:
+	spin_unlock(&mpath->state_lock);
+	return false;
+}
+
 /**
- * mesh_path_start_discovery - launch a path discovery from the PREQ queue
+ * mesh_path_start_discovery - launch path discoveries from the PREQ queue
  *
  * @sdata: local mesh subif
+ *
+ * Takes up to MESH_PREQ_MAX_TARGETS entries from the PREQ queue, highest
+ * priority first, and sends a single PREQ for all of them. Entries whose PREQ
+ * would go to a different DA than the first one are left for a later PREQ.
  */
 void mesh_path_start_discovery(struct ieee80211_sub_if_data *sdata)
 {
 	struct ieee80211_if_mesh *ifmsh = &sdata->u.mesh;
-	struct mesh_preq_queue *preq_node;
+	struct hwmp_preq_target targets[MESH_PREQ_MAX_TARGETS];
+	struct mesh_path *mpaths[MESH_PREQ_MAX_TARGETS];
+	struct mesh_preq_queue *preq_node, *tmp;
 	struct mesh_path *mpath;
-	u8 ttl, target_flags;
-	const u8 *da;
+	const u8 *da = NULL;
+	int prio, i, n = 0;
+	LIST_HEAD(done);
 	u32 lifetime;
 
+	rcu_read_lock();
 	spin_lock_bh(&ifmsh->mesh_preq_queue_lock);
 	if (!ifmsh->preq_queue_len ||
 		time_before(jiffies, ifmsh->last_preq +
 				min_preq_int_jiff(sdata))) {
 		spin_unlock_bh(&ifmsh->mesh_preq_queue_lock);
+		rcu_read_unlock();
 		return;
 	}
 
-	preq_node = list_first_entry(&ifmsh->preq_queue.list,
-			struct mesh_preq_queue, list);
-	list_del(&preq_node->list);
-	--ifmsh->preq_queue_len;
-	spin_unlock_bh(&ifmsh->mesh_preq_queue_lock);
-
-	rcu_read_lock();
-	mpath = mesh_path_lookup(preq_node->dst, sdata);
-	if (!mpath)
-		goto enddiscovery;
-
-	spin_lock_bh(&mpath->state_lock);
-	mpath->flags &= ~MESH_PATH_REQ_QUEUED;
-	if (preq_node->flags & PREQ_Q_F_START) {
-		if (mpath->flags & MESH_PATH_RESOLVING) {
-			spin_unlock_bh(&mpath->state_lock);
-			goto enddiscovery;
-		} else {
-			mpath->flags &= ~MESH_PATH_RESOLVED;
-			mpath->flags |= MESH_PATH_RESOLVING;
-			mpath->discovery_retries = 0;
-			mpath->discovery_timeout = disc_timeout_jiff(sdata);
+	for (prio = 0; prio < NUM_MESH_PREQ_PRIO; prio++) {
+		list_for_each_entry_safe(preq_node, tmp,
+					 &ifmsh->preq_queue[prio], list) {
+			if (n == MESH_PREQ_MAX_TARGETS)
+				break;
+
+			mpath = mesh_path_lookup(preq_node->dst, sdata);
+			if (mpath && da &&
+			    !ether_addr_equal(da, mesh_preq_da(mpath)))
+				continue;
+
+			list_move_tail(&preq_node->list, &done);
+			--ifmsh->preq_queue_len;
+			if (!mpath ||
+			    !mesh_preq_target_get(sdata, mpath,
+						  preq_node->flags,
+						  &targets[n]))
+				continue;
+
+			if (!da)
+				da = mesh_preq_da(mpath);
+			mpaths[n++] = mpath;
 		}
-	} else if (!(mpath->flags & MESH_PATH_RESOLVING) ||
-			mpath->flags & MESH_PATH_RESOLVED) {
-		mpath->flags &= ~MESH_PATH_RESOLVING;
-		spin_unlock_bh(&mpath->state_lock);
-		goto enddiscovery;
 	}
 
-	ifmsh->last_preq = jiffies;
+	if (n) {
+		ifmsh->last_preq = jiffies;
+		ifmsh->hwmp_stats.preq_frames++;
+		ifmsh->hwmp_stats.preq_targets += n;
 
-	if (time_after(jiffies, ifmsh->last_sn_update +
-				net_traversal_jiffies(sdata)) ||
-	    time_before(jiffies, ifmsh->last_sn_update)) {
-		++ifmsh->sn;
-		sdata->u.mesh.last_sn_update = jiffies;
-	}
-	lifetime = default_lifetime(sdata);
-	ttl = sdata->u.mesh.mshcfg.element_ttl;
-	if (ttl == 0) {
-		sdata->u.mesh.mshstats.dropped_frames_ttl++;
-		spin_unlock_bh(&mpath->state_lock);
-		goto enddiscovery;
+		if (time_after(jiffies, ifmsh->last_sn_update +
+					net_traversal_jiffies(sdata)) ||
+		    time_before(jiffies, ifmsh->last_sn_update)) {
+			++ifmsh->sn;
+			ifmsh->last_sn_update = jiffies;
+		}
 	}
 
-	if (preq_node->flags & PREQ_Q_F_REFRESH)
-		target_flags = MP_F_DO;
-	else
-		target_flags = MP_F_RF;
+	/* whatever is left goes out once the PREQ interval has passed */
+	if (ifmsh->preq_queue_len)
+		mod_timer(&ifmsh->mesh_path_timer, ifmsh->last_preq +
+						min_preq_int_jiff(sdata) + 1);
+	spin_unlock_bh(&ifmsh->mesh_preq_queue_lock);
 
-	spin_unlock_bh(&mpath->state_lock);
-	da = (mpath->is_root) ? mpath->rann_snd_addr : broadcast_addr;
-	mesh_path_sel_frame_tx(MPATH_PREQ, 0, sdata->vif.addr,
-			cpu_to_le32(ifmsh->sn), target_flags, mpath->dst,
-			cpu_to_le32(mpath->sn), da, 0,
-			ttl, cpu_to_le32(lifetime), 0,
-			cpu_to_le32(ifmsh->preq_id++), sdata);
-	mod_timer(&mpath->timer, jiffies + mpath->discovery_timeout);
-
-enddiscovery:
+	if (n) {
+		lifetime = default_lifetime(sdata);
+		mesh_preq_frame_tx(sdata, 0, sdata->vif.addr,
+				   cpu_to_le32(ifmsh->sn), targets, n, da, 0,
+				   ifmsh->mshcfg.element_ttl,
+				   cpu_to_le32(lifetime), 0,
+				   cpu_to_le32(ifmsh->preq_id++));
+		for (i = 0; i < n; i++)
+			mod_timer(&mpaths[i]->timer,
+				  jiffies + mpaths[i]->discovery_timeout);
+	}
 	rcu_read_unlock();
-	kfree(preq_node);
+
+	list_for_each_entry_safe(preq_node, tmp, &done, list)
+		kfree(preq_node);
 }
 
 /**
@@ -1179,6 +1432,9 @@ void mesh_path_timer(unsigned long data)
 		mpath->flags = 0;
 		mpath->exp_time = jiffies;
 		spin_unlock_bh(&mpath->state_lock);
+		spin_lock_bh(&sdata->u.mesh.mesh_preq_queue_lock);
+		sdata->u.mesh.hwmp_stats.disc_failed++;
+		spin_unlock_bh(&sdata->u.mesh.mesh_preq_queue_lock);
 		if (!mpath->is_gate && mesh_gate_num(sdata) > 0) {
 			ret = mesh_path_send_to_gates(mpath);
 			if (ret)
@@ -1224,3 +1480,61 @@ mesh_path_tx_root_frame(struct ieee80211_sub_if_data *sdata)
 		return;
 	}
 }
+
+int mesh_hwmp_stats_format(struct ieee80211_sub_if_data *sdata,
+			   char *buf, int buflen)
+{
+	static const char * const prio_names[NUM_MESH_PREQ_PRIO] = {
+		[MESH_PREQ_PRIO_HIGH] = "high",
+		[MESH_PREQ_PRIO_NORMAL] = "normal",
+		[MESH_PREQ_PRIO_LOW] = "low",
+	};
+	struct ieee80211_if_mesh *ifmsh = &sdata->u.mesh;
+	struct mesh_hwmp_stats stats;
+	int depth[NUM_MESH_PREQ_PRIO] = {};
+	struct mesh_preq_queue *preq_node;
+	int len = 0, prio, i;
+
+	spin_lock_bh(&ifmsh->mesh_preq_queue_lock);
+	stats = ifmsh->hwmp_stats;
+	for (prio = 0; prio < NUM_MESH_PREQ_PRIO; prio++)
+		list_for_each_entry(preq_node, &ifmsh->preq_queue[prio], list)
+			depth[prio]++;
+	spin_unlock_bh(&ifmsh->mesh_preq_queue_lock);
+
+	for (prio = 0; prio < NUM_MESH_PREQ_PRIO; prio++)
+		len += scnprintf(buf + len, buflen - len,
+				 "preq queue %s: depth %d queued %u\n",
+				 prio_names[prio], depth[prio],
+				 stats.preq_queued[prio]);
+	len += scnprintf(buf + len, buflen - len,
+			 "preq queue max depth: %u\n"
+			 "preq queue full drops: %u\n"
+			 "preq frames: %u targets: %u\n"
+			 "discoveries started: %u resolved: %u failed: %u\n",
+			 stats.preq_queue_max, stats.preq_queue_full,
+			 stats.preq_frames, stats.preq_targets,
+			 stats.disc_started, stats.disc_resolved,
+			 stats.disc_failed);
+	if (stats.disc_resolved)
+		len += scnprintf(buf + len, buflen - len,
+				 "discovery latency: avg %llu ms max %u ms\n",
+				 (unsigned long long)
+					div_u64(stats.disc_latency_sum,
+						stats.disc_resolved),
+				 stats.disc_latency_max);
+	for (i = 0; i < MESH_DISC_HIST_BUCKETS; i++) {
+		if (i == 0)
+			len += scnprintf(buf + len, buflen - len,
+					 "  <%lu ms",
+					 2UL << MESH_DISC_HIST_SHIFT);
+		else
+			len += scnprintf(buf + len, buflen - len,
+					 " >=%lu ms",
+					 1UL << (i + MESH_DISC_HIST_SHIFT));
+		len += scnprintf(buf + len, buflen - len, ": %u\n",
+				 stats.disc_latency_hist[i]);
+	}
+
+	return len;
+}
@@ -13,13 +13,27 @@
 #include <linux/slab.h>
 #include <linux/spinlock.h>
 #include <linux/string.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/percpu.h>
+#include <asm/unaligned.h>
 #include <net/mac80211.h>
 #include "wme.h"
 #include "ieee80211_i.h"
 #include "mesh.h"
 
 /* There will be initially 2^INIT_PATHS_SIZE_ORDER buckets */
-#define INIT_PATHS_SIZE_ORDER	2
+#define INIT_PATHS_SIZE_ORDER	4
+
+/*
+ * Tables never shrink below their initial size, so the lock picked by
+ * the low bits of the hash covers all buckets a path can be in while
+ * the table grows.
+ */
+#define MESH_TBL_NUM_LOCKS	(1 << INIT_PATHS_SIZE_ORDER)
+
+/* Number of buckets moved to the grown table per mesh work run */
+#define MESH_TBL_REHASH_BATCH	16
 
 /* Keep the mean chain length below this constant */
 #define MEAN_CHAIN_LEN		2
@@ -28,40 +42,23 @@
 				time_after(jiffies, mpath->exp_time) && \
 				!(mpath->flags & MESH_PATH_FIXED))
 
+/* entry on the list of known mesh gates */
 struct mpath_node {
 	struct hlist_node list;
 	struct rcu_head rcu;
-	/* This indirection allows two different tables to point to the same
-	 * mesh_path structure, useful when resizing
-	 */
 	struct mesh_path *mpath;
 };
 
-static struct mesh_table __rcu *mesh_paths;
-static struct mesh_table __rcu *mpp_paths; /* Store paths for MPP&MAP */
-
-int mesh_paths_generation;
-
-/* This lock will have the grow table function as writer and add / delete nodes
- * as readers. RCU provides sufficient protection only when reading the table
- * (i.e. doing lookups).  Adding or adding or removing nodes requires we take
- * the read lock or we risk operating on an old table.  The write lock is only
- * needed when modifying the number of buckets a table.
- */
-static DEFINE_RWLOCK(pathtbl_resize_lock);
-
-
-static inline struct mesh_table *resize_dereference_mesh_paths(void)
+static inline struct mesh_path *mpath_from_hnode(struct hlist_node *n,
+						 u8 link)
 {
-	return rcu_dereference_protected(mesh_paths,
-		lockdep_is_held(&pathtbl_resize_lock));
+	return container_of(n - link, struct mesh_path, hnode[0]);
 }
 
-static inline struct mesh_table *resize_dereference_mpp_paths(void)
-{
-	return rcu_dereference_protected(mpp_paths,
-		lockdep_is_held(&pathtbl_resize_lock));
-}
+#define hlist_for_each_mpath_rcu(mpath, pos, head, link)		\
+	for (pos = rcu_dereference_raw(hlist_first_rcu(head));		\
+	     pos && ({ mpath = mpath_from_hnode(pos, link); 1; });	\
+	     pos = rcu_dereference_raw(hlist_next_rcu(pos)))
 
 /*
  * CAREFUL -- "tbl" must not be an expression,
@@ -69,44 +66,46 @@ static inline struct mesh_table *resize_dereference_mpp_paths(void)
  * it's used twice. So it is illegal to do
  *	for_each_mesh_entry(rcu_dereference(...), ...)
  */
-#define for_each_mesh_entry(tbl, p, node, i) \
+#define for_each_mesh_entry(tbl, p, mpath, i) \
 	for (i = 0; i <= tbl->hash_mask; i++) \
-		hlist_for_each_entry_rcu(node, p, &tbl->hash_buckets[i], list)
+		hlist_for_each_mpath_rcu(mpath, p, &tbl->hash_buckets[i], \
+					 tbl->link)
 
+/* visits a table and, while it grows, the table it grows into */
+#define for_each_mesh_table(head, tbl) \
+	for (tbl = rcu_dereference(head); tbl; \
+	     tbl = rcu_dereference(tbl->future_tbl))
 
-static struct mesh_table *mesh_table_alloc(int size_order)
+/*
+ * Only the mesh work (and interface setup/teardown) changes the table
+ * pointers of an interface and starts or finishes growing a table.
+ */
+static inline struct mesh_table *
+mesh_table_dereference(struct mesh_table __rcu *p)
+{
+	return rcu_dereference_protected(p, 1);
+}
+
+
+static struct mesh_table *mesh_table_alloc(int size_order, gfp_t gfp)
 {
-	int i;
 	struct mesh_table *newtbl;
 
-	newtbl = kmalloc(sizeof(struct mesh_table), GFP_ATOMIC);
+	newtbl = kzalloc(sizeof(struct mesh_table), gfp);
 	if (!newtbl)
 		return NULL;
 
 	newtbl->hash_buckets = kzalloc(sizeof(struct hlist_head) *
-			(1 << size_order), GFP_ATOMIC);
+			(1 << size_order), gfp);
 
 	if (!newtbl->hash_buckets) {
 		kfree(newtbl);
 		return NULL;
 	}
 
-	newtbl->hashwlock = kmalloc(sizeof(spinlock_t) *
-			(1 << size_order), GFP_ATOMIC);
-	if (!newtbl->hashwlock) {
-		kfree(newtbl->hash_buckets);
-		kfree(newtbl);
-		return NULL;
-	}
-
 	newtbl->size_order = size_order;
 	newtbl->hash_mask = (1 << size_order) - 1;
 	atomic_set(&newtbl->entries,  0);
-	get_random_bytes(&newtbl->hash_rnd,
-			sizeof(newtbl->hash_rnd));
-	for (i = 0; i <= newtbl->hash_mask; i++)
-		spin_lock_init(&newtbl->hashwlock[i]);
-	spin_lock_init(&newtbl->gates_lock);
 
 	return newtbl;
 }
@@ -114,81 +113,120 @@ static struct mesh_table *mesh_table_alloc(int size_order)
 static void __mesh_table_free(struct mesh_table *tbl)
 {
 	kfree(tbl->hash_buckets);
-	kfree(tbl->hashwlock);
 	kfree(tbl);
 }
 
-static void mesh_table_free(struct mesh_table *tbl, bool free_leafs)
+static struct mesh_table *mesh_table_create(void)
 {
-	struct hlist_head *mesh_hash;
-	struct hlist_node *p, *q;
-	struct mpath_node *gate;
+	struct mesh_table *tbl;
 	int i;
 
-	mesh_hash = tbl->hash_buckets;
-	for (i = 0; i <= tbl->hash_mask; i++) {
-		spin_lock_bh(&tbl->hashwlock[i]);
-		hlist_for_each_safe(p, q, &mesh_hash[i]) {
-			tbl->free_node(p, free_leafs);
-			atomic_dec(&tbl->entries);
-		}
-		spin_unlock_bh(&tbl->hashwlock[i]);
-	}
-	if (free_leafs) {
-		spin_lock_bh(&tbl->gates_lock);
-		hlist_for_each_entry_safe(gate, p, q,
-					 tbl->known_gates, list) {
-			hlist_del(&gate->list);
-			kfree(gate);
-		}
-		kfree(tbl->known_gates);
-		spin_unlock_bh(&tbl->gates_lock);
+	tbl = mesh_table_alloc(INIT_PATHS_SIZE_ORDER, GFP_KERNEL);
+	if (!tbl)
+		return NULL;
+
+	tbl->hashwlock = kmalloc(sizeof(spinlock_t) * MESH_TBL_NUM_LOCKS,
+				 GFP_KERNEL);
+	if (!tbl->hashwlock) {
+		__mesh_table_free(tbl);
+		return NULL;
 	}
+	for (i = 0; i < MESH_TBL_NUM_LOCKS; i++)
+		spin_lock_init(&tbl->hashwlock[i]);
 
-	__mesh_table_free(tbl);
+	get_random_bytes(&tbl->hash_rnd, sizeof(tbl->hash_rnd));
+	tbl->mean_chain_len = MEAN_CHAIN_LEN;
+
+	return tbl;
+}
+
+static void mesh_path_free(struct mesh_path *mpath)
+{
+	del_timer_sync(&mpath->timer);
+	kfree(mpath);
 }
 
-static int mesh_table_grow(struct mesh_table *oldtbl,
-			   struct mesh_table *newtbl)
+/* frees a table, the table it was growing into and all paths in them */
+static void mesh_table_destroy(struct mesh_table *tbl)
 {
-	struct hlist_head *oldhash;
+	struct mesh_table *ftbl;
 	struct hlist_node *p, *q;
+	spinlock_t *hashwlock = tbl->hashwlock;
 	int i;
 
-	if (atomic_read(&oldtbl->entries)
-			< oldtbl->mean_chain_len * (oldtbl->hash_mask + 1))
-		return -EAGAIN;
+	while (tbl) {
+		ftbl = mesh_table_dereference(tbl->future_tbl);
+		for (i = 0; i <= tbl->hash_mask; i++) {
+			hlist_for_each_safe(p, q, &tbl->hash_buckets[i]) {
+				hlist_del(p);
+				mesh_path_free(mpath_from_hnode(p, tbl->link));
+			}
+		}
+		__mesh_table_free(tbl);
+		tbl = ftbl;
+	}
 
-	newtbl->free_node = oldtbl->free_node;
-	newtbl->mean_chain_len = oldtbl->mean_chain_len;
-	newtbl->copy_node = oldtbl->copy_node;
-	newtbl->known_gates = oldtbl->known_gates;
-	atomic_set(&newtbl->entries, atomic_read(&oldtbl->entries));
+	kfree(hashwlock);
+}
 
-	oldhash = oldtbl->hash_buckets;
-	for (i = 0; i <= oldtbl->hash_mask; i++)
-		hlist_for_each(p, &oldhash[i])
-			if (oldtbl->copy_node(p, newtbl) < 0)
-				goto errcopy;
+static u32 mesh_table_hash(const u8 *addr, struct mesh_table *tbl)
+{
+	return jhash_2words(get_unaligned((const u32 *)addr),
+			    get_unaligned((const u16 *)(addr + 4)),
+			    tbl->hash_rnd);
+}
 
-	return 0;
+static inline struct hlist_head *mesh_table_bucket(struct mesh_table *tbl,
+						   u32 hash)
+{
+	return &tbl->hash_buckets[hash & tbl->hash_mask];
+}
 
-errcopy:
-	for (i = 0; i <= newtbl->hash_mask; i++) {
-		hlist_for_each_safe(p, q, &newtbl->hash_buckets[i])
-			oldtbl->free_node(p, 0);
-	}
-	return -ENOMEM;
+static inline spinlock_t *mesh_table_lock(struct mesh_table *tbl, u32 hash)
+{
+	return &tbl->hashwlock[hash & (MESH_TBL_NUM_LOCKS - 1)];
+}
+
+/* the table new entries must be added to */
+static struct mesh_table *mesh_table_last(struct mesh_table *tbl)
+{
+	struct mesh_table *ftbl;
+
+	while ((ftbl = rcu_dereference(tbl->future_tbl)))
+		tbl = ftbl;
+	return tbl;
 }
 
-static u32 mesh_table_hash(u8 *addr, struct ieee80211_sub_if_data *sdata,
-			   struct mesh_table *tbl)
+#ifdef CONFIG_MAC80211_DEBUGFS
+static inline u64 mesh_tbl_clock(void)
+{
+	return ktime_to_ns(ktime_get());
+}
+
+static void mesh_tbl_account(struct ieee80211_sub_if_data *sdata,
+			     enum mesh_tbl_op op, u64 start)
+{
+	struct mesh_tbl_stats __percpu *stats = sdata->u.mesh.tbl_stats;
+	u64 delta = mesh_tbl_clock() - start;
+	int idx = delta ? ilog2(delta) : 0;
+
+	if (!stats)
+		return;
+
+	idx = clamp(idx - MESH_TBL_HIST_SHIFT, 0, MESH_TBL_HIST_BUCKETS - 1);
+	this_cpu_inc(stats->hist[op][idx]);
+}
+#else
+static inline u64 mesh_tbl_clock(void)
 {
-	/* Use last four bytes of hw addr and interface index as hash index */
-	return jhash_2words(*(u32 *)(addr+2), sdata->dev->ifindex, tbl->hash_rnd)
-		& tbl->hash_mask;
+	return 0;
 }
 
+static inline void mesh_tbl_account(struct ieee80211_sub_if_data *sdata,
+				    enum mesh_tbl_op op, u64 start)
+{
+}
+#endif
 
 /**
  *
@@ -329,19 +367,17 @@ static void mesh_path_move_to_queue(struct mesh_path *gate_mpath,
 }
 
 
-static struct mesh_path *mpath_lookup(struct mesh_table *tbl, u8 *dst,
-					  struct ieee80211_sub_if_data *sdata)
+static struct mesh_path *mpath_lookup(struct mesh_table *tbl, const u8 *dst)
 {
 	struct mesh_path *mpath;
 	struct hlist_node *n;
-	struct hlist_head *bucket;
-	struct mpath_node *node;
+	u32 hash = mesh_table_hash(dst, tbl);
 
-	bucket = &tbl->hash_buckets[mesh_table_hash(dst, sdata, tbl)];
-	hlist_for_each_entry_rcu(node, n, bucket, list) {
-		mpath = node->mpath;
-		if (mpath->sdata == sdata &&
-		    ether_addr_equal(dst, mpath->dst)) {
+	for (; tbl; tbl = rcu_dereference(tbl->future_tbl)) {
+		hlist_for_each_mpath_rcu(mpath, n, mesh_table_bucket(tbl, hash),
+					 tbl->link) {
+			if (!ether_addr_equal(dst, mpath->dst))
+				continue;
 			if (MPATH_EXPIRED(mpath)) {
 				spin_lock_bh(&mpath->state_lock);
 				mpath->flags &= ~MESH_PATH_ACTIVE;
@@ -364,19 +400,29 @@ static struct mesh_path *mpath_lookup(struct mesh_table *tbl, u8 *dst,
  */
 struct mesh_path *mesh_path_lookup(u8 *dst, struct ieee80211_sub_if_data *sdata)
 {
-	return mpath_lookup(rcu_dereference(mesh_paths), dst, sdata);
+	struct mesh_path *mpath;
+	u64 start = mesh_tbl_clock();
+
+	mpath = mpath_lookup(rcu_dereference(sdata->u.mesh.mesh_paths), dst);
+	mesh_tbl_account(sdata, MESH_TBL_LOOKUP, start);
+	return mpath;
 }
 
 struct mesh_path *mpp_path_lookup(u8 *dst, struct ieee80211_sub_if_data *sdata)
 {
-	return mpath_lookup(rcu_dereference(mpp_paths), dst, sdata);
+	struct mesh_path *mpath;
+	u64 start = mesh_tbl_clock();
+
+	mpath = mpath_lookup(rcu_dereference(sdata->u.mesh.mpp_paths), dst);
+	mesh_tbl_account(sdata, MESH_TBL_LOOKUP, start);
+	return mpath;
 }
 
 
 /**
  * mesh_path_lookup_by_idx - look up a path in the mesh path table by its index
  * @idx: index
- * @sdata: local subif, or NULL for all entries
+ * @sdata: local subif
  *
  * Returns: pointer to the mesh path structure, or NULL if not found.
  *
@@ -384,43 +430,99 @@ struct mesh_path *mpp_path_lookup(u8 *dst, struct ieee80211_sub_if_data *sdata)
  */
 struct mesh_path *mesh_path_lookup_by_idx(int idx, struct ieee80211_sub_if_data *sdata)
 {
-	struct mesh_table *tbl = rcu_dereference(mesh_paths);
-	struct mpath_node *node;
+	struct mesh_table *tbl;
+	struct mesh_path *mpath;
 	struct hlist_node *p;
 	int i;
 	int j = 0;
 
-	for_each_mesh_entry(tbl, p, node, i) {
-		if (sdata && node->mpath->sdata != sdata)
-			continue;
-		if (j++ == idx) {
-			if (MPATH_EXPIRED(node->mpath)) {
-				spin_lock_bh(&node->mpath->state_lock);
-				node->mpath->flags &= ~MESH_PATH_ACTIVE;
-				spin_unlock_bh(&node->mpath->state_lock);
+	for_each_mesh_table(sdata->u.mesh.mesh_paths, tbl) {
+		for_each_mesh_entry(tbl, p, mpath, i) {
+			if (j++ != idx)
+				continue;
+			if (MPATH_EXPIRED(mpath)) {
+				spin_lock_bh(&mpath->state_lock);
+				mpath->flags &= ~MESH_PATH_ACTIVE;
+				spin_unlock_bh(&mpath->state_lock);
 			}
-			return node->mpath;
+			return mpath;
 		}
 	}
 
 	return NULL;
 }
 
+/**
+ * mesh_path_lookup_next - look up the path following a dump cursor
+ * @cursor: position of the dump
+ * @sdata: local subif
+ *
+ * Continues right after the path the cursor points to as long as the path
+ * table didn't change, otherwise counts @cursor->idx paths from the start.
+ *
+ * Returns: pointer to the mesh path structure, or NULL if there are no
+ * more paths.
+ *
+ * Locking: must be called within a read rcu section.
+ */
+struct mesh_path *
+mesh_path_lookup_next(const struct cfg80211_dump_cursor *cursor,
+		      struct ieee80211_sub_if_data *sdata)
+{
+	struct mesh_table *tbl;
+	struct mesh_path *mpath;
+	struct hlist_node *p;
+	unsigned int i;
+
+	if (!cursor->idx ||
+	    cursor->generation != sdata->u.mesh.mesh_paths_generation)
+		return mesh_path_lookup_by_idx(cursor->idx, sdata);
+
+	for_each_mesh_table(sdata->u.mesh.mesh_paths, tbl) {
+		i = mesh_table_hash(cursor->addr, tbl) & tbl->hash_mask;
+		hlist_for_each_mpath_rcu(mpath, p, &tbl->hash_buckets[i],
+					 tbl->link)
+			if (ether_addr_equal(cursor->addr, mpath->dst))
+				goto found;
+	}
+
+	return mesh_path_lookup_by_idx(cursor->idx, sdata);
+
+ found:
+	/* the rest of the bucket, then the following buckets and tables */
+	p = rcu_dereference_raw(hlist_next_rcu(p));
+	while (!p) {
+		if (++i > tbl->hash_mask) {
+			tbl = rcu_dereference(tbl->future_tbl);
+			if (!tbl)
+				return NULL;
+			i = 0;
+		}
+		p = rcu_dereference_raw(hlist_first_rcu(&tbl->hash_buckets[i]));
+	}
+
+	mpath = mpath_from_hnode(p, tbl->link);
+	if (MPATH_EXPIRED(mpath)) {
+		spin_lock_bh(&mpath->state_lock);
+		mpath->flags &= ~MESH_PATH_ACTIVE;
+		spin_unlock_bh(&mpath->state_lock);
+	}
+	return mpath;
+}
+
 /**
  * mesh_path_add_gate - add the given mpath to a mesh gate to our path table
  * @mpath: gate path to add to table
  */
 int mesh_path_add_gate(struct mesh_path *mpath)
 {
-	struct mesh_table *tbl;
+	struct ieee80211_if_mesh *ifmsh = &mpath->sdata->u.mesh;
 	struct mpath_node *gate, *new_gate;
 	struct hlist_node *n;
 	int err;
 
 	rcu_read_lock();
-	tbl = rcu_dereference(mesh_paths);
-
-	hlist_for_each_entry_rcu(gate, n, tbl->known_gates, list)
+	hlist_for_each_entry_rcu(gate, n, &ifmsh->known_gates, list)
 		if (gate->mpath == mpath) {
 			err = -EEXIST;
 			goto err_rcu;
@@ -433,15 +535,15 @@ int mesh_path_add_gate(struct mesh_path *mpath)
 	}
 
 	mpath->is_gate = true;
-	mpath->sdata->u.mesh.num_gates++;
+	ifmsh->num_gates++;
 	new_gate->mpath = mpath;
-	spin_lock_bh(&tbl->gates_lock);
-	hlist_add_head_rcu(&new_gate->list, tbl->known_gates);
-	spin_unlock_bh(&tbl->gates_lock);
+	spin_lock_bh(&ifmsh->gates_lock);
+	hlist_add_head_rcu(&new_gate->list, &ifmsh->known_gates);
+	spin_unlock_bh(&ifmsh->gates_lock);
 	rcu_read_unlock();
 	mpath_dbg(mpath->sdata,
 		  "Mesh path: Recorded new gate: %pM. %d known gates\n",
-		  mpath->dst, mpath->sdata->u.mesh.num_gates);
+		  mpath->dst, ifmsh->num_gates);
 	return 0;
 err_rcu:
 	rcu_read_unlock();
@@ -450,29 +552,30 @@ err_rcu:
 
 /**
  * mesh_gate_del - remove a mesh gate from the list of known gates
- * @tbl: table which holds our list of known gates
+ * @ifmsh: mesh interface which holds our list of known gates
  * @mpath: gate mpath
  *
  * Returns: 0 on success
  *
  * Locking: must be called inside rcu_read_lock() section
  */
-static int mesh_gate_del(struct mesh_table *tbl, struct mesh_path *mpath)
+static int mesh_gate_del(struct ieee80211_if_mesh *ifmsh,
+			 struct mesh_path *mpath)
 {
 	struct mpath_node *gate;
 	struct hlist_node *p, *q;
 
-	hlist_for_each_entry_safe(gate, p, q, tbl->known_gates, list)
+	hlist_for_each_entry_safe(gate, p, q, &ifmsh->known_gates, list)
 		if (gate->mpath == mpath) {
-			spin_lock_bh(&tbl->gates_lock);
+			spin_lock_bh(&ifmsh->gates_lock);
 			hlist_del_rcu(&gate->list);
 			kfree_rcu(gate, rcu);
-			spin_unlock_bh(&tbl->gates_lock);
-			mpath->sdata->u.mesh.num_gates--;
+			spin_unlock_bh(&ifmsh->gates_lock);
+			ifmsh->num_gates--;
 			mpath->is_gate = false;
 			mpath_dbg(mpath->sdata,
 				  "Mesh path: Deleted gate: %pM. %d known gates\n",
-				  mpath->dst, mpath->sdata->u.mesh.num_gates);
+				  mpath->dst, ifmsh->num_gates);
 			break;
 		}
 
@@ -488,6 +591,51 @@ int mesh_gate_num(struct ieee80211_sub_if_data *sdata)
 	return sdata->u.mesh.num_gates;
 }
 
+/**
+ * mesh_table_add - add a path to a path table
+ * @tbl: current table of the path table, as read under RCU
+ * @new_mpath: the path to add
+ * @grow: set to true when the table needs to grow
+ *
+ * Returns: 0 on success, -EEXIST if there already is a path to the
+ * same destination
+ *
+ * Locking: must be called within a read rcu section.
+ */
+static int mesh_table_add(struct mesh_table *tbl, struct mesh_path *new_mpath,
+			  bool *grow)
+{
+	struct mesh_table *t;
+	struct mesh_path *mpath;
+	struct hlist_node *n;
+	spinlock_t *lock;
+	u32 hash;
+
+	hash = mesh_table_hash(new_mpath->dst, tbl);
+	lock = mesh_table_lock(tbl, hash);
+
+	spin_lock_bh(lock);
+
+	for (t = tbl; t; t = rcu_dereference(t->future_tbl))
+		hlist_for_each_mpath_rcu(mpath, n, mesh_table_bucket(t, hash),
+					 t->link)
+			if (ether_addr_equal(new_mpath->dst, mpath->dst)) {
+				spin_unlock_bh(lock);
+				return -EEXIST;
+			}
+
+	/* while growing, new paths go straight into the new table */
+	t = mesh_table_last(tbl);
+	new_mpath->hlink = t->link;
+	hlist_add_head_rcu(&new_mpath->hnode[t->link],
+			   mesh_table_bucket(t, hash));
+	*grow = atomic_inc_return(&t->entries) >=
+		t->mean_chain_len * (t->hash_mask + 1);
+
+	spin_unlock_bh(lock);
+	return 0;
+}
+
 /**
  * mesh_path_add - allocate and add a new path to the mesh path table
  * @addr: destination address of the path (ETH_ALEN length)
@@ -501,14 +649,10 @@ int mesh_path_add(u8 *dst, struct ieee80211_sub_if_data *sdata)
 {
 	struct ieee80211_if_mesh *ifmsh = &sdata->u.mesh;
 	struct ieee80211_local *local = sdata->local;
-	struct mesh_table *tbl;
-	struct mesh_path *mpath, *new_mpath;
-	struct mpath_node *node, *new_node;
-	struct hlist_head *bucket;
-	struct hlist_node *n;
-	int grow = 0;
+	struct mesh_path *new_mpath;
+	bool grow = false;
 	int err = 0;
-	u32 hash_idx;
+	u64 start;
 
 	if (ether_addr_equal(dst, sdata->vif.addr))
 		/* never add ourselves as neighbours */
@@ -525,48 +669,29 @@ int mesh_path_add(u8 *dst, struct ieee80211_sub_if_data *sdata)
 	if (!new_mpath)
 		goto err_path_alloc;
 
-	new_node = kmalloc(sizeof(struct mpath_node), GFP_ATOMIC);
-	if (!new_node)
-		goto err_node_alloc;
-
-	read_lock_bh(&pathtbl_resize_lock);
 	memcpy(new_mpath->dst, dst, ETH_ALEN);
 	memset(new_mpath->rann_snd_addr, 0xff, ETH_ALEN);
 	new_mpath->is_root = false;
 	new_mpath->sdata = sdata;
 	new_mpath->flags = 0;
 	skb_queue_head_init(&new_mpath->frame_queue);
-	new_node->mpath = new_mpath;
 	new_mpath->timer.data = (unsigned long) new_mpath;
 	new_mpath->timer.function = mesh_path_timer;
 	new_mpath->exp_time = jiffies;
 	spin_lock_init(&new_mpath->state_lock);
 	init_timer(&new_mpath->timer);
 
-	tbl = resize_dereference_mesh_paths();
-
-	hash_idx = mesh_table_hash(dst, sdata, tbl);
-	bucket = &tbl->hash_buckets[hash_idx];
-
-	spin_lock(&tbl->hashwlock[hash_idx]);
-
-	err = -EEXIST;
-	hlist_for_each_entry(node, n, bucket, list) {
-		mpath = node->mpath;
-		if (mpath->sdata == sdata &&
-		    ether_addr_equal(dst, mpath->dst))
-			goto err_exists;
-	}
-
-	hlist_add_head_rcu(&new_node->list, bucket);
-	if (atomic_inc_return(&tbl->entries) >=
-	    tbl->mean_chain_len * (tbl->hash_mask + 1))
-		grow = 1;
+	start = mesh_tbl_clock();
+	rcu_read_lock();
+	err = mesh_table_add(rcu_dereference(ifmsh->mesh_paths), new_mpath,
+			     &grow);
+	rcu_read_unlock();
+	mesh_tbl_account(sdata, MESH_TBL_INSERT, start);
+	if (err)
+		goto err_exists;
 
-	mesh_paths_generation++;
+	ifmsh->mesh_paths_generation++;
 
-	spin_unlock(&tbl->hashwlock[hash_idx]);
-	read_unlock_bh(&pathtbl_resize_lock);
 	if (grow) {
 		set_bit(MESH_WORK_GROW_MPATH_TABLE,  &ifmsh->wrkq_flags);
 		ieee80211_queue_work(&local->hw, &sdata->work);
@@ -574,76 +699,115 @@ int mesh_path_add(u8 *dst, struct ieee80211_sub_if_data *sdata)
 	return 0;
 
 err_exists:
-	spin_unlock(&tbl->hashwlock[hash_idx]);
-	read_unlock_bh(&pathtbl_resize_lock);
-	kfree(new_node);
-err_node_alloc:
 	kfree(new_mpath);
 err_path_alloc:
 	atomic_dec(&sdata->u.mesh.mpaths);
 	return err;
 }
 
-static void mesh_table_free_rcu(struct rcu_head *rcu)
+/*
+ * Starts growing the table if it is too full, then moves the next batch
+ * of buckets to the new table. Once all have been moved the new table
+ * becomes the current one; the old one is freed after all readers that
+ * might still be walking it are gone.
+ *
+ * Returns: true if there are buckets left to move
+ */
+static bool mesh_table_grow(struct mesh_table __rcu **tblp)
 {
-	struct mesh_table *tbl = container_of(rcu, struct mesh_table, rcu_head);
+	struct mesh_table *tbl = mesh_table_dereference(*tblp);
+	struct mesh_table *newtbl;
+	struct hlist_head *bucket;
+	struct hlist_node *n;
+	struct mesh_path *mpath;
+	unsigned int end;
+	spinlock_t *lock;
+	u32 hash;
+
+	newtbl = mesh_table_dereference(tbl->future_tbl);
+	if (!newtbl) {
+		if (atomic_read(&tbl->entries)
+				< tbl->mean_chain_len * (tbl->hash_mask + 1))
+			return false;
+
+		newtbl = mesh_table_alloc(tbl->size_order + 1, GFP_KERNEL);
+		if (!newtbl)
+			return false;
+		newtbl->hashwlock = tbl->hashwlock;
+		newtbl->hash_rnd = tbl->hash_rnd;
+		newtbl->mean_chain_len = tbl->mean_chain_len;
+		newtbl->link = !tbl->link;
+		tbl->rehash_idx = 0;
+		rcu_assign_pointer(tbl->future_tbl, newtbl);
+	}
+
+	end = min(tbl->rehash_idx + MESH_TBL_REHASH_BATCH, tbl->hash_mask + 1);
+	for (; tbl->rehash_idx < end; tbl->rehash_idx++) {
+		bucket = &tbl->hash_buckets[tbl->rehash_idx];
+		lock = mesh_table_lock(tbl, tbl->rehash_idx);
+
+		spin_lock_bh(lock);
+		while ((n = bucket->first)) {
+			mpath = mpath_from_hnode(n, tbl->link);
+			hash = mesh_table_hash(mpath->dst, tbl);
+			/*
+			 * Link into the new table before unlinking from the
+			 * old one, lookups check the new table last.
+			 */
+			hlist_add_head_rcu(&mpath->hnode[newtbl->link],
+					   mesh_table_bucket(newtbl, hash));
+			mpath->hlink = newtbl->link;
+			hlist_del_rcu(n);
+			atomic_dec(&tbl->entries);
+			atomic_inc(&newtbl->entries);
+		}
+		spin_unlock_bh(lock);
+	}
 
-	mesh_table_free(tbl, false);
+	if (tbl->rehash_idx <= tbl->hash_mask)
+		return true;
+
+	rcu_assign_pointer(*tblp, newtbl);
+	synchronize_rcu();
+	__mesh_table_free(tbl);
+
+	/* it may have filled up again while we were moving entries */
+	return atomic_read(&newtbl->entries) >=
+		newtbl->mean_chain_len * (newtbl->hash_mask + 1);
 }
 
-void mesh_mpath_table_grow(void)
+void mesh_mpath_table_grow(struct ieee80211_sub_if_data *sdata)
 {
-	struct mesh_table *oldtbl, *newtbl;
-
-	write_lock_bh(&pathtbl_resize_lock);
-	oldtbl = resize_dereference_mesh_paths();
-	newtbl = mesh_table_alloc(oldtbl->size_order + 1);
-	if (!newtbl)
-		goto out;
-	if (mesh_table_grow(oldtbl, newtbl) < 0) {
-		__mesh_table_free(newtbl);
-		goto out;
-	}
-	rcu_assign_pointer(mesh_paths, newtbl);
+	struct ieee80211_if_mesh *ifmsh = &sdata->u.mesh;
+	bool more = mesh_table_grow(&ifmsh->mesh_paths);
 
-	call_rcu(&oldtbl->rcu_head, mesh_table_free_rcu);
+	/* paths moved, dumps can't resume at their last position */
+	ifmsh->mesh_paths_generation++;
 
- out:
-	write_unlock_bh(&pathtbl_resize_lock);
+	if (more) {
+		set_bit(MESH_WORK_GROW_MPATH_TABLE, &ifmsh->wrkq_flags);
+		ieee80211_queue_work(&sdata->local->hw, &sdata->work);
+	}
 }
 
-void mesh_mpp_table_grow(void)
+void mesh_mpp_table_grow(struct ieee80211_sub_if_data *sdata)
 {
-	struct mesh_table *oldtbl, *newtbl;
+	struct ieee80211_if_mesh *ifmsh = &sdata->u.mesh;
 
-	write_lock_bh(&pathtbl_resize_lock);
-	oldtbl = resize_dereference_mpp_paths();
-	newtbl = mesh_table_alloc(oldtbl->size_order + 1);
-	if (!newtbl)
-		goto out;
-	if (mesh_table_grow(oldtbl, newtbl) < 0) {
-		__mesh_table_free(newtbl);
-		goto out;
+	if (mesh_table_grow(&ifmsh->mpp_paths)) {
+		set_bit(MESH_WORK_GROW_MPP_TABLE, &ifmsh->wrkq_flags);
+		ieee80211_queue_work(&sdata->local->hw, &sdata->work);
 	}
-	rcu_assign_pointer(mpp_paths, newtbl);
-	call_rcu(&oldtbl->rcu_head, mesh_table_free_rcu);
-
- out:
-	write_unlock_bh(&pathtbl_resize_lock);
 }
 
 int mpp_path_add(u8 *dst, u8 *mpp, struct ieee80211_sub_if_data *sdata)
 {
 	struct ieee80211_if_mesh *ifmsh = &sdata->u.mesh;
 	struct ieee80211_local *local = sdata->local;
-	struct mesh_table *tbl;
-	struct mesh_path *mpath, *new_mpath;
-	struct mpath_node *node, *new_node;
-	struct hlist_head *bucket;
-	struct hlist_node *n;
-	int grow = 0;
+	struct mesh_path *new_mpath;
+	bool grow = false;
 	int err = 0;
-	u32 hash_idx;
+	u64 start;
 
 	if (ether_addr_equal(dst, sdata->vif.addr))
 		/* never add ourselves as neighbours */
@@ -657,43 +821,24 @@ int mpp_path_add(u8 *dst, u8 *mpp, struct ieee80211_sub_if_data *sdata)
 	if (!new_mpath)
 		goto err_path_alloc;
 
-	new_node = kmalloc(sizeof(struct mpath_node), GFP_ATOMIC);
-	if (!new_node)
-		goto err_node_alloc;
-
-	read_lock_bh(&pathtbl_resize_lock);
 	memcpy(new_mpath->dst, dst, ETH_ALEN);
 	memcpy(new_mpath->mpp, mpp, ETH_ALEN);
 	new_mpath->sdata = sdata;
 	new_mpath->flags = 0;
 	skb_queue_head_init(&new_mpath->frame_queue);
-	new_node->mpath = new_mpath;
 	init_timer(&new_mpath->timer);
 	new_mpath->exp_time = jiffies;
 	spin_lock_init(&new_mpath->state_lock);
 
-	tbl = resize_dereference_mpp_paths();
-
-	hash_idx = mesh_table_hash(dst, sdata, tbl);
-	bucket = &tbl->hash_buckets[hash_idx];
-
-	spin_lock(&tbl->hashwlock[hash_idx]);
-
-	err = -EEXIST;
-	hlist_for_each_entry(node, n, bucket, list) {
-		mpath = node->mpath;
-		if (mpath->sdata == sdata &&
-		    ether_addr_equal(dst, mpath->dst))
-			goto err_exists;
-	}
-
-	hlist_add_head_rcu(&new_node->list, bucket);
-	if (atomic_inc_return(&tbl->entries) >=
-	    tbl->mean_chain_len * (tbl->hash_mask + 1))
-		grow = 1;
+	start = mesh_tbl_clock();
+	rcu_read_lock();
+	err = mesh_table_add(rcu_dereference(ifmsh->mpp_paths), new_mpath,
+			     &grow);
+	rcu_read_unlock();
+	mesh_tbl_account(sdata, MESH_TBL_INSERT, start);
+	if (err)
+		goto err_exists;
 
-	spin_unlock(&tbl->hashwlock[hash_idx]);
-	read_unlock_bh(&pathtbl_resize_lock);
 	if (grow) {
 		set_bit(MESH_WORK_GROW_MPP_TABLE,  &ifmsh->wrkq_flags);
 		ieee80211_queue_work(&local->hw, &sdata->work);
@@ -701,10 +846,6 @@ int mpp_path_add(u8 *dst, u8 *mpp, struct ieee80211_sub_if_data *sdata)
 	return 0;
 
 err_exists:
-	spin_unlock(&tbl->hashwlock[hash_idx]);
-	read_unlock_bh(&pathtbl_resize_lock);
-	kfree(new_node);
-err_node_alloc:
 	kfree(new_mpath);
 err_path_alloc:
 	return err;
@@ -724,57 +865,74 @@ void mesh_plink_broken(struct sta_info *sta)
 	struct mesh_table *tbl;
 	static const u8 bcast[ETH_ALEN] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
 	struct mesh_path *mpath;
-	struct mpath_node *node;
 	struct hlist_node *p;
 	struct ieee80211_sub_if_data *sdata = sta->sdata;
 	int i;
 	__le16 reason = cpu_to_le16(WLAN_REASON_MESH_PATH_DEST_UNREACHABLE);
 
 	rcu_read_lock();
-	tbl = rcu_dereference(mesh_paths);
-	for_each_mesh_entry(tbl, p, node, i) {
-		mpath = node->mpath;
-		if (rcu_dereference(mpath->next_hop) == sta &&
-		    mpath->flags & MESH_PATH_ACTIVE &&
-		    !(mpath->flags & MESH_PATH_FIXED)) {
-			spin_lock_bh(&mpath->state_lock);
-			mpath->flags &= ~MESH_PATH_ACTIVE;
-			++mpath->sn;
-			spin_unlock_bh(&mpath->state_lock);
-			mesh_path_error_tx(sdata->u.mesh.mshcfg.element_ttl,
+	for_each_mesh_table(sdata->u.mesh.mesh_paths, tbl) {
+		for_each_mesh_entry(tbl, p, mpath, i) {
+			if (rcu_dereference(mpath->next_hop) == sta &&
+			    mpath->flags & MESH_PATH_ACTIVE &&
+			    !(mpath->flags & MESH_PATH_FIXED)) {
+				spin_lock_bh(&mpath->state_lock);
+				mpath->flags &= ~MESH_PATH_ACTIVE;
+				++mpath->sn;
+				spin_unlock_bh(&mpath->state_lock);
+				mesh_path_error_tx(sdata->u.mesh.mshcfg.element_ttl,
 					mpath->dst, cpu_to_le32(mpath->sn),
 					reason, bcast, sdata);
+			}
 		}
 	}
 	rcu_read_unlock();
 }
 
-static void mesh_path_node_reclaim(struct rcu_head *rp)
+static void mesh_path_reclaim(struct rcu_head *rp)
 {
-	struct mpath_node *node = container_of(rp, struct mpath_node, rcu);
-	struct ieee80211_sub_if_data *sdata = node->mpath->sdata;
+	struct mesh_path *mpath = container_of(rp, struct mesh_path, rcu);
+	struct ieee80211_sub_if_data *sdata = mpath->sdata;
 
-	del_timer_sync(&node->mpath->timer);
+	del_timer_sync(&mpath->timer);
 	atomic_dec(&sdata->u.mesh.mpaths);
-	kfree(node->mpath);
-	kfree(node);
+	kfree(mpath);
 }
 
-/* needs to be called with the corresponding hashwlock taken */
-static void __mesh_path_del(struct mesh_table *tbl, struct mpath_node *node)
+/*
+ * needs to be called with the lock for the path's hash taken, @tbl is
+ * the current table of the path table the path is in
+ */
+static void __mesh_path_del(struct mesh_table *tbl, struct mesh_path *mpath)
 {
-	struct mesh_path *mpath;
-	mpath = node->mpath;
+	/* might have been deleted since the caller found it */
+	if (mpath->flags & MESH_PATH_DELETED)
+		return;
+
+	while (tbl->link != mpath->hlink)
+		tbl = rcu_dereference(tbl->future_tbl);
+
 	spin_lock(&mpath->state_lock);
-	mpath->flags |= MESH_PATH_RESOLVING;
+	mpath->flags |= MESH_PATH_RESOLVING | MESH_PATH_DELETED;
 	if (mpath->is_gate)
-		mesh_gate_del(tbl, mpath);
-	hlist_del_rcu(&node->list);
-	call_rcu(&node->rcu, mesh_path_node_reclaim);
+		mesh_gate_del(&mpath->sdata->u.mesh, mpath);
+	hlist_del_rcu(&mpath->hnode[mpath->hlink]);
+	call_rcu(&mpath->rcu, mesh_path_reclaim);
 	spin_unlock(&mpath->state_lock);
 	atomic_dec(&tbl->entries);
 }
 
+static void mesh_path_del_entry(struct mesh_table *tbl,
+				struct mesh_path *mpath)
+{
+	spinlock_t *lock = mesh_table_lock(tbl,
+					   mesh_table_hash(mpath->dst, tbl));
+
+	spin_lock_bh(lock);
+	__mesh_path_del(tbl, mpath);
+	spin_unlock_bh(lock);
+}
+
 /**
  * mesh_path_flush_by_nexthop - Deletes mesh paths if their next hop matches
  *
@@ -788,44 +946,34 @@ static void __mesh_path_del(struct mesh_table *tbl, struct mpath_node *node)
  */
 void mesh_path_flush_by_nexthop(struct sta_info *sta)
 {
-	struct mesh_table *tbl;
+	struct mesh_table *tbl, *t;
 	struct mesh_path *mpath;
-	struct mpath_node *node;
 	struct hlist_node *p;
 	int i;
 
 	rcu_read_lock();
-	read_lock_bh(&pathtbl_resize_lock);
-	tbl = resize_dereference_mesh_paths();
-	for_each_mesh_entry(tbl, p, node, i) {
-		mpath = node->mpath;
-		if (rcu_dereference(mpath->next_hop) == sta) {
-			spin_lock(&tbl->hashwlock[i]);
-			__mesh_path_del(tbl, node);
-			spin_unlock(&tbl->hashwlock[i]);
+	tbl = rcu_dereference(sta->sdata->u.mesh.mesh_paths);
+	for (t = tbl; t; t = rcu_dereference(t->future_tbl)) {
+		for_each_mesh_entry(t, p, mpath, i) {
+			if (rcu_dereference(mpath->next_hop) == sta)
+				mesh_path_del_entry(tbl, mpath);
 		}
 	}
-	read_unlock_bh(&pathtbl_resize_lock);
 	rcu_read_unlock();
 }
 
-static void table_flush_by_iface(struct mesh_table *tbl,
-				 struct ieee80211_sub_if_data *sdata)
+static void table_flush(struct mesh_table __rcu *head)
 {
+	struct mesh_table *tbl, *t;
 	struct mesh_path *mpath;
-	struct mpath_node *node;
 	struct hlist_node *p;
 	int i;
 
 	WARN_ON(!rcu_read_lock_held());
-	for_each_mesh_entry(tbl, p, node, i) {
-		mpath = node->mpath;
-		if (mpath->sdata != sdata)
-			continue;
-		spin_lock_bh(&tbl->hashwlock[i]);
-		__mesh_path_del(tbl, node);
-		spin_unlock_bh(&tbl->hashwlock[i]);
-	}
+	tbl = rcu_dereference(head);
+	for (t = tbl; t; t = rcu_dereference(t->future_tbl))
+		for_each_mesh_entry(t, p, mpath, i)
+			mesh_path_del_entry(tbl, mpath);
 }
 
 /**
@@ -838,15 +986,9 @@ static void table_flush_by_iface(struct mesh_table *tbl,
  */
 void mesh_path_flush_by_iface(struct ieee80211_sub_if_data *sdata)
 {
-	struct mesh_table *tbl;
-
 	rcu_read_lock();
-	read_lock_bh(&pathtbl_resize_lock);
-	tbl = resize_dereference_mesh_paths();
-	table_flush_by_iface(tbl, sdata);
-	tbl = resize_dereference_mpp_paths();
-	table_flush_by_iface(tbl, sdata);
-	read_unlock_bh(&pathtbl_resize_lock);
+	table_flush(sdata->u.mesh.mesh_paths);
+	table_flush(sdata->u.mesh.mpp_paths);
 	rcu_read_unlock();
 }
 
@@ -860,34 +1002,34 @@ void mesh_path_flush_by_iface(struct ieee80211_sub_if_data *sdata)
  */
 int mesh_path_del(u8 *addr, struct ieee80211_sub_if_data *sdata)
 {
-	struct mesh_table *tbl;
+	struct mesh_table *tbl, *t;
 	struct mesh_path *mpath;
-	struct mpath_node *node;
-	struct hlist_head *bucket;
 	struct hlist_node *n;
-	int hash_idx;
+	spinlock_t *lock;
+	u32 hash;
 	int err = 0;
 
-	read_lock_bh(&pathtbl_resize_lock);
-	tbl = resize_dereference_mesh_paths();
-	hash_idx = mesh_table_hash(addr, sdata, tbl);
-	bucket = &tbl->hash_buckets[hash_idx];
-
-	spin_lock(&tbl->hashwlock[hash_idx]);
-	hlist_for_each_entry(node, n, bucket, list) {
-		mpath = node->mpath;
-		if (mpath->sdata == sdata &&
-		    ether_addr_equal(addr, mpath->dst)) {
-			__mesh_path_del(tbl, node);
-			goto enddel;
+	rcu_read_lock();
+	tbl = rcu_dereference(sdata->u.mesh.mesh_paths);
+	hash = mesh_table_hash(addr, tbl);
+	lock = mesh_table_lock(tbl, hash);
+
+	spin_lock_bh(lock);
+	for (t = tbl; t; t = rcu_dereference(t->future_tbl)) {
+		hlist_for_each_mpath_rcu(mpath, n, mesh_table_bucket(t, hash),
+					 t->link) {
+			if (ether_addr_equal(addr, mpath->dst)) {
+				__mesh_path_del(tbl, mpath);
+				goto enddel;
+			}
 		}
 	}
 
 	err = -ENXIO;
 enddel:
-	mesh_paths_generation++;
-	spin_unlock(&tbl->hashwlock[hash_idx]);
-	read_unlock_bh(&pathtbl_resize_lock);
+	sdata->u.mesh.mesh_paths_generation++;
+	spin_unlock_bh(lock);
+	rcu_read_unlock();
 	return err;
 }
 
@@ -906,6 +1048,7 @@ void mesh_path_tx_pending(struct mesh_path *mpath)
 				&mpath->frame_queue);
 }
 
+
 /**
  * mesh_path_send_to_gates - sends pending frames to all known mesh gates
  *
@@ -919,25 +1062,13 @@ void mesh_path_tx_pending(struct mesh_path *mpath)
 int mesh_path_send_to_gates(struct mesh_path *mpath)
 {
 	struct ieee80211_sub_if_data *sdata = mpath->sdata;
+	struct hlist_head *known_gates = &sdata->u.mesh.known_gates;
 	struct hlist_node *n;
-	struct mesh_table *tbl;
 	struct mesh_path *from_mpath = mpath;
 	struct mpath_node *gate = NULL;
 	bool copy = false;
-	struct hlist_head *known_gates;
-
-	rcu_read_lock();
-	tbl = rcu_dereference(mesh_paths);
-	known_gates = tbl->known_gates;
-	rcu_read_unlock();
-
-	if (!known_gates)
-		return -EHOSTUNREACH;
 
 	hlist_for_each_entry_rcu(gate, n, known_gates, list) {
-		if (gate->mpath->sdata != sdata)
-			continue;
-
 		if (gate->mpath->flags & MESH_PATH_ACTIVE) {
 			mpath_dbg(sdata, "Forwarding to %pM\n", gate->mpath->dst);
 			mesh_path_move_to_queue(gate->mpath, from_mpath, copy);
@@ -950,15 +1081,13 @@ int mesh_path_send_to_gates(struct mesh_path *mpath)
 		}
 	}
 
-	hlist_for_each_entry_rcu(gate, n, known_gates, list)
-		if (gate->mpath->sdata == sdata) {
-			mpath_dbg(sdata, "Sending to %pM\n", gate->mpath->dst);
-			mesh_path_tx_pending(gate->mpath);
-		}
+	hlist_for_each_entry_rcu(gate, n, known_gates, list) {
+		mpath_dbg(sdata, "Sending to %pM\n", gate->mpath->dst);
+		mesh_path_tx_pending(gate->mpath);
+	}
 
 	return (from_mpath == mpath) ? -EHOSTUNREACH : 0;
 }
-
 /**
  * mesh_path_discard_frame - discard a frame whose path could not be resolved
  *
@@ -1011,110 +1140,157 @@ void mesh_path_fix_nexthop(struct mesh_path *mpath, struct sta_info *next_hop)
 	mesh_path_tx_pending(mpath);
 }
 
-static void mesh_path_node_free(struct hlist_node *p, bool free_leafs)
-{
-	struct mesh_path *mpath;
-	struct mpath_node *node = hlist_entry(p, struct mpath_node, list);
-	mpath = node->mpath;
-	hlist_del_rcu(p);
-	if (free_leafs) {
-		del_timer_sync(&mpath->timer);
-		kfree(mpath);
-	}
-	kfree(node);
-}
 
-static int mesh_path_node_copy(struct hlist_node *p, struct mesh_table *newtbl)
-{
-	struct mesh_path *mpath;
-	struct mpath_node *node, *new_node;
-	u32 hash_idx;
-
-	new_node = kmalloc(sizeof(struct mpath_node), GFP_ATOMIC);
-	if (new_node == NULL)
-		return -ENOMEM;
-
-	node = hlist_entry(p, struct mpath_node, list);
-	mpath = node->mpath;
-	new_node->mpath = mpath;
-	hash_idx = mesh_table_hash(mpath->dst, mpath->sdata, newtbl);
-	hlist_add_head(&new_node->list,
-			&newtbl->hash_buckets[hash_idx]);
-	return 0;
-}
-
-int mesh_pathtbl_init(void)
+int mesh_pathtbl_init(struct ieee80211_sub_if_data *sdata)
 {
+	struct ieee80211_if_mesh *ifmsh = &sdata->u.mesh;
 	struct mesh_table *tbl_path, *tbl_mpp;
-	int ret;
 
-	tbl_path = mesh_table_alloc(INIT_PATHS_SIZE_ORDER);
+	INIT_HLIST_HEAD(&ifmsh->known_gates);
+	spin_lock_init(&ifmsh->gates_lock);
+	ifmsh->mesh_paths_generation = 0;
+
+	tbl_path = mesh_table_create();
 	if (!tbl_path)
 		return -ENOMEM;
-	tbl_path->free_node = &mesh_path_node_free;
-	tbl_path->copy_node = &mesh_path_node_copy;
-	tbl_path->mean_chain_len = MEAN_CHAIN_LEN;
-	tbl_path->known_gates = kzalloc(sizeof(struct hlist_head), GFP_ATOMIC);
-	if (!tbl_path->known_gates) {
-		ret = -ENOMEM;
-		goto free_path;
-	}
-	INIT_HLIST_HEAD(tbl_path->known_gates);
 
-
-	tbl_mpp = mesh_table_alloc(INIT_PATHS_SIZE_ORDER);
-	if (!tbl_mpp) {
-		ret = -ENOMEM;
+	tbl_mpp = mesh_table_create();
+	if (!tbl_mpp)
 		goto free_path;
-	}
-	tbl_mpp->free_node = &mesh_path_node_free;
-	tbl_mpp->copy_node = &mesh_path_node_copy;
-	tbl_mpp->mean_chain_len = MEAN_CHAIN_LEN;
-	tbl_mpp->known_gates = kzalloc(sizeof(struct hlist_head), GFP_ATOMIC);
-	if (!tbl_mpp->known_gates) {
-		ret = -ENOMEM;
-		goto free_mpp;
-	}
-	INIT_HLIST_HEAD(tbl_mpp->known_gates);
+
+#ifdef CONFIG_MAC80211_DEBUGFS
+	/* the statistics are optional, don't fail without them */
+	ifmsh->tbl_stats = alloc_percpu(struct mesh_tbl_stats);
+#endif
 
 	/* Need no locking since this is during init */
-	RCU_INIT_POINTER(mesh_paths, tbl_path);
-	RCU_INIT_POINTER(mpp_paths, tbl_mpp);
+	RCU_INIT_POINTER(ifmsh->mesh_paths, tbl_path);
+	RCU_INIT_POINTER(ifmsh->mpp_paths, tbl_mpp);
 
 	return 0;
 
-free_mpp:
-	mesh_table_free(tbl_mpp, true);
 free_path:
-	mesh_table_free(tbl_path, true);
-	return ret;
+	mesh_table_destroy(tbl_path);
+	return -ENOMEM;
 }
 
 void mesh_path_expire(struct ieee80211_sub_if_data *sdata)
 {
 	struct mesh_table *tbl;
 	struct mesh_path *mpath;
-	struct mpath_node *node;
 	struct hlist_node *p;
 	int i;
 
 	rcu_read_lock();
-	tbl = rcu_dereference(mesh_paths);
-	for_each_mesh_entry(tbl, p, node, i) {
-		if (node->mpath->sdata != sdata)
-			continue;
-		mpath = node->mpath;
-		if ((!(mpath->flags & MESH_PATH_RESOLVING)) &&
-		    (!(mpath->flags & MESH_PATH_FIXED)) &&
-		     time_after(jiffies, mpath->exp_time + MESH_PATH_EXPIRE))
-			mesh_path_del(mpath->dst, mpath->sdata);
+	for_each_mesh_table(sdata->u.mesh.mesh_paths, tbl) {
+		for_each_mesh_entry(tbl, p, mpath, i) {
+			if ((!(mpath->flags & MESH_PATH_RESOLVING)) &&
+			    (!(mpath->flags & MESH_PATH_FIXED)) &&
+			     time_after(jiffies, mpath->exp_time + MESH_PATH_EXPIRE))
+				mesh_path_del(mpath->dst, mpath->sdata);
+		}
+	}
+	rcu_read_unlock();
+}
+
+void mesh_pathtbl_unregister(struct ieee80211_sub_if_data *sdata)
+{
+	struct ieee80211_if_mesh *ifmsh = &sdata->u.mesh;
+	struct mesh_table *tbl_path, *tbl_mpp;
+
+	tbl_path = mesh_table_dereference(ifmsh->mesh_paths);
+	tbl_mpp = mesh_table_dereference(ifmsh->mpp_paths);
+	RCU_INIT_POINTER(ifmsh->mesh_paths, NULL);
+	RCU_INIT_POINTER(ifmsh->mpp_paths, NULL);
+
+	/* paths deleted by the flush may still be waiting for their grace period */
+	rcu_barrier();
+
+	/* the interface is down, nobody can be looking at the tables anymore */
+	if (tbl_path)
+		mesh_table_destroy(tbl_path);
+	if (tbl_mpp)
+		mesh_table_destroy(tbl_mpp);
+
+#ifdef CONFIG_MAC80211_DEBUGFS
+	free_percpu(ifmsh->tbl_stats);
+	ifmsh->tbl_stats = NULL;
+#endif
+}
+
+#ifdef CONFIG_MAC80211_DEBUGFS
+static int mesh_table_stats_format(struct mesh_table __rcu *head,
+				   const char *name, char *buf, int buflen)
+{
+	struct mesh_table *tbl, *ftbl;
+	int len;
+
+	rcu_read_lock();
+	tbl = rcu_dereference(head);
+	if (!tbl) {
+		rcu_read_unlock();
+		return 0;
 	}
+	ftbl = rcu_dereference(tbl->future_tbl);
+	len = scnprintf(buf, buflen, "%s: %d entries, %u buckets",
+			name, atomic_read(&tbl->entries) +
+			      (ftbl ? atomic_read(&ftbl->entries) : 0),
+			tbl->hash_mask + 1);
+	if (ftbl)
+		len += scnprintf(buf + len, buflen - len,
+				 ", growing to %u (%u/%u moved)",
+				 ftbl->hash_mask + 1, tbl->rehash_idx,
+				 tbl->hash_mask + 1);
+	len += scnprintf(buf + len, buflen - len, "\n");
 	rcu_read_unlock();
+
+	return len;
 }
 
-void mesh_pathtbl_unregister(void)
+int mesh_pathtbl_stats_format(struct ieee80211_sub_if_data *sdata,
+			      char *buf, int buflen)
 {
-	/* no need for locking during exit path */
-	mesh_table_free(rcu_dereference_protected(mesh_paths, 1), true);
-	mesh_table_free(rcu_dereference_protected(mpp_paths, 1), true);
+	static const char * const op_names[NUM_MESH_TBL_OPS] = {
+		[MESH_TBL_LOOKUP] = "lookup",
+		[MESH_TBL_INSERT] = "insert",
+	};
+	struct ieee80211_if_mesh *ifmsh = &sdata->u.mesh;
+	u64 hist[MESH_TBL_HIST_BUCKETS];
+	int len = 0, cpu, op, i;
+
+	len += mesh_table_stats_format(ifmsh->mesh_paths, "mpath",
+				       buf + len, buflen - len);
+	len += mesh_table_stats_format(ifmsh->mpp_paths, "mpp",
+				       buf + len, buflen - len);
+
+	if (!ifmsh->tbl_stats)
+		return len;
+
+	for (op = 0; op < NUM_MESH_TBL_OPS; op++) {
+		memset(hist, 0, sizeof(hist));
+		for_each_possible_cpu(cpu) {
+			struct mesh_tbl_stats *stats =
+				per_cpu_ptr(ifmsh->tbl_stats, cpu);
+
+			for (i = 0; i < MESH_TBL_HIST_BUCKETS; i++)
+				hist[i] += stats->hist[op][i];
+		}
+
+		len += scnprintf(buf + len, buflen - len, "%s latency:\n",
+				 op_names[op]);
+		for (i = 0; i < MESH_TBL_HIST_BUCKETS; i++) {
+			if (i == 0)
+				len += scnprintf(buf + len, buflen - len,
+						 "  <%lu ns", 2UL << MESH_TBL_HIST_SHIFT);
+			else
+				len += scnprintf(buf + len, buflen - len,
+						 " >=%lu ns",
+						 1UL << (i + MESH_TBL_HIST_SHIFT));
+			len += scnprintf(buf + len, buflen - len, ": %llu\n",
+					 (unsigned long long)hist[i]);
+		}
+	}
+
+	return len;
 }
+#endif
@@ -13,24 +13,29 @@
 
 #include "michael.h"
 
-static void michael_block(struct michael_mic_ctx *mctx, u32 val)
+/*
+ * Each block depends on the result of the previous one, so there is no
+ * parallelism to extract; keep l and r in registers instead and let the
+ * callers below feed two blocks per loop iteration.
+ */
+static __always_inline void michael_block(u32 *l, u32 *r, u32 val)
 {
-	mctx->l ^= val;
-	mctx->r ^= rol32(mctx->l, 17);
-	mctx->l += mctx->r;
-	mctx->r ^= ((mctx->l & 0xff00ff00) >> 8) |
-		   ((mctx->l & 0x00ff00ff) << 8);
-	mctx->l += mctx->r;
-	mctx->r ^= rol32(mctx->l, 3);
-	mctx->l += mctx->r;
-	mctx->r ^= ror32(mctx->l, 2);
-	mctx->l += mctx->r;
+	*l ^= val;
+	*r ^= rol32(*l, 17);
+	*l += *r;
+	*r ^= ((*l & 0xff00ff00) >> 8) | ((*l & 0x00ff00ff) << 8);
+	*l += *r;
+	*r ^= rol32(*l, 3);
+	*l += *r;
+	*r ^= ror32(*l, 2);
+	*l += *r;
 }
 
-static void michael_mic_hdr(struct michael_mic_ctx *mctx, const u8 *key,
-			    struct ieee80211_hdr *hdr)
+void michael_mic_init(struct michael_mic_ctx *mctx, const u8 *key,
+		      struct ieee80211_hdr *hdr)
 {
 	u8 *da, *sa, tid;
+	u32 l, r;
 
 	da = ieee80211_get_DA(hdr);
 	sa = ieee80211_get_SA(hdr);
@@ -39,48 +44,82 @@ static void michael_mic_hdr(struct michael_mic_ctx *mctx, const u8 *key,
 	else
 		tid = 0;
 
-	mctx->l = get_unaligned_le32(key);
-	mctx->r = get_unaligned_le32(key + 4);
+	l = get_unaligned_le32(key);
+	r = get_unaligned_le32(key + 4);
 
 	/*
 	 * A pseudo header (DA, SA, Priority, 0, 0, 0) is used in Michael MIC
 	 * calculation, but it is _not_ transmitted
 	 */
-	michael_block(mctx, get_unaligned_le32(da));
-	michael_block(mctx, get_unaligned_le16(&da[4]) |
-			    (get_unaligned_le16(sa) << 16));
-	michael_block(mctx, get_unaligned_le32(&sa[2]));
-	michael_block(mctx, tid);
+	michael_block(&l, &r, get_unaligned_le32(da));
+	michael_block(&l, &r, get_unaligned_le16(&da[4]) |
+			      (get_unaligned_le16(sa) << 16));
+	michael_block(&l, &r, get_unaligned_le32(&sa[2]));
+	michael_block(&l, &r, tid);
+
+	mctx->l = l;
+	mctx->r = r;
+	mctx->tail = 0;
+	mctx->tail_len = 0;
 }
 
-void michael_mic(const u8 *key, struct ieee80211_hdr *hdr,
-		 const u8 *data, size_t data_len, u8 *mic)
+/*
+ * Add @data_len octets to the MIC. May be called any number of times,
+ * with arbitrary lengths, e.g. once for each fragment of a paged skb.
+ */
+void michael_mic_update(struct michael_mic_ctx *mctx, const u8 *data,
+			size_t data_len)
 {
-	u32 val;
-	size_t block, blocks, left;
-	struct michael_mic_ctx mctx;
+	u32 l = mctx->l, r = mctx->r;
+
+	/* complete a block left partial by the previous call */
+	while (mctx->tail_len && data_len) {
+		mctx->tail |= (u32)*data++ << (8 * mctx->tail_len);
+		data_len--;
+		if (++mctx->tail_len == 4) {
+			michael_block(&l, &r, mctx->tail);
+			mctx->tail = 0;
+			mctx->tail_len = 0;
+		}
+	}
 
-	michael_mic_hdr(&mctx, key, hdr);
+	for (; data_len >= 8; data += 8, data_len -= 8) {
+		michael_block(&l, &r, get_unaligned_le32(data));
+		michael_block(&l, &r, get_unaligned_le32(data + 4));
+	}
 
-	/* Real data */
-	blocks = data_len / 4;
-	left = data_len % 4;
+	if (data_len >= 4) {
+		michael_block(&l, &r, get_unaligned_le32(data));
+		data += 4;
+		data_len -= 4;
+	}
 
-	for (block = 0; block < blocks; block++)
-		michael_block(&mctx, get_unaligned_le32(&data[block * 4]));
+	while (data_len--)
+		mctx->tail |= (u32)*data++ << (8 * mctx->tail_len++);
+
+	mctx->l = l;
+	mctx->r = r;
+}
+
+void michael_mic_final(struct michael_mic_ctx *mctx, u8 *mic)
+{
+	u32 l = mctx->l, r = mctx->r;
 
 	/* Partial block of 0..3 bytes and padding: 0x5a + 4..7 zeros to make
 	 * total length a multiple of 4. */
-	val = 0x5a;
-	while (left > 0) {
-		val <<= 8;
-		left--;
-		val |= data[blocks * 4 + left];
-	}
+	michael_block(&l, &r, mctx->tail | (0x5a << (8 * mctx->tail_len)));
+	michael_block(&l, &r, 0);
 
-	michael_block(&mctx, val);
-	michael_block(&mctx, 0);
+	put_unaligned_le32(l, mic);
+	put_unaligned_le32(r, mic + 4);
+}
+
+void michael_mic(const u8 *key, struct ieee80211_hdr *hdr,
+		 const u8 *data, size_t data_len, u8 *mic)
+{
+	struct michael_mic_ctx mctx;
 
-	put_unaligned_le32(mctx.l, mic);
-	put_unaligned_le32(mctx.r, mic + 4);
+	michael_mic_init(&mctx, key, hdr);
+	michael_mic_update(&mctx, data, data_len);
+	michael_mic_final(&mctx, mic);
 }
@@ -16,8 +16,16 @@
 
 struct michael_mic_ctx {
 	u32 l, r;
+	u32 tail;		/* octets of a not yet complete block */
+	unsigned int tail_len;
 };
 
+void michael_mic_init(struct michael_mic_ctx *mctx, const u8 *key,
+		      struct ieee80211_hdr *hdr);
+void michael_mic_update(struct michael_mic_ctx *mctx, const u8 *data,
+			size_t data_len);
+void michael_mic_final(struct michael_mic_ctx *mctx, u8 *mic);
+
 void michael_mic(const u8 *key, struct ieee80211_hdr *hdr,
 		 const u8 *data, size_t data_len, u8 *mic);
 
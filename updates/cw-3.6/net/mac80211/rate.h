@@ -76,6 +76,17 @@ static inline void rate_control_rate_update(struct ieee80211_local *local,
 	drv_sta_rc_update(local, sta->sdata, &sta->sta, changed);
 }
 
+static inline u32 rate_control_get_expected_throughput(struct sta_info *sta)
+{
+	struct rate_control_ref *ref = sta->rate_ctrl;
+
+	if (!ref || !ref->ops->get_expected_throughput ||
+	    !test_sta_flag(sta, WLAN_STA_RATE_CONTROL))
+		return 0;
+
+	return ref->ops->get_expected_throughput(sta->rate_ctrl_priv);
+}
+
 static inline void *rate_control_alloc_sta(struct rate_control_ref *ref,
 					   struct ieee80211_sta *sta,
 					   gfp_t gfp)
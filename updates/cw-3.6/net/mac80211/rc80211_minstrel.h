@@ -79,6 +79,11 @@ struct minstrel_priv {
 	unsigned int lookaround_rate;
 	unsigned int lookaround_rate_mrr;
 
+	/* minstrel_ht warm-start history, see rc80211_minstrel_ht.c */
+	struct list_head ht_history;
+	spinlock_t ht_history_lock;
+	unsigned int ht_history_len;
+
 #ifdef CONFIG_MAC80211_DEBUGFS
 	/*
 	 * enable fixed rate processing per RC
@@ -88,6 +93,7 @@ struct minstrel_priv {
 	 */
 	u32 fixed_rate_idx;
 	struct dentry *dbg_fixed_rate;
+	struct dentry *dbg_ht_history;
 #endif
 
 };
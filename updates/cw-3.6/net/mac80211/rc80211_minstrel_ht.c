@@ -10,6 +10,8 @@
 #include <linux/skbuff.h>
 #include <linux/debugfs.h>
 #include <linux/random.h>
+#include <linux/etherdevice.h>
+#include <linux/slab.h>
 #include <linux/ieee80211.h>
 #include <net/mac80211.h>
 #include "rate.h"
@@ -130,10 +132,11 @@ minstrel_get_ratestats(struct minstrel_ht_sta *mi, int index)
  * Recalculate success probabilities and counters for a rate using EWMA
  */
 static void
-minstrel_calc_rate_ewma(struct minstrel_rate_stats *mr)
+minstrel_calc_rate_ewma(struct minstrel_ht_sta *mi,
+			struct minstrel_rate_stats *mr)
 {
 	if (unlikely(mr->attempts > 0)) {
-		mr->sample_skipped = 0;
+		mr->attempt_seq = mi->update_seq;
 		mr->cur_prob = MINSTREL_FRAC(mr->success, mr->attempts);
 		if (!mr->att_hist)
 			mr->probability = mr->cur_prob;
@@ -142,8 +145,6 @@ minstrel_calc_rate_ewma(struct minstrel_rate_stats *mr)
 				mr->cur_prob, EWMA_LEVEL);
 		mr->att_hist += mr->attempts;
 		mr->succ_hist += mr->success;
-	} else {
-		mr->sample_skipped++;
 	}
 	mr->last_success = mr->success;
 	mr->last_attempts = mr->attempts;
@@ -151,6 +152,32 @@ minstrel_calc_rate_ewma(struct minstrel_rate_stats *mr)
 	mr->attempts = 0;
 }
 
+/* number of statistics updates since the rate was last attempted */
+static inline unsigned int
+minstrel_ht_sample_skipped(struct minstrel_ht_sta *mi,
+			   struct minstrel_rate_stats *mr)
+{
+	return min_t(u32, mi->update_seq - mr->attempt_seq, 255);
+}
+
+/*
+ * Fill the per-rate table of 1000000 / tx time for the current average
+ * A-MPDU length, so that throughput updates need no division
+ */
+static void
+minstrel_ht_calc_tp_base(struct minstrel_ht_sta *mi, int group)
+{
+	struct minstrel_mcs_group_data *mg = &mi->groups[group];
+	unsigned int usecs;
+	int i;
+
+	for (i = 0; i < MCS_GROUP_RATES; i++) {
+		usecs = mi->overhead / mi->tp_ampdu_len;
+		usecs += minstrel_mcs_groups[group].duration[i];
+		mg->tp_base[i] = 1000000 / usecs;
+	}
+}
+
 /*
  * Calculate throughput based on the average A-MPDU length, taking into account
  * the expected number of retransmissions and their expected length
@@ -159,7 +186,6 @@ static void
 minstrel_ht_calc_tp(struct minstrel_ht_sta *mi, int group, int rate)
 {
 	struct minstrel_rate_stats *mr;
-	unsigned int usecs;
 
 	mr = &mi->groups[group].rates[rate];
 
@@ -168,14 +194,72 @@ minstrel_ht_calc_tp(struct minstrel_ht_sta *mi, int group, int rate)
 		return;
 	}
 
-	usecs = mi->overhead / MINSTREL_TRUNC(mi->avg_ampdu_len);
-	usecs += minstrel_mcs_groups[group].duration[rate];
-	mr->cur_tp = MINSTREL_TRUNC((1000000 / usecs) * mr->probability);
+	mr->cur_tp = MINSTREL_TRUNC(mi->groups[group].tp_base[rate] *
+				    mr->probability);
+}
+
+/*
+ * Select the best throughput, second best throughput and best probability
+ * rates of a group
+ */
+static void
+minstrel_ht_group_select(struct minstrel_ht_sta *mi, int group)
+{
+	struct minstrel_mcs_group_data *mg = &mi->groups[group];
+	struct minstrel_rate_stats *mr;
+	int cur_prob = 0, cur_prob_tp = 0, cur_tp = 0, cur_tp2 = 0;
+	int i, index;
+
+	mg->max_tp_rate = 0;
+	mg->max_tp_rate2 = 0;
+	mg->max_prob_rate = 0;
+
+	for (i = 0; i < MCS_GROUP_RATES; i++) {
+		if (!(mg->supported & BIT(i)))
+			continue;
+
+		mr = &mg->rates[i];
+		index = MCS_GROUP_RATES * group + i;
+
+		if (!mr->cur_tp)
+			continue;
+
+		/* ignore the lowest rate of each single-stream group */
+		if (!i && minstrel_mcs_groups[group].streams == 1)
+			continue;
+
+		if ((mr->cur_tp > cur_prob_tp && mr->probability >
+		     MINSTREL_FRAC(3, 4)) || mr->probability > cur_prob) {
+			mg->max_prob_rate = index;
+			cur_prob = mr->probability;
+			cur_prob_tp = mr->cur_tp;
+		}
+
+		if (mr->cur_tp > cur_tp) {
+			swap(index, mg->max_tp_rate);
+			cur_tp = mr->cur_tp;
+			mr = minstrel_get_ratestats(mi, index);
+		}
+
+		if (index >= mg->max_tp_rate)
+			continue;
+
+		if (mr->cur_tp > cur_tp2) {
+			mg->max_tp_rate2 = index;
+			cur_tp2 = mr->cur_tp;
+		}
+	}
 }
 
 /*
  * Update rate statistics and select new primary rates
  *
+ * Only rates attempted since the previous update have new statistics, so
+ * only those are recalculated, and only groups containing such rates have
+ * their candidates selected again. Everything is recalculated when the
+ * integer part of the average A-MPDU length changes, since that affects
+ * the throughput and retry count of every rate.
+ *
  * Rules for rate selection:
  *  - max_prob_rate must use only one stream, as a tradeoff between delivery
  *    probability and throughput during strong fluctuations
@@ -187,8 +271,10 @@ minstrel_ht_update_stats(struct minstrel_priv *mp, struct minstrel_ht_sta *mi)
 {
 	struct minstrel_mcs_group_data *mg;
 	struct minstrel_rate_stats *mr;
-	int cur_prob, cur_prob_tp, cur_tp, cur_tp2;
-	int group, i, index;
+	int cur_prob_tp, cur_tp, cur_tp2;
+	unsigned long changed;
+	bool full = false;
+	int group, i;
 
 	if (mi->ampdu_packets > 0) {
 		mi->avg_ampdu_len = minstrel_ewma(mi->avg_ampdu_len,
@@ -197,6 +283,13 @@ minstrel_ht_update_stats(struct minstrel_priv *mp, struct minstrel_ht_sta *mi)
 		mi->ampdu_packets = 0;
 	}
 
+	if (mi->tp_ampdu_len != MINSTREL_TRUNC(mi->avg_ampdu_len)) {
+		mi->tp_ampdu_len = MINSTREL_TRUNC(mi->avg_ampdu_len);
+		mi->stats_full++;
+		full = true;
+	}
+
+	mi->update_seq++;
 	mi->sample_slow = 0;
 	mi->sample_count = 0;
 	mi->max_tp_rate = 0;
@@ -204,64 +297,43 @@ minstrel_ht_update_stats(struct minstrel_priv *mp, struct minstrel_ht_sta *mi)
 	mi->max_prob_rate = 0;
 
 	for (group = 0; group < ARRAY_SIZE(minstrel_mcs_groups); group++) {
-		cur_prob = 0;
-		cur_prob_tp = 0;
-		cur_tp = 0;
-		cur_tp2 = 0;
-
 		mg = &mi->groups[group];
 		if (!mg->supported)
 			continue;
 
-		mg->max_tp_rate = 0;
-		mg->max_tp_rate2 = 0;
-		mg->max_prob_rate = 0;
 		mi->sample_count++;
 
-		for (i = 0; i < MCS_GROUP_RATES; i++) {
-			if (!(mg->supported & BIT(i)))
-				continue;
+		/* roll over last_success/last_attempts of idle rates too */
+		changed = (mg->touched | mg->prev_touched) & mg->supported;
+		for_each_set_bit(i, &changed, MCS_GROUP_RATES)
+			minstrel_calc_rate_ewma(mi, &mg->rates[i]);
+
+		changed = mg->touched & mg->supported;
+		mg->prev_touched = mg->touched;
+		mg->touched = 0;
+
+		if (full) {
+			minstrel_ht_calc_tp_base(mi, group);
+			changed = mg->supported;
+		}
+
+		if (!changed)
+			continue;
 
+		for_each_set_bit(i, &changed, MCS_GROUP_RATES) {
 			mr = &mg->rates[i];
 			mr->retry_updated = false;
-			index = MCS_GROUP_RATES * group + i;
-			minstrel_calc_rate_ewma(mr);
 			minstrel_ht_calc_tp(mi, group, i);
-
-			if (!mr->cur_tp)
-				continue;
-
-			/* ignore the lowest rate of each single-stream group */
-			if (!i && minstrel_mcs_groups[group].streams == 1)
-				continue;
-
-			if ((mr->cur_tp > cur_prob_tp && mr->probability >
-			     MINSTREL_FRAC(3, 4)) || mr->probability > cur_prob) {
-				mg->max_prob_rate = index;
-				cur_prob = mr->probability;
-				cur_prob_tp = mr->cur_tp;
-			}
-
-			if (mr->cur_tp > cur_tp) {
-				swap(index, mg->max_tp_rate);
-				cur_tp = mr->cur_tp;
-				mr = minstrel_get_ratestats(mi, index);
-			}
-
-			if (index >= mg->max_tp_rate)
-				continue;
-
-			if (mr->cur_tp > cur_tp2) {
-				mg->max_tp_rate2 = index;
-				cur_tp2 = mr->cur_tp;
-			}
+			mi->stats_rates++;
 		}
+
+		minstrel_ht_group_select(mi, group);
+		mi->stats_groups++;
 	}
 
 	/* try to sample up to half of the available rates during each interval */
 	mi->sample_count *= 4;
 
-	cur_prob = 0;
 	cur_prob_tp = 0;
 	cur_tp = 0;
 	cur_tp2 = 0;
@@ -274,7 +346,6 @@ minstrel_ht_update_stats(struct minstrel_priv *mp, struct minstrel_ht_sta *mi)
 		if (cur_prob_tp < mr->cur_tp &&
 		    minstrel_mcs_groups[group].streams == 1) {
 			mi->max_prob_rate = mg->max_prob_rate;
-			cur_prob = mr->cur_prob;
 			cur_prob_tp = mr->cur_tp;
 		}
 
@@ -428,6 +499,7 @@ minstrel_ht_tx_status(void *priv, struct ieee80211_supported_band *sband,
 
 		group = minstrel_ht_get_group_idx(&ar[i]);
 		rate = &mi->groups[group].rates[ar[i].idx % 8];
+		mi->groups[group].touched |= BIT(ar[i].idx % 8);
 
 		if (last)
 			rate->success += info->status.ampdu_ack_len;
@@ -587,7 +659,7 @@ minstrel_get_sample_rate(struct minstrel_priv *mp, struct minstrel_ht_sta *mi)
 	 */
 	if (minstrel_get_duration(sample_idx) >
 	    minstrel_get_duration(mi->max_tp_rate)) {
-		if (mr->sample_skipped < 20)
+		if (minstrel_ht_sample_skipped(mi, mr) < 20)
 			return -1;
 
 		if (mi->sample_slow++ > 2)
@@ -688,6 +760,247 @@ minstrel_ht_get_rate(void *priv, struct ieee80211_sta *sta, void *priv_sta,
 	}
 }
 
+/*
+ * Warm-start history
+ *
+ * When a station goes away, the per-rate success probabilities learned
+ * for it are kept in a small LRU cache keyed by the peer address. When
+ * the same peer (re)associates, they seed its statistics so that the
+ * first rate selection is based on history instead of blind sampling.
+ * Seeded rates have no attempt history, so the first real measurement
+ * of a rate replaces the seeded value outright.
+ */
+static struct minstrel_ht_history *
+minstrel_ht_history_find(struct minstrel_priv *mp, const u8 *addr)
+{
+	struct minstrel_ht_history *h;
+
+	list_for_each_entry(h, &mp->ht_history, list)
+		if (ether_addr_equal(h->addr, addr))
+			return h;
+
+	return NULL;
+}
+
+/* drop entries beyond the size limit and those that are too old */
+static void
+minstrel_ht_history_expire(struct minstrel_priv *mp)
+{
+	struct minstrel_ht_history *h, *tmp;
+
+	list_for_each_entry_safe_reverse(h, tmp, &mp->ht_history, list) {
+		if (mp->ht_history_len <= MINSTREL_HT_HISTORY_MAX &&
+		    time_before(jiffies, h->last_update +
+					 MINSTREL_HT_HISTORY_AGE))
+			break;
+
+		list_del(&h->list);
+		kfree(h);
+		mp->ht_history_len--;
+	}
+}
+
+/* insert @h keeping the list sorted by last update, newest first */
+static void
+minstrel_ht_history_insert(struct minstrel_priv *mp,
+			   struct minstrel_ht_history *h)
+{
+	struct minstrel_ht_history *pos;
+
+	list_for_each_entry(pos, &mp->ht_history, list)
+		if (time_after_eq(h->last_update, pos->last_update))
+			break;
+
+	list_add_tail(&h->list, &pos->list);
+}
+
+static void
+minstrel_ht_history_save(struct minstrel_priv *mp, struct minstrel_ht_sta *mi,
+			 const u8 *addr)
+{
+	struct minstrel_ht_history *h;
+	struct minstrel_rate_stats *mr;
+	bool measured = false;
+	int group, i;
+
+	for (group = 0; group < ARRAY_SIZE(mi->groups) && !measured; group++)
+		for (i = 0; i < MCS_GROUP_RATES; i++)
+			if (mi->groups[group].rates[i].att_hist)
+				measured = true;
+
+	if (!measured)
+		return;
+
+	spin_lock_bh(&mp->ht_history_lock);
+
+	h = minstrel_ht_history_find(mp, addr);
+	if (h) {
+		list_del(&h->list);
+	} else {
+		h = kzalloc(sizeof(*h), GFP_ATOMIC);
+		if (!h)
+			goto out;
+		memcpy(h->addr, addr, ETH_ALEN);
+		mp->ht_history_len++;
+	}
+
+	h->last_update = jiffies;
+	h->avg_ampdu_len = mi->avg_ampdu_len;
+	for (group = 0; group < ARRAY_SIZE(mi->groups); group++) {
+		for (i = 0; i < MCS_GROUP_RATES; i++) {
+			mr = &mi->groups[group].rates[i];
+			if (mr->att_hist)
+				h->prob[group][i] = min_t(unsigned int,
+							  mr->probability,
+							  0xffff);
+		}
+	}
+	list_add(&h->list, &mp->ht_history);
+
+	minstrel_ht_history_expire(mp);
+ out:
+	spin_unlock_bh(&mp->ht_history_lock);
+}
+
+static void
+minstrel_ht_history_restore(struct minstrel_priv *mp,
+			    struct minstrel_ht_sta *mi, const u8 *addr)
+{
+	struct minstrel_ht_history *h;
+	struct minstrel_mcs_group_data *mg;
+	u8 sample_count;
+	int group, i;
+
+	spin_lock_bh(&mp->ht_history_lock);
+	minstrel_ht_history_expire(mp);
+
+	h = minstrel_ht_history_find(mp, addr);
+	if (!h) {
+		spin_unlock_bh(&mp->ht_history_lock);
+		return;
+	}
+
+	if (h->avg_ampdu_len)
+		mi->avg_ampdu_len = h->avg_ampdu_len;
+
+	for (group = 0; group < ARRAY_SIZE(mi->groups); group++) {
+		mg = &mi->groups[group];
+		for (i = 0; i < MCS_GROUP_RATES; i++)
+			if (mg->supported & BIT(i))
+				mg->rates[i].probability = h->prob[group][i];
+	}
+
+	spin_unlock_bh(&mp->ht_history_lock);
+
+	/* the seeded rates were not attempted, recalculate all of them */
+	mi->tp_ampdu_len = 0;
+
+	/* pick the initial rates, but keep the initial sampling burst */
+	sample_count = mi->sample_count;
+	minstrel_ht_update_stats(mp, mi);
+	mi->sample_count = sample_count;
+}
+
+int
+minstrel_ht_history_import(struct minstrel_priv *mp,
+			   const struct minstrel_ht_history_rec *rec)
+{
+	struct minstrel_ht_history *h;
+	unsigned long age;
+	u32 avg_ampdu_len = le32_to_cpu(rec->avg_ampdu_len);
+	int group, i;
+
+	if (rec->version != MINSTREL_HT_HISTORY_VERSION ||
+	    rec->n_groups != ARRAY_SIZE(minstrel_mcs_groups) ||
+	    !is_valid_ether_addr(rec->addr))
+		return -EINVAL;
+
+	/*
+	 * 0 means nothing was aggregated yet; anything else ends up as a
+	 * divisor in the throughput calculation and scales sample_wait.
+	 */
+	if (avg_ampdu_len && (avg_ampdu_len < MINSTREL_FRAC(1, 1) ||
+			      avg_ampdu_len > MINSTREL_FRAC(64, 1)))
+		return -EINVAL;
+
+	age = msecs_to_jiffies(le32_to_cpu(rec->age_ms));
+	if (age >= MINSTREL_HT_HISTORY_AGE)
+		return 0;
+
+	spin_lock_bh(&mp->ht_history_lock);
+
+	h = minstrel_ht_history_find(mp, rec->addr);
+	if (h) {
+		/* don't replace fresher data learned since the export */
+		if (time_after(h->last_update, jiffies - age))
+			goto out;
+		list_del(&h->list);
+	} else {
+		h = kzalloc(sizeof(*h), GFP_ATOMIC);
+		if (!h) {
+			spin_unlock_bh(&mp->ht_history_lock);
+			return -ENOMEM;
+		}
+		memcpy(h->addr, rec->addr, ETH_ALEN);
+		mp->ht_history_len++;
+	}
+
+	h->last_update = jiffies - age;
+	h->avg_ampdu_len = avg_ampdu_len;
+	for (group = 0; group < ARRAY_SIZE(minstrel_mcs_groups); group++)
+		for (i = 0; i < MCS_GROUP_RATES; i++)
+			h->prob[group][i] = le16_to_cpu(rec->prob[group][i]);
+	minstrel_ht_history_insert(mp, h);
+
+	minstrel_ht_history_expire(mp);
+ out:
+	spin_unlock_bh(&mp->ht_history_lock);
+	return 0;
+}
+
+/* @recs must have room for MINSTREL_HT_HISTORY_MAX records */
+void
+minstrel_ht_history_export(struct minstrel_priv *mp,
+			   struct minstrel_ht_history_rec *recs,
+			   unsigned int *n_recs)
+{
+	struct minstrel_ht_history *h;
+	struct minstrel_ht_history_rec *rec = recs;
+	int group, i;
+
+	spin_lock_bh(&mp->ht_history_lock);
+	minstrel_ht_history_expire(mp);
+
+	list_for_each_entry(h, &mp->ht_history, list) {
+		memset(rec, 0, sizeof(*rec));
+		rec->version = MINSTREL_HT_HISTORY_VERSION;
+		rec->n_groups = ARRAY_SIZE(minstrel_mcs_groups);
+		memcpy(rec->addr, h->addr, ETH_ALEN);
+		rec->age_ms = cpu_to_le32(jiffies_to_msecs(jiffies -
+							   h->last_update));
+		rec->avg_ampdu_len = cpu_to_le32(h->avg_ampdu_len);
+		for (group = 0; group < ARRAY_SIZE(minstrel_mcs_groups); group++)
+			for (i = 0; i < MCS_GROUP_RATES; i++)
+				rec->prob[group][i] =
+					cpu_to_le16(h->prob[group][i]);
+		rec++;
+	}
+
+	spin_unlock_bh(&mp->ht_history_lock);
+	*n_recs = rec - recs;
+}
+
+static void
+minstrel_ht_history_free(struct minstrel_priv *mp)
+{
+	struct minstrel_ht_history *h, *tmp;
+
+	list_for_each_entry_safe(h, tmp, &mp->ht_history, list)
+		kfree(h);
+	INIT_LIST_HEAD(&mp->ht_history);
+	mp->ht_history_len = 0;
+}
+
 static void
 minstrel_ht_update_caps(void *priv, struct ieee80211_supported_band *sband,
                         struct ieee80211_sta *sta, void *priv_sta)
@@ -772,6 +1085,7 @@ minstrel_ht_update_caps(void *priv, struct ieee80211_supported_band *sband,
 	if (!n_supported)
 		goto use_legacy;
 
+	minstrel_ht_history_restore(mp, mi, sta->addr);
 	return;
 
 use_legacy:
@@ -794,6 +1108,12 @@ minstrel_ht_rate_update(void *priv, struct ieee80211_supported_band *sband,
                         struct ieee80211_sta *sta, void *priv_sta,
                         u32 changed)
 {
+	struct minstrel_ht_sta_priv *msp = priv_sta;
+
+	/* don't lose what was learned so far when the caps change */
+	if (msp->is_ht)
+		minstrel_ht_history_save(priv, &msp->ht, sta->addr);
+
 	minstrel_ht_update_caps(priv, sband, sta, priv_sta);
 }
 
@@ -839,6 +1159,9 @@ minstrel_ht_free_sta(void *priv, struct ieee80211_sta *sta, void *priv_sta)
 {
 	struct minstrel_ht_sta_priv *msp = priv_sta;
 
+	if (msp->is_ht)
+		minstrel_ht_history_save(priv, &msp->ht, sta->addr);
+
 	kfree(msp->sample_table);
 	kfree(msp->ratelist);
 	kfree(msp);
@@ -847,15 +1170,47 @@ minstrel_ht_free_sta(void *priv, struct ieee80211_sta *sta, void *priv_sta)
 static void *
 minstrel_ht_alloc(struct ieee80211_hw *hw, struct dentry *debugfsdir)
 {
-	return mac80211_minstrel.alloc(hw, debugfsdir);
+	struct minstrel_priv *mp;
+
+	mp = mac80211_minstrel.alloc(hw, debugfsdir);
+	if (!mp)
+		return NULL;
+
+	INIT_LIST_HEAD(&mp->ht_history);
+	spin_lock_init(&mp->ht_history_lock);
+#ifdef CONFIG_MAC80211_DEBUGFS
+	minstrel_ht_add_history_debugfs(mp, debugfsdir);
+#endif
+
+	return mp;
 }
 
 static void
 minstrel_ht_free(void *priv)
 {
+	struct minstrel_priv *mp = priv;
+
+#ifdef CONFIG_MAC80211_DEBUGFS
+	debugfs_remove(mp->dbg_ht_history);
+#endif
+	minstrel_ht_history_free(mp);
 	mac80211_minstrel.free(priv);
 }
 
+static u32
+minstrel_ht_get_expected_throughput(void *priv_sta)
+{
+	struct minstrel_ht_sta_priv *msp = priv_sta;
+	struct minstrel_ht_sta *mi = &msp->ht;
+
+	if (!msp->is_ht)
+		return mac80211_minstrel.get_expected_throughput(&msp->legacy);
+
+	/* cur_tp is in packets of AVG_PKT_SIZE bytes per second */
+	return minstrel_get_ratestats(mi, mi->max_tp_rate)->cur_tp *
+	       AVG_PKT_SIZE * 8 / 1000;
+}
+
 static struct rate_control_ops mac80211_minstrel_ht = {
 	.name = "minstrel_ht",
 	.tx_status = minstrel_ht_tx_status,
@@ -870,6 +1225,7 @@ static struct rate_control_ops mac80211_minstrel_ht = {
 	.add_sta_debugfs = minstrel_ht_add_sta_debugfs,
 	.remove_sta_debugfs = minstrel_ht_remove_sta_debugfs,
 #endif
+	.get_expected_throughput = minstrel_ht_get_expected_throughput,
 };
 
 
@@ -50,7 +50,9 @@ struct minstrel_rate_stats {
 	unsigned int retry_count_rtscts;
 
 	bool retry_updated;
-	u8 sample_skipped;
+
+	/* value of update_seq when this rate was last attempted */
+	u32 attempt_seq;
 };
 
 struct minstrel_mcs_group_data {
@@ -60,6 +62,16 @@ struct minstrel_mcs_group_data {
 	/* bitfield of supported MCS rates of this group */
 	u8 supported;
 
+	/*
+	 * bitfields of rates attempted during the current and the previous
+	 * sampling interval; only those need their statistics updated
+	 */
+	u8 touched;
+	u8 prev_touched;
+
+	/* 1000000 / average frame tx time, indexed by rate */
+	u16 tp_base[MCS_GROUP_RATES];
+
 	/* selected primary rates */
 	unsigned int max_tp_rate;
 	unsigned int max_tp_rate2;
@@ -89,6 +101,17 @@ struct minstrel_ht_sta {
 	/* time of last status update */
 	unsigned long stats_update;
 
+	/* number of statistics updates, used for sample_skipped accounting */
+	u32 update_seq;
+
+	/* A-MPDU length the tp_base tables were computed for, 0 if invalid */
+	unsigned int tp_ampdu_len;
+
+	/* statistics update cost counters */
+	unsigned int stats_rates;
+	unsigned int stats_groups;
+	unsigned int stats_full;
+
 	/* overhead time in usec for each frame */
 	unsigned int overhead;
 	unsigned int overhead_rtscts;
@@ -124,7 +147,53 @@ struct minstrel_ht_sta_priv {
 	bool is_ht;
 };
 
+/*
+ * Per-peer history used to warm-start a station's statistics when it
+ * (re)associates. Bounded to MINSTREL_HT_HISTORY_MAX entries, kept in
+ * LRU order, and entries not updated for MINSTREL_HT_HISTORY_AGE are
+ * dropped.
+ */
+#define MINSTREL_HT_HISTORY_MAX	64
+#define MINSTREL_HT_HISTORY_AGE	(10 * 60 * HZ)
+
+struct minstrel_ht_history {
+	struct list_head list;
+	unsigned long last_update;
+	u8 addr[ETH_ALEN];
+
+	unsigned int avg_ampdu_len;
+
+	/* success probability, 0 if never measured */
+	u16 prob[MINSTREL_MAX_STREAMS * MINSTREL_STREAM_GROUPS][MCS_GROUP_RATES];
+};
+
+/*
+ * Export/import format of the ht_history debugfs file: reading it
+ * returns one record per cached peer, writing whole records back
+ * (e.g. after a reboot) merges them into the cache.
+ */
+#define MINSTREL_HT_HISTORY_VERSION	1
+
+struct minstrel_ht_history_rec {
+	u8 version;
+	u8 n_groups;
+	u8 addr[ETH_ALEN];
+	__le32 age_ms;
+	__le32 avg_ampdu_len;
+	__le16 prob[MINSTREL_MAX_STREAMS * MINSTREL_STREAM_GROUPS][MCS_GROUP_RATES];
+} __packed;
+
+struct minstrel_priv;
+
+int minstrel_ht_history_import(struct minstrel_priv *mp,
+			       const struct minstrel_ht_history_rec *rec);
+void minstrel_ht_history_export(struct minstrel_priv *mp,
+				struct minstrel_ht_history_rec *recs,
+				unsigned int *n_recs);
+
 void minstrel_ht_add_sta_debugfs(void *priv, void *priv_sta, struct dentry *dir);
 void minstrel_ht_remove_sta_debugfs(void *priv, void *priv_sta);
+void minstrel_ht_add_history_debugfs(struct minstrel_priv *mp,
+				     struct dentry *dir);
 
 #endif
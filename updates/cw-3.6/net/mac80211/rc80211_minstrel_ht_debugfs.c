@@ -89,6 +89,10 @@ minstrel_ht_stats_open(struct inode *inode, struct file *file)
 	p += sprintf(p, "Average A-MPDU length: %d.%d\n",
 		MINSTREL_TRUNC(mi->avg_ampdu_len),
 		MINSTREL_TRUNC(mi->avg_ampdu_len * 10) % 10);
+	p += sprintf(p, "Statistics updates: %u (rates recalculated %u, "
+			"groups rescanned %u, full %u)\n",
+			mi->update_seq, mi->stats_rates, mi->stats_groups,
+			mi->stats_full);
 	ms->len = p - ms->buf;
 
 	return nonseekable_open(inode, file);
@@ -118,3 +122,64 @@ minstrel_ht_remove_sta_debugfs(void *priv, void *priv_sta)
 
 	debugfs_remove(msp->dbg_stats);
 }
+
+static int
+minstrel_ht_history_open(struct inode *inode, struct file *file)
+{
+	struct minstrel_priv *mp = inode->i_private;
+	struct minstrel_debugfs_info *ms;
+	unsigned int n_recs = 0;
+
+	ms = kmalloc(sizeof(*ms) + MINSTREL_HT_HISTORY_MAX *
+		     sizeof(struct minstrel_ht_history_rec), GFP_KERNEL);
+	if (!ms)
+		return -ENOMEM;
+
+	if (file->f_mode & FMODE_READ)
+		minstrel_ht_history_export(mp,
+			(struct minstrel_ht_history_rec *) ms->buf, &n_recs);
+
+	ms->len = n_recs * sizeof(struct minstrel_ht_history_rec);
+	file->private_data = ms;
+	return 0;
+}
+
+static ssize_t
+minstrel_ht_history_write(struct file *file, const char __user *buf,
+			  size_t count, loff_t *ppos)
+{
+	struct minstrel_priv *mp = file->f_path.dentry->d_inode->i_private;
+	struct minstrel_ht_history_rec rec;
+	size_t done;
+	int ret;
+
+	if (count % sizeof(rec))
+		return -EINVAL;
+
+	for (done = 0; done < count; done += sizeof(rec)) {
+		if (copy_from_user(&rec, buf + done, sizeof(rec)))
+			return -EFAULT;
+
+		ret = minstrel_ht_history_import(mp, &rec);
+		if (ret)
+			return ret;
+	}
+
+	return count;
+}
+
+static const struct file_operations minstrel_ht_history_fops = {
+	.owner = THIS_MODULE,
+	.open = minstrel_ht_history_open,
+	.read = minstrel_stats_read,
+	.write = minstrel_ht_history_write,
+	.release = minstrel_stats_release,
+	.llseek = default_llseek,
+};
+
+void
+minstrel_ht_add_history_debugfs(struct minstrel_priv *mp, struct dentry *dir)
+{
+	mp->dbg_ht_history = debugfs_create_file("ht_history",
+			S_IRUSR | S_IWUSR, dir, mp, &minstrel_ht_history_fops);
+}
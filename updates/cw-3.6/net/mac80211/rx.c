@@ -531,11 +531,53 @@ static inline u16 seq_sub(u16 sq1, u16 sq2)
 }
 
 
+static inline int ieee80211_reorder_index(struct tid_ampdu_rx *tid_agg_rx,
+					  u16 sn)
+{
+	return seq_sub(sn, tid_agg_rx->ssn) % tid_agg_rx->buf_size;
+}
+
+/*
+ * Distance from @index to the next stored frame in the reorder ring,
+ * or buf_size if there is none.
+ */
+static int ieee80211_reorder_next_stored(struct tid_ampdu_rx *tid_agg_rx,
+					 int index)
+{
+	int size = tid_agg_rx->buf_size;
+	int next;
+
+	next = find_next_bit(tid_agg_rx->reorder_bitmap, size, index);
+	if (next < size)
+		return next - index;
+
+	next = find_first_bit(tid_agg_rx->reorder_bitmap, index);
+	if (next < index)
+		return size - index + next;
+
+	return size;
+}
+
+/* Number of consecutive stored frames starting at @index. */
+static int ieee80211_reorder_run_len(struct tid_ampdu_rx *tid_agg_rx,
+				     int index)
+{
+	int size = tid_agg_rx->buf_size;
+	int end;
+
+	end = find_next_zero_bit(tid_agg_rx->reorder_bitmap, size, index);
+	if (end < size)
+		return end - index;
+
+	return size - index +
+	       find_first_zero_bit(tid_agg_rx->reorder_bitmap, index);
+}
+
 static void ieee80211_release_reorder_frame(struct ieee80211_sub_if_data *sdata,
 					    struct tid_ampdu_rx *tid_agg_rx,
-					    int index)
+					    int index,
+					    struct sk_buff_head *frames)
 {
-	struct ieee80211_local *local = sdata->local;
 	struct sk_buff *skb = tid_agg_rx->reorder_buf[index];
 	struct ieee80211_rx_status *status;
 
@@ -547,26 +589,62 @@ static void ieee80211_release_reorder_frame(struct ieee80211_sub_if_data *sdata,
 	/* release the frame from the reorder ring buffer */
 	tid_agg_rx->stored_mpdu_num--;
 	tid_agg_rx->reorder_buf[index] = NULL;
+	__clear_bit(index, tid_agg_rx->reorder_bitmap);
+	tid_agg_rx->stats.released++;
 	status = IEEE80211_SKB_RXCB(skb);
 	status->rx_flags |= IEEE80211_RX_DEFERRED_RELEASE;
-	skb_queue_tail(&local->rx_skb_queue, skb);
+	__skb_queue_tail(frames, skb);
 
 no_frame:
 	tid_agg_rx->head_seq_num = seq_inc(tid_agg_rx->head_seq_num);
 }
 
+/*
+ * Hand the frames released from the reorder buffer to the RX handlers,
+ * taking the RX queue lock once for the whole run. Called with the
+ * reorder_lock still held so that releases stay in order.
+ */
+static void ieee80211_release_reorder_batch(struct ieee80211_local *local,
+					    struct tid_ampdu_rx *tid_agg_rx,
+					    struct sk_buff_head *frames)
+{
+	lockdep_assert_held(&tid_agg_rx->reorder_lock);
+
+	if (skb_queue_empty(frames))
+		return;
+
+	tid_agg_rx->stats.batches++;
+
+	spin_lock(&local->rx_skb_queue.lock);
+	skb_queue_splice_tail_init(frames, &local->rx_skb_queue);
+	spin_unlock(&local->rx_skb_queue.lock);
+}
+
 static void ieee80211_release_reorder_frames(struct ieee80211_sub_if_data *sdata,
 					     struct tid_ampdu_rx *tid_agg_rx,
-					     u16 head_seq_num)
+					     u16 head_seq_num,
+					     struct sk_buff_head *frames)
 {
-	int index;
+	int index, skip;
 
 	lockdep_assert_held(&tid_agg_rx->reorder_lock);
 
 	while (seq_less(tid_agg_rx->head_seq_num, head_seq_num)) {
-		index = seq_sub(tid_agg_rx->head_seq_num, tid_agg_rx->ssn) %
-							tid_agg_rx->buf_size;
-		ieee80211_release_reorder_frame(sdata, tid_agg_rx, index);
+		index = ieee80211_reorder_index(tid_agg_rx,
+						tid_agg_rx->head_seq_num);
+		skip = ieee80211_reorder_next_stored(tid_agg_rx, index);
+
+		/* no more stored frames before the new head, jump there */
+		if (!tid_agg_rx->stored_mpdu_num ||
+		    skip >= seq_sub(head_seq_num, tid_agg_rx->head_seq_num)) {
+			tid_agg_rx->head_seq_num = head_seq_num;
+			break;
+		}
+
+		tid_agg_rx->head_seq_num =
+			(tid_agg_rx->head_seq_num + skip) & SEQ_MASK;
+		ieee80211_release_reorder_frame(sdata, tid_agg_rx,
+				(index + skip) % tid_agg_rx->buf_size, frames);
 	}
 }
 
@@ -582,28 +660,35 @@ static void ieee80211_release_reorder_frames(struct ieee80211_sub_if_data *sdata
 #define HT_RX_REORDER_BUF_TIMEOUT (HZ / 10)
 
 static void ieee80211_sta_reorder_release(struct ieee80211_sub_if_data *sdata,
-					  struct tid_ampdu_rx *tid_agg_rx)
+					  struct tid_ampdu_rx *tid_agg_rx,
+					  struct sk_buff_head *frames)
 {
-	int index, j;
+	int size = tid_agg_rx->buf_size;
+	int index, j, run;
 
 	lockdep_assert_held(&tid_agg_rx->reorder_lock);
 
 	/* release the buffer until next missing frame */
-	index = seq_sub(tid_agg_rx->head_seq_num, tid_agg_rx->ssn) %
-						tid_agg_rx->buf_size;
-	if (!tid_agg_rx->reorder_buf[index] &&
+	index = ieee80211_reorder_index(tid_agg_rx, tid_agg_rx->head_seq_num);
+	if (!test_bit(index, tid_agg_rx->reorder_bitmap) &&
 	    tid_agg_rx->stored_mpdu_num) {
 		/*
 		 * No buffers ready to be released, but check whether any
 		 * frames in the reorder buffer have timed out.
 		 */
 		int skipped = 1;
-		for (j = (index + 1) % tid_agg_rx->buf_size; j != index;
-		     j = (j + 1) % tid_agg_rx->buf_size) {
-			if (!tid_agg_rx->reorder_buf[j]) {
-				skipped++;
-				continue;
-			}
+		int dist = 0;
+		int gap;
+
+		while (tid_agg_rx->stored_mpdu_num) {
+			gap = ieee80211_reorder_next_stored(tid_agg_rx,
+						(index + dist + 1) % size);
+			dist += gap + 1;
+			if (dist >= size)
+				break;
+			j = (index + dist) % size;
+			skipped += gap;
+
 			if (skipped &&
 			    !time_after(jiffies, tid_agg_rx->reorder_time[j] +
 					HT_RX_REORDER_BUF_TIMEOUT))
@@ -611,7 +696,9 @@ static void ieee80211_sta_reorder_release(struct ieee80211_sub_if_data *sdata,
 
 			ht_dbg_ratelimited(sdata,
 					   "release an RX reorder frame due to timeout on earlier frames\n");
-			ieee80211_release_reorder_frame(sdata, tid_agg_rx, j);
+			ieee80211_release_reorder_frame(sdata, tid_agg_rx, j,
+							frames);
+			tid_agg_rx->stats.released_timeout++;
 
 			/*
 			 * Increment the head seq# also for the skipped slots.
@@ -620,21 +707,21 @@ static void ieee80211_sta_reorder_release(struct ieee80211_sub_if_data *sdata,
 				(tid_agg_rx->head_seq_num + skipped) & SEQ_MASK;
 			skipped = 0;
 		}
-	} else while (tid_agg_rx->reorder_buf[index]) {
-		ieee80211_release_reorder_frame(sdata, tid_agg_rx, index);
-		index =	seq_sub(tid_agg_rx->head_seq_num, tid_agg_rx->ssn) %
-							tid_agg_rx->buf_size;
+	} else {
+		/* the whole in-order run is found with a single scan */
+		for (run = ieee80211_reorder_run_len(tid_agg_rx, index); run;
+		     run--) {
+			ieee80211_release_reorder_frame(sdata, tid_agg_rx,
+							index, frames);
+			index = (index + 1) % size;
+		}
 	}
 
 	if (tid_agg_rx->stored_mpdu_num) {
-		j = index = seq_sub(tid_agg_rx->head_seq_num,
-				    tid_agg_rx->ssn) % tid_agg_rx->buf_size;
-
-		for (; j != (index - 1) % tid_agg_rx->buf_size;
-		     j = (j + 1) % tid_agg_rx->buf_size) {
-			if (tid_agg_rx->reorder_buf[j])
-				break;
-		}
+		index = ieee80211_reorder_index(tid_agg_rx,
+						tid_agg_rx->head_seq_num);
+		j = (index + ieee80211_reorder_next_stored(tid_agg_rx, index)) %
+		    size;
 
  set_release_timer:
 
@@ -659,9 +746,12 @@ static bool ieee80211_sta_manage_reorder_buf(struct ieee80211_sub_if_data *sdata
 	u16 sc = le16_to_cpu(hdr->seq_ctrl);
 	u16 mpdu_seq_num = (sc & IEEE80211_SCTL_SEQ) >> 4;
 	u16 head_seq_num, buf_size;
+	struct sk_buff_head frames;
 	int index;
 	bool ret = true;
 
+	__skb_queue_head_init(&frames);
+
 	spin_lock(&tid_agg_rx->reorder_lock);
 
 	buf_size = tid_agg_rx->buf_size;
@@ -681,15 +771,15 @@ static bool ieee80211_sta_manage_reorder_buf(struct ieee80211_sub_if_data *sdata
 		head_seq_num = seq_inc(seq_sub(mpdu_seq_num, buf_size));
 		/* release stored frames up to new head to stack */
 		ieee80211_release_reorder_frames(sdata, tid_agg_rx,
-						 head_seq_num);
+						 head_seq_num, &frames);
 	}
 
 	/* Now the new frame is always in the range of the reordering buffer */
 
-	index = seq_sub(mpdu_seq_num, tid_agg_rx->ssn) % tid_agg_rx->buf_size;
+	index = ieee80211_reorder_index(tid_agg_rx, mpdu_seq_num);
 
 	/* check if we already stored this frame */
-	if (tid_agg_rx->reorder_buf[index]) {
+	if (test_bit(index, tid_agg_rx->reorder_bitmap)) {
 		dev_kfree_skb(skb);
 		goto out;
 	}
@@ -710,10 +800,18 @@ static bool ieee80211_sta_manage_reorder_buf(struct ieee80211_sub_if_data *sdata
 	/* put the frame in the reordering buffer */
 	tid_agg_rx->reorder_buf[index] = skb;
 	tid_agg_rx->reorder_time[index] = jiffies;
+	__set_bit(index, tid_agg_rx->reorder_bitmap);
 	tid_agg_rx->stored_mpdu_num++;
-	ieee80211_sta_reorder_release(sdata, tid_agg_rx);
+
+	tid_agg_rx->stats.buffered++;
+	tid_agg_rx->stats.depth_hist[ilog2(tid_agg_rx->stored_mpdu_num)]++;
+	if (tid_agg_rx->stored_mpdu_num > tid_agg_rx->stats.max_depth)
+		tid_agg_rx->stats.max_depth = tid_agg_rx->stored_mpdu_num;
+
+	ieee80211_sta_reorder_release(sdata, tid_agg_rx, &frames);
 
  out:
+	ieee80211_release_reorder_batch(sdata->local, tid_agg_rx, &frames);
 	spin_unlock(&tid_agg_rx->reorder_lock);
 	return ret;
 }
@@ -807,7 +905,7 @@ ieee80211_rx_h_check(struct ieee80211_rx_data *rx)
 			     hdr->seq_ctrl)) {
 			if (status->rx_flags & IEEE80211_RX_RA_MATCH) {
 				rx->local->dot11FrameDuplicateCount++;
-				rx->sta->num_duplicates++;
+				sta_stats_inc(rx->sta, num_duplicates);
 			}
 			return RX_DROP_UNUSABLE;
 		} else
@@ -1110,6 +1208,7 @@ static void ap_sta_ps_start(struct sta_info *sta)
 	set_sta_flag(sta, WLAN_STA_PS_STA);
 	if (!(local->hw.flags & IEEE80211_HW_AP_LINK_PS))
 		drv_sta_notify(local, sdata, STA_NOTIFY_SLEEP, &sta->sta);
+	ieee80211_txq_ps_buffer(local, sta);
 	ps_dbg(sdata, "STA %pM aid %d enters power save mode\n",
 	       sta->sta.addr, sta->sta.aid);
 }
@@ -1231,6 +1330,7 @@ ieee80211_rx_h_sta_process(struct ieee80211_rx_data *rx)
 	struct sk_buff *skb = rx->skb;
 	struct ieee80211_rx_status *status = IEEE80211_SKB_RXCB(skb);
 	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *)skb->data;
+	struct sta_pcpu_stats *stats;
 
 	if (!sta)
 		return RX_CONTINUE;
@@ -1244,7 +1344,7 @@ ieee80211_rx_h_sta_process(struct ieee80211_rx_data *rx)
 		u8 *bssid = ieee80211_get_bssid(hdr, rx->skb->len,
 						NL80211_IFTYPE_ADHOC);
 		if (ether_addr_equal(bssid, rx->sdata->u.ibss.bssid)) {
-			sta->last_rx = jiffies;
+			sta_update_last_rx(sta);
 			if (ieee80211_is_data(hdr->frame_control)) {
 				sta->last_rx_rate_idx = status->rate_idx;
 				sta->last_rx_rate_flag = status->flag;
@@ -1255,7 +1355,7 @@ ieee80211_rx_h_sta_process(struct ieee80211_rx_data *rx)
 		 * Mesh beacons will update last_rx when if they are found to
 		 * match the current local configuration when processed.
 		 */
-		sta->last_rx = jiffies;
+		sta_update_last_rx(sta);
 		if (ieee80211_is_data(hdr->frame_control)) {
 			sta->last_rx_rate_idx = status->rate_idx;
 			sta->last_rx_rate_flag = status->flag;
@@ -1268,8 +1368,10 @@ ieee80211_rx_h_sta_process(struct ieee80211_rx_data *rx)
 	if (rx->sdata->vif.type == NL80211_IFTYPE_STATION)
 		ieee80211_sta_rx_notify(rx->sdata, hdr);
 
-	sta->rx_fragments++;
-	sta->rx_bytes += rx->skb->len;
+	stats = sta_stats_begin(sta);
+	stats->rx_fragments++;
+	stats->rx_bytes += rx->skb->len;
+	sta_stats_end(stats);
 	if (!(status->flag & RX_FLAG_NO_SIGNAL_VAL)) {
 		sta->last_signal = status->signal;
 		ewma_add(&sta->avg_signal, -status->signal);
@@ -1330,7 +1432,7 @@ ieee80211_rx_h_sta_process(struct ieee80211_rx_data *rx)
 		 * Update counter and free packet here to avoid
 		 * counting this as a dropped packed.
 		 */
-		sta->rx_packets++;
+		sta_stats_inc(sta, rx_packets);
 		dev_kfree_skb(rx->skb);
 		return RX_QUEUED;
 	}
@@ -1522,7 +1624,7 @@ ieee80211_rx_h_defragment(struct ieee80211_rx_data *rx)
 
  out:
 	if (rx->sta)
-		rx->sta->rx_packets++;
+		sta_stats_inc(rx->sta, rx_packets);
 	if (is_multicast_ether_addr(hdr->addr1))
 		rx->local->dot11MulticastReceivedFrameCount++;
 	else
@@ -1757,7 +1859,10 @@ ieee80211_deliver_skb(struct ieee80211_rx_data *rx)
 			/* deliver to local stack */
 			skb->protocol = eth_type_trans(skb, dev);
 			memset(skb->cb, 0, sizeof(skb->cb));
-			netif_receive_skb(skb);
+			if (rx->napi)
+				napi_gro_receive(rx->napi, skb);
+			else
+				netif_receive_skb(skb);
 		}
 	}
 
@@ -2020,6 +2125,7 @@ ieee80211_rx_h_ctrl(struct ieee80211_rx_data *rx)
 	struct sk_buff *skb = rx->skb;
 	struct ieee80211_bar *bar = (struct ieee80211_bar *)skb->data;
 	struct tid_ampdu_rx *tid_agg_rx;
+	struct sk_buff_head frames;
 	u16 start_seq_num;
 	u16 tid;
 
@@ -2051,10 +2157,13 @@ ieee80211_rx_h_ctrl(struct ieee80211_rx_data *rx)
 			mod_timer(&tid_agg_rx->session_timer,
 				  TU_TO_EXP_TIME(tid_agg_rx->timeout));
 
+		__skb_queue_head_init(&frames);
+
 		spin_lock(&tid_agg_rx->reorder_lock);
 		/* release stored frames up to start of BAR */
 		ieee80211_release_reorder_frames(rx->sdata, tid_agg_rx,
-						 start_seq_num);
+						 start_seq_num, &frames);
+		ieee80211_release_reorder_batch(rx->local, tid_agg_rx, &frames);
 		spin_unlock(&tid_agg_rx->reorder_lock);
 
 		kfree_skb(skb);
@@ -2348,7 +2457,7 @@ ieee80211_rx_h_action(struct ieee80211_rx_data *rx)
 
  handled:
 	if (rx->sta)
-		rx->sta->rx_packets++;
+		sta_stats_inc(rx->sta, rx_packets);
 	dev_kfree_skb(rx->skb);
 	return RX_QUEUED;
 
@@ -2357,7 +2466,7 @@ ieee80211_rx_h_action(struct ieee80211_rx_data *rx)
 	skb_queue_tail(&sdata->skb_queue, rx->skb);
 	ieee80211_queue_work(&local->hw, &sdata->work);
 	if (rx->sta)
-		rx->sta->rx_packets++;
+		sta_stats_inc(rx->sta, rx_packets);
 	return RX_QUEUED;
 }
 
@@ -2385,7 +2494,7 @@ ieee80211_rx_h_userspace_mgmt(struct ieee80211_rx_data *rx)
 			     rx->skb->data, rx->skb->len,
 			     GFP_ATOMIC)) {
 		if (rx->sta)
-			rx->sta->rx_packets++;
+			sta_stats_inc(rx->sta, rx_packets);
 		dev_kfree_skb(rx->skb);
 		return RX_QUEUED;
 	}
@@ -2491,7 +2600,7 @@ ieee80211_rx_h_mgmt(struct ieee80211_rx_data *rx)
 	skb_queue_tail(&sdata->skb_queue, rx->skb);
 	ieee80211_queue_work(&rx->local->hw, &sdata->work);
 	if (rx->sta)
-		rx->sta->rx_packets++;
+		sta_stats_inc(rx->sta, rx_packets);
 
 	return RX_QUEUED;
 }
@@ -2573,7 +2682,7 @@ static void ieee80211_rx_handlers_result(struct ieee80211_rx_data *rx,
 	case RX_DROP_MONITOR:
 		I802_DEBUG_INC(rx->sdata->local->rx_handlers_drop);
 		if (rx->sta)
-			rx->sta->rx_dropped++;
+			sta_stats_inc(rx->sta, rx_dropped);
 		/* fall through */
 	case RX_CONTINUE: {
 		struct ieee80211_rate *rate = NULL;
@@ -2592,7 +2701,7 @@ static void ieee80211_rx_handlers_result(struct ieee80211_rx_data *rx,
 	case RX_DROP_UNUSABLE:
 		I802_DEBUG_INC(rx->sdata->local->rx_handlers_drop);
 		if (rx->sta)
-			rx->sta->rx_dropped++;
+			sta_stats_inc(rx->sta, rx_dropped);
 		dev_kfree_skb(rx->skb);
 		break;
 	case RX_QUEUED:
@@ -2701,13 +2810,17 @@ void ieee80211_release_reorder_timeout(struct sta_info *sta, int tid)
 		.flags = 0,
 	};
 	struct tid_ampdu_rx *tid_agg_rx;
+	struct sk_buff_head frames;
 
 	tid_agg_rx = rcu_dereference(sta->ampdu_mlme.tid_rx[tid]);
 	if (!tid_agg_rx)
 		return;
 
+	__skb_queue_head_init(&frames);
+
 	spin_lock(&tid_agg_rx->reorder_lock);
-	ieee80211_sta_reorder_release(sta->sdata, tid_agg_rx);
+	ieee80211_sta_reorder_release(sta->sdata, tid_agg_rx, &frames);
+	ieee80211_release_reorder_batch(sta->local, tid_agg_rx, &frames);
 	spin_unlock(&tid_agg_rx->reorder_lock);
 
 	ieee80211_rx_handlers(&rx);
@@ -2846,7 +2959,8 @@ static bool ieee80211_prepare_and_rx_handle(struct ieee80211_rx_data *rx,
  * be called with rcu_read_lock protection.
  */
 static void __ieee80211_rx_handle_packet(struct ieee80211_hw *hw,
-					 struct sk_buff *skb)
+					 struct sk_buff *skb,
+					 struct napi_struct *napi)
 {
 	struct ieee80211_local *local = hw_to_local(hw);
 	struct ieee80211_sub_if_data *sdata;
@@ -2854,6 +2968,7 @@ static void __ieee80211_rx_handle_packet(struct ieee80211_hw *hw,
 	__le16 fc;
 	struct ieee80211_rx_data rx;
 	struct ieee80211_sub_if_data *prev;
+	struct sta_hash_table *tbl;
 	struct sta_info *sta, *tmp, *prev_sta;
 	int err = 0;
 
@@ -2861,6 +2976,7 @@ static void __ieee80211_rx_handle_packet(struct ieee80211_hw *hw,
 	memset(&rx, 0, sizeof(rx));
 	rx.skb = skb;
 	rx.local = local;
+	rx.napi = napi;
 
 	if (ieee80211_is_data(fc) || ieee80211_is_mgmt(fc))
 		local->dot11ReceivedFragmentCount++;
@@ -2886,7 +3002,7 @@ static void __ieee80211_rx_handle_packet(struct ieee80211_hw *hw,
 	if (ieee80211_is_data(fc)) {
 		prev_sta = NULL;
 
-		for_each_sta_info(local, hdr->addr2, sta, tmp) {
+		for_each_sta_info(local, tbl, hdr->addr2, sta, tmp) {
 			if (!prev_sta) {
 				prev_sta = sta;
 				continue;
@@ -2949,11 +3065,8 @@ static void __ieee80211_rx_handle_packet(struct ieee80211_hw *hw,
 	dev_kfree_skb(skb);
 }
 
-/*
- * This is the receive path handler. It is called by a low level driver when an
- * 802.11 MPDU is received from the hardware.
- */
-void ieee80211_rx(struct ieee80211_hw *hw, struct sk_buff *skb)
+static void __ieee80211_rx(struct ieee80211_hw *hw, struct sk_buff *skb,
+			   struct napi_struct *napi)
 {
 	struct ieee80211_local *local = hw_to_local(hw);
 	struct ieee80211_rate *rate = NULL;
@@ -3048,7 +3161,7 @@ void ieee80211_rx(struct ieee80211_hw *hw, struct sk_buff *skb)
 	ieee80211_tpt_led_trig_rx(local,
 			((struct ieee80211_hdr *)skb->data)->frame_control,
 			skb->len);
-	__ieee80211_rx_handle_packet(hw, skb);
+	__ieee80211_rx_handle_packet(hw, skb, napi);
 
 	rcu_read_unlock();
 
@@ -3056,6 +3169,15 @@ void ieee80211_rx(struct ieee80211_hw *hw, struct sk_buff *skb)
  drop:
 	kfree_skb(skb);
 }
+
+/*
+ * This is the receive path handler. It is called by a low level driver when an
+ * 802.11 MPDU is received from the hardware.
+ */
+void ieee80211_rx(struct ieee80211_hw *hw, struct sk_buff *skb)
+{
+	__ieee80211_rx(hw, skb, NULL);
+}
 #if (LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,32))
 EXPORT_SYMBOL(ieee80211_rx);
 #else
@@ -3063,6 +3185,20 @@ EXPORT_SYMBOL(mac80211_ieee80211_rx);
 #endif
 
 
+void ieee80211_rx_napi(struct ieee80211_hw *hw, struct sk_buff_head *skbs)
+{
+	struct ieee80211_local *local = hw_to_local(hw);
+	struct napi_struct *napi = NULL;
+	struct sk_buff *skb;
+
+	if (hw->flags & IEEE80211_HW_RX_GRO)
+		napi = &local->napi;
+
+	while ((skb = __skb_dequeue(skbs)))
+		__ieee80211_rx(hw, skb, napi);
+}
+EXPORT_SYMBOL(ieee80211_rx_napi);
+
 /* This is a version of the rx handler that can be called from hard irq
  * context. Post the skb on the queue and schedule the tasklet */
 void ieee80211_rx_irqsafe(struct ieee80211_hw *hw, struct sk_buff *skb)
@@ -13,6 +13,9 @@
 #include <linux/netdevice.h>
 #include <linux/types.h>
 #include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
+#include <linux/random.h>
 #include <linux/skbuff.h>
 #include <linux/if_arp.h>
 #include <linux/timer.h>
@@ -63,32 +66,114 @@
  * freed before they are done using it.
  */
 
+static struct sta_hash_table *sta_hash_table_alloc(unsigned int order,
+						   u8 link)
+{
+	struct sta_hash_table *tbl;
+	size_t size = sizeof(*tbl) + (sizeof(tbl->buckets[0]) << order);
+
+	if (size <= PAGE_SIZE)
+		tbl = kzalloc(size, GFP_KERNEL);
+	else
+		tbl = vzalloc(size);
+	if (!tbl)
+		return NULL;
+
+	tbl->order = order;
+	tbl->mask = (1 << order) - 1;
+	tbl->link = link;
+	get_random_bytes(&tbl->seed, sizeof(tbl->seed));
+
+	return tbl;
+}
+
+static void sta_hash_table_free(struct sta_hash_table *tbl)
+{
+	if (is_vmalloc_addr(tbl))
+		vfree(tbl);
+	else
+		kfree(tbl);
+}
+
+static inline struct sta_hash_table *
+sta_hash_dereference(struct ieee80211_local *local)
+{
+	return rcu_dereference_protected(local->sta_hash,
+					 lockdep_is_held(&local->sta_mtx));
+}
+
 /* Caller must hold local->sta_mtx */
 static int sta_info_hash_del(struct ieee80211_local *local,
 			     struct sta_info *sta)
 {
+	struct sta_hash_table *tbl = sta_hash_dereference(local);
+	struct sta_info __rcu **pprev;
 	struct sta_info *s;
 
-	s = rcu_dereference_protected(local->sta_hash[STA_HASH(sta->sta.addr)],
-				      lockdep_is_held(&local->sta_mtx));
-	if (!s)
-		return -ENOENT;
-	if (s == sta) {
-		rcu_assign_pointer(local->sta_hash[STA_HASH(sta->sta.addr)],
-				   s->hnext);
-		return 0;
+	pprev = &tbl->buckets[sta_hash_bucket(tbl, sta->sta.addr)];
+	while ((s = rcu_dereference_protected(*pprev,
+				lockdep_is_held(&local->sta_mtx)))) {
+		if (s == sta) {
+			rcu_assign_pointer(*pprev, s->hnext[tbl->link]);
+			return 0;
+		}
+		pprev = &s->hnext[tbl->link];
 	}
 
-	while (rcu_access_pointer(s->hnext) &&
-	       rcu_access_pointer(s->hnext) != sta)
-		s = rcu_dereference_protected(s->hnext,
-					lockdep_is_held(&local->sta_mtx));
-	if (rcu_access_pointer(s->hnext)) {
-		rcu_assign_pointer(s->hnext, sta->hnext);
-		return 0;
+	return -ENOENT;
+}
+
+/*
+ * Caller must hold local->sta_mtx, and all stations on the
+ * sta_list must be in the hash table (and vice versa).
+ *
+ * All stations are linked into the new table through the link
+ * pointer that the current table doesn't use, so RCU readers
+ * walking the current table are never disturbed. Once the new
+ * table is published we wait for those readers to go away, the
+ * old links are then free to be reused by the next resize.
+ */
+static int sta_info_hash_resize(struct ieee80211_local *local,
+				unsigned int order)
+{
+	struct sta_hash_table *old_tbl = sta_hash_dereference(local);
+	struct sta_hash_table *new_tbl;
+	struct sta_info *sta;
+	u32 idx;
+
+	might_sleep();
+
+	new_tbl = sta_hash_table_alloc(order, !old_tbl->link);
+	if (!new_tbl)
+		return -ENOMEM;
+
+	list_for_each_entry(sta, &local->sta_list, list) {
+		idx = sta_hash_bucket(new_tbl, sta->sta.addr);
+		sta->hnext[new_tbl->link] = new_tbl->buckets[idx];
+		RCU_INIT_POINTER(new_tbl->buckets[idx], sta);
 	}
 
-	return -ENOENT;
+	rcu_assign_pointer(local->sta_hash, new_tbl);
+	synchronize_rcu();
+	sta_hash_table_free(old_tbl);
+
+	return 0;
+}
+
+/* Caller must hold local->sta_mtx */
+static void sta_info_hash_check_size(struct ieee80211_local *local)
+{
+	struct sta_hash_table *tbl = sta_hash_dereference(local);
+	unsigned long buckets = tbl->mask + 1;
+
+	if (local->num_sta > buckets && tbl->order < STA_HASH_MAX_ORDER) {
+		if (!sta_info_hash_resize(local, tbl->order + 1))
+			local->sta_hash_grows++;
+	} else if (local->num_sta < buckets / 4 &&
+		   tbl->order > STA_HASH_MIN_ORDER) {
+		if (!sta_info_hash_resize(local, tbl->order - 1))
+			local->sta_hash_shrinks++;
+	}
 }
 
 /* protected by RCU */
@@ -96,15 +181,18 @@ struct sta_info *sta_info_get(struct ieee80211_sub_if_data *sdata,
 			      const u8 *addr)
 {
 	struct ieee80211_local *local = sdata->local;
+	struct sta_hash_table *tbl;
 	struct sta_info *sta;
 
-	sta = rcu_dereference_check(local->sta_hash[STA_HASH(addr)],
+	tbl = rcu_dereference_check(local->sta_hash,
+				    lockdep_is_held(&local->sta_mtx));
+	sta = rcu_dereference_check(tbl->buckets[sta_hash_bucket(tbl, addr)],
 				    lockdep_is_held(&local->sta_mtx));
 	while (sta) {
 		if (sta->sdata == sdata &&
 		    ether_addr_equal(sta->sta.addr, addr))
 			break;
-		sta = rcu_dereference_check(sta->hnext,
+		sta = rcu_dereference_check(sta->hnext[tbl->link],
 					    lockdep_is_held(&local->sta_mtx));
 	}
 	return sta;
@@ -118,16 +206,19 @@ struct sta_info *sta_info_get_bss(struct ieee80211_sub_if_data *sdata,
 				  const u8 *addr)
 {
 	struct ieee80211_local *local = sdata->local;
+	struct sta_hash_table *tbl;
 	struct sta_info *sta;
 
-	sta = rcu_dereference_check(local->sta_hash[STA_HASH(addr)],
+	tbl = rcu_dereference_check(local->sta_hash,
+				    lockdep_is_held(&local->sta_mtx));
+	sta = rcu_dereference_check(tbl->buckets[sta_hash_bucket(tbl, addr)],
 				    lockdep_is_held(&local->sta_mtx));
 	while (sta) {
 		if ((sta->sdata == sdata ||
 		     (sta->sdata->bss && sta->sdata->bss == sdata->bss)) &&
 		    ether_addr_equal(sta->sta.addr, addr))
 			break;
-		sta = rcu_dereference_check(sta->hnext,
+		sta = rcu_dereference_check(sta->hnext[tbl->link],
 					    lockdep_is_held(&local->sta_mtx));
 	}
 	return sta;
@@ -153,6 +244,78 @@ struct sta_info *sta_info_get_by_idx(struct ieee80211_sub_if_data *sdata,
 	return NULL;
 }
 
+/**
+ * sta_get_stats - sum up the per-CPU counters of a STA
+ *
+ * @sta: the station
+ * @sum: filled with the totals, @sum->syncp is not used
+ */
+void sta_get_stats(struct sta_info *sta, struct sta_pcpu_stats *sum)
+{
+	struct ieee80211_local *local = sta->local;
+	ktime_t start = ktime_get();
+	int cpu;
+
+	memset(sum, 0, sizeof(*sum));
+
+	for_each_possible_cpu(cpu) {
+		struct sta_pcpu_stats *stats, tmp;
+		unsigned int seq;
+
+		stats = per_cpu_ptr(sta->pcpu_stats, cpu);
+		do {
+			seq = u64_stats_fetch_begin_bh(&stats->syncp);
+			tmp = *stats;
+		} while (u64_stats_fetch_retry_bh(&stats->syncp, seq));
+
+		sum->rx_packets += tmp.rx_packets;
+		sum->rx_bytes += tmp.rx_bytes;
+		sum->rx_fragments += tmp.rx_fragments;
+		sum->rx_dropped += tmp.rx_dropped;
+		sum->num_duplicates += tmp.num_duplicates;
+		sum->tx_packets += tmp.tx_packets;
+		sum->tx_bytes += tmp.tx_bytes;
+		sum->tx_fragments += tmp.tx_fragments;
+		sum->tx_filtered_count += tmp.tx_filtered_count;
+		sum->tx_retry_failed += tmp.tx_retry_failed;
+		sum->tx_retry_count += tmp.tx_retry_count;
+	}
+
+	atomic_inc(&local->sta_stats_folds);
+	atomic64_add(ktime_to_ns(ktime_sub(ktime_get(), start)),
+		     &local->sta_stats_fold_ns);
+}
+
+/**
+ * sta_info_get_next - get the STA following a dump cursor
+ *
+ * @sdata: interface the STAs are dumped for
+ * @cursor: position of the dump
+ *
+ * Continues right after the STA the cursor points to as long as the STA
+ * list didn't change, otherwise counts @cursor->idx STAs from the start
+ * since the STA might have been re-added at the end of the list.
+ *
+ * Locking: must hold local->sta_mtx or be in an RCU read section
+ */
+struct sta_info *sta_info_get_next(struct ieee80211_sub_if_data *sdata,
+				   const struct cfg80211_dump_cursor *cursor)
+{
+	struct ieee80211_local *local = sdata->local;
+	struct sta_info *sta = NULL;
+
+	if (cursor->idx && cursor->generation == local->sta_generation)
+		sta = sta_info_get(sdata, cursor->addr);
+	if (!sta)
+		return sta_info_get_by_idx(sdata, cursor->idx);
+
+	list_for_each_entry_continue_rcu(sta, &local->sta_list, list)
+		if (sta->sdata == sdata)
+			return sta;
+
+	return NULL;
+}
+
 /**
  * sta_info_free - free STA
  *
@@ -171,6 +334,7 @@ void sta_info_free(struct ieee80211_local *local, struct sta_info *sta)
 
 	sta_dbg(sta->sdata, "Destroyed STA %pM\n", sta->sta.addr);
 
+	free_percpu(sta->pcpu_stats);
 	kfree(sta);
 }
 
@@ -178,9 +342,12 @@ void sta_info_free(struct ieee80211_local *local, struct sta_info *sta)
 static void sta_info_hash_add(struct ieee80211_local *local,
 			      struct sta_info *sta)
 {
+	struct sta_hash_table *tbl = sta_hash_dereference(local);
+	u32 idx = sta_hash_bucket(tbl, sta->sta.addr);
+
 	lockdep_assert_held(&local->sta_mtx);
-	sta->hnext = local->sta_hash[STA_HASH(sta->sta.addr)];
-	rcu_assign_pointer(local->sta_hash[STA_HASH(sta->sta.addr)], sta);
+	sta->hnext[tbl->link] = tbl->buckets[idx];
+	rcu_assign_pointer(tbl->buckets[idx], sta);
 }
 
 static void sta_unblock(struct work_struct *wk)
@@ -254,6 +421,7 @@ struct sta_info *sta_info_alloc(struct ieee80211_sub_if_data *sdata,
 	do_posix_clock_monotonic_gettime(&uptime);
 	sta->last_connected = uptime.tv_sec;
 	ewma_init(&sta->avg_signal, 1024, 8);
+	ewma_init(&sta->avg_metric, 16, 8);
 
 	if (sta_prepare_rate_control(local, sta, gfp)) {
 		kfree(sta);
@@ -273,6 +441,8 @@ struct sta_info *sta_info_alloc(struct ieee80211_sub_if_data *sdata,
 		skb_queue_head_init(&sta->tx_filtered[i]);
 	}
 
+	ieee80211_txq_init(sta);
+
 	for (i = 0; i < NUM_RX_DATA_QUEUES; i++)
 		sta->last_seq_ctrl[i] = cpu_to_le16(USHRT_MAX);
 
@@ -376,6 +546,8 @@ static int sta_info_insert_finish(struct sta_info *sta) __acquires(RCU)
 
 	list_add_rcu(&sta->list, &local->sta_list);
 
+	sta_info_hash_check_size(local);
+
 	set_sta_flag(sta, WLAN_STA_INSERTED);
 
 	ieee80211_sta_debugfs_add(sta);
@@ -415,6 +587,18 @@ int sta_info_insert_rcu(struct sta_info *sta) __acquires(RCU)
 		goto out_free;
 	}
 
+	/*
+	 * Allocated here rather than in sta_info_alloc() since that may
+	 * be called in atomic context (IBSS), and nothing touches the
+	 * counters before the station is inserted.
+	 */
+	sta->pcpu_stats = alloc_percpu(struct sta_pcpu_stats);
+	if (!sta->pcpu_stats) {
+		err = -ENOMEM;
+		rcu_read_lock();
+		goto out_free;
+	}
+
 	mutex_lock(&local->sta_mtx);
 
 	err = sta_info_insert_finish(sta);
@@ -691,9 +875,17 @@ int __must_check __sta_info_destroy(struct sta_info *sta)
 
 	sta->dead = true;
 
+	/*
+	 * Don't hand queued frames to the driver after the station is
+	 * removed from it; frames still being queued are dropped below.
+	 */
+	ieee80211_txq_purge(local, sta);
+
 	local->num_sta--;
 	local->sta_generation++;
 
+	sta_info_hash_check_size(local);
+
 	if (sdata->vif.type == NL80211_IFTYPE_AP_VLAN)
 		RCU_INIT_POINTER(sdata->u.vlan.sta, NULL);
 
@@ -734,6 +926,8 @@ int __must_check __sta_info_destroy(struct sta_info *sta)
 		__skb_queue_purge(&sta->tx_filtered[ac]);
 	}
 
+	ieee80211_txq_purge(local, sta);
+
 #ifdef CONFIG_MAC80211_MESH
 	if (ieee80211_vif_is_mesh(&sdata->vif))
 		mesh_accept_plinks_update(sdata);
@@ -823,14 +1017,28 @@ static void sta_info_cleanup(unsigned long data)
 		  round_jiffies(jiffies + STA_INFO_CLEANUP_INTERVAL));
 }
 
-void sta_info_init(struct ieee80211_local *local)
+int sta_info_init(struct ieee80211_local *local)
 {
+	struct sta_hash_table *tbl;
+
+	tbl = sta_hash_table_alloc(STA_HASH_MIN_ORDER, 0);
+	if (!tbl)
+		return -ENOMEM;
+	RCU_INIT_POINTER(local->sta_hash, tbl);
+
 	spin_lock_init(&local->tim_lock);
 	mutex_init(&local->sta_mtx);
 	INIT_LIST_HEAD(&local->sta_list);
 
 	setup_timer(&local->sta_cleanup, sta_info_cleanup,
 		    (unsigned long)local);
+	return 0;
+}
+
+void sta_info_deinit(struct ieee80211_local *local)
+{
+	sta_hash_table_free(rcu_dereference_protected(local->sta_hash, 1));
+	RCU_INIT_POINTER(local->sta_hash, NULL);
 }
 
 void sta_info_stop(struct ieee80211_local *local)
@@ -893,13 +1101,14 @@ struct ieee80211_sta *ieee80211_find_sta_by_ifaddr(struct ieee80211_hw *hw,
 					       const u8 *addr,
 					       const u8 *localaddr)
 {
+	struct sta_hash_table *tbl;
 	struct sta_info *sta, *nxt;
 
 	/*
 	 * Just return a random station if localaddr is NULL
 	 * ... first in list.
 	 */
-	for_each_sta_info(hw_to_local(hw), addr, sta, nxt) {
+	for_each_sta_info(hw_to_local(hw), tbl, addr, sta, nxt) {
 		if (localaddr &&
 		    !ether_addr_equal(sta->sdata->vif.addr, localaddr))
 			continue;
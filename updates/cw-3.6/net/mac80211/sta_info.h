@@ -15,6 +15,10 @@
 #include <linux/workqueue.h>
 #include <linux/average.h>
 #include <linux/etherdevice.h>
+#include <linux/jhash.h>
+#include <linux/percpu.h>
+#include <linux/u64_stats_sync.h>
+#include <asm/unaligned.h>
 #include "key.h"
 
 /**
@@ -136,11 +140,36 @@ struct tid_ampdu_tx {
 	bool bar_pending;
 };
 
+/* one bucket per power of two up to IEEE80211_MAX_AMPDU_BUF stored MPDUs */
+#define IEEE80211_REORDER_DEPTH_HIST	7
+
+/**
+ * struct tid_ampdu_rx_stats - RX reorder buffer statistics
+ *
+ * @buffered: MPDUs that arrived out of order and had to be buffered
+ * @released: MPDUs released from the reorder buffer
+ * @released_timeout: MPDUs released because earlier ones timed out
+ * @batches: number of times a run of MPDUs was handed to the RX handlers
+ * @max_depth: largest number of MPDUs held in the reorder buffer at once
+ * @depth_hist: number of MPDUs held when a frame was buffered, in log2
+ *	buckets
+ */
+struct tid_ampdu_rx_stats {
+	u32 buffered;
+	u32 released;
+	u32 released_timeout;
+	u32 batches;
+	u16 max_depth;
+	u32 depth_hist[IEEE80211_REORDER_DEPTH_HIST];
+};
+
 /**
  * struct tid_ampdu_rx - TID aggregation information (Rx).
  *
  * @reorder_buf: buffer to reorder incoming aggregated MPDUs
  * @reorder_time: jiffies when skb was added
+ * @reorder_bitmap: occupied slots of @reorder_buf, so that runs of stored
+ *	frames and gaps can be found a word at a time
  * @session_timer: check if peer keeps Tx-ing on the TID (by timeout value)
  * @reorder_timer: releases expired frames from the reorder buffer.
  * @last_rx: jiffies of last rx activity
@@ -152,6 +181,7 @@ struct tid_ampdu_tx {
  * @dialog_token: dialog token for aggregation session
  * @rcu_head: RCU head used for freeing this struct
  * @reorder_lock: serializes access to reorder buffer, see below.
+ * @stats: reorder buffer statistics for this session, for debugfs
  *
  * This structure's lifetime is managed by RCU, assignments to
  * the array holding it must hold the aggregation mutex.
@@ -166,6 +196,7 @@ struct tid_ampdu_rx {
 	spinlock_t reorder_lock;
 	struct sk_buff **reorder_buf;
 	unsigned long *reorder_time;
+	DECLARE_BITMAP(reorder_bitmap, IEEE80211_MAX_AMPDU_BUF);
 	struct timer_list session_timer;
 	struct timer_list reorder_timer;
 	unsigned long last_rx;
@@ -175,6 +206,7 @@ struct tid_ampdu_rx {
 	u16 buf_size;
 	u16 timeout;
 	u8 dialog_token;
+	struct tid_ampdu_rx_stats stats;
 };
 
 /**
@@ -210,6 +242,129 @@ struct sta_ampdu_mlme {
 };
 
 
+/*
+ * Per-TID intermediate TX queues: at most this many frames are queued
+ * per TID, and each TID may send this many bytes per scheduling round.
+ */
+#define IEEE80211_TXQ_MAX_LEN	256
+#define IEEE80211_TXQ_QUANTUM	1514
+
+/* default CoDel parameters of the intermediate TX queues, in usecs */
+#define IEEE80211_CODEL_TARGET		20000
+#define IEEE80211_CODEL_INTERVAL	100000
+
+/**
+ * struct ieee80211_codel_params - CoDel parameters of an interface
+ *
+ * @target: acceptable standing queue delay, in usecs
+ * @interval: width of the window the queue delay is checked in, in usecs
+ * @ecn: mark ECN capable frames instead of dropping them where possible
+ */
+struct ieee80211_codel_params {
+	u32 target;
+	u32 interval;
+	bool ecn;
+};
+
+/**
+ * struct ieee80211_codel_vars - CoDel state of a queue
+ *
+ * This is the state of the CoDel algorithm as in &struct codel_vars,
+ * with times in usecs.
+ *
+ * @count: number of drops since entering the dropping state
+ * @lastcount: @count when the dropping state was entered
+ * @dropping: set while in the dropping state
+ * @rec_inv_sqrt: reciprocal value of sqrt(@count) >> 1
+ * @first_above_time: when the queue delay went (or will go) above the
+ *	target for an interval, 0 if it's below
+ * @drop_next: time to drop the next frame, or when the last was dropped
+ */
+struct ieee80211_codel_vars {
+	u32 count;
+	u32 lastcount;
+	bool dropping;
+	u16 rec_inv_sqrt;
+	u32 first_above_time;
+	u32 drop_next;
+};
+
+/**
+ * struct txq_info - per-TID intermediate TX queue
+ *
+ * Station data frames wait here, after the TX handlers have run, until
+ * they are handed to the driver. Queues with frames are kept on the
+ * active list of their hardware queue and served by deficit round robin,
+ * so a slow station can't fill a hardware queue on its own.
+ *
+ * @queue: frames waiting to be handed to the driver
+ * @schedule_order: entry in the active list of @hw_queue, empty if the
+ *	queue is not active
+ * @sta: station the frames are destined to
+ * @deficit: DRR deficit in bytes, the queue may send while it's >= 0
+ * @backlog_bytes: number of bytes in @queue
+ * @hw_queue: hardware queue the frames are destined for
+ * @tid: TID of the frames
+ * @enqueued: number of frames queued
+ * @dequeued: number of frames handed to the driver
+ * @drops: number of frames dropped because the queue was full or the
+ *	station went away
+ * @cvars: CoDel state
+ * @codel_drops: number of frames dropped by CoDel
+ * @codel_marks: number of frames ECN marked by CoDel
+ * @avg_sojourn: moving average of the time frames spent queued, in usecs
+ * @max_sojourn: longest time a frame spent queued, in usecs
+ *
+ * All fields are protected by the local txq_lock.
+ */
+struct txq_info {
+	struct sk_buff_head queue;
+	struct list_head schedule_order;
+	struct sta_info *sta;
+	int deficit;
+	unsigned int backlog_bytes;
+	u8 hw_queue;
+	u8 tid;
+
+	unsigned long enqueued, dequeued, drops;
+	struct ieee80211_codel_vars cvars;
+	u32 codel_drops, codel_marks;
+	struct ewma avg_sojourn;
+	unsigned int max_sojourn;
+};
+
+/**
+ * struct sta_pcpu_stats - per-CPU STA statistics
+ *
+ * The counters the RX, TX and TX status paths bump for every frame, kept
+ * per CPU so they don't share a cacheline between CPUs. They are only
+ * updated with BHs disabled; use sta_get_stats() to read them.
+ *
+ * @syncp: synchronizes 64-bit reads on 32-bit hosts
+ * @rx_packets: Number of MSDUs received from this STA
+ * @rx_bytes: Number of bytes received from this STA
+ * @rx_fragments: number of received MPDUs
+ * @rx_dropped: number of dropped MPDUs from this STA
+ * @num_duplicates: number of duplicate frames received from this STA
+ * @tx_packets: number of transmitted MSDUs
+ * @tx_bytes: number of bytes transmitted to this STA
+ * @tx_fragments: number of transmitted MPDUs
+ * @tx_filtered_count: number of frames the hardware filtered for this STA
+ * @tx_retry_failed: number of frames that failed retry
+ * @tx_retry_count: total number of retries for frames to this STA
+ */
+struct sta_pcpu_stats {
+	struct u64_stats_sync syncp;
+	u64 rx_packets, rx_bytes;
+	u64 rx_fragments;
+	u64 rx_dropped;
+	u64 num_duplicates;
+	u64 tx_packets, tx_bytes;
+	u64 tx_fragments;
+	u64 tx_filtered_count;
+	u64 tx_retry_failed, tx_retry_count;
+};
+
 /**
  * struct sta_info - STA information
  *
@@ -217,7 +372,8 @@ struct sta_ampdu_mlme {
  * mac80211 is communicating with.
  *
  * @list: global linked list entry
- * @hnext: hash table linked list pointer
+ * @hnext: hash table linked list pointers, the one in use is selected
+ *	by the @link member of the current &struct sta_hash_table
  * @local: pointer to the global information
  * @sdata: virtual interface this station belongs to
  * @ptk: peer key negotiated with this station, if any
@@ -240,24 +396,17 @@ struct sta_ampdu_mlme {
  *	entered power saving state, these are also delivered to
  *	the station when it leaves powersave or polls for frames
  * @driver_buffered_tids: bitmap of TIDs the driver has data buffered on
- * @rx_packets: Number of MSDUs received from this STA
- * @rx_bytes: Number of bytes received from this STA
+ * @txq: per-TID intermediate TX queues
+ * @pcpu_stats: per-CPU RX/TX counters, see &struct sta_pcpu_stats
  * @wep_weak_iv_count: number of weak WEP IVs received from this station
  * @last_rx: time (in jiffies) when last frame was received from this STA
  * @last_connected: time (in seconds) when a station got connected
- * @num_duplicates: number of duplicate frames received from this STA
- * @rx_fragments: number of received MPDUs
- * @rx_dropped: number of dropped MPDUs from this STA
  * @last_signal: signal of last received frame from this STA
  * @avg_signal: moving average of signal of received frames from this STA
  * @last_seq_ctrl: last received seq/frag number from this STA (per RX queue)
- * @tx_filtered_count: number of frames the hardware filtered for this STA
- * @tx_retry_failed: number of frames that failed retry
- * @tx_retry_count: total number of retries for frames to this STA
  * @fail_avg: moving percentage of failed MSDUs
- * @tx_packets: number of RX/TX MSDUs
- * @tx_bytes: number of bytes transmitted to this STA
- * @tx_fragments: number of transmitted MPDUs
+ * @avg_metric: moving average of the airtime link metric to this STA
+ * @metric_update: time (in jiffies) when @avg_metric was last updated
  * @tid_seq: per-TID sequence numbers for sending to this STA
  * @ampdu_mlme: A-MPDU state machine state
  * @timer_to_tid: identity mapping to ID timers
@@ -287,7 +436,7 @@ struct sta_ampdu_mlme {
 struct sta_info {
 	/* General information, mostly static */
 	struct list_head list;
-	struct sta_info __rcu *hnext;
+	struct sta_info __rcu *hnext[2];
 	struct ieee80211_local *local;
 	struct ieee80211_sub_if_data *sdata;
 	struct ieee80211_key __rcu *gtk[NUM_DEFAULT_KEYS + NUM_DEFAULT_MGMT_KEYS];
@@ -317,29 +466,26 @@ struct sta_info {
 	struct sk_buff_head tx_filtered[IEEE80211_NUM_ACS];
 	unsigned long driver_buffered_tids;
 
+	struct txq_info txq[STA_TID_NUM];
+
+	struct sta_pcpu_stats __percpu *pcpu_stats;
+
 	/* Updated from RX path only, no locking requirements */
-	unsigned long rx_packets, rx_bytes;
 	unsigned long wep_weak_iv_count;
 	unsigned long last_rx;
 	long last_connected;
-	unsigned long num_duplicates;
-	unsigned long rx_fragments;
-	unsigned long rx_dropped;
 	int last_signal;
 	struct ewma avg_signal;
 	/* Plus 1 for non-QoS frames */
 	__le16 last_seq_ctrl[NUM_RX_DATA_QUEUES + 1];
 
 	/* Updated from TX status path only, no locking requirements */
-	unsigned long tx_filtered_count;
-	unsigned long tx_retry_failed, tx_retry_count;
 	/* moving percentage of failed MSDUs */
 	unsigned int fail_avg;
+	struct ewma avg_metric;
+	unsigned long metric_update;
 
 	/* Updated from TX path only, no locking requirements */
-	unsigned long tx_packets;
-	unsigned long tx_bytes;
-	unsigned long tx_fragments;
 	struct ieee80211_tx_rate last_tx_rate;
 	int last_rx_rate_idx;
 	int last_rx_rate_flag;
@@ -386,6 +532,44 @@ struct sta_info {
 	struct ieee80211_sta sta;
 };
 
+/*
+ * Update per-CPU STA counters, BHs must be disabled. Use the
+ * sta_stats_begin()/sta_stats_end() pair to update several at once.
+ */
+static inline struct sta_pcpu_stats *sta_stats_begin(struct sta_info *sta)
+{
+	struct sta_pcpu_stats *stats = this_cpu_ptr(sta->pcpu_stats);
+
+	u64_stats_update_begin(&stats->syncp);
+	return stats;
+}
+
+static inline void sta_stats_end(struct sta_pcpu_stats *stats)
+{
+	u64_stats_update_end(&stats->syncp);
+}
+
+#define sta_stats_add(sta, field, val)					\
+	do {								\
+		struct sta_pcpu_stats *__stats = sta_stats_begin(sta);	\
+		__stats->field += (val);				\
+		sta_stats_end(__stats);					\
+	} while (0)
+
+#define sta_stats_inc(sta, field)	sta_stats_add(sta, field, 1)
+
+void sta_get_stats(struct sta_info *sta, struct sta_pcpu_stats *sum);
+
+/*
+ * Only store the time of the last RX when it changes, so busy stations
+ * don't dirty the cacheline for every frame.
+ */
+static inline void sta_update_last_rx(struct sta_info *sta)
+{
+	if (sta->last_rx != jiffies)
+		sta->last_rx = jiffies;
+}
+
 static inline enum nl80211_plink_state sta_plink_state(struct sta_info *sta)
 {
 #ifdef CONFIG_MAC80211_MESH
@@ -462,9 +646,43 @@ rcu_dereference_protected_tid_tx(struct sta_info *sta, int tid)
 					 lockdep_is_held(&sta->ampdu_mlme.mtx));
 }
 
-#define STA_HASH_SIZE 256
-#define STA_HASH(sta) (sta[5])
+/*
+ * The station hash table starts out with 2^STA_HASH_MIN_ORDER buckets
+ * and doubles whenever the number of stations exceeds the number of
+ * buckets, it is halved again when it becomes less than a quarter full.
+ */
+#define STA_HASH_MIN_ORDER	8
+#define STA_HASH_MAX_ORDER	14
+
+/**
+ * struct sta_hash_table - RCU protected, resizable station hash table
+ *
+ * @mask: number of buckets minus one
+ * @order: log2 of the number of buckets
+ * @seed: random seed for the hash function
+ * @link: index into &struct sta_info's @hnext used by this table,
+ *	a resize links all stations through the other one so readers
+ *	of the old table are not disturbed
+ * @buckets: the hash buckets
+ *
+ * The table is replaced as a whole when resized, under the
+ * station mutex; lookups must be done under RCU read lock.
+ */
+struct sta_hash_table {
+	u32 mask;
+	u32 seed;
+	u8 order;
+	u8 link;
+	struct sta_info __rcu *buckets[0];
+};
 
+static inline u32 sta_hash_bucket(const struct sta_hash_table *tbl,
+				  const u8 *addr)
+{
+	return jhash_2words(get_unaligned((const u32 *)addr),
+			    get_unaligned((const u16 *)(addr + 4)),
+			    tbl->seed) & tbl->mask;
+}
 
 /* Maximum number of frames to buffer per power saving station per AC */
 #define STA_MAX_TX_BUFFER	64
@@ -488,23 +706,26 @@ struct sta_info *sta_info_get_bss(struct ieee80211_sub_if_data *sdata,
 
 static inline
 void for_each_sta_info_type_check(struct ieee80211_local *local,
+				  struct sta_hash_table *tbl,
 				  const u8 *addr,
 				  struct sta_info *sta,
 				  struct sta_info *nxt)
 {
 }
 
-#define for_each_sta_info(local, _addr, _sta, nxt)			\
+#define for_each_sta_info(local, tbl, _addr, _sta, nxt)			\
 	for (	/* initialise loop */					\
-		_sta = rcu_dereference(local->sta_hash[STA_HASH(_addr)]),\
-		nxt = _sta ? rcu_dereference(_sta->hnext) : NULL;	\
+		tbl = rcu_dereference(local->sta_hash),			\
+		_sta = rcu_dereference(					\
+			tbl->buckets[sta_hash_bucket(tbl, _addr)]),	\
+		nxt = _sta ? rcu_dereference(_sta->hnext[tbl->link]) : NULL;\
 		/* typecheck */						\
-		for_each_sta_info_type_check(local, (_addr), _sta, nxt),\
+		for_each_sta_info_type_check(local, tbl, (_addr), _sta, nxt),\
 		/* continue condition */				\
 		_sta;							\
 		/* advance loop */					\
 		_sta = nxt,						\
-		nxt = _sta ? rcu_dereference(_sta->hnext) : NULL	\
+		nxt = _sta ? rcu_dereference(_sta->hnext[tbl->link]) : NULL\
 	     )								\
 	/* compare address and run code only if it matches */		\
 	if (ether_addr_equal(_sta->sta.addr, (_addr)))
@@ -514,6 +735,8 @@ void for_each_sta_info_type_check(struct ieee80211_local *local,
  */
 struct sta_info *sta_info_get_by_idx(struct ieee80211_sub_if_data *sdata,
 				     int idx);
+struct sta_info *sta_info_get_next(struct ieee80211_sub_if_data *sdata,
+				   const struct cfg80211_dump_cursor *cursor);
 /*
  * Create a new STA info, caller owns returned structure
  * until sta_info_insert().
@@ -542,7 +765,8 @@ int sta_info_destroy_addr_bss(struct ieee80211_sub_if_data *sdata,
 
 void sta_info_recalc_tim(struct sta_info *sta);
 
-void sta_info_init(struct ieee80211_local *local);
+int sta_info_init(struct ieee80211_local *local);
+void sta_info_deinit(struct ieee80211_local *local);
 void sta_info_stop(struct ieee80211_local *local);
 int sta_info_flush(struct ieee80211_local *local,
 		   struct ieee80211_sub_if_data *sdata);
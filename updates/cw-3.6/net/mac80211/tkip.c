@@ -105,11 +105,10 @@ static void tkip_mixing_phase1(const u8 *tk, struct tkip_ctx *ctx,
 	ctx->p1k_iv32 = tsc_IV32;
 }
 
-static void tkip_mixing_phase2(const u8 *tk, struct tkip_ctx *ctx,
+static void tkip_mixing_phase2(const u8 *tk, const u16 *p1k,
 			       u16 tsc_IV16, u8 *rc4key)
 {
 	u16 ppk[6];
-	const u16 *p1k = ctx->p1k;
 	int i;
 
 	ppk[0] = p1k[0];
@@ -212,26 +211,54 @@ void ieee80211_get_tkip_p2k(struct ieee80211_key_conf *keyconf,
 
 	spin_lock_irqsave(&key->u.tkip.txlock, flags);
 	ieee80211_compute_tkip_p1k(key, iv32);
-	tkip_mixing_phase2(tk, ctx, iv16, p2k);
+	tkip_mixing_phase2(tk, ctx->p1k, iv16, p2k);
 	spin_unlock_irqrestore(&key->u.tkip.txlock, flags);
 }
 EXPORT_SYMBOL(ieee80211_get_tkip_p2k);
 
+/*
+ * Called with the TX lock held, right after the frame's TSC has been
+ * assigned: bring the cached P1K up to date for the current IV32 and
+ * hand out a copy, so that phase 2 and RC4 can run without the lock.
+ */
+void ieee80211_tkip_get_tx_p1k(struct ieee80211_key *key, u16 *p1k)
+{
+	struct tkip_ctx *ctx = &key->u.tkip.tx;
+
+	ieee80211_compute_tkip_p1k(key, ctx->iv32);
+	memcpy(p1k, ctx->p1k, sizeof(ctx->p1k));
+}
+
+#ifdef CONFIG_MAC80211_CRYPTO_TEST
+/*
+ * Derive the per-packet RC4 key like the TX path does, with phase 1 only
+ * redone when @iv32 changes, but without needing an interface or key.
+ */
+void ieee80211_tkip_mix(const u8 *tk, const u8 *ta, struct tkip_ctx *ctx,
+			u32 iv32, u16 iv16, u8 *rc4key)
+{
+	if (ctx->p1k_iv32 != iv32 || ctx->state == TKIP_STATE_NOT_INIT)
+		tkip_mixing_phase1(tk, ctx, ta, iv32);
+	tkip_mixing_phase2(tk, ctx->p1k, iv16, rc4key);
+}
+#endif
+
 /*
  * Encrypt packet payload with TKIP using @key. @pos is a pointer to the
- * beginning of the buffer containing payload. This payload must include
- * the IV/Ext.IV and space for (taildroom) four octets for ICV.
+ * beginning of the buffer containing payload. This payload must have
+ * space for (taildroom) four octets for ICV. @p1k and @iv16 are the
+ * phase 1 key and low TSC bits the frame's IV was built from.
  * @payload_len is the length of payload (_not_ including IV/ICV length).
- * @ta is the transmitter addresses.
  */
 int ieee80211_tkip_encrypt_data(struct crypto_cipher *tfm,
 				struct ieee80211_key *key,
-				struct sk_buff *skb,
+				const u16 *p1k, u16 iv16,
 				u8 *payload, size_t payload_len)
 {
+	const u8 *tk = &key->conf.key[NL80211_TKIP_DATA_OFFSET_ENCR_KEY];
 	u8 rc4key[16];
 
-	ieee80211_get_tkip_p2k(&key->conf, skb, rc4key);
+	tkip_mixing_phase2(tk, p1k, iv16, rc4key);
 
 	return ieee80211_wep_encrypt_data(tfm, rc4key, 16,
 					  payload, payload_len);
@@ -279,8 +306,13 @@ int ieee80211_tkip_decrypt_data(struct crypto_cipher *tfm,
 		goto done;
 	}
 
+	/*
+	 * The P1K is cached per queue (TID) and tagged with the IV32 it
+	 * was computed for; RX for a queue is serialized, so no locking
+	 * is needed here.
+	 */
 	if (key->u.tkip.rx[queue].state == TKIP_STATE_NOT_INIT ||
-	    key->u.tkip.rx[queue].iv32 != iv32) {
+	    key->u.tkip.rx[queue].p1k_iv32 != iv32) {
 		/* IV16 wrapped around - perform TKIP phase 1 */
 		tkip_mixing_phase1(tk, &key->u.tkip.rx[queue], ta, iv32);
 	}
@@ -297,7 +329,7 @@ int ieee80211_tkip_decrypt_data(struct crypto_cipher *tfm,
 		key->u.tkip.rx[queue].state = TKIP_STATE_PHASE1_HW_UPLOADED;
 	}
 
-	tkip_mixing_phase2(tk, &key->u.tkip.rx[queue], iv16, rc4key);
+	tkip_mixing_phase2(tk, key->u.tkip.rx[queue].p1k, iv16, rc4key);
 
 	res = ieee80211_wep_decrypt_data(tfm, rc4key, 16, pos, payload_len - 12);
  done:
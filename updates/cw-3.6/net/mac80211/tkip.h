@@ -14,10 +14,11 @@
 #include "key.h"
 
 u8 *ieee80211_tkip_add_iv(u8 *pos, struct ieee80211_key *key);
+void ieee80211_tkip_get_tx_p1k(struct ieee80211_key *key, u16 *p1k);
 
 int ieee80211_tkip_encrypt_data(struct crypto_cipher *tfm,
 				struct ieee80211_key *key,
-				struct sk_buff *skb,
+				const u16 *p1k, u16 iv16,
 				u8 *payload, size_t payload_len);
 
 enum {
@@ -32,4 +33,9 @@ int ieee80211_tkip_decrypt_data(struct crypto_cipher *tfm,
 				u8 *ra, int only_iv, int queue,
 				u32 *out_iv32, u16 *out_iv16);
 
+#ifdef CONFIG_MAC80211_CRYPTO_TEST
+void ieee80211_tkip_mix(const u8 *tk, const u8 *ta, struct tkip_ctx *ctx,
+			u32 iv32, u16 iv16, u8 *rc4key);
+#endif
+
 #endif /* TKIP_H */
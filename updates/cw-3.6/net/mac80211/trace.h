@@ -1253,6 +1253,11 @@ DEFINE_EVENT(local_sdata_evt, drv_mgd_prepare_tx,
 	TP_ARGS(local, sdata)
 );
 
+DEFINE_EVENT(local_u32_evt, drv_wake_tx_queue,
+	TP_PROTO(struct ieee80211_local *local, u32 queue),
+	TP_ARGS(local, queue)
+);
+
 /*
  * Tracing for API calls that drivers call.
  */
@@ -1642,6 +1647,80 @@ TRACE_EVENT(stop_queue,
 	)
 );
 
+/*
+ * TX status as handed to rate control. Besides the status itself this
+ * records the capabilities rate control bases its decisions on, so the
+ * output is sufficient to replay a station's traffic offline (see
+ * tools/rcsim).
+ */
+TRACE_EVENT(tx_status,
+	TP_PROTO(struct ieee80211_local *local,
+		 struct ieee80211_sta *sta,
+		 struct sk_buff *skb),
+
+	TP_ARGS(local, sta, skb),
+
+	TP_STRUCT__entry(
+		LOCAL_ENTRY
+		STA_ENTRY
+		__field(u32, flags)
+		__field(u32, len)
+		__field(u16, fc)
+		__field(u8, band)
+		__field(u8, ampdu_len)
+		__field(u8, ampdu_ack_len)
+		__array(s8, idx, IEEE80211_TX_MAX_RATES)
+		__array(u8, count, IEEE80211_TX_MAX_RATES)
+		__array(u8, rc_flags, IEEE80211_TX_MAX_RATES)
+		__field(u32, supp_rates)
+		__field(u16, ht_cap)
+		__array(u8, rx_mask, 4)
+	),
+
+	TP_fast_assign(
+		struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
+		int i;
+
+		LOCAL_ASSIGN;
+		STA_ASSIGN;
+		__entry->flags = info->flags;
+		__entry->len = skb->len;
+		__entry->fc = le16_to_cpu(((struct ieee80211_hdr *)
+					   skb->data)->frame_control);
+		__entry->band = info->band;
+		__entry->ampdu_len = info->status.ampdu_len;
+		__entry->ampdu_ack_len = info->status.ampdu_ack_len;
+		for (i = 0; i < IEEE80211_TX_MAX_RATES; i++) {
+			__entry->idx[i] = info->status.rates[i].idx;
+			__entry->count[i] = info->status.rates[i].count;
+			__entry->rc_flags[i] = info->status.rates[i].flags;
+		}
+		__entry->supp_rates = sta->supp_rates[info->band];
+		__entry->ht_cap = sta->ht_cap.ht_supported ?
+				  sta->ht_cap.cap : 0;
+		memset(__entry->rx_mask, 0, sizeof(__entry->rx_mask));
+		if (sta->ht_cap.ht_supported)
+			memcpy(__entry->rx_mask, sta->ht_cap.mcs.rx_mask,
+			       sizeof(__entry->rx_mask));
+	),
+
+	TP_printk(
+		LOCAL_PR_FMT STA_PR_FMT " band:%u len:%u fc:0x%04x flags:0x%08x"
+		" ampdu:%u/%u rates:%d/%u/0x%02x,%d/%u/0x%02x,%d/%u/0x%02x,"
+		"%d/%u/0x%02x supp:0x%08x ht:%d/0x%04x mcs:%02x%02x%02x%02x",
+		LOCAL_PR_ARG, STA_PR_ARG, __entry->band, __entry->len,
+		__entry->fc, __entry->flags,
+		__entry->ampdu_ack_len, __entry->ampdu_len,
+		__entry->idx[0], __entry->count[0], __entry->rc_flags[0],
+		__entry->idx[1], __entry->count[1], __entry->rc_flags[1],
+		__entry->idx[2], __entry->count[2], __entry->rc_flags[2],
+		__entry->idx[3], __entry->count[3], __entry->rc_flags[3],
+		__entry->supp_rates, __entry->ht_cap != 0, __entry->ht_cap,
+		__entry->rx_mask[0], __entry->rx_mask[1],
+		__entry->rx_mask[2], __entry->rx_mask[3]
+	)
+);
+
 #ifdef CONFIG_MAC80211_MESSAGE_TRACING
 #undef TRACE_SYSTEM
 #define TRACE_SYSTEM mac80211_msg
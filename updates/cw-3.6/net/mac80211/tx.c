@@ -18,9 +18,11 @@
 #include <linux/etherdevice.h>
 #include <linux/bitmap.h>
 #include <linux/rcupdate.h>
+#include <linux/reciprocal_div.h>
 #include <linux/export.h>
 #include <net/net_namespace.h>
 #include <net/ieee80211_radiotap.h>
+#include <net/inet_ecn.h>
 #include <net/cfg80211.h>
 #include <net/mac80211.h>
 #include <asm/unaligned.h>
@@ -982,16 +984,19 @@ ieee80211_tx_h_fragment(struct ieee80211_tx_data *tx)
 static ieee80211_tx_result debug_noinline
 ieee80211_tx_h_stats(struct ieee80211_tx_data *tx)
 {
+	struct sta_pcpu_stats *stats;
 	struct sk_buff *skb;
 
 	if (!tx->sta)
 		return TX_CONTINUE;
 
-	tx->sta->tx_packets++;
+	stats = sta_stats_begin(tx->sta);
+	stats->tx_packets++;
 	skb_queue_walk(&tx->skbs, skb) {
-		tx->sta->tx_fragments++;
-		tx->sta->tx_bytes += skb->len;
+		stats->tx_fragments++;
+		stats->tx_bytes += skb->len;
 	}
+	sta_stats_end(stats);
 
 	return TX_CONTINUE;
 }
@@ -1113,19 +1118,12 @@ static bool ieee80211_tx_prep_agg(struct ieee80211_tx_data *tx,
 	return queued;
 }
 
-/*
- * initialises @tx
- */
-static ieee80211_tx_result
-ieee80211_tx_prepare(struct ieee80211_sub_if_data *sdata,
-		     struct ieee80211_tx_data *tx,
-		     struct sk_buff *skb)
+static void ieee80211_tx_init(struct ieee80211_sub_if_data *sdata,
+			      struct ieee80211_tx_data *tx,
+			      struct sk_buff *skb)
 {
 	struct ieee80211_local *local = sdata->local;
-	struct ieee80211_hdr *hdr;
 	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
-	int tid;
-	u8 *qc;
 
 	memset(tx, 0, sizeof(*tx));
 	tx->skb = skb;
@@ -1140,19 +1138,21 @@ ieee80211_tx_prepare(struct ieee80211_sub_if_data *sdata,
 	 * now.
 	 */
 	info->flags &= ~IEEE80211_TX_INTFL_NEED_TXPROCESSING;
+}
 
-	hdr = (struct ieee80211_hdr *) skb->data;
-
-	if (sdata->vif.type == NL80211_IFTYPE_AP_VLAN) {
-		tx->sta = rcu_dereference(sdata->u.vlan.sta);
-		if (!tx->sta && sdata->dev->ieee80211_ptr->use_4addr)
-			return TX_DROP;
-	} else if (info->flags & IEEE80211_TX_CTL_INJECTED ||
-		   tx->sdata->control_port_protocol == tx->skb->protocol) {
-		tx->sta = sta_info_get_bss(sdata, hdr->addr1);
-	}
-	if (!tx->sta)
-		tx->sta = sta_info_get(sdata, hdr->addr1);
+/*
+ * Per-frame part of ieee80211_tx_prepare(), @tx->sta must already be
+ * set up.
+ */
+static ieee80211_tx_result
+ieee80211_tx_prepare_frame(struct ieee80211_tx_data *tx)
+{
+	struct ieee80211_local *local = tx->local;
+	struct sk_buff *skb = tx->skb;
+	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *) skb->data;
+	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
+	int tid;
+	u8 *qc;
 
 	if (tx->sta && ieee80211_is_data_qos(hdr->frame_control) &&
 	    !ieee80211_is_qos_nullfunc(hdr->frame_control) &&
@@ -1198,6 +1198,494 @@ ieee80211_tx_prepare(struct ieee80211_sub_if_data *sdata,
 	return TX_CONTINUE;
 }
 
+/*
+ * initialises @tx
+ */
+static ieee80211_tx_result
+ieee80211_tx_prepare(struct ieee80211_sub_if_data *sdata,
+		     struct ieee80211_tx_data *tx,
+		     struct sk_buff *skb)
+{
+	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *) skb->data;
+	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
+
+	ieee80211_tx_init(sdata, tx, skb);
+
+	if (sdata->vif.type == NL80211_IFTYPE_AP_VLAN) {
+		tx->sta = rcu_dereference(sdata->u.vlan.sta);
+		if (!tx->sta && sdata->dev->ieee80211_ptr->use_4addr)
+			return TX_DROP;
+	} else if (info->flags & IEEE80211_TX_CTL_INJECTED ||
+		   tx->sdata->control_port_protocol == tx->skb->protocol) {
+		tx->sta = sta_info_get_bss(sdata, hdr->addr1);
+	}
+	if (!tx->sta)
+		tx->sta = sta_info_get(sdata, hdr->addr1);
+
+	return ieee80211_tx_prepare_frame(tx);
+}
+
+/*
+ * Intermediate TX queues
+ *
+ * Station data frames are queued per TID after the TX handlers ran and
+ * handed to the driver in deficit round robin order per hardware queue,
+ * either pulled by the driver with ieee80211_tx_dequeue() or pushed by
+ * mac80211 while the hardware queue isn't stopped. Frame enqueue times
+ * are kept in skb->tstamp, which isn't otherwise used on this path.
+ *
+ * As the frames have been through the TX handlers already, whatever the
+ * handlers decided has to be fixed up here when it changes: a station
+ * that goes to sleep gets its queued frames moved to its PS buffers, and
+ * a BlockAck session that ends takes the A-MPDU flag off the frames of
+ * its TID.
+ */
+void ieee80211_txq_init(struct sta_info *sta)
+{
+	struct txq_info *txqi;
+	int tid;
+
+	for (tid = 0; tid < STA_TID_NUM; tid++) {
+		txqi = &sta->txq[tid];
+		skb_queue_head_init(&txqi->queue);
+		INIT_LIST_HEAD(&txqi->schedule_order);
+		txqi->sta = sta;
+		txqi->tid = tid;
+		ewma_init(&txqi->avg_sojourn, 1024, 8);
+	}
+}
+
+void ieee80211_txq_purge(struct ieee80211_local *local, struct sta_info *sta)
+{
+	struct txq_info *txqi;
+	int tid;
+
+	spin_lock_bh(&local->txq_lock);
+	for (tid = 0; tid < STA_TID_NUM; tid++) {
+		txqi = &sta->txq[tid];
+		local->txq_backlog[txqi->hw_queue] -=
+			skb_queue_len(&txqi->queue);
+		txqi->drops += skb_queue_len(&txqi->queue);
+		txqi->backlog_bytes = 0;
+		__skb_queue_purge(&txqi->queue);
+		list_del_init(&txqi->schedule_order);
+	}
+	spin_unlock_bh(&local->txq_lock);
+}
+
+void ieee80211_txq_ps_buffer(struct ieee80211_local *local,
+			     struct sta_info *sta)
+{
+	struct ieee80211_tx_info *info;
+	struct sk_buff_head frames;
+	struct txq_info *txqi;
+	struct sk_buff *skb;
+	int tid, ac, buffered = 0;
+
+	__skb_queue_head_init(&frames);
+
+	spin_lock_bh(&local->txq_lock);
+	for (tid = 0; tid < STA_TID_NUM; tid++) {
+		txqi = &sta->txq[tid];
+		local->txq_backlog[txqi->hw_queue] -=
+			skb_queue_len(&txqi->queue);
+		txqi->backlog_bytes = 0;
+		skb_queue_splice_tail_init(&txqi->queue, &frames);
+		list_del_init(&txqi->schedule_order);
+	}
+	spin_unlock_bh(&local->txq_lock);
+
+	/*
+	 * Anything the TX handlers buffered in the meantime is newer, so
+	 * put these in front of it, newest first; a full buffer then drops
+	 * the oldest frames like the handlers do.
+	 */
+	while ((skb = __skb_dequeue_tail(&frames))) {
+		ac = skb_get_queue_mapping(skb);
+		if (skb_queue_len(&sta->ps_tx_buf[ac]) >= STA_MAX_TX_BUFFER) {
+			ieee80211_free_txskb(&local->hw, skb);
+			continue;
+		}
+
+		info = IEEE80211_SKB_CB(skb);
+		info->control.jiffies = jiffies;
+		skb_queue_head(&sta->ps_tx_buf[ac], skb);
+		buffered++;
+	}
+
+	if (!buffered)
+		return;
+
+	local->total_ps_buffered += buffered;
+	if (!timer_pending(&local->sta_cleanup))
+		mod_timer(&local->sta_cleanup,
+			  round_jiffies(jiffies + STA_INFO_CLEANUP_INTERVAL));
+	sta_info_recalc_tim(sta);
+}
+
+void ieee80211_txq_agg_stop(struct ieee80211_local *local,
+			    struct sta_info *sta, int tid)
+{
+	struct txq_info *txqi = &sta->txq[tid];
+	struct sk_buff *skb;
+
+	spin_lock_bh(&local->txq_lock);
+	skb_queue_walk(&txqi->queue, skb)
+		IEEE80211_SKB_CB(skb)->flags &= ~IEEE80211_TX_CTL_AMPDU;
+	spin_unlock_bh(&local->txq_lock);
+}
+
+/* take the next frame off an intermediate queue, with txq_lock held */
+static struct sk_buff *ieee80211_txq_pop(struct ieee80211_local *local,
+					 struct txq_info *txqi, ktime_t now)
+{
+	struct sk_buff *skb;
+	unsigned int sojourn;
+
+	skb = __skb_dequeue(&txqi->queue);
+	if (!skb)
+		return NULL;
+
+	local->txq_backlog[txqi->hw_queue]--;
+	txqi->backlog_bytes -= skb->len;
+
+	sojourn = ktime_us_delta(now, skb->tstamp);
+	ewma_add(&txqi->avg_sojourn, sojourn);
+	txqi->max_sojourn = max(txqi->max_sojourn, sojourn);
+
+	return skb;
+}
+
+/*
+ * CoDel, as in include/net/codel.h but on the intermediate queues: frames
+ * are dropped, or ECN marked, at dequeue once their queueing delay stayed
+ * above the target for an interval. Times are in usecs.
+ */
+#define IEEE80211_CODEL_REC_INV_SQRT_SHIFT	(32 - 16)
+
+static void ieee80211_codel_newton_step(struct ieee80211_codel_vars *vars)
+{
+	u32 invsqrt = ((u32)vars->rec_inv_sqrt) <<
+		      IEEE80211_CODEL_REC_INV_SQRT_SHIFT;
+	u32 invsqrt2 = ((u64)invsqrt * invsqrt) >> 32;
+	u64 val = (3LL << 32) - ((u64)vars->count * invsqrt2);
+
+	val >>= 2; /* avoid overflow in following multiply */
+	val = (val * invsqrt) >> (32 - 2 + 1);
+
+	vars->rec_inv_sqrt = val >> IEEE80211_CODEL_REC_INV_SQRT_SHIFT;
+}
+
+/* t + interval / sqrt(count) */
+static u32 ieee80211_codel_control_law(u32 t, u32 interval, u16 rec_inv_sqrt)
+{
+	return t + reciprocal_divide(interval, (u32)rec_inv_sqrt <<
+				     IEEE80211_CODEL_REC_INV_SQRT_SHIFT);
+}
+
+static bool ieee80211_codel_should_drop(struct sk_buff *skb,
+					struct txq_info *txqi,
+					struct ieee80211_codel_params *cparams,
+					u32 now)
+{
+	struct ieee80211_codel_vars *vars = &txqi->cvars;
+	u32 enqueue_time;
+
+	if (!skb) {
+		vars->first_above_time = 0;
+		return false;
+	}
+
+	enqueue_time = ktime_to_us(skb->tstamp);
+	if ((s32)(now - enqueue_time) < (s32)cparams->target ||
+	    txqi->backlog_bytes <= ETH_FRAME_LEN) {
+		/* went below - stay below for at least interval */
+		vars->first_above_time = 0;
+		return false;
+	}
+
+	if (!vars->first_above_time) {
+		/*
+		 * just went above from below, if we stay above for at
+		 * least interval it's ok to drop
+		 */
+		vars->first_above_time = (now + cparams->interval) | 1;
+		return false;
+	}
+
+	return (s32)(now - vars->first_above_time) > 0;
+}
+
+/*
+ * ECN mark a frame instead of dropping it, if its IP header is still in
+ * the clear: not encrypted or MIC protected in software, and not a
+ * fragment.
+ */
+static bool ieee80211_codel_mark(struct ieee80211_codel_params *cparams,
+				 struct sk_buff *skb)
+{
+	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
+	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *)skb->data;
+	struct ieee80211_key_conf *hw_key = info->control.hw_key;
+
+	if (!cparams->ecn)
+		return false;
+
+	if (ieee80211_has_protected(hdr->frame_control) &&
+	    (!hw_key || (hw_key->flags & IEEE80211_KEY_FLAG_GENERATE_MMIC)))
+		return false;
+
+	if (ieee80211_has_morefrags(hdr->frame_control) ||
+	    (hdr->seq_ctrl & cpu_to_le16(IEEE80211_SCTL_FRAG)))
+		return false;
+
+	return INET_ECN_set_ce(skb);
+}
+
+static void ieee80211_codel_drop(struct ieee80211_sub_if_data *sdata,
+				 struct txq_info *txqi, struct sk_buff *skb)
+{
+	txqi->codel_drops++;
+	sdata->codel_drops++;
+	dev_kfree_skb(skb);
+}
+
+static struct sk_buff *ieee80211_txq_codel_dequeue(struct ieee80211_local *local,
+						   struct txq_info *txqi)
+{
+	struct ieee80211_sub_if_data *sdata = txqi->sta->sdata;
+	struct ieee80211_codel_params *cparams = &sdata->codel;
+	struct ieee80211_codel_vars *vars = &txqi->cvars;
+	ktime_t ktime = ktime_get();
+	u32 now = ktime_to_us(ktime);
+	struct sk_buff *skb;
+	bool drop;
+
+	skb = ieee80211_txq_pop(local, txqi, ktime);
+	if (!skb) {
+		vars->dropping = false;
+		return NULL;
+	}
+
+	drop = ieee80211_codel_should_drop(skb, txqi, cparams, now);
+	if (vars->dropping) {
+		if (!drop) {
+			/* sojourn time below target - leave dropping state */
+			vars->dropping = false;
+			return skb;
+		}
+
+		/*
+		 * A large backlog might result in drop rates so high that
+		 * the next drop should happen now, hence the loop.
+		 */
+		while (vars->dropping &&
+		       (s32)(now - vars->drop_next) >= 0) {
+			vars->count++;
+			ieee80211_codel_newton_step(vars);
+			if (ieee80211_codel_mark(cparams, skb)) {
+				txqi->codel_marks++;
+				sdata->codel_marks++;
+				vars->drop_next = ieee80211_codel_control_law(
+						vars->drop_next,
+						cparams->interval,
+						vars->rec_inv_sqrt);
+				return skb;
+			}
+
+			ieee80211_codel_drop(sdata, txqi, skb);
+			skb = ieee80211_txq_pop(local, txqi, ktime);
+			if (!ieee80211_codel_should_drop(skb, txqi, cparams,
+							 now))
+				vars->dropping = false;
+			else
+				vars->drop_next = ieee80211_codel_control_law(
+						vars->drop_next,
+						cparams->interval,
+						vars->rec_inv_sqrt);
+		}
+	} else if (drop) {
+		if (ieee80211_codel_mark(cparams, skb)) {
+			txqi->codel_marks++;
+			sdata->codel_marks++;
+		} else {
+			ieee80211_codel_drop(sdata, txqi, skb);
+			skb = ieee80211_txq_pop(local, txqi, ktime);
+			ieee80211_codel_should_drop(skb, txqi, cparams, now);
+		}
+		vars->dropping = true;
+
+		/*
+		 * if we went above target close to when we last went below
+		 * it, the drop rate that controlled the queue on the last
+		 * cycle is a good starting point to control it now
+		 */
+		if ((s32)(now - vars->drop_next) <
+		    (s32)(16 * cparams->interval)) {
+			vars->count = (vars->count - vars->lastcount) | 1;
+			ieee80211_codel_newton_step(vars);
+		} else {
+			vars->count = 1;
+			vars->rec_inv_sqrt =
+				~0U >> IEEE80211_CODEL_REC_INV_SQRT_SHIFT;
+		}
+		vars->lastcount = vars->count;
+		vars->drop_next = ieee80211_codel_control_law(now,
+						cparams->interval,
+						vars->rec_inv_sqrt);
+	}
+
+	return skb;
+}
+
+struct sk_buff *ieee80211_tx_dequeue(struct ieee80211_hw *hw, int queue)
+{
+	struct ieee80211_local *local = hw_to_local(hw);
+	struct list_head *active = &local->active_txqs[queue];
+	struct txq_info *txqi;
+	struct sk_buff *skb = NULL;
+
+	if (WARN_ON(queue >= hw->queues))
+		return NULL;
+
+	spin_lock_bh(&local->txq_lock);
+	while (!list_empty(active)) {
+		txqi = list_first_entry(active, struct txq_info,
+					schedule_order);
+
+		if (txqi->deficit < 0) {
+			txqi->deficit += IEEE80211_TXQ_QUANTUM;
+			list_move_tail(&txqi->schedule_order, active);
+			continue;
+		}
+
+		skb = ieee80211_txq_codel_dequeue(local, txqi);
+		if (skb_queue_empty(&txqi->queue))
+			list_del_init(&txqi->schedule_order);
+		if (!skb)
+			continue;
+
+		txqi->deficit -= skb->len;
+		txqi->dequeued++;
+		break;
+	}
+	spin_unlock_bh(&local->txq_lock);
+
+	return skb;
+}
+EXPORT_SYMBOL(ieee80211_tx_dequeue);
+
+static bool ieee80211_txq_can_push(struct ieee80211_local *local, int queue)
+{
+	unsigned long flags;
+	bool ret;
+
+	spin_lock_irqsave(&local->queue_stop_reason_lock, flags);
+	ret = !local->queue_stop_reasons[queue] &&
+	      skb_queue_empty(&local->pending[queue]);
+	spin_unlock_irqrestore(&local->queue_stop_reason_lock, flags);
+
+	return ret;
+}
+
+/*
+ * Pass queued frames to a driver that doesn't pull them. Only one context
+ * pushes a hardware queue at a time, so that the frames of a TID reach
+ * the driver in order.
+ */
+static void ieee80211_txq_push(struct ieee80211_local *local, int queue)
+{
+	struct sk_buff *skb;
+
+	while (local->txq_backlog[queue] &&
+	       ieee80211_txq_can_push(local, queue)) {
+		if (test_and_set_bit_lock(queue, &local->txq_pushing))
+			return;
+
+		while (ieee80211_txq_can_push(local, queue)) {
+			skb = ieee80211_tx_dequeue(&local->hw, queue);
+			if (!skb)
+				break;
+			drv_tx(local, skb);
+		}
+
+		clear_bit_unlock(queue, &local->txq_pushing);
+		/* recheck for frames queued while we held the bit */
+		smp_mb__after_clear_bit();
+	}
+}
+
+/*
+ * Queue station data frames on the intermediate queue of their TID.
+ * Returns false if the frames have to be passed to the driver directly.
+ */
+static bool ieee80211_txq_enqueue(struct ieee80211_local *local,
+				  struct ieee80211_vif *vif,
+				  struct ieee80211_sta *pubsta,
+				  struct sk_buff_head *skbs)
+{
+	struct sta_info *sta = container_of(pubsta, struct sta_info, sta);
+	struct sk_buff *skb = skb_peek(skbs);
+	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
+	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *)skb->data;
+	struct txq_info *txqi;
+	int q = info->hw_queue;
+	u8 tid;
+
+	if (!ieee80211_is_data_present(hdr->frame_control) ||
+	    (info->flags & (IEEE80211_TX_CTL_TX_OFFCHAN |
+			    IEEE80211_TX_CTL_NO_PS_BUFFER)))
+		return false;
+
+	/* non-QoS stations get scheduled through their TID 0 queue */
+	if (ieee80211_is_data_qos(hdr->frame_control))
+		tid = *ieee80211_get_qos_ctl(hdr) & IEEE80211_QOS_CTL_TID_MASK;
+	else
+		tid = 0;
+	txqi = &sta->txq[tid];
+
+	spin_lock_bh(&local->txq_lock);
+	while ((skb = __skb_dequeue(skbs))) {
+		info = IEEE80211_SKB_CB(skb);
+		info->control.vif = vif;
+		info->control.sta = pubsta;
+
+		if (sta->dead ||
+		    skb_queue_len(&txqi->queue) >= IEEE80211_TXQ_MAX_LEN) {
+			txqi->drops++;
+			dev_kfree_skb(skb);
+			continue;
+		}
+
+		skb->tstamp = ktime_get();
+		txqi->backlog_bytes += skb->len;
+		txqi->enqueued++;
+		local->txq_backlog[q]++;
+		__skb_queue_tail(&txqi->queue, skb);
+	}
+
+	if (!skb_queue_empty(&txqi->queue) &&
+	    list_empty(&txqi->schedule_order)) {
+		txqi->hw_queue = q;
+		list_add_tail(&txqi->schedule_order, &local->active_txqs[q]);
+	}
+	spin_unlock_bh(&local->txq_lock);
+
+	/* the station went to sleep after the TX handlers looked at it */
+	if (unlikely(test_sta_flag(sta, WLAN_STA_PS_STA) ||
+		     test_sta_flag(sta, WLAN_STA_PS_DRIVER))) {
+		ieee80211_txq_ps_buffer(local, sta);
+		return true;
+	}
+
+	if (local->ops->wake_tx_queue)
+		drv_wake_tx_queue(local, q);
+	else
+		ieee80211_txq_push(local, q);
+
+	return true;
+}
+
 static bool ieee80211_tx_frags(struct ieee80211_local *local,
 			       struct ieee80211_vif *vif,
 			       struct ieee80211_sta *sta,
@@ -1207,6 +1695,9 @@ static bool ieee80211_tx_frags(struct ieee80211_local *local,
 	struct sk_buff *skb, *tmp;
 	unsigned long flags;
 
+	if (sta && !txpending && ieee80211_txq_enqueue(local, vif, sta, skbs))
+		return true;
+
 	skb_queue_walk_safe(skbs, skb, tmp) {
 		struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
 		int q = info->hw_queue;
@@ -1312,14 +1803,23 @@ static bool __ieee80211_tx(struct ieee80211_local *local,
 	return result;
 }
 
-/*
- * Invoke TX handlers, return 0 on success and non-zero if the
- * frame was dropped or queued.
- */
-static int invoke_tx_handlers(struct ieee80211_tx_data *tx)
+static int ieee80211_tx_h_done(struct ieee80211_tx_data *tx,
+			       ieee80211_tx_result res)
 {
-	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(tx->skb);
-	ieee80211_tx_result res = TX_DROP;
+	if (unlikely(res == TX_DROP)) {
+		I802_DEBUG_INC(tx->local->tx_handlers_drop);
+		if (tx->skb)
+			dev_kfree_skb(tx->skb);
+		else
+			__skb_queue_purge(&tx->skbs);
+		return -1;
+	} else if (unlikely(res == TX_QUEUED)) {
+		I802_DEBUG_INC(tx->local->tx_handlers_queued);
+		return -1;
+	}
+
+	return 0;
+}
 
 #define CALL_TXH(txh) \
 	do {				\
@@ -1328,6 +1828,15 @@ static int invoke_tx_handlers(struct ieee80211_tx_data *tx)
 			goto txh_done;	\
 	} while (0)
 
+/*
+ * Invoke the TX handlers up to and including rate control, i.e. those
+ * that set up the per-station state of the frame. Returns 0 on success
+ * and non-zero if the frame was dropped or queued.
+ */
+static int invoke_tx_handlers_early(struct ieee80211_tx_data *tx)
+{
+	ieee80211_tx_result res = TX_DROP;
+
 	CALL_TXH(ieee80211_tx_h_dynamic_ps);
 	CALL_TXH(ieee80211_tx_h_check_assoc);
 	CALL_TXH(ieee80211_tx_h_ps_buf);
@@ -1336,6 +1845,19 @@ static int invoke_tx_handlers(struct ieee80211_tx_data *tx)
 	if (!(tx->local->hw.flags & IEEE80211_HW_HAS_RATE_CONTROL))
 		CALL_TXH(ieee80211_tx_h_rate_ctrl);
 
+ txh_done:
+	return ieee80211_tx_h_done(tx, res);
+}
+
+/*
+ * Invoke the remaining, per-frame TX handlers, same return value as
+ * invoke_tx_handlers_early().
+ */
+static int invoke_tx_handlers_late(struct ieee80211_tx_data *tx)
+{
+	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(tx->skb);
+	ieee80211_tx_result res = TX_CONTINUE;
+
 	if (unlikely(info->flags & IEEE80211_TX_INTFL_RETRANSMISSION)) {
 		__skb_queue_tail(&tx->skbs, tx->skb);
 		tx->skb = NULL;
@@ -1350,22 +1872,37 @@ static int invoke_tx_handlers(struct ieee80211_tx_data *tx)
 	CALL_TXH(ieee80211_tx_h_encrypt);
 	if (!(tx->local->hw.flags & IEEE80211_HW_HAS_RATE_CONTROL))
 		CALL_TXH(ieee80211_tx_h_calculate_duration);
-#undef CALL_TXH
 
  txh_done:
-	if (unlikely(res == TX_DROP)) {
-		I802_DEBUG_INC(tx->local->tx_handlers_drop);
-		if (tx->skb)
-			dev_kfree_skb(tx->skb);
-		else
-			__skb_queue_purge(&tx->skbs);
-		return -1;
-	} else if (unlikely(res == TX_QUEUED)) {
-		I802_DEBUG_INC(tx->local->tx_handlers_queued);
-		return -1;
-	}
+	return ieee80211_tx_h_done(tx, res);
+}
 
-	return 0;
+/*
+ * Invoke TX handlers, return 0 on success and non-zero if the
+ * frame was dropped or queued.
+ */
+static int invoke_tx_handlers(struct ieee80211_tx_data *tx)
+{
+	int r = invoke_tx_handlers_early(tx);
+
+	if (r)
+		return r;
+	return invoke_tx_handlers_late(tx);
+}
+
+static void ieee80211_tx_setup_queue(struct ieee80211_tx_data *tx)
+{
+	struct ieee80211_local *local = tx->local;
+	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(tx->skb);
+
+	tx->channel = local->hw.conf.channel;
+	info->band = tx->channel->band;
+
+	/* set up hw_queue value early */
+	if (!(info->flags & IEEE80211_TX_CTL_TX_OFFCHAN) ||
+	    !(local->hw.flags & IEEE80211_HW_QUEUE_CONTROL))
+		info->hw_queue =
+			tx->sdata->vif.hw_queue[skb_get_queue_mapping(tx->skb)];
 }
 
 /*
@@ -1377,7 +1914,6 @@ static bool ieee80211_tx(struct ieee80211_sub_if_data *sdata,
 	struct ieee80211_local *local = sdata->local;
 	struct ieee80211_tx_data tx;
 	ieee80211_tx_result res_prepare;
-	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
 	bool result = true;
 	int led_len;
 
@@ -1399,14 +1935,7 @@ static bool ieee80211_tx(struct ieee80211_sub_if_data *sdata,
 		goto out;
 	}
 
-	tx.channel = local->hw.conf.channel;
-	info->band = tx.channel->band;
-
-	/* set up hw_queue value early */
-	if (!(info->flags & IEEE80211_TX_CTL_TX_OFFCHAN) ||
-	    !(local->hw.flags & IEEE80211_HW_QUEUE_CONTROL))
-		info->hw_queue =
-			sdata->vif.hw_queue[skb_get_queue_mapping(skb)];
+	ieee80211_tx_setup_queue(&tx);
 
 	if (!invoke_tx_handlers(&tx))
 		result = __ieee80211_tx(local, &tx.skbs, led_len,
@@ -1416,27 +1945,268 @@ static bool ieee80211_tx(struct ieee80211_sub_if_data *sdata,
 	return result;
 }
 
+/*
+ * Batched transmission
+ *
+ * Consecutive unicast QoS data frames to the same station and TID, e.g.
+ * the segments of one GSO frame, get the same station, key and rate
+ * control decision. Only the first frame of a batch goes through the
+ * station lookup, key selection and rate control; the others take them
+ * from struct ieee80211_tx_batch and only run the handlers that do need
+ * to look at every frame (power save buffering, sequence numbers,
+ * fragmentation, encryption, duration).
+ *
+ * If the rate control algorithm marked the first frame as a probe, the
+ * next frame asks it again.
+ */
+struct ieee80211_tx_batch {
+	struct sta_info *sta;
+	struct ieee80211_key *key;
+	struct ieee80211_key_conf *hw_key;
+	struct ieee80211_tx_rate rates[IEEE80211_TX_MAX_RATES];
+	u32 rate_flags;
+	s8 rts_cts_rate_idx;
+	u8 tid;
+	bool rts;
+	bool have_rates;
+};
+
+static bool ieee80211_tx_batch_rts(struct ieee80211_local *local,
+				   struct sk_buff *skb)
+{
+	u32 len = min_t(u32, skb->len + FCS_LEN,
+			     local->hw.wiphy->frag_threshold);
+
+	return len > local->hw.wiphy->rts_threshold;
+}
+
+static bool ieee80211_tx_batch_eligible(struct ieee80211_sub_if_data *sdata,
+					struct sk_buff *skb)
+{
+	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
+	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *) skb->data;
+
+	if (info->flags & (IEEE80211_TX_CTL_INJECTED |
+			   IEEE80211_TX_CTL_NO_ACK |
+			   IEEE80211_TX_CTL_USE_MINRATE |
+			   IEEE80211_TX_CTL_TX_OFFCHAN |
+			   IEEE80211_TX_INTFL_DONT_ENCRYPT |
+			   IEEE80211_TX_INTFL_RETRANSMISSION))
+		return false;
+
+	if (skb->protocol == sdata->control_port_protocol)
+		return false;
+
+	return ieee80211_is_data_qos(hdr->frame_control) &&
+	       !ieee80211_is_qos_nullfunc(hdr->frame_control) &&
+	       !is_multicast_ether_addr(hdr->addr1);
+}
+
+static bool ieee80211_tx_batch_match(struct ieee80211_sub_if_data *sdata,
+				     struct ieee80211_tx_batch *batch,
+				     struct sk_buff *skb)
+{
+	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *) skb->data;
+	u8 tid;
+
+	if (!batch->sta || !ieee80211_tx_batch_eligible(sdata, skb))
+		return false;
+
+	tid = *ieee80211_get_qos_ctl(hdr) & IEEE80211_QOS_CTL_TID_MASK;
+
+	return tid == batch->tid &&
+	       ether_addr_equal(hdr->addr1, batch->sta->sta.addr) &&
+	       ieee80211_tx_batch_rts(sdata->local, skb) == batch->rts;
+}
+
+static void ieee80211_tx_batch_save_rates(struct ieee80211_tx_batch *batch,
+					  struct ieee80211_tx_info *info)
+{
+	batch->have_rates = !(info->flags & IEEE80211_TX_CTL_RATE_CTRL_PROBE);
+	memcpy(batch->rates, info->control.rates, sizeof(batch->rates));
+	batch->rts_cts_rate_idx = info->control.rts_cts_rate_idx;
+	/* minstrel_ht sets these along with the rates */
+	batch->rate_flags = info->flags & (IEEE80211_TX_CTL_STBC |
+					   IEEE80211_TX_CTL_LDPC);
+}
+
+/* take the batch state from a frame that went through all handlers */
+static void ieee80211_tx_batch_start(struct ieee80211_tx_batch *batch,
+				     struct ieee80211_tx_data *tx)
+{
+	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(tx->skb);
+	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *) tx->skb->data;
+
+	batch->sta = NULL;
+	if (!tx->sta || !ieee80211_tx_batch_eligible(tx->sdata, tx->skb))
+		return;
+
+	batch->sta = tx->sta;
+	batch->tid = *ieee80211_get_qos_ctl(hdr) & IEEE80211_QOS_CTL_TID_MASK;
+	batch->rts = ieee80211_tx_batch_rts(tx->local, tx->skb);
+	batch->key = tx->key;
+	batch->hw_key = info->control.hw_key;
+	ieee80211_tx_batch_save_rates(batch, info);
+}
+
+/*
+ * Counterpart of invoke_tx_handlers_early() for the following frames
+ * of a batch.
+ */
+static int invoke_tx_handlers_batch(struct ieee80211_tx_data *tx,
+				    struct ieee80211_tx_batch *batch)
+{
+	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(tx->skb);
+	ieee80211_tx_result res = TX_DROP;
+
+	CALL_TXH(ieee80211_tx_h_dynamic_ps);
+	CALL_TXH(ieee80211_tx_h_check_assoc);
+	CALL_TXH(ieee80211_tx_h_ps_buf);
+
+	tx->key = batch->key;
+	if (tx->key) {
+		if (unlikely(tx->key->flags & KEY_FLAG_TAINTED)) {
+			res = TX_DROP;
+			goto txh_done;
+		}
+		tx->key->tx_rx_count++;
+		info->control.hw_key = batch->hw_key;
+	}
+
+	if (!(tx->local->hw.flags & IEEE80211_HW_HAS_RATE_CONTROL)) {
+		if (batch->have_rates) {
+			memcpy(info->control.rates, batch->rates,
+			       sizeof(batch->rates));
+			info->control.rts_cts_rate_idx =
+				batch->rts_cts_rate_idx;
+			info->flags |= batch->rate_flags;
+		} else {
+			CALL_TXH(ieee80211_tx_h_rate_ctrl);
+			ieee80211_tx_batch_save_rates(batch, info);
+		}
+	}
+
+ txh_done:
+	return ieee80211_tx_h_done(tx, res);
+}
+
+#undef CALL_TXH
+
+/*
+ * Transmit a list of frames, sharing the per-station work between
+ * consecutive frames where possible. Called under RCU read lock.
+ */
+static void ieee80211_tx_batch(struct ieee80211_sub_if_data *sdata,
+			       struct sk_buff_head *skbs)
+{
+	struct ieee80211_local *local = sdata->local;
+	struct ieee80211_tx_batch batch;
+	struct ieee80211_tx_data tx;
+	ieee80211_tx_result res_prepare;
+	struct sk_buff *skb;
+	unsigned int n = 0;
+	bool shared;
+	int led_len;
+
+	batch.sta = NULL;
+
+	while ((skb = __skb_dequeue(skbs))) {
+		n++;
+
+		if (unlikely(skb->len < 10)) {
+			dev_kfree_skb(skb);
+			continue;
+		}
+
+		led_len = skb->len;
+		shared = ieee80211_tx_batch_match(sdata, &batch, skb);
+		if (shared) {
+			ieee80211_tx_init(sdata, &tx, skb);
+			tx.sta = batch.sta;
+			res_prepare = ieee80211_tx_prepare_frame(&tx);
+		} else {
+			if (batch.sta)
+				local->tx_batch_split++;
+			batch.sta = NULL;
+			res_prepare = ieee80211_tx_prepare(sdata, &tx, skb);
+		}
+
+		if (unlikely(res_prepare == TX_DROP)) {
+			dev_kfree_skb(skb);
+			continue;
+		} else if (unlikely(res_prepare == TX_QUEUED)) {
+			continue;
+		}
+
+		ieee80211_tx_setup_queue(&tx);
+
+		if (shared) {
+			local->tx_batch_shared++;
+			if (invoke_tx_handlers_batch(&tx, &batch))
+				continue;
+		} else {
+			if (invoke_tx_handlers_early(&tx))
+				continue;
+			ieee80211_tx_batch_start(&batch, &tx);
+		}
+
+		if (!invoke_tx_handlers_late(&tx))
+			__ieee80211_tx(local, &tx.skbs, led_len, tx.sta, false);
+	}
+
+	if (n)
+		local->tx_batch_hist[min_t(unsigned int,
+					   n > 1 ? fls(n - 1) : 0,
+					   IEEE80211_TX_BATCH_HIST - 1)]++;
+}
+
 /* device xmit handlers */
 
+/*
+ * Head- and tailroom needed for the keys that may be used on @sdata;
+ * frames on AP_VLAN interfaces may also use those of the AP.
+ */
+void ieee80211_crypto_tx_room(struct ieee80211_sub_if_data *sdata,
+			      int *headroom, int *tailroom)
+{
+	*headroom = sdata->crypto_tx_headroom;
+	*tailroom = sdata->crypto_tx_tailroom;
+
+	if (sdata->vif.type == NL80211_IFTYPE_AP_VLAN && sdata->bss) {
+		struct ieee80211_sub_if_data *ap;
+
+		ap = container_of(sdata->bss, struct ieee80211_sub_if_data,
+				  u.ap);
+		*headroom = max_t(int, *headroom, ap->crypto_tx_headroom);
+		*tailroom = max_t(int, *tailroom, ap->crypto_tx_tailroom);
+	}
+}
+
 static int ieee80211_skb_resize(struct ieee80211_sub_if_data *sdata,
 				struct sk_buff *skb,
 				int head_need, bool may_encrypt)
 {
 	struct ieee80211_local *local = sdata->local;
-	int tail_need = 0;
+	int tail_need = 0, crypto_head;
 
-	if (may_encrypt && sdata->crypto_tx_tailroom_needed_cnt) {
-		tail_need = IEEE80211_ENCRYPT_TAILROOM;
+	if (may_encrypt) {
+		ieee80211_crypto_tx_room(sdata, &crypto_head, &tail_need);
 		tail_need -= skb_tailroom(skb);
 		tail_need = max_t(int, tail_need, 0);
 	}
 
-	if (skb_cloned(skb))
+	if (skb_cloned(skb)) {
 		I802_DEBUG_INC(local->tx_expand_skb_head_cloned);
-	else if (head_need || tail_need)
+		sdata->tx_expand_cloned++;
+	} else if (head_need || tail_need) {
 		I802_DEBUG_INC(local->tx_expand_skb_head);
-	else
+		if (head_need)
+			sdata->tx_expand_head++;
+		if (tail_need)
+			sdata->tx_expand_tail++;
+	} else {
 		return 0;
+	}
 
 	if (pskb_expand_head(skb, head_need, tail_need, GFP_ATOMIC)) {
 		wiphy_debug(local->hw.wiphy,
@@ -1447,28 +2217,32 @@ static int ieee80211_skb_resize(struct ieee80211_sub_if_data *sdata,
 	return 0;
 }
 
-void ieee80211_xmit(struct ieee80211_sub_if_data *sdata, struct sk_buff *skb)
+/*
+ * Common part of ieee80211_xmit() and ieee80211_xmit_list(), returns
+ * false if the frame was consumed. Called under RCU read lock.
+ */
+static bool ieee80211_xmit_prepare(struct ieee80211_sub_if_data *sdata,
+				   struct sk_buff *skb)
 {
 	struct ieee80211_local *local = sdata->local;
 	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
 	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *) skb->data;
-	int headroom;
+	int headroom, crypto_head, crypto_tail;
 	bool may_encrypt;
 
-	rcu_read_lock();
-
 	may_encrypt = !(info->flags & IEEE80211_TX_INTFL_DONT_ENCRYPT);
 
 	headroom = local->tx_headroom;
-	if (may_encrypt)
-		headroom += IEEE80211_ENCRYPT_HEADROOM;
+	if (may_encrypt) {
+		ieee80211_crypto_tx_room(sdata, &crypto_head, &crypto_tail);
+		headroom += crypto_head;
+	}
 	headroom -= skb_headroom(skb);
 	headroom = max_t(int, 0, headroom);
 
 	if (ieee80211_skb_resize(sdata, skb, headroom, may_encrypt)) {
 		dev_kfree_skb(skb);
-		rcu_read_unlock();
-		return;
+		return false;
 	}
 
 	hdr = (struct ieee80211_hdr *) skb->data;
@@ -1479,8 +2253,7 @@ void ieee80211_xmit(struct ieee80211_sub_if_data *sdata, struct sk_buff *skb)
 	    !is_multicast_ether_addr(hdr->addr1) &&
 	    mesh_nexthop_resolve(skb, sdata)) {
 		/* skb queued: don't free */
-		rcu_read_unlock();
-		return;
+		return false;
 	}
 
 #if (LINUX_VERSION_CODE < KERNEL_VERSION(2,6,27))
@@ -1488,7 +2261,35 @@ void ieee80211_xmit(struct ieee80211_sub_if_data *sdata, struct sk_buff *skb)
 	skb_set_queue_mapping(skb, ieee80211_select_queue(sdata, skb));
 #endif
 	ieee80211_set_qos_hdr(sdata, skb);
-	ieee80211_tx(sdata, skb, false);
+	return true;
+}
+
+void ieee80211_xmit(struct ieee80211_sub_if_data *sdata, struct sk_buff *skb)
+{
+	rcu_read_lock();
+	if (ieee80211_xmit_prepare(sdata, skb))
+		ieee80211_tx(sdata, skb, false);
+	rcu_read_unlock();
+}
+
+/*
+ * Like ieee80211_xmit() for a list of frames from the same source, e.g.
+ * the segments of a GSO frame; see ieee80211_tx_batch(). Empties @skbs.
+ */
+void ieee80211_xmit_list(struct ieee80211_sub_if_data *sdata,
+			 struct sk_buff_head *skbs)
+{
+	struct sk_buff_head batch;
+	struct sk_buff *skb;
+
+	__skb_queue_head_init(&batch);
+
+	rcu_read_lock();
+	while ((skb = __skb_dequeue(skbs)))
+		if (ieee80211_xmit_prepare(sdata, skb))
+			__skb_queue_tail(&batch, skb);
+
+	ieee80211_tx_batch(sdata, &batch);
 	rcu_read_unlock();
 }
 
@@ -1703,6 +2504,20 @@ fail:
 	return NETDEV_TX_OK; /* meaning, we dealt with the skb */
 }
 
+/*
+ * Drop a frame, or a segment of one, before it was handed to the TX path;
+ * @info_id is the TX status request it would have carried, if any.
+ */
+static void ieee80211_drop_segment(struct ieee80211_local *local,
+				   struct sk_buff *skb, int info_id)
+{
+	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
+
+	memset(info, 0, sizeof(*info));
+	info->ack_frame_id = info_id;
+	ieee80211_free_txskb(&local->hw, skb);
+}
+
 /**
  * ieee80211_subif_start_xmit - netif start_xmit function for Ethernet-type
  * subinterfaces (wlan#, WDS, and VLAN interfaces)
@@ -1717,6 +2532,9 @@ fail:
  * IEEE 802.11 header based on which interface the packet is coming in. The
  * encapsulated packet will then be passed to master interface, wlan#.11, for
  * transmission (through low-level driver).
+ *
+ * GSO packets are segmented here after the header was built, and the segments
+ * are transmitted as one batch, see ieee80211_xmit_list().
  */
 netdev_tx_t ieee80211_subif_start_xmit(struct sk_buff *skb,
 				    struct net_device *dev)
@@ -1739,6 +2557,9 @@ netdev_tx_t ieee80211_subif_start_xmit(struct sk_buff *skb,
 	bool multicast;
 	u32 info_flags = 0;
 	u16 info_id = 0;
+	struct sk_buff_head skbs;
+	struct sk_buff *next;
+	int crypto_head, crypto_tail;
 
 	if (unlikely(skb->len < ETH_HLEN)) {
 		ret = NETDEV_TX_OK;
@@ -2041,84 +2862,153 @@ netdev_tx_t ieee80211_subif_start_xmit(struct sk_buff *skb,
 		encaps_len = 0;
 	}
 
-	nh_pos = skb_network_header(skb) - skb->data;
-	h_pos = skb_transport_header(skb) - skb->data;
-
-	skb_pull(skb, skip_header_bytes);
-	nh_pos -= skip_header_bytes;
-	h_pos -= skip_header_bytes;
-
-	head_need = hdrlen + encaps_len + meshhdrlen - skb_headroom(skb);
-
 	/*
-	 * So we need to modify the skb header and hence need a copy of
-	 * that. The head_need variable above doesn't, so far, include
-	 * the needed header space that we don't need right away. If we
-	 * can, then we don't reallocate right now but only after the
-	 * frame arrives at the master device (if it does...)
-	 *
-	 * If we cannot, however, then we will reallocate to include all
-	 * the ever needed space. Also, if we need to reallocate it anyway,
-	 * make it big enough for everything we may ever need.
+	 * The header above was built from the Ethernet header, which is
+	 * the same for all segments of a GSO frame; segment it now and
+	 * only put the 802.11 header onto each segment.
 	 */
+	if (skb_is_gso(skb)) {
+		struct sk_buff *segs;
 
-	if (head_need > 0 || skb_cloned(skb)) {
-		head_need += IEEE80211_ENCRYPT_HEADROOM;
-		head_need += local->tx_headroom;
-		head_need = max_t(int, 0, head_need);
-		if (ieee80211_skb_resize(sdata, skb, head_need, true))
-			goto fail;
+		segs = skb_gso_segment(skb, local->hw.netdev_features);
+		if (IS_ERR_OR_NULL(segs)) {
+			ieee80211_drop_segment(local, skb, info_id);
+			return NETDEV_TX_OK;
+		}
+		dev_kfree_skb(skb);
+		skb = segs;
 	}
 
-	if (encaps_data) {
-		memcpy(skb_push(skb, encaps_len), encaps_data, encaps_len);
-		nh_pos += encaps_len;
-		h_pos += encaps_len;
-	}
+	__skb_queue_head_init(&skbs);
 
-#ifdef CONFIG_MAC80211_MESH
-	if (meshhdrlen > 0) {
-		memcpy(skb_push(skb, meshhdrlen), &mesh_hdr, meshhdrlen);
-		nh_pos += meshhdrlen;
-		h_pos += meshhdrlen;
-	}
-#endif
+	for (; skb; skb = next) {
+		next = skb->next;
+		skb->next = NULL;
+
+		/*
+		 * The TX handlers neither deal with paged frames nor with
+		 * checksum offload (unless the driver asked for the
+		 * latter), segments of a GSO frame already come in one
+		 * piece and with the checksum filled in.
+		 */
+		if (skb->ip_summed == CHECKSUM_PARTIAL &&
+		    !(local->hw.netdev_features & NETIF_F_ALL_CSUM) &&
+		    skb_checksum_help(skb)) {
+			ieee80211_drop_segment(local, skb, next ? 0 : info_id);
+			continue;
+		}
+
+		if (skb_linearize(skb)) {
+			ieee80211_drop_segment(local, skb, next ? 0 : info_id);
+			continue;
+		}
+
+		nh_pos = skb_network_header(skb) - skb->data;
+		h_pos = skb_transport_header(skb) - skb->data;
 
-	if (ieee80211_is_data_qos(fc)) {
-		__le16 *qos_control;
+		skb_pull(skb, skip_header_bytes);
+		nh_pos -= skip_header_bytes;
+		h_pos -= skip_header_bytes;
+
+		head_need = hdrlen + encaps_len + meshhdrlen -
+			    skb_headroom(skb);
 
-		qos_control = (__le16*) skb_push(skb, 2);
-		memcpy(skb_push(skb, hdrlen - 2), &hdr, hdrlen - 2);
 		/*
-		 * Maybe we could actually set some fields here, for now just
-		 * initialise to zero to indicate no special operation.
+		 * So we need to modify the skb header and hence need a copy
+		 * of that. The head_need variable above doesn't, so far,
+		 * include the needed header space that we don't need right
+		 * away. If we can, then we don't reallocate right now but
+		 * only after the frame arrives at the master device (if it
+		 * does...)
+		 *
+		 * If we cannot, however, then we will reallocate to include
+		 * all the ever needed space. Also, if we need to reallocate
+		 * it anyway, make it big enough for everything we may ever
+		 * need.
 		 */
-		*qos_control = 0;
-	} else
-		memcpy(skb_push(skb, hdrlen), &hdr, hdrlen);
 
-	nh_pos += hdrlen;
-	h_pos += hdrlen;
+		if (head_need > 0 || skb_cloned(skb)) {
+			ieee80211_crypto_tx_room(sdata, &crypto_head,
+						 &crypto_tail);
+			head_need += crypto_head;
+			head_need += local->tx_headroom;
+			head_need = max_t(int, 0, head_need);
+			if (ieee80211_skb_resize(sdata, skb, head_need, true)) {
+				ieee80211_drop_segment(local, skb,
+						       next ? 0 : info_id);
+				continue;
+			}
+		}
 
-	dev->stats.tx_packets++;
-	dev->stats.tx_bytes += skb->len;
+		if (encaps_data) {
+			memcpy(skb_push(skb, encaps_len), encaps_data,
+			       encaps_len);
+			nh_pos += encaps_len;
+			h_pos += encaps_len;
+		}
 
-	/* Update skb pointers to various headers since this modified frame
-	 * is going to go through Linux networking code that may potentially
-	 * need things like pointer to IP header. */
-	skb_set_mac_header(skb, 0);
-	skb_set_network_header(skb, nh_pos);
-	skb_set_transport_header(skb, h_pos);
+#ifdef CONFIG_MAC80211_MESH
+		if (meshhdrlen > 0) {
+			/* each segment needs its own mesh sequence number */
+			if (!skb_queue_empty(&skbs))
+				put_unaligned(cpu_to_le32(
+					sdata->u.mesh.mesh_seqnum++),
+					&mesh_hdr.seqnum);
+			memcpy(skb_push(skb, meshhdrlen), &mesh_hdr,
+			       meshhdrlen);
+			nh_pos += meshhdrlen;
+			h_pos += meshhdrlen;
+		}
+#endif
 
-	info = IEEE80211_SKB_CB(skb);
-	memset(info, 0, sizeof(*info));
+		if (ieee80211_is_data_qos(fc)) {
+			__le16 *qos_control;
 
-	dev->trans_start = jiffies;
+			qos_control = (__le16*) skb_push(skb, 2);
+			memcpy(skb_push(skb, hdrlen - 2), &hdr, hdrlen - 2);
+			/*
+			 * Maybe we could actually set some fields here, for
+			 * now just initialise to zero to indicate no special
+			 * operation.
+			 */
+			*qos_control = 0;
+		} else
+			memcpy(skb_push(skb, hdrlen), &hdr, hdrlen);
 
-	info->flags = info_flags;
-	info->ack_frame_id = info_id;
+		nh_pos += hdrlen;
+		h_pos += hdrlen;
 
-	ieee80211_xmit(sdata, skb);
+		dev->stats.tx_packets++;
+		dev->stats.tx_bytes += skb->len;
+
+		/* Update skb pointers to various headers since this modified
+		 * frame is going to go through Linux networking code that may
+		 * potentially need things like pointer to IP header. */
+		skb_set_mac_header(skb, 0);
+		skb_set_network_header(skb, nh_pos);
+		skb_set_transport_header(skb, h_pos);
+
+		info = IEEE80211_SKB_CB(skb);
+		memset(info, 0, sizeof(*info));
+
+		/* only the last segment reports the status of the frame */
+		if (!next) {
+			info->flags = info_flags;
+			info->ack_frame_id = info_id;
+		} else {
+			info->flags = info_flags &
+				      ~IEEE80211_TX_CTL_REQ_TX_STATUS;
+		}
+
+		__skb_queue_tail(&skbs, skb);
+	}
+
+	dev->trans_start = jiffies;
+
+	if (skb_queue_len(&skbs) == 1)
+		ieee80211_xmit(sdata, __skb_dequeue(&skbs));
+	else
+		ieee80211_xmit_list(sdata, &skbs);
 
 	return NETDEV_TX_OK;
 
@@ -2191,10 +3081,12 @@ void ieee80211_tx_pending(unsigned long data)
 	for (i = 0; i < local->hw.queues; i++) {
 		/*
 		 * If queue is stopped by something other than due to pending
-		 * frames, or we have no pending frames, proceed to next queue.
+		 * frames, or we have no pending or queued frames, proceed to
+		 * next queue.
 		 */
 		if (local->queue_stop_reasons[i] ||
-		    skb_queue_empty(&local->pending[i]))
+		    (skb_queue_empty(&local->pending[i]) &&
+		     !ieee80211_txq_needs_push(local, i)))
 			continue;
 
 		while (!skb_queue_empty(&local->pending[i])) {
@@ -2216,7 +3108,19 @@ void ieee80211_tx_pending(unsigned long data)
 				break;
 		}
 
-		if (skb_queue_empty(&local->pending[i]))
+		if (!skb_queue_empty(&local->pending[i]))
+			continue;
+
+		if (ieee80211_txq_needs_push(local, i)) {
+			spin_unlock_irqrestore(&local->queue_stop_reason_lock,
+					       flags);
+			ieee80211_txq_push(local, i);
+			spin_lock_irqsave(&local->queue_stop_reason_lock,
+					  flags);
+		}
+
+		if (!local->queue_stop_reasons[i] &&
+		    skb_queue_empty(&local->pending[i]))
 			ieee80211_propagate_queue_wake(local, i);
 	}
 	spin_unlock_irqrestore(&local->queue_stop_reason_lock, flags);
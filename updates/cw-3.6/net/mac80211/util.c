@@ -314,7 +314,8 @@ static void __ieee80211_wake_queue(struct ieee80211_hw *hw, int queue,
 		/* someone still has this queue stopped */
 		return;
 
-	if (skb_queue_empty(&local->pending[queue])) {
+	if (skb_queue_empty(&local->pending[queue]) &&
+	    !ieee80211_txq_needs_push(local, queue)) {
 		rcu_read_lock();
 		ieee80211_propagate_queue_wake(local, queue);
 		rcu_read_unlock();
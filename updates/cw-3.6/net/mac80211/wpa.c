@@ -13,6 +13,8 @@
 #include <linux/compiler.h>
 #include <linux/ieee80211.h>
 #include <linux/gfp.h>
+#include <linux/slab.h>
+#include <linux/scatterlist.h>
 #include <asm/unaligned.h>
 #include <net/mac80211.h>
 #include <crypto/aes.h>
@@ -78,13 +80,42 @@ ieee80211_tx_h_michael_mic_add(struct ieee80211_tx_data *tx)
 }
 
 
+/*
+ * Compute the Michael MIC over @data_len octets following the header,
+ * walking the fragments of a paged skb instead of linearizing it.
+ */
+void ieee80211_michael_mic_skb(const u8 *key, struct sk_buff *skb,
+			       unsigned int hdrlen, unsigned int data_len,
+			       u8 *mic)
+{
+	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *)skb->data;
+	struct michael_mic_ctx mctx;
+	struct skb_seq_state st;
+	unsigned int consumed = 0, len;
+	const u8 *data;
+
+	michael_mic_init(&mctx, key, hdr);
+
+	skb_prepare_seq_read(skb, hdrlen, hdrlen + data_len, &st);
+	while (consumed < data_len &&
+	       (len = skb_seq_read(consumed, &data, &st)) != 0) {
+		/* a block runs to its end, not to the limit given above */
+		len = min(len, data_len - consumed);
+		michael_mic_update(&mctx, data, len);
+		consumed += len;
+	}
+	skb_abort_seq_read(&st);
+
+	michael_mic_final(&mctx, mic);
+}
+
 ieee80211_rx_result
 ieee80211_rx_h_michael_mic_verify(struct ieee80211_rx_data *rx)
 {
-	u8 *data, *key = NULL;
+	u8 *key = NULL;
 	size_t data_len;
 	unsigned int hdrlen;
-	u8 mic[MICHAEL_MIC_LEN];
+	u8 mic[MICHAEL_MIC_LEN], rx_mic[MICHAEL_MIC_LEN];
 	struct sk_buff *skb = rx->skb;
 	struct ieee80211_rx_status *status = IEEE80211_SKB_RXCB(skb);
 	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *)skb->data;
@@ -138,19 +169,20 @@ ieee80211_rx_h_michael_mic_verify(struct ieee80211_rx_data *rx)
 	if (skb->len < hdrlen + MICHAEL_MIC_LEN)
 		return RX_DROP_UNUSABLE;
 
-	if (skb_linearize(rx->skb))
+	if (!pskb_may_pull(rx->skb, hdrlen))
 		return RX_DROP_UNUSABLE;
 	hdr = (void *)skb->data;
 
-	data = skb->data + hdrlen;
 	data_len = skb->len - hdrlen - MICHAEL_MIC_LEN;
 	key = &rx->key->conf.key[NL80211_TKIP_DATA_OFFSET_RX_MIC_KEY];
-	michael_mic(key, hdr, data, data_len, mic);
-	if (memcmp(mic, data + data_len, MICHAEL_MIC_LEN) != 0)
+	ieee80211_michael_mic_skb(key, skb, hdrlen, data_len, mic);
+	if (skb_copy_bits(skb, hdrlen + data_len, rx_mic, MICHAEL_MIC_LEN) ||
+	    memcmp(mic, rx_mic, MICHAEL_MIC_LEN) != 0)
 		goto mic_fail;
 
 	/* remove Michael MIC from payload */
-	skb_trim(skb, skb->len - MICHAEL_MIC_LEN);
+	if (pskb_trim(skb, skb->len - MICHAEL_MIC_LEN))
+		return RX_DROP_UNUSABLE;
 
 update_iv:
 	/* update IV in key information to be able to detect replays */
@@ -180,6 +212,7 @@ static int tkip_encrypt_skb(struct ieee80211_tx_data *tx, struct sk_buff *skb)
 	unsigned long flags;
 	unsigned int hdrlen;
 	int len, tail;
+	u16 p1k[5], iv16;
 	u8 *pos;
 
 	if (info->control.hw_key &&
@@ -211,12 +244,18 @@ static int tkip_encrypt_skb(struct ieee80211_tx_data *tx, struct sk_buff *skb)
 	    (info->control.hw_key->flags & IEEE80211_KEY_FLAG_PUT_IV_SPACE))
 		return 0;
 
-	/* Increase IV for the frame */
+	/*
+	 * Increase IV for the frame; for software encryption also pick up
+	 * the matching phase 1 key while holding the lock anyway.
+	 */
 	spin_lock_irqsave(&key->u.tkip.txlock, flags);
 	key->u.tkip.tx.iv16++;
 	if (key->u.tkip.tx.iv16 == 0)
 		key->u.tkip.tx.iv32++;
+	iv16 = key->u.tkip.tx.iv16;
 	pos = ieee80211_tkip_add_iv(pos, key);
+	if (!info->control.hw_key)
+		ieee80211_tkip_get_tx_p1k(key, p1k);
 	spin_unlock_irqrestore(&key->u.tkip.txlock, flags);
 
 	/* hwaccel - with software IV */
@@ -227,7 +266,7 @@ static int tkip_encrypt_skb(struct ieee80211_tx_data *tx, struct sk_buff *skb)
 	skb_put(skb, TKIP_ICV_LEN);
 
 	return ieee80211_tkip_encrypt_data(tx->local->wep_tx_tfm,
-					   key, skb, pos, len);
+					   key, p1k, iv16, pos, len);
 }
 
 
@@ -264,11 +303,6 @@ ieee80211_crypto_tkip_decrypt(struct ieee80211_rx_data *rx)
 	if (!rx->sta || skb->len - hdrlen < 12)
 		return RX_DROP_UNUSABLE;
 
-	/* it may be possible to optimize this a bit more */
-	if (skb_linearize(rx->skb))
-		return RX_DROP_UNUSABLE;
-	hdr = (void *)skb->data;
-
 	/*
 	 * Let TKIP code verify IV, but skip decryption.
 	 * In the case where hardware checks the IV as well,
@@ -277,6 +311,18 @@ ieee80211_crypto_tkip_decrypt(struct ieee80211_rx_data *rx)
 	if (status->flag & RX_FLAG_DECRYPTED)
 		hwaccel = 1;
 
+	/*
+	 * Software decryption works on a linear buffer; when the hardware
+	 * already decrypted the frame only the IV has to be looked at.
+	 */
+	if (hwaccel) {
+		if (!pskb_may_pull(rx->skb, hdrlen + TKIP_IV_LEN))
+			return RX_DROP_UNUSABLE;
+	} else if (skb_linearize(rx->skb)) {
+		return RX_DROP_UNUSABLE;
+	}
+	hdr = (void *)skb->data;
+
 	res = ieee80211_tkip_decrypt_data(rx->local->wep_rx_tfm,
 					  key, skb->data + hdrlen,
 					  skb->len - hdrlen, rx->sta->sta.addr,
@@ -287,7 +333,8 @@ ieee80211_crypto_tkip_decrypt(struct ieee80211_rx_data *rx)
 		return RX_DROP_UNUSABLE;
 
 	/* Trim ICV */
-	skb_trim(skb, skb->len - TKIP_ICV_LEN);
+	if (pskb_trim(skb, skb->len - TKIP_ICV_LEN))
+		return RX_DROP_UNUSABLE;
 
 	/* Remove IV */
 	memmove(skb->data + TKIP_IV_LEN, skb->data, hdrlen);
@@ -297,22 +344,15 @@ ieee80211_crypto_tkip_decrypt(struct ieee80211_rx_data *rx)
 }
 
 
-static void ccmp_special_blocks(struct sk_buff *skb, u8 *pn, u8 *scratch,
-				int encrypted)
+static void ccmp_special_blocks(struct sk_buff *skb, u8 *pn, u8 *b_0, u8 *aad)
 {
 	__le16 mask_fc;
 	int a4_included, mgmt;
 	u8 qos_tid;
-	u8 *b_0, *aad;
-	u16 data_len, len_a;
+	u16 len_a;
 	unsigned int hdrlen;
 	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *)skb->data;
 
-	memset(scratch, 0, 6 * AES_BLOCK_SIZE);
-
-	b_0 = scratch + 3 * AES_BLOCK_SIZE;
-	aad = scratch + 4 * AES_BLOCK_SIZE;
-
 	/*
 	 * Mask FC: zero subtype b4 b5 b6 (if not mgmt)
 	 * Retry, PwrMgt, MoreData; set Protected
@@ -334,20 +374,19 @@ static void ccmp_special_blocks(struct sk_buff *skb, u8 *pn, u8 *scratch,
 	else
 		qos_tid = 0;
 
-	data_len = skb->len - hdrlen - CCMP_HDR_LEN;
-	if (encrypted)
-		data_len -= CCMP_MIC_LEN;
-
-	/* First block, b_0 */
-	b_0[0] = 0x59; /* flags: Adata: 1, M: 011, L: 001 */
+	/*
+	 * First block, b_0, is the CCM IV: L' | Nonce | 0. The CCM layer
+	 * derives the CBC-MAC and CTR blocks from it, filling in the flags
+	 * and the l(m) field, so only L' = L - 1 = 1 is set here.
+	 */
+	memset(b_0, 0, AES_BLOCK_SIZE);
+	b_0[0] = 0x1;
 	/* Nonce: Nonce Flags | A2 | PN
 	 * Nonce Flags: Priority (b0..b3) | Management (b4) | Reserved (b5..b7)
 	 */
 	b_0[1] = qos_tid | (mgmt << 4);
 	memcpy(&b_0[2], hdr->addr2, ETH_ALEN);
 	memcpy(&b_0[8], pn, CCMP_PN_LEN);
-	/* l(m) */
-	put_unaligned_be16(data_len, &b_0[14]);
 
 	/* AAD (extra authenticate-only data) / masked 802.11 header
 	 * FC | A1 | A2 | A3 | SC | [A4] | [QC] */
@@ -403,7 +442,9 @@ static int ccmp_encrypt_skb(struct ieee80211_tx_data *tx, struct sk_buff *skb)
 	u8 *pos;
 	u8 pn[6];
 	u64 pn64;
-	u8 scratch[6 * AES_BLOCK_SIZE];
+	u8 aad[2 * AES_BLOCK_SIZE];
+	u8 b_0[AES_BLOCK_SIZE];
+	struct scatterlist sg;
 
 	if (info->control.hw_key &&
 	    !(info->control.hw_key->flags & IEEE80211_KEY_FLAG_GENERATE_IV) &&
@@ -455,11 +496,11 @@ static int ccmp_encrypt_skb(struct ieee80211_tx_data *tx, struct sk_buff *skb)
 		return 0;
 
 	pos += CCMP_HDR_LEN;
-	ccmp_special_blocks(skb, pn, scratch, 0);
-	ieee80211_aes_ccm_encrypt(key->u.ccmp.tfm, scratch, pos, len,
-				  pos, skb_put(skb, CCMP_MIC_LEN));
+	ccmp_special_blocks(skb, pn, b_0, aad);
+	skb_put(skb, CCMP_MIC_LEN);
+	sg_init_one(&sg, pos, len + CCMP_MIC_LEN);
 
-	return 0;
+	return ieee80211_aes_ccm_encrypt(key->u.ccmp.tfm, b_0, aad, &sg, len);
 }
 
 
@@ -479,6 +520,41 @@ ieee80211_crypto_ccmp_encrypt(struct ieee80211_tx_data *tx)
 }
 
 
+/*
+ * Decrypt and verify the payload in place. Paged frames are decrypted
+ * where they are rather than linearized first.
+ */
+static int ccmp_decrypt_skb(struct crypto_aead *tfm, struct sk_buff *skb,
+			    int offset, int data_len, u8 *b_0, u8 *aad)
+{
+	struct scatterlist sg_stack[MAX_SKB_FRAGS + 1], *sg = sg_stack;
+	struct sk_buff *trailer;
+	int nsg, err;
+
+	if (!skb_is_nonlinear(skb)) {
+		sg_init_one(sg, skb->data + offset, data_len + CCMP_MIC_LEN);
+		return ieee80211_aes_ccm_decrypt(tfm, b_0, aad, sg, data_len);
+	}
+
+	nsg = skb_cow_data(skb, 0, &trailer);
+	if (nsg < 0)
+		return nsg;
+
+	if (nsg > ARRAY_SIZE(sg_stack)) {
+		sg = kmalloc(nsg * sizeof(*sg), GFP_ATOMIC);
+		if (!sg)
+			return -ENOMEM;
+	}
+
+	sg_init_table(sg, nsg);
+	skb_to_sgvec(skb, sg, offset, data_len + CCMP_MIC_LEN);
+	err = ieee80211_aes_ccm_decrypt(tfm, b_0, aad, sg, data_len);
+
+	if (sg != sg_stack)
+		kfree(sg);
+	return err;
+}
+
 ieee80211_rx_result
 ieee80211_crypto_ccmp_decrypt(struct ieee80211_rx_data *rx)
 {
@@ -501,13 +577,8 @@ ieee80211_crypto_ccmp_decrypt(struct ieee80211_rx_data *rx)
 	if (!rx->sta || data_len < 0)
 		return RX_DROP_UNUSABLE;
 
-	if (status->flag & RX_FLAG_DECRYPTED) {
-		if (!pskb_may_pull(rx->skb, hdrlen + CCMP_HDR_LEN))
-			return RX_DROP_UNUSABLE;
-	} else {
-		if (skb_linearize(rx->skb))
-			return RX_DROP_UNUSABLE;
-	}
+	if (!pskb_may_pull(rx->skb, hdrlen + CCMP_HDR_LEN))
+		return RX_DROP_UNUSABLE;
 
 	ccmp_hdr2pn(pn, skb->data + hdrlen);
 
@@ -519,15 +590,14 @@ ieee80211_crypto_ccmp_decrypt(struct ieee80211_rx_data *rx)
 	}
 
 	if (!(status->flag & RX_FLAG_DECRYPTED)) {
-		u8 scratch[6 * AES_BLOCK_SIZE];
+		u8 aad[2 * AES_BLOCK_SIZE];
+		u8 b_0[AES_BLOCK_SIZE];
 		/* hardware didn't decrypt/verify MIC */
-		ccmp_special_blocks(skb, pn, scratch, 1);
+		ccmp_special_blocks(skb, pn, b_0, aad);
 
-		if (ieee80211_aes_ccm_decrypt(
-			    key->u.ccmp.tfm, scratch,
-			    skb->data + hdrlen + CCMP_HDR_LEN, data_len,
-			    skb->data + skb->len - CCMP_MIC_LEN,
-			    skb->data + hdrlen + CCMP_HDR_LEN))
+		if (ccmp_decrypt_skb(key->u.ccmp.tfm, skb,
+				     hdrlen + CCMP_HDR_LEN, data_len,
+				     b_0, aad))
 			return RX_DROP_UNUSABLE;
 	}
 
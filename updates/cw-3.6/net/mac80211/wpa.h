@@ -17,6 +17,9 @@ ieee80211_tx_result
 ieee80211_tx_h_michael_mic_add(struct ieee80211_tx_data *tx);
 ieee80211_rx_result
 ieee80211_rx_h_michael_mic_verify(struct ieee80211_rx_data *rx);
+void ieee80211_michael_mic_skb(const u8 *key, struct sk_buff *skb,
+			       unsigned int hdrlen, unsigned int data_len,
+			       u8 *mic);
 
 ieee80211_tx_result
 ieee80211_crypto_tkip_encrypt(struct ieee80211_tx_data *tx);
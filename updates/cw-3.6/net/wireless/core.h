@@ -9,7 +9,6 @@
 #include <linux/list.h>
 #include <linux/netdevice.h>
 #include <linux/kref.h>
-#include <linux/rbtree.h>
 #include <linux/debugfs.h>
 #include <linux/rfkill.h>
 #include <linux/workqueue.h>
@@ -18,6 +17,30 @@
 #include <net/cfg80211.h>
 #include "reg.h"
 
+#define CFG80211_BSS_HASH_BITS	8
+#define CFG80211_BSS_HASH_SIZE	(1 << CFG80211_BSS_HASH_BITS)
+
+/* scan result processing statistics, protected by bss_lock */
+struct cfg80211_bss_stats {
+	u32 entries;
+	u32 inserts;
+	u32 updates;
+	u32 hidden;
+	u64 update_ns;
+	u32 expire_runs;
+	u32 expired;
+	u64 expire_ns;
+	u32 lookups;
+	u32 lookup_hits;
+};
+
+/* station/mesh path dump statistics, protected by RTNL */
+struct cfg80211_dump_stats {
+	u32 calls;
+	u32 entries;
+	u64 ns;
+};
+
 struct cfg80211_registered_device {
 	const struct cfg80211_ops *ops;
 	struct list_head list;
@@ -63,8 +86,10 @@ struct cfg80211_registered_device {
 
 	/* BSSes/scanning */
 	spinlock_t bss_lock;
-	struct list_head bss_list;
-	struct rb_root bss_tree;
+	struct list_head bss_list; /* least recently updated first */
+	struct hlist_head bss_hash[CFG80211_BSS_HASH_SIZE];
+	struct hlist_head bss_ssid_hash[CFG80211_BSS_HASH_SIZE];
+	struct cfg80211_bss_stats bss_stats;
 	u32 bss_generation;
 	struct cfg80211_scan_request *scan_req; /* protected by RTNL */
 	struct cfg80211_sched_scan_request *sched_scan_req;
@@ -74,6 +99,9 @@ struct cfg80211_registered_device {
 
 	struct mutex sched_scan_mtx;
 
+	struct cfg80211_dump_stats station_dump_stats;
+	struct cfg80211_dump_stats mpath_dump_stats;
+
 #ifdef CONFIG_NL80211_TESTMODE
 	struct genl_info *testmode_info;
 #endif
@@ -133,7 +161,8 @@ static inline void assert_cfg80211_lock(void)
 
 struct cfg80211_internal_bss {
 	struct list_head list;
-	struct rb_node rbn;
+	struct hlist_node hnode;
+	struct hlist_node ssid_hnode;
 	unsigned long ts;
 	struct kref ref;
 	atomic_t hold;
@@ -100,6 +100,76 @@ static const struct file_operations ht40allow_map_ops = {
 	.llseek = default_llseek,
 };
 
+static ssize_t bss_stats_read(struct file *file, char __user *user_buf,
+			      size_t count, loff_t *ppos)
+{
+	struct wiphy *wiphy = file->private_data;
+	struct cfg80211_registered_device *rdev = wiphy_to_dev(wiphy);
+	struct cfg80211_bss_stats stats;
+	char buf[512];
+	int len;
+
+	spin_lock_bh(&rdev->bss_lock);
+	stats = rdev->bss_stats;
+	spin_unlock_bh(&rdev->bss_lock);
+
+	len = scnprintf(buf, sizeof(buf),
+			"entries: %u\n"
+			"inserts: %u\n"
+			"updates: %u\n"
+			"hidden: %u\n"
+			"update_ns: %llu\n"
+			"expire_runs: %u\n"
+			"expired: %u\n"
+			"expire_ns: %llu\n"
+			"lookups: %u\n"
+			"lookup_hits: %u\n",
+			stats.entries, stats.inserts, stats.updates,
+			stats.hidden, (unsigned long long)stats.update_ns,
+			stats.expire_runs, stats.expired,
+			(unsigned long long)stats.expire_ns,
+			stats.lookups, stats.lookup_hits);
+
+	return simple_read_from_buffer(user_buf, count, ppos, buf, len);
+}
+
+static const struct file_operations bss_stats_ops = {
+	.read = bss_stats_read,
+	.open = simple_open,
+	.llseek = default_llseek,
+};
+
+static ssize_t dump_stats_read(struct file *file, char __user *user_buf,
+			       size_t count, loff_t *ppos)
+{
+	struct wiphy *wiphy = file->private_data;
+	struct cfg80211_registered_device *rdev = wiphy_to_dev(wiphy);
+	struct cfg80211_dump_stats sta, mpath;
+	char buf[256];
+	int len;
+
+	rtnl_lock();
+	sta = rdev->station_dump_stats;
+	mpath = rdev->mpath_dump_stats;
+	rtnl_unlock();
+
+	len = scnprintf(buf, sizeof(buf),
+			"          calls    entries         ns\n"
+			"station   %-8u %-10u %llu\n"
+			"mpath     %-8u %-10u %llu\n",
+			sta.calls, sta.entries, (unsigned long long)sta.ns,
+			mpath.calls, mpath.entries,
+			(unsigned long long)mpath.ns);
+
+	return simple_read_from_buffer(user_buf, count, ppos, buf, len);
+}
+
+static const struct file_operations dump_stats_ops = {
+	.read = dump_stats_read,
+	.open = simple_open,
+	.llseek = default_llseek,
+};
+
 #define DEBUGFS_ADD(name)						\
 	debugfs_create_file(#name, S_IRUGO, phyd, &rdev->wiphy, &name## _ops);
 
@@ -112,4 +182,6 @@ void cfg80211_debugfs_rdev_add(struct cfg80211_registered_device *rdev)
 	DEBUGFS_ADD(short_retry_limit);
 	DEBUGFS_ADD(long_retry_limit);
 	DEBUGFS_ADD(ht40allow_map);
+	DEBUGFS_ADD(bss_stats);
+	DEBUGFS_ADD(dump_stats);
 }
@@ -2879,29 +2879,65 @@ static int nl80211_send_station(struct sk_buff *msg, u32 pid, u32 seq,
 	return -EMSGSIZE;
 }
 
+/* station and mesh path dumps keep their position after the ifindex */
+static struct cfg80211_dump_cursor *
+nl80211_dump_cursor(struct netlink_callback *cb)
+{
+	BUILD_BUG_ON(sizeof(struct cfg80211_dump_cursor) >
+		     sizeof(cb->args) - sizeof(cb->args[0]));
+
+	return (void *)&cb->args[1];
+}
+
+static void nl80211_dump_cursor_advance(struct cfg80211_dump_cursor *cursor,
+					const u8 *addr, int generation)
+{
+	cursor->idx++;
+	memcpy(cursor->addr, addr, ETH_ALEN);
+	cursor->generation = generation;
+}
+
+static void nl80211_dump_account(struct cfg80211_dump_stats *stats,
+				 ktime_t start, int entries)
+{
+	stats->calls++;
+	stats->entries += entries;
+	stats->ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+}
+
 static int nl80211_dump_station(struct sk_buff *skb,
 				struct netlink_callback *cb)
 {
 	struct station_info sinfo;
 	struct cfg80211_registered_device *dev;
 	struct net_device *netdev;
+	struct cfg80211_dump_cursor *cursor = nl80211_dump_cursor(cb);
 	u8 mac_addr[ETH_ALEN];
-	int sta_idx = cb->args[1];
+	int entries = 0;
+	ktime_t start;
 	int err;
 
 	err = nl80211_prepare_netdev_dump(skb, cb, &dev, &netdev);
 	if (err)
 		return err;
 
-	if (!dev->ops->dump_station) {
+	if (!dev->ops->dump_station && !dev->ops->dump_station_next) {
 		err = -EOPNOTSUPP;
 		goto out_err;
 	}
 
+	start = ktime_get();
+
 	while (1) {
 		memset(&sinfo, 0, sizeof(sinfo));
-		err = dev->ops->dump_station(&dev->wiphy, netdev, sta_idx,
-					     mac_addr, &sinfo);
+		if (dev->ops->dump_station_next)
+			err = dev->ops->dump_station_next(&dev->wiphy, netdev,
+							  cursor, mac_addr,
+							  &sinfo);
+		else
+			err = dev->ops->dump_station(&dev->wiphy, netdev,
+						     cursor->idx, mac_addr,
+						     &sinfo);
 		if (err == -ENOENT)
 			break;
 		if (err)
@@ -2914,12 +2950,14 @@ static int nl80211_dump_station(struct sk_buff *skb,
 				&sinfo) < 0)
 			goto out;
 
-		sta_idx++;
+		nl80211_dump_cursor_advance(cursor, mac_addr,
+					    sinfo.generation);
+		entries++;
 	}
 
 
  out:
-	cb->args[1] = sta_idx;
+	nl80211_dump_account(&dev->station_dump_stats, start, entries);
 	err = skb->len;
  out_err:
 	nl80211_finish_netdev_dump(dev);
@@ -3339,16 +3377,18 @@ static int nl80211_dump_mpath(struct sk_buff *skb,
 	struct mpath_info pinfo;
 	struct cfg80211_registered_device *dev;
 	struct net_device *netdev;
+	struct cfg80211_dump_cursor *cursor = nl80211_dump_cursor(cb);
 	u8 dst[ETH_ALEN];
 	u8 next_hop[ETH_ALEN];
-	int path_idx = cb->args[1];
+	int entries = 0;
+	ktime_t start;
 	int err;
 
 	err = nl80211_prepare_netdev_dump(skb, cb, &dev, &netdev);
 	if (err)
 		return err;
 
-	if (!dev->ops->dump_mpath) {
+	if (!dev->ops->dump_mpath && !dev->ops->dump_mpath_next) {
 		err = -EOPNOTSUPP;
 		goto out_err;
 	}
@@ -3358,9 +3398,17 @@ static int nl80211_dump_mpath(struct sk_buff *skb,
 		goto out_err;
 	}
 
+	start = ktime_get();
+
 	while (1) {
-		err = dev->ops->dump_mpath(&dev->wiphy, netdev, path_idx,
-					   dst, next_hop, &pinfo);
+		if (dev->ops->dump_mpath_next)
+			err = dev->ops->dump_mpath_next(&dev->wiphy, netdev,
+							cursor, dst, next_hop,
+							&pinfo);
+		else
+			err = dev->ops->dump_mpath(&dev->wiphy, netdev,
+						   cursor->idx, dst, next_hop,
+						   &pinfo);
 		if (err == -ENOENT)
 			break;
 		if (err)
@@ -3372,12 +3420,13 @@ static int nl80211_dump_mpath(struct sk_buff *skb,
 				       &pinfo) < 0)
 			goto out;
 
-		path_idx++;
+		nl80211_dump_cursor_advance(cursor, dst, pinfo.generation);
+		entries++;
 	}
 
 
  out:
-	cb->args[1] = path_idx;
+	nl80211_dump_account(&dev->mpath_dump_stats, start, entries);
 	err = skb->len;
  out_err:
 	nl80211_finish_netdev_dump(dev);
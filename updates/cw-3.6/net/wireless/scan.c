@@ -10,6 +10,8 @@
 #include <linux/wireless.h>
 #include <linux/nl80211.h>
 #include <linux/etherdevice.h>
+#include <linux/jhash.h>
+#include <asm/unaligned.h>
 #include <net/arp.h>
 #include <net/cfg80211.h>
 #include <net/cfg80211-wext.h>
@@ -188,12 +190,50 @@ void cfg80211_bss_age(struct cfg80211_registered_device *dev,
 	}
 }
 
+static u32 bss_hash_bssid(const u8 *bssid)
+{
+	return jhash_2words(get_unaligned((const u32 *)bssid),
+			    get_unaligned((const u16 *)(bssid + 4)), 0) &
+	       (CFG80211_BSS_HASH_SIZE - 1);
+}
+
+static u32 bss_hash_ssid(const u8 *ssid, size_t ssid_len)
+{
+	return jhash(ssid, ssid_len, 0) & (CFG80211_BSS_HASH_SIZE - 1);
+}
+
+static u32 bss_hash_ssid_ie(struct cfg80211_bss *a)
+{
+	const u8 *ie = cfg80211_find_ie(WLAN_EID_SSID,
+					a->information_elements,
+					a->len_information_elements);
+
+	/* BSSes without SSID IE share the bucket of the empty SSID */
+	if (!ie)
+		return bss_hash_ssid(NULL, 0);
+	return bss_hash_ssid(ie + 2, ie[1]);
+}
+
+/* must hold dev->bss_lock! */
+static void __cfg80211_link_bss(struct cfg80211_registered_device *dev,
+				struct cfg80211_internal_bss *bss)
+{
+	list_add_tail(&bss->list, &dev->bss_list);
+	hlist_add_head(&bss->hnode,
+		       &dev->bss_hash[bss_hash_bssid(bss->pub.bssid)]);
+	hlist_add_head(&bss->ssid_hnode,
+		       &dev->bss_ssid_hash[bss_hash_ssid_ie(&bss->pub)]);
+	dev->bss_stats.entries++;
+}
+
 /* must hold dev->bss_lock! */
 static void __cfg80211_unlink_bss(struct cfg80211_registered_device *dev,
 				  struct cfg80211_internal_bss *bss)
 {
 	list_del_init(&bss->list);
-	rb_erase(&bss->rbn, &dev->bss_tree);
+	hlist_del_init(&bss->hnode);
+	hlist_del_init(&bss->ssid_hnode);
+	dev->bss_stats.entries--;
 	kref_put(&bss->ref, bss_release);
 }
 
@@ -201,19 +241,29 @@ static void __cfg80211_unlink_bss(struct cfg80211_registered_device *dev,
 void cfg80211_bss_expire(struct cfg80211_registered_device *dev)
 {
 	struct cfg80211_internal_bss *bss, *tmp;
-	bool expired = false;
+	ktime_t start = ktime_get();
+	u32 expired = 0;
 
+	/*
+	 * bss_list is ordered by the time of the last update, so we can
+	 * stop at the first entry that hasn't expired yet. Held entries
+	 * are never expired and just skipped.
+	 */
 	list_for_each_entry_safe(bss, tmp, &dev->bss_list, list) {
 		if (atomic_read(&bss->hold))
 			continue;
 		if (!time_after(jiffies, bss->ts + IEEE80211_SCAN_RESULT_EXPIRE))
-			continue;
+			break;
 		__cfg80211_unlink_bss(dev, bss);
-		expired = true;
+		expired++;
 	}
 
 	if (expired)
 		dev->bss_generation++;
+
+	dev->bss_stats.expire_runs++;
+	dev->bss_stats.expired += expired;
+	dev->bss_stats.expire_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
 }
 
 const u8 *cfg80211_find_ie(u8 eid, const u8 *ies, int len)
@@ -422,11 +472,6 @@ static int cmp_hidden_bss(struct cfg80211_bss *a,
 			b->information_elements,
 			b->len_information_elements);
 
-	/* Key comparator must use same algorithm in any rb-tree
-	 * search function (order is important), otherwise ordering
-	 * of items in the tree is broken and search gives incorrect
-	 * results. This code uses same order as cmp_ies() does. */
-
 	/* sort missing IE before (left of) present IE */
 	if (!ie1)
 		return -1;
@@ -449,6 +494,21 @@ static int cmp_hidden_bss(struct cfg80211_bss *a,
 	return 0;
 }
 
+static bool bss_usable(struct cfg80211_internal_bss *bss,
+		       struct ieee80211_channel *channel,
+		       u16 capa_mask, u16 capa_val, unsigned long now)
+{
+	if ((bss->pub.capability & capa_mask) != capa_val)
+		return false;
+	if (channel && bss->pub.channel != channel)
+		return false;
+	/* Don't get expired BSS structs */
+	if (time_after(now, bss->ts + IEEE80211_SCAN_RESULT_EXPIRE) &&
+	    !atomic_read(&bss->hold))
+		return false;
+	return true;
+}
+
 struct cfg80211_bss *cfg80211_get_bss(struct wiphy *wiphy,
 				      struct ieee80211_channel *channel,
 				      const u8 *bssid,
@@ -457,26 +517,52 @@ struct cfg80211_bss *cfg80211_get_bss(struct wiphy *wiphy,
 {
 	struct cfg80211_registered_device *dev = wiphy_to_dev(wiphy);
 	struct cfg80211_internal_bss *bss, *res = NULL;
+	struct hlist_node *n;
 	unsigned long now = jiffies;
 
 	spin_lock_bh(&dev->bss_lock);
 
-	list_for_each_entry(bss, &dev->bss_list, list) {
-		if ((bss->pub.capability & capa_mask) != capa_val)
-			continue;
-		if (channel && bss->pub.channel != channel)
-			continue;
-		/* Don't get expired BSS structs */
-		if (time_after(now, bss->ts + IEEE80211_SCAN_RESULT_EXPIRE) &&
-		    !atomic_read(&bss->hold))
-			continue;
-		if (is_bss(&bss->pub, bssid, ssid, ssid_len)) {
-			res = bss;
-			kref_get(&res->ref);
-			break;
+	/* all candidates share the BSSID or SSID bucket if one is given */
+	if (bssid) {
+		hlist_for_each_entry(bss, n,
+				     &dev->bss_hash[bss_hash_bssid(bssid)],
+				     hnode) {
+			if (!bss_usable(bss, channel, capa_mask, capa_val,
+					now))
+				continue;
+			if (is_bss(&bss->pub, bssid, ssid, ssid_len)) {
+				res = bss;
+				break;
+			}
+		}
+	} else if (ssid) {
+		hlist_for_each_entry(bss, n,
+			&dev->bss_ssid_hash[bss_hash_ssid(ssid, ssid_len)],
+			ssid_hnode) {
+			if (!bss_usable(bss, channel, capa_mask, capa_val,
+					now))
+				continue;
+			if (is_bss(&bss->pub, NULL, ssid, ssid_len)) {
+				res = bss;
+				break;
+			}
+		}
+	} else {
+		list_for_each_entry(bss, &dev->bss_list, list) {
+			if (bss_usable(bss, channel, capa_mask, capa_val,
+				       now)) {
+				res = bss;
+				break;
+			}
 		}
 	}
 
+	dev->bss_stats.lookups++;
+	if (res) {
+		dev->bss_stats.lookup_hits++;
+		kref_get(&res->ref);
+	}
+
 	spin_unlock_bh(&dev->bss_lock);
 	if (!res)
 		return NULL;
@@ -511,78 +597,59 @@ struct cfg80211_bss *cfg80211_get_mesh(struct wiphy *wiphy,
 }
 EXPORT_SYMBOL(cfg80211_get_mesh);
 
-
-static void rb_insert_bss(struct cfg80211_registered_device *dev,
-			  struct cfg80211_internal_bss *bss)
-{
-	struct rb_node **p = &dev->bss_tree.rb_node;
-	struct rb_node *parent = NULL;
-	struct cfg80211_internal_bss *tbss;
-	int cmp;
-
-	while (*p) {
-		parent = *p;
-		tbss = rb_entry(parent, struct cfg80211_internal_bss, rbn);
-
-		cmp = cmp_bss(&bss->pub, &tbss->pub);
-
-		if (WARN_ON(!cmp)) {
-			/* will sort of leak this BSS */
-			return;
-		}
-
-		if (cmp < 0)
-			p = &(*p)->rb_left;
-		else
-			p = &(*p)->rb_right;
-	}
-
-	rb_link_node(&bss->rbn, parent, p);
-	rb_insert_color(&bss->rbn, &dev->bss_tree);
-}
-
+/*
+ * cmp_bss() only considers two BSSes equal if their SSID IEs match and,
+ * unless both are mesh BSSes, their BSSIDs match as well. So all entries
+ * that can match a regular BSS are in its BSSID bucket, and all entries
+ * that can match a mesh BSS are in its SSID bucket.
+ */
 static struct cfg80211_internal_bss *
-rb_find_bss(struct cfg80211_registered_device *dev,
-	    struct cfg80211_internal_bss *res)
+hash_find_bss(struct cfg80211_registered_device *dev,
+	      struct cfg80211_internal_bss *res)
 {
-	struct rb_node *n = dev->bss_tree.rb_node;
 	struct cfg80211_internal_bss *bss;
-	int r;
-
-	while (n) {
-		bss = rb_entry(n, struct cfg80211_internal_bss, rbn);
-		r = cmp_bss(&res->pub, &bss->pub);
+	struct hlist_node *n;
+	struct hlist_head *head;
+
+	if (is_mesh_bss(&res->pub)) {
+		head = &dev->bss_ssid_hash[bss_hash_ssid_ie(&res->pub)];
+		hlist_for_each_entry(bss, n, head, ssid_hnode)
+			if (!cmp_bss(&res->pub, &bss->pub))
+				return bss;
+		return NULL;
+	}
 
-		if (r == 0)
+	head = &dev->bss_hash[bss_hash_bssid(res->pub.bssid)];
+	hlist_for_each_entry(bss, n, head, hnode)
+		if (!cmp_bss(&res->pub, &bss->pub))
 			return bss;
-		else if (r < 0)
-			n = n->rb_left;
-		else
-			n = n->rb_right;
-	}
 
 	return NULL;
 }
 
 static struct cfg80211_internal_bss *
-rb_find_hidden_bss(struct cfg80211_registered_device *dev,
-	    struct cfg80211_internal_bss *res)
+hash_find_hidden_bss(struct cfg80211_registered_device *dev,
+		     struct cfg80211_internal_bss *res)
 {
-	struct rb_node *n = dev->bss_tree.rb_node;
 	struct cfg80211_internal_bss *bss;
-	int r;
+	struct hlist_node *n;
+	struct hlist_head *head;
 
-	while (n) {
-		bss = rb_entry(n, struct cfg80211_internal_bss, rbn);
-		r = cmp_hidden_bss(&res->pub, &bss->pub);
+	/*
+	 * The hidden entry has a different SSID IE, so for a mesh BSS
+	 * (which may match any BSSID) there's no bucket to look in.
+	 */
+	if (is_mesh_bss(&res->pub)) {
+		list_for_each_entry(bss, &dev->bss_list, list)
+			if (!cmp_hidden_bss(&res->pub, &bss->pub))
+				return bss;
+		return NULL;
+	}
 
-		if (r == 0)
+	head = &dev->bss_hash[bss_hash_bssid(res->pub.bssid)];
+	hlist_for_each_entry(bss, n, head, hnode)
+		if (!cmp_hidden_bss(&res->pub, &bss->pub))
 			return bss;
-		else if (r < 0)
-			n = n->rb_left;
-		else
-			n = n->rb_right;
-	}
 
 	return NULL;
 }
@@ -611,6 +678,7 @@ cfg80211_bss_update(struct cfg80211_registered_device *dev,
 		    struct cfg80211_internal_bss *res)
 {
 	struct cfg80211_internal_bss *found = NULL;
+	ktime_t start;
 
 	/*
 	 * The reference to "res" is donated to this function.
@@ -621,11 +689,13 @@ cfg80211_bss_update(struct cfg80211_registered_device *dev,
 		return NULL;
 	}
 
-	res->ts = jiffies;
-
 	spin_lock_bh(&dev->bss_lock);
 
-	found = rb_find_bss(dev, res);
+	start = ktime_get();
+	/* set under the lock to keep bss_list ordered by ts */
+	res->ts = jiffies;
+
+	found = hash_find_bss(dev, res);
 
 	if (found) {
 		found->pub.beacon_interval = res->pub.beacon_interval;
@@ -717,6 +787,9 @@ cfg80211_bss_update(struct cfg80211_registered_device *dev,
 			}
 		}
 
+		list_move_tail(&found->list, &dev->bss_list);
+		dev->bss_stats.updates++;
+
 		kref_put(&res->ref, bss_release);
 	} else {
 		struct cfg80211_internal_bss *hidden;
@@ -730,17 +803,20 @@ cfg80211_bss_update(struct cfg80211_registered_device *dev,
 		/* TODO: The code is not trying to update existing probe
 		 * response bss entries when beacon ies are
 		 * getting changed. */
-		hidden = rb_find_hidden_bss(dev, res);
-		if (hidden)
+		hidden = hash_find_hidden_bss(dev, res);
+		if (hidden) {
 			copy_hidden_ies(res, hidden);
+			dev->bss_stats.hidden++;
+		}
 
 		/* this "consumes" the reference */
-		list_add_tail(&res->list, &dev->bss_list);
-		rb_insert_bss(dev, res);
+		__cfg80211_link_bss(dev, res);
+		dev->bss_stats.inserts++;
 		found = res;
 	}
 
 	dev->bss_generation++;
+	dev->bss_stats.update_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
 	spin_unlock_bh(&dev->bss_lock);
 
 	kref_get(&found->ref);
@@ -0,0 +1,2 @@
+/* the real header only needs <linux/types.h> and <asm/byteorder.h> */
+#include "../../../../include/linux/ieee80211.h"
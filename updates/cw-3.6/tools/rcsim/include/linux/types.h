@@ -0,0 +1 @@
+#include <rcsim/kernel.h>
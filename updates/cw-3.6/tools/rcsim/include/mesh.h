@@ -0,0 +1 @@
+/* rc80211_pid_algo.c includes mesh.h but uses nothing from it */
@@ -0,0 +1,36 @@
+/*
+ * Stand-in for net/mac80211/rate.h and the parts of ieee80211_i.h and
+ * sta_info.h that the rate control algorithms reach into.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef __RCSIM_RATE_H
+#define __RCSIM_RATE_H
+
+#include <net/mac80211.h>
+
+#define IEEE80211_NUM_TIDS	16
+
+struct sta_info {
+	struct {
+		void *tid_tx[IEEE80211_NUM_TIDS];
+	} ampdu_mlme;
+
+	/* must be last, like the real one */
+	struct ieee80211_sta sta;
+};
+
+int ieee80211_frame_duration(enum ieee80211_band band, size_t len,
+			     int rate, int erp, int short_preamble);
+
+int rc80211_pid_init(void);
+void rc80211_pid_exit(void);
+int rc80211_minstrel_init(void);
+void rc80211_minstrel_exit(void);
+int rc80211_minstrel_ht_init(void);
+void rc80211_minstrel_ht_exit(void);
+
+#endif /* __RCSIM_RATE_H */
@@ -0,0 +1,242 @@
+/*
+ * Minimal kernel environment for building the mac80211 rate control
+ * algorithms in userspace. Only what rc80211_minstrel{,_ht}.c and
+ * rc80211_pid_algo.c actually use is provided; all the <linux/...>
+ * headers they include resolve to this file.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef __RCSIM_KERNEL_H
+#define __RCSIM_KERNEL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <endian.h>
+#include <errno.h>
+#include <sys/types.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
+
+typedef u16 __le16;
+typedef u32 __le32;
+typedef u64 __le64;
+typedef u16 __be16;
+typedef u32 __be32;
+typedef u64 __be64;
+typedef u16 __sum16;
+typedef u8 __u8;
+typedef u16 __u16;
+typedef u32 __u32;
+
+typedef unsigned int gfp_t;
+#define GFP_KERNEL	0
+#define GFP_ATOMIC	1
+
+#define __packed	__attribute__((packed))
+#define __aligned(x)	__attribute__((aligned(x)))
+#define __init
+#define __exit
+#define __user
+#define EXPORT_SYMBOL(x)
+#define EXPORT_SYMBOL_GPL(x)
+
+#define likely(x)	__builtin_expect(!!(x), 1)
+#define unlikely(x)	__builtin_expect(!!(x), 0)
+
+#define BIT(nr)			(1UL << (nr))
+#define ARRAY_SIZE(arr)		(sizeof(arr) / sizeof((arr)[0]))
+#define DIV_ROUND_UP(n, d)	(((n) + (d) - 1) / (d))
+#define div_u64(n, d)		((u64)(n) / (u32)(d))
+#define BUILD_BUG_ON(cond)	((void)sizeof(char[1 - 2 * !!(cond)]))
+#define WARN_ON(cond)		({ int __c = !!(cond); __c; })
+#define WARN_ON_ONCE(cond)	WARN_ON(cond)
+
+#define container_of(ptr, type, member) \
+	((type *)((char *)(ptr) - offsetof(type, member)))
+
+#define min(x, y)	({ typeof(x) _x = (x); typeof(y) _y = (y); \
+			   _x < _y ? _x : _y; })
+#define max(x, y)	({ typeof(x) _x = (x); typeof(y) _y = (y); \
+			   _x > _y ? _x : _y; })
+#define min_t(type, x, y) \
+	({ type __x = (x); type __y = (y); __x < __y ? __x : __y; })
+#define max_t(type, x, y) \
+	({ type __x = (x); type __y = (y); __x > __y ? __x : __y; })
+#define swap(a, b) \
+	do { typeof(a) __tmp = (a); (a) = (b); (b) = __tmp; } while (0)
+
+/* bitmaps: only single-word ones are used */
+static inline unsigned long find_next_bit(const unsigned long *addr,
+					  unsigned long size,
+					  unsigned long offset)
+{
+	unsigned long word;
+
+	if (offset >= size)
+		return size;
+
+	word = *addr >> offset;
+	if (size < 8 * sizeof(long))
+		word &= (1UL << (size - offset)) - 1;
+	if (!word)
+		return size;
+
+	return offset + __builtin_ctzl(word);
+}
+
+#define for_each_set_bit(bit, addr, size) \
+	for ((bit) = find_next_bit((addr), (size), 0); \
+	     (bit) < (size); \
+	     (bit) = find_next_bit((addr), (size), (bit) + 1))
+
+#define cpu_to_le16(x)	htole16(x)
+#define cpu_to_le32(x)	htole32(x)
+#define le16_to_cpu(x)	le16toh(x)
+#define le32_to_cpu(x)	le32toh(x)
+#define cpu_to_be16(x)	htobe16(x)
+#define be16_to_cpu(x)	be16toh(x)
+#define __cpu_to_le16(x)	cpu_to_le16(x)
+#define __le16_to_cpu(x)	le16_to_cpu(x)
+
+/* time: the simulator advances jiffies as it replays a trace */
+#define HZ	1000
+
+extern unsigned long jiffies;
+
+#define time_after(a, b)	((long)((b) - (a)) < 0)
+#define time_before(a, b)	time_after(b, a)
+#define time_after_eq(a, b)	((long)((a) - (b)) >= 0)
+#define time_before_eq(a, b)	time_after_eq(b, a)
+
+static inline unsigned long msecs_to_jiffies(unsigned int m)
+{
+	return m;
+}
+
+static inline unsigned int jiffies_to_msecs(unsigned long j)
+{
+	return j;
+}
+
+/* memory */
+#define kmalloc(size, gfp)	malloc(size)
+#define kzalloc(size, gfp)	calloc(1, size)
+#define kfree(ptr)		free(ptr)
+
+/* locking: the simulator is single threaded */
+typedef struct { int unused; } spinlock_t;
+typedef struct { int unused; } wait_queue_head_t;
+
+#define spin_lock_init(l)	do { (void)(l); } while (0)
+#define spin_lock(l)		do { (void)(l); } while (0)
+#define spin_unlock(l)		do { (void)(l); } while (0)
+#define spin_lock_bh(l)		do { (void)(l); } while (0)
+#define spin_unlock_bh(l)	do { (void)(l); } while (0)
+
+/* lists */
+struct list_head {
+	struct list_head *next, *prev;
+};
+
+static inline void INIT_LIST_HEAD(struct list_head *list)
+{
+	list->next = list;
+	list->prev = list;
+}
+
+static inline void __list_add(struct list_head *new, struct list_head *prev,
+			      struct list_head *next)
+{
+	next->prev = new;
+	new->next = next;
+	new->prev = prev;
+	prev->next = new;
+}
+
+static inline void list_add(struct list_head *new, struct list_head *head)
+{
+	__list_add(new, head, head->next);
+}
+
+static inline void list_add_tail(struct list_head *new,
+				 struct list_head *head)
+{
+	__list_add(new, head->prev, head);
+}
+
+static inline void list_del(struct list_head *entry)
+{
+	entry->next->prev = entry->prev;
+	entry->prev->next = entry->next;
+}
+
+#define list_entry(ptr, type, member)	container_of(ptr, type, member)
+
+#define list_for_each_entry(pos, head, member)				\
+	for (pos = list_entry((head)->next, typeof(*pos), member);	\
+	     &pos->member != (head);					\
+	     pos = list_entry(pos->member.next, typeof(*pos), member))
+
+#define list_for_each_entry_safe(pos, n, head, member)			\
+	for (pos = list_entry((head)->next, typeof(*pos), member),	\
+	     n = list_entry(pos->member.next, typeof(*pos), member);	\
+	     &pos->member != (head);					\
+	     pos = n, n = list_entry(n->member.next, typeof(*n), member))
+
+#define list_for_each_entry_safe_reverse(pos, n, head, member)		\
+	for (pos = list_entry((head)->prev, typeof(*pos), member),	\
+	     n = list_entry(pos->member.prev, typeof(*pos), member);	\
+	     &pos->member != (head);					\
+	     pos = n, n = list_entry(n->member.prev, typeof(*n), member))
+
+/* networking */
+#define ETH_ALEN	6
+#define ETH_P_PAE	0x888E
+
+static inline bool ether_addr_equal(const u8 *addr1, const u8 *addr2)
+{
+	return !memcmp(addr1, addr2, ETH_ALEN);
+}
+
+static inline bool is_valid_ether_addr(const u8 *addr)
+{
+	static const u8 zero[ETH_ALEN];
+
+	return !(addr[0] & 0x01) && memcmp(addr, zero, ETH_ALEN);
+}
+
+struct sk_buff {
+	unsigned char *data;
+	unsigned int len;
+	__be16 protocol;
+	u16 queue_mapping;
+	char cb[48] __aligned(8);
+};
+
+static inline u16 skb_get_queue_mapping(const struct sk_buff *skb)
+{
+	return skb->queue_mapping;
+}
+
+void get_random_bytes(void *buf, int nbytes);
+
+/* debugfs is never built in, but prototypes still mention these */
+struct dentry;
+struct inode;
+struct file;
+struct module;
+
+#endif /* __RCSIM_KERNEL_H */
@@ -0,0 +1,147 @@
+/*
+ * Kernel and mac80211 functions the rate control algorithms call,
+ * reimplemented for the simulator.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <stdio.h>
+#include "rate.h"
+#include "rcsim.h"
+
+/* start close to a wrap-around, like the kernel does */
+unsigned long jiffies = (unsigned long)(-300 * HZ);
+
+static struct rate_control_ops *rcsim_algs[8];
+static u64 rcsim_rand_state = 0x9e3779b97f4a7c15ULL;
+
+u64 rcsim_rand(u64 *state)
+{
+	/* xorshift64* */
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return *state * 0x2545f4914f6cdd1dULL;
+}
+
+void rcsim_seed_kernel(u64 seed)
+{
+	rcsim_rand_state = seed ? seed : 1;
+}
+
+void get_random_bytes(void *buf, int nbytes)
+{
+	u8 *p = buf;
+	u64 r = 0;
+	int i;
+
+	for (i = 0; i < nbytes; i++) {
+		if (!(i % 8))
+			r = rcsim_rand(&rcsim_rand_state);
+		p[i] = r;
+		r >>= 8;
+	}
+}
+
+int ieee80211_rate_control_register(struct rate_control_ops *ops)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(rcsim_algs); i++) {
+		if (!rcsim_algs[i]) {
+			rcsim_algs[i] = ops;
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+void ieee80211_rate_control_unregister(struct rate_control_ops *ops)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(rcsim_algs); i++)
+		if (rcsim_algs[i] == ops)
+			rcsim_algs[i] = NULL;
+}
+
+struct rate_control_ops *rcsim_find_alg(const char *name)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(rcsim_algs); i++)
+		if (rcsim_algs[i] && !strcmp(rcsim_algs[i]->name, name))
+			return rcsim_algs[i];
+
+	return NULL;
+}
+
+void rcsim_list_algs(FILE *f)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(rcsim_algs); i++)
+		if (rcsim_algs[i])
+			fprintf(f, " %s", rcsim_algs[i]->name);
+}
+
+/*
+ * A block ack session is "established" right away; whether frames are
+ * actually aggregated is taken from the trace.
+ */
+int ieee80211_start_tx_ba_session(struct ieee80211_sta *pubsta, u16 tid,
+				  u16 timeout)
+{
+	struct sta_info *sta = container_of(pubsta, struct sta_info, sta);
+
+	sta->ampdu_mlme.tid_tx[tid] = sta;
+	rcsim_ba_sessions++;
+	return 0;
+}
+
+/* from net/mac80211/rate.c */
+bool rate_control_send_low(struct ieee80211_sta *sta,
+			   void *priv_sta,
+			   struct ieee80211_tx_rate_control *txrc)
+{
+	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(txrc->skb);
+	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *) txrc->skb->data;
+
+	if (!sta || !priv_sta ||
+	    (info->flags & (IEEE80211_TX_CTL_NO_ACK |
+			    IEEE80211_TX_CTL_USE_MINRATE)) ||
+	    !ieee80211_is_data(hdr->frame_control)) {
+		info->control.rates[0].idx =
+			rate_lowest_index(txrc->sband, sta);
+		info->control.rates[0].count =
+			(info->flags & IEEE80211_TX_CTL_NO_ACK) ?
+			1 : txrc->hw->max_rate_tries;
+		return true;
+	}
+	return false;
+}
+
+/* from net/mac80211/util.c */
+int ieee80211_frame_duration(enum ieee80211_band band, size_t len,
+			     int rate, int erp, int short_preamble)
+{
+	int dur;
+
+	if (band == IEEE80211_BAND_5GHZ || erp) {
+		dur = 16; /* SIFS + signal ext */
+		dur += 16; /* 17.3.2.3: T_PREAMBLE = 16 usec */
+		dur += 4; /* 17.3.2.3: T_SIGNAL = 4 usec */
+		dur += 4 * DIV_ROUND_UP((16 + 8 * (len + 4) + 6) * 10,
+					4 * rate); /* T_SYM x N_SYM */
+	} else {
+		dur = 10; /* aSIFSTime = 10 usec */
+		dur += short_preamble ? (72 + 24) : (144 + 48);
+
+		dur += DIV_ROUND_UP(8 * (len + 4) * 10, rate);
+	}
+
+	return dur;
+}
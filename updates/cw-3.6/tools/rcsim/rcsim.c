@@ -0,0 +1,1053 @@
+/*
+ * rcsim - offline replay of mac80211 rate control
+ *
+ * Links the unmodified rate control algorithms from net/mac80211 and
+ * drives them with TX status recorded by the mac80211:tx_status
+ * tracepoint, e.g.
+ *
+ *   echo 1 > /sys/kernel/debug/tracing/events/mac80211/tx_status/enable
+ *   cat /sys/kernel/debug/tracing/trace_pipe > tx_status.txt
+ *
+ * (trace-cmd report output works as well).
+ *
+ * The trace is first reduced to a per-station channel model: for every
+ * rate and time window the fraction of successful attempts, derived the
+ * same way minstrel accounts them. Every traced frame is then sent again
+ * through the selected algorithm; the rates it picks are attempted
+ * against the model and the outcome is reported back via tx_status.
+ * Rates the trace never used are extrapolated from their neighbours, so
+ * absolute numbers are only as good as the trace's rate coverage; the
+ * tool is meant for comparing algorithms and revisions against each
+ * other on the same trace.
+ *
+ * Reported are the rates picked, the estimated throughput for both the
+ * recorded and the simulated rate choices, and the CPU time spent in the
+ * algorithm's get_rate and tx_status callbacks.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <time.h>
+#include "rate.h"
+#include "rcsim.h"
+
+#define RCSIM_MAX_STA		64
+#define RCSIM_LINE_LEN		1024
+
+/* channel model keys: 4 MCS flag combinations x 32 MCS, then legacy */
+#define KEY_MCS(idx, sgi, ht40)	((idx) | ((sgi) << 5) | ((ht40) << 6))
+#define KEY_LEGACY(idx)		(128 + (idx))
+#define N_KEYS			(128 + 32)
+
+/* attempts needed before a model estimate is trusted */
+#define MODEL_MIN_ATTEMPTS	10
+/* how many windows to look around when the current one has no data */
+#define MODEL_WINDOW_SPAN	5
+
+struct rcsim_event {
+	u64 t_us;
+	int sta;
+	u32 len;
+	u32 flags;
+	u16 fc;
+	u8 ampdu_len;
+	u8 ampdu_ack_len;
+	struct ieee80211_tx_rate rates[IEEE80211_TX_MAX_RATES];
+};
+
+struct rcsim_obs {
+	u8 key;
+	u32 attempts;
+	u32 success;
+};
+
+struct rcsim_window {
+	struct rcsim_obs *obs;
+	int n_obs;
+};
+
+struct rcsim_link_stats {
+	u64 frames;
+	u64 mpdus;
+	u64 mpdus_acked;
+	u64 bytes_acked;
+	u64 airtime_us;
+};
+
+struct rcsim_sta {
+	struct sta_info *si;
+	void *priv_sta;
+	enum ieee80211_band band;
+
+	/* channel model */
+	struct rcsim_window *win;
+	int n_win;
+	u32 total_att[N_KEYS];
+	u32 total_succ[N_KEYS];
+
+	struct rcsim_link_stats trace, sim;
+	u64 first_rate[N_KEYS];
+};
+
+struct rcsim_cost {
+	u64 calls;
+	u64 total_ns;
+	u64 max_ns;
+};
+
+unsigned long rcsim_ba_sessions;
+
+static struct rcsim_event *events;
+static size_t n_events, max_events;
+static struct rcsim_sta stations[RCSIM_MAX_STA];
+static int n_stations;
+static u64 t_start = ~0ULL, t_end;
+
+static unsigned int window_us = 100000;
+static u64 sim_rand_state;
+static long timer_overhead_ns;
+static struct rcsim_cost cost_get_rate, cost_tx_status;
+
+static struct ieee80211_rate rates_2ghz[] = {
+	{ .bitrate = 10 },
+	{ .bitrate = 20, .flags = IEEE80211_RATE_SHORT_PREAMBLE },
+	{ .bitrate = 55, .flags = IEEE80211_RATE_SHORT_PREAMBLE },
+	{ .bitrate = 110, .flags = IEEE80211_RATE_SHORT_PREAMBLE },
+	{ .bitrate = 60, .flags = IEEE80211_RATE_ERP_G },
+	{ .bitrate = 90, .flags = IEEE80211_RATE_ERP_G },
+	{ .bitrate = 120, .flags = IEEE80211_RATE_ERP_G },
+	{ .bitrate = 180, .flags = IEEE80211_RATE_ERP_G },
+	{ .bitrate = 240, .flags = IEEE80211_RATE_ERP_G },
+	{ .bitrate = 360, .flags = IEEE80211_RATE_ERP_G },
+	{ .bitrate = 480, .flags = IEEE80211_RATE_ERP_G },
+	{ .bitrate = 540, .flags = IEEE80211_RATE_ERP_G },
+};
+
+static struct ieee80211_rate rates_5ghz[] = {
+	{ .bitrate = 60 },
+	{ .bitrate = 90 },
+	{ .bitrate = 120 },
+	{ .bitrate = 180 },
+	{ .bitrate = 240 },
+	{ .bitrate = 360 },
+	{ .bitrate = 480 },
+	{ .bitrate = 540 },
+};
+
+static struct ieee80211_supported_band band_2ghz = {
+	.band = IEEE80211_BAND_2GHZ,
+	.bitrates = rates_2ghz,
+	.n_bitrates = ARRAY_SIZE(rates_2ghz),
+};
+
+static struct ieee80211_supported_band band_5ghz = {
+	.band = IEEE80211_BAND_5GHZ,
+	.bitrates = rates_5ghz,
+	.n_bitrates = ARRAY_SIZE(rates_5ghz),
+};
+
+static struct wiphy wiphy = {
+	.bands = {
+		[IEEE80211_BAND_2GHZ] = &band_2ghz,
+		[IEEE80211_BAND_5GHZ] = &band_5ghz,
+	},
+};
+
+static struct ieee80211_hw hw = {
+	.wiphy = &wiphy,
+	.max_rates = 4,
+	.max_report_rates = 4,
+	.max_rate_tries = 10,
+	.conf = {
+		.long_frame_max_tx_count = 4,
+		.short_frame_max_tx_count = 7,
+	},
+};
+
+static struct ieee80211_bss_conf bss_conf;
+
+/* data bits per OFDM symbol and stream, 20 and 40 MHz */
+static const u16 ht_bps[2][8] = {
+	{ 26, 52, 78, 104, 156, 208, 234, 260 },
+	{ 54, 108, 162, 216, 324, 432, 486, 540 },
+};
+
+static int rate_key(const struct ieee80211_tx_rate *r)
+{
+	if (r->flags & IEEE80211_TX_RC_MCS)
+		return KEY_MCS(r->idx & 31,
+			       !!(r->flags & IEEE80211_TX_RC_SHORT_GI),
+			       !!(r->flags & IEEE80211_TX_RC_40_MHZ_WIDTH));
+
+	return KEY_LEGACY(r->idx & 31);
+}
+
+static void key_name(struct rcsim_sta *st, int key, char *buf, size_t len)
+{
+	struct ieee80211_supported_band *sband = wiphy.bands[st->band];
+	int idx;
+
+	if (key < 128) {
+		snprintf(buf, len, "MCS%d%s%s", key & 31,
+			 key & (1 << 6) ? "/HT40" : "",
+			 key & (1 << 5) ? "/SGI" : "");
+		return;
+	}
+
+	idx = key - 128;
+	if (idx < sband->n_bitrates)
+		snprintf(buf, len, "%d.%dM", sband->bitrates[idx].bitrate / 10,
+			 sband->bitrates[idx].bitrate % 10);
+	else
+		snprintf(buf, len, "legacy%d", idx);
+}
+
+/*
+ * Airtime estimate for one attempt of @n_mpdu frames of @len bytes:
+ * contention (DIFS and the average initial backoff), PHY preamble, data
+ * and the (block) ack.
+ */
+static unsigned int attempt_airtime(struct rcsim_sta *st, int key,
+				    unsigned int len, unsigned int n_mpdu)
+{
+	struct ieee80211_supported_band *sband = wiphy.bands[st->band];
+	unsigned int t = 34 + (15 * 9) / 2;
+	unsigned int bits, bps, streams, nsym;
+	struct ieee80211_rate *rate;
+	int idx;
+
+	if (key < 128) {
+		idx = key & 31;
+		streams = idx / 8 + 1;
+		bps = ht_bps[!!(key & (1 << 6))][idx % 8] * streams;
+		/* MPDU, FCS and A-MPDU delimiter, padded to 4 bytes */
+		bits = 16 + 6 + 8 * n_mpdu * ((len + 4 + 4 + 3) & ~3);
+		nsym = DIV_ROUND_UP(bits, bps);
+
+		t += 32 + 4 * streams;
+		t += (key & (1 << 5)) ? DIV_ROUND_UP(nsym * 18, 5) : nsym * 4;
+		/* SIFS + (block) ack at a 24 Mbit/s basic rate */
+		t += 16 + (n_mpdu > 1 ? 32 : 28);
+		return t;
+	}
+
+	idx = key - 128;
+	if (idx >= sband->n_bitrates)
+		idx = sband->n_bitrates - 1;
+	rate = &sband->bitrates[idx];
+
+	/* ieee80211_frame_duration() includes the SIFS */
+	t += n_mpdu * ieee80211_frame_duration(st->band, len, rate->bitrate,
+					       !!(rate->flags &
+						  IEEE80211_RATE_ERP_G), 1);
+	t += ieee80211_frame_duration(st->band, 10, rate->bitrate,
+				      !!(rate->flags & IEEE80211_RATE_ERP_G),
+				      1);
+	return t;
+}
+
+/*
+ * Trace parsing
+ */
+
+static int find_station(const u8 *addr)
+{
+	int i;
+
+	for (i = 0; i < n_stations; i++)
+		if (ether_addr_equal(stations[i].si->sta.addr, addr))
+			return i;
+
+	return -1;
+}
+
+static int add_station(const u8 *addr, int band, u32 supp_rates, int ht,
+		       u16 ht_cap, const u8 *rx_mask)
+{
+	struct rcsim_sta *st;
+	struct ieee80211_sta *sta;
+
+	if (n_stations == RCSIM_MAX_STA) {
+		fprintf(stderr, "rcsim: too many stations\n");
+		return -1;
+	}
+
+	if (band != IEEE80211_BAND_2GHZ && band != IEEE80211_BAND_5GHZ) {
+		fprintf(stderr, "rcsim: unsupported band %d\n", band);
+		return -1;
+	}
+
+	st = &stations[n_stations];
+	st->si = calloc(1, sizeof(*st->si));
+	if (!st->si)
+		return -1;
+
+	st->band = band;
+	sta = &st->si->sta;
+	memcpy(sta->addr, addr, ETH_ALEN);
+	sta->wme = true;
+	sta->supp_rates[band] = supp_rates ? supp_rates :
+		(1 << wiphy.bands[band]->n_bitrates) - 1;
+	if (ht) {
+		sta->ht_cap.ht_supported = true;
+		sta->ht_cap.cap = ht_cap;
+		memcpy(sta->ht_cap.mcs.rx_mask, rx_mask, 4);
+	}
+
+	return n_stations++;
+}
+
+static struct rcsim_obs *model_obs(struct rcsim_sta *st, u64 t, int key)
+{
+	struct rcsim_window *w;
+	int i, n = (t - t_start) / window_us;
+
+	if (n >= st->n_win) {
+		int new_n = n + 64;
+
+		st->win = realloc(st->win, new_n * sizeof(*st->win));
+		if (!st->win)
+			return NULL;
+		memset(&st->win[st->n_win], 0,
+		       (new_n - st->n_win) * sizeof(*st->win));
+		st->n_win = new_n;
+	}
+
+	w = &st->win[n];
+	for (i = 0; i < w->n_obs; i++)
+		if (w->obs[i].key == key)
+			return &w->obs[i];
+
+	w->obs = realloc(w->obs, (w->n_obs + 1) * sizeof(*w->obs));
+	if (!w->obs)
+		return NULL;
+
+	w->obs[w->n_obs].key = key;
+	w->obs[w->n_obs].attempts = 0;
+	w->obs[w->n_obs].success = 0;
+	return &w->obs[w->n_obs++];
+}
+
+static bool rate_valid(const struct ieee80211_tx_rate *r)
+{
+	return r->idx >= 0 && r->count;
+}
+
+/*
+ * Walk the rate chain of a status report, calling @fn for each stage
+ * with the number of attempts and successes it accounts for, the same
+ * way minstrel_ht does: all attempts count as failures except for the
+ * ones acked on the last stage.
+ */
+static void for_each_stage(const struct rcsim_event *ev,
+			   void (*fn)(const struct rcsim_event *ev, int key,
+				      unsigned int tries, unsigned int att,
+				      unsigned int succ, void *data),
+			   void *data)
+{
+	unsigned int n_mpdu = 1, acked;
+	bool last;
+	int i;
+
+	if (ev->flags & IEEE80211_TX_STAT_AMPDU) {
+		n_mpdu = ev->ampdu_len;
+		acked = ev->ampdu_ack_len;
+	} else {
+		acked = !!(ev->flags & IEEE80211_TX_STAT_ACK);
+	}
+
+	for (i = 0; i < IEEE80211_TX_MAX_RATES; i++) {
+		if (!rate_valid(&ev->rates[i]))
+			break;
+
+		last = i == IEEE80211_TX_MAX_RATES - 1 ||
+		       !rate_valid(&ev->rates[i + 1]);
+		fn(ev, rate_key(&ev->rates[i]), ev->rates[i].count,
+		   ev->rates[i].count * n_mpdu, last ? acked : 0, data);
+	}
+}
+
+static void model_add_stage(const struct rcsim_event *ev, int key,
+			    unsigned int tries, unsigned int att,
+			    unsigned int succ, void *data)
+{
+	struct rcsim_sta *st = &stations[ev->sta];
+	struct rcsim_obs *o;
+
+	o = model_obs(st, ev->t_us, key);
+	if (!o) {
+		fprintf(stderr, "rcsim: out of memory\n");
+		exit(1);
+	}
+
+	o->attempts += att;
+	o->success += min(succ, att);
+	st->total_att[key] += att;
+	st->total_succ[key] += min(succ, att);
+}
+
+static void trace_add_stage(const struct rcsim_event *ev, int key,
+			    unsigned int tries, unsigned int att,
+			    unsigned int succ, void *data)
+{
+	struct rcsim_link_stats *ls = data;
+	unsigned int n_mpdu = 1;
+
+	if (ev->flags & IEEE80211_TX_STAT_AMPDU)
+		n_mpdu = ev->ampdu_len;
+
+	ls->airtime_us += tries * attempt_airtime(&stations[ev->sta], key,
+						  ev->len, n_mpdu);
+}
+
+static bool ignore_event(const struct rcsim_event *ev)
+{
+	/* aggregated frames without status are covered by the one with it */
+	if ((ev->flags & IEEE80211_TX_CTL_AMPDU) &&
+	    !(ev->flags & IEEE80211_TX_STAT_AMPDU))
+		return true;
+
+	/* not subject to rate control */
+	if (ev->flags & IEEE80211_TX_CTL_NO_ACK)
+		return true;
+
+	return !rate_valid(&ev->rates[0]);
+}
+
+static int parse_line(const char *line, int lineno)
+{
+	static const char tag[] = " tx_status: ";
+	struct rcsim_event *ev;
+	const char *p, *ts;
+	char phy[32];
+	unsigned int addr[ETH_ALEN], rx_mask[4], idx[4], cnt[4], fl[4];
+	unsigned int band, len, fc, flags, ack, ampdu, supp, ht, ht_cap;
+	u8 mac[ETH_ALEN], mask[4];
+	double t;
+	int i, n, sta;
+
+	p = strstr(line, tag);
+	if (!p)
+		return 0;
+
+	/* "... 1234.567890: tx_status: ..." */
+	ts = p;
+	while (ts > line && ts[-1] != ' ')
+		ts--;
+	if (sscanf(ts, "%lf:", &t) != 1)
+		goto bad;
+
+	n = sscanf(p + strlen(tag),
+		   "%31s sta:%x:%x:%x:%x:%x:%x band:%u len:%u fc:0x%x "
+		   "flags:0x%x ampdu:%u/%u "
+		   "rates:%d/%u/0x%x,%d/%u/0x%x,%d/%u/0x%x,%d/%u/0x%x "
+		   "supp:0x%x ht:%u/0x%x mcs:%2x%2x%2x%2x",
+		   phy, &addr[0], &addr[1], &addr[2], &addr[3], &addr[4],
+		   &addr[5], &band, &len, &fc, &flags, &ack, &ampdu,
+		   (int *)&idx[0], &cnt[0], &fl[0], (int *)&idx[1], &cnt[1],
+		   &fl[1], (int *)&idx[2], &cnt[2], &fl[2], (int *)&idx[3],
+		   &cnt[3], &fl[3], &supp, &ht, &ht_cap, &rx_mask[0],
+		   &rx_mask[1], &rx_mask[2], &rx_mask[3]);
+	if (n != 32)
+		goto bad;
+
+	for (i = 0; i < ETH_ALEN; i++)
+		mac[i] = addr[i];
+	for (i = 0; i < 4; i++)
+		mask[i] = rx_mask[i];
+
+	sta = find_station(mac);
+	if (sta < 0)
+		sta = add_station(mac, band, supp, ht, ht_cap, mask);
+	if (sta < 0)
+		return -1;
+
+	if (n_events == max_events) {
+		max_events = max_events ? 2 * max_events : 4096;
+		events = realloc(events, max_events * sizeof(*events));
+		if (!events) {
+			fprintf(stderr, "rcsim: out of memory\n");
+			return -1;
+		}
+	}
+
+	ev = &events[n_events];
+	ev->t_us = t * 1000000.0 + 0.5;
+	ev->sta = sta;
+	ev->len = len;
+	ev->fc = fc;
+	ev->flags = flags;
+	ev->ampdu_len = ampdu;
+	ev->ampdu_ack_len = ack;
+	for (i = 0; i < IEEE80211_TX_MAX_RATES; i++) {
+		ev->rates[i].idx = (int)idx[i];
+		ev->rates[i].count = cnt[i];
+		ev->rates[i].flags = fl[i];
+	}
+
+	if (ignore_event(ev))
+		return 0;
+
+	if (ev->t_us < t_start)
+		t_start = ev->t_us;
+	if (ev->t_us > t_end)
+		t_end = ev->t_us;
+	n_events++;
+	return 0;
+
+ bad:
+	fprintf(stderr, "rcsim: line %d: cannot parse tx_status event\n",
+		lineno);
+	return -1;
+}
+
+static int event_cmp(const void *a, const void *b)
+{
+	const struct rcsim_event *ea = a, *eb = b;
+
+	if (ea->t_us != eb->t_us)
+		return ea->t_us < eb->t_us ? -1 : 1;
+	return 0;
+}
+
+static int load_trace(FILE *f)
+{
+	char line[RCSIM_LINE_LEN];
+	int lineno = 0;
+	size_t i;
+
+	while (fgets(line, sizeof(line), f)) {
+		lineno++;
+		if (parse_line(line, lineno))
+			return -1;
+	}
+
+	if (!n_events) {
+		fprintf(stderr, "rcsim: no usable tx_status events\n");
+		return -1;
+	}
+
+	/* per-CPU buffers can interleave slightly out of order */
+	qsort(events, n_events, sizeof(*events), event_cmp);
+
+	for (i = 0; i < n_events; i++)
+		for_each_stage(&events[i], model_add_stage, NULL);
+
+	return 0;
+}
+
+/*
+ * Channel model
+ */
+
+static bool model_window_prob(struct rcsim_sta *st, u64 t, int key,
+			      double *prob)
+{
+	u64 att = 0, succ = 0;
+	int n = (t - t_start) / window_us;
+	int span, w, i;
+
+	for (span = 0; span <= MODEL_WINDOW_SPAN; span++) {
+		for (w = n - span; w <= n + span; w += span ? 2 * span : 1) {
+			if (w < 0 || w >= st->n_win)
+				continue;
+
+			for (i = 0; i < st->win[w].n_obs; i++) {
+				if (st->win[w].obs[i].key != key)
+					continue;
+				att += st->win[w].obs[i].attempts;
+				succ += st->win[w].obs[i].success;
+			}
+		}
+
+		if (att >= MODEL_MIN_ATTEMPTS) {
+			*prob = (double)succ / att;
+			return true;
+		}
+	}
+
+	if (st->total_att[key] >= MODEL_MIN_ATTEMPTS) {
+		*prob = (double)st->total_succ[key] / st->total_att[key];
+		return true;
+	}
+
+	return false;
+}
+
+/*
+ * Success probability of a single attempt at @key around time @t. Rates
+ * without enough samples are derived from the nearest measured rate of
+ * the same kind: faster ones get half the success probability per step,
+ * slower ones are assumed to do at least as well as the nearest faster
+ * one. MCS variants (SGI, HT40, more streams) that were never measured
+ * at all fall back to their plain counterpart with a penalty.
+ */
+static double model_prob(struct rcsim_sta *st, u64 t, int key)
+{
+	double prob, scale = 1.0;
+	int base, idx, i;
+
+	if (model_window_prob(st, t, key, &prob))
+		return prob;
+
+	if (key < 128) {
+		idx = key & 31;
+		base = key & ~31;
+
+		for (i = idx - 1, scale = 0.5; i >= (idx & ~7);
+		     i--, scale /= 2)
+			if (model_window_prob(st, t, base | i, &prob))
+				return prob * scale;
+
+		for (i = idx + 1; i <= (idx | 7); i++)
+			if (model_window_prob(st, t, base | i, &prob))
+				return prob;
+
+		if (key & (1 << 5))
+			return 0.9 * model_prob(st, t, key & ~(1 << 5));
+		if (key & (1 << 6))
+			return 0.8 * model_prob(st, t, key & ~(1 << 6));
+		if (idx >= 8)
+			return 0.5 * model_prob(st, t, key - 8);
+
+		return 0.5;
+	}
+
+	idx = key - 128;
+	for (i = idx - 1, scale = 0.5; i >= 0; i--, scale /= 2)
+		if (model_window_prob(st, t, KEY_LEGACY(i), &prob))
+			return prob * scale;
+
+	for (i = idx + 1; i < 32; i++)
+		if (model_window_prob(st, t, KEY_LEGACY(i), &prob))
+			return prob;
+
+	return 0.5;
+}
+
+static bool sim_attempt(double prob)
+{
+	return (rcsim_rand(&sim_rand_state) >> 11) * (1.0 / 9007199254740992.0) <
+	       prob;
+}
+
+/*
+ * Replay
+ */
+
+static long ns_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static void calibrate_timer(void)
+{
+	long best = -1, t0, t1;
+	int i;
+
+	for (i = 0; i < 1000; i++) {
+		t0 = ns_now();
+		t1 = ns_now();
+		if (best < 0 || t1 - t0 < best)
+			best = t1 - t0;
+	}
+	timer_overhead_ns = best;
+}
+
+static void account_cost(struct rcsim_cost *c, long t0, long t1)
+{
+	long ns = t1 - t0 - timer_overhead_ns;
+
+	if (ns < 0)
+		ns = 0;
+
+	c->calls++;
+	c->total_ns += ns;
+	if (ns > c->max_ns)
+		c->max_ns = ns;
+}
+
+static void sim_frame(struct rate_control_ops *ops, void *priv,
+		      const struct rcsim_event *ev, FILE *dump)
+{
+	struct rcsim_sta *st = &stations[ev->sta];
+	struct ieee80211_supported_band *sband = wiphy.bands[st->band];
+	struct ieee80211_tx_rate_control txrc;
+	struct ieee80211_tx_info *info;
+	struct ieee80211_tx_rate *r;
+	struct ieee80211_hdr *hdr;
+	struct sk_buff skb;
+	u8 frame[64];
+	unsigned int n_mpdu = 1, acked = 0, tries, airtime;
+	bool aggr = ev->flags & IEEE80211_TX_STAT_AMPDU;
+	double prob;
+	long t0, t1;
+	int i, j, key;
+
+	if (aggr)
+		n_mpdu = ev->ampdu_len;
+
+	/* only the header is looked at, room for a 4-address QoS one */
+	memset(frame, 0, sizeof(frame));
+	hdr = (struct ieee80211_hdr *)frame;
+	hdr->frame_control = cpu_to_le16(ev->fc);
+	memcpy(hdr->addr1, st->si->sta.addr, ETH_ALEN);
+
+	memset(&skb, 0, sizeof(skb));
+	skb.data = frame;
+	skb.len = ev->len;
+	skb.queue_mapping = IEEE80211_AC_BE;
+
+	info = IEEE80211_SKB_CB(&skb);
+	info->band = st->band;
+	if (aggr)
+		info->flags |= IEEE80211_TX_CTL_AMPDU;
+	for (i = 0; i < IEEE80211_TX_MAX_RATES; i++) {
+		info->control.rates[i].idx = -1;
+		info->control.rates[i].flags = 0;
+		info->control.rates[i].count = 0;
+	}
+
+	memset(&txrc, 0, sizeof(txrc));
+	txrc.hw = &hw;
+	txrc.sband = sband;
+	txrc.bss_conf = &bss_conf;
+	txrc.skb = &skb;
+	txrc.max_rate_idx = -1;
+	txrc.rate_idx_mask = ~0;
+	memset(txrc.rate_idx_mcs_mask, 0xff, sizeof(txrc.rate_idx_mcs_mask));
+
+	t0 = ns_now();
+	ops->get_rate(priv, &st->si->sta, st->priv_sta, &txrc);
+	t1 = ns_now();
+	account_cost(&cost_get_rate, t0, t1);
+
+	/* transmit against the channel model */
+	r = info->control.rates;
+	st->first_rate[rate_key(&r[0])]++;
+	for (i = 0; i < hw.max_rates && !acked; i++) {
+		if (!rate_valid(&r[i]))
+			break;
+
+		key = rate_key(&r[i]);
+		prob = model_prob(st, ev->t_us, key);
+		airtime = attempt_airtime(st, key, ev->len, n_mpdu);
+
+		for (tries = 0; tries < r[i].count && !acked; tries++) {
+			st->sim.airtime_us += airtime;
+			for (j = 0; j < n_mpdu; j++)
+				acked += sim_attempt(prob);
+		}
+		r[i].count = tries;
+	}
+	for (; i < IEEE80211_TX_MAX_RATES; i++) {
+		r[i].idx = -1;
+		r[i].count = 0;
+	}
+
+	if (aggr) {
+		info->flags |= IEEE80211_TX_STAT_AMPDU;
+		info->status.ampdu_len = n_mpdu;
+		info->status.ampdu_ack_len = acked;
+	} else if (acked) {
+		info->flags |= IEEE80211_TX_STAT_ACK;
+	}
+
+	st->sim.frames++;
+	st->sim.mpdus += n_mpdu;
+	st->sim.mpdus_acked += acked;
+	st->sim.bytes_acked += (u64)acked * ev->len;
+
+	if (dump) {
+		fprintf(dump, "%llu.%06llu %d", (unsigned long long)
+			(ev->t_us / 1000000), (unsigned long long)
+			(ev->t_us % 1000000), ev->sta);
+		for (i = 0; i < IEEE80211_TX_MAX_RATES; i++) {
+			char name[32];
+
+			if (!rate_valid(&r[i]))
+				break;
+			key_name(st, rate_key(&r[i]), name, sizeof(name));
+			fprintf(dump, " %s/%u", name, r[i].count);
+		}
+		fprintf(dump, " acked %u/%u\n", acked, n_mpdu);
+	}
+
+	t0 = ns_now();
+	ops->tx_status(priv, sband, &st->si->sta, st->priv_sta, &skb);
+	t1 = ns_now();
+	account_cost(&cost_tx_status, t0, t1);
+}
+
+static int replay(struct rate_control_ops *ops, FILE *dump)
+{
+	struct rcsim_sta *st;
+	void *priv;
+	size_t i;
+	int s;
+
+	priv = ops->alloc(&hw, NULL);
+	if (!priv)
+		return -ENOMEM;
+
+	for (s = 0; s < n_stations; s++) {
+		st = &stations[s];
+		st->priv_sta = ops->alloc_sta(priv, &st->si->sta, GFP_KERNEL);
+		if (!st->priv_sta)
+			return -ENOMEM;
+		ops->rate_init(priv, wiphy.bands[st->band], &st->si->sta,
+			       st->priv_sta);
+	}
+
+	for (i = 0; i < n_events; i++) {
+		const struct rcsim_event *ev = &events[i];
+		struct rcsim_link_stats *ls = &stations[ev->sta].trace;
+
+		jiffies = (unsigned long)(-300 * HZ) +
+			  (ev->t_us - t_start) / (1000000 / HZ);
+
+		/* what the recorded rate choices achieved */
+		for_each_stage(ev, trace_add_stage, ls);
+		ls->frames++;
+		if (ev->flags & IEEE80211_TX_STAT_AMPDU) {
+			ls->mpdus += ev->ampdu_len;
+			ls->mpdus_acked += ev->ampdu_ack_len;
+			ls->bytes_acked += (u64)ev->ampdu_ack_len * ev->len;
+		} else {
+			ls->mpdus++;
+			if (ev->flags & IEEE80211_TX_STAT_ACK) {
+				ls->mpdus_acked++;
+				ls->bytes_acked += ev->len;
+			}
+		}
+
+		sim_frame(ops, priv, ev, dump);
+	}
+
+	for (s = 0; s < n_stations; s++) {
+		st = &stations[s];
+		ops->free_sta(priv, &st->si->sta, st->priv_sta);
+	}
+	ops->free(priv);
+
+	return 0;
+}
+
+/*
+ * Report
+ */
+
+static double mbps(const struct rcsim_link_stats *ls)
+{
+	if (!ls->airtime_us)
+		return 0;
+	return ls->bytes_acked * 8.0 / ls->airtime_us;
+}
+
+static double pct(u64 a, u64 b)
+{
+	return b ? 100.0 * a / b : 0;
+}
+
+static void report(const char *alg, unsigned int top)
+{
+	struct rcsim_link_stats trace = {}, sim = {};
+	struct rcsim_sta *st;
+	const struct ieee80211_sta *sta;
+	unsigned int n;
+	int s, k, best;
+	u64 shown;
+	char name[32];
+
+	printf("rcsim: %s, %d station(s), %zu frames, %.3f s\n", alg,
+	       n_stations, n_events, (t_end - t_start) / 1000000.0);
+
+	for (s = 0; s < n_stations; s++) {
+		st = &stations[s];
+		sta = &st->si->sta;
+
+		printf("\nsta %02x:%02x:%02x:%02x:%02x:%02x %s",
+		       sta->addr[0], sta->addr[1], sta->addr[2],
+		       sta->addr[3], sta->addr[4], sta->addr[5],
+		       st->band == IEEE80211_BAND_5GHZ ? "5GHz" : "2.4GHz");
+		if (sta->ht_cap.ht_supported)
+			printf(" ht cap 0x%04x mcs %02x%02x%02x%02x",
+			       sta->ht_cap.cap, sta->ht_cap.mcs.rx_mask[0],
+			       sta->ht_cap.mcs.rx_mask[1],
+			       sta->ht_cap.mcs.rx_mask[2],
+			       sta->ht_cap.mcs.rx_mask[3]);
+		printf("\n");
+		printf("  %-6s %10s %12s %10s %12s\n", "", "frames",
+		       "delivered", "Mbit/s", "airtime ms");
+		printf("  %-6s %10llu %11.1f%% %10.2f %12.1f\n", "trace",
+		       (unsigned long long)st->trace.frames,
+		       pct(st->trace.mpdus_acked, st->trace.mpdus),
+		       mbps(&st->trace), st->trace.airtime_us / 1000.0);
+		printf("  %-6s %10llu %11.1f%% %10.2f %12.1f\n", "sim",
+		       (unsigned long long)st->sim.frames,
+		       pct(st->sim.mpdus_acked, st->sim.mpdus),
+		       mbps(&st->sim), st->sim.airtime_us / 1000.0);
+
+		printf("  first rate picked:\n");
+		shown = 0;
+		for (n = 0; n < top; n++) {
+			best = -1;
+			for (k = 0; k < N_KEYS; k++)
+				if (st->first_rate[k] &&
+				    (best < 0 ||
+				     st->first_rate[k] > st->first_rate[best]))
+					best = k;
+			if (best < 0)
+				break;
+
+			key_name(st, best, name, sizeof(name));
+			printf("    %-16s %6.2f%%\n", name,
+			       pct(st->first_rate[best], st->sim.frames));
+			shown += st->first_rate[best];
+			st->first_rate[best] = 0;
+		}
+		if (shown < st->sim.frames)
+			printf("    %-16s %6.2f%%\n", "other",
+			       pct(st->sim.frames - shown, st->sim.frames));
+
+		trace.mpdus += st->trace.mpdus;
+		trace.mpdus_acked += st->trace.mpdus_acked;
+		trace.bytes_acked += st->trace.bytes_acked;
+		trace.airtime_us += st->trace.airtime_us;
+		sim.mpdus += st->sim.mpdus;
+		sim.mpdus_acked += st->sim.mpdus_acked;
+		sim.bytes_acked += st->sim.bytes_acked;
+		sim.airtime_us += st->sim.airtime_us;
+	}
+
+	printf("\ncpu cost (timer overhead %ld ns subtracted):\n",
+	       timer_overhead_ns);
+	printf("  get_rate   %10llu calls %8.1f ns avg %8llu ns max\n",
+	       (unsigned long long)cost_get_rate.calls,
+	       cost_get_rate.calls ? (double)cost_get_rate.total_ns /
+				     cost_get_rate.calls : 0,
+	       (unsigned long long)cost_get_rate.max_ns);
+	printf("  tx_status  %10llu calls %8.1f ns avg %8llu ns max\n",
+	       (unsigned long long)cost_tx_status.calls,
+	       cost_tx_status.calls ? (double)cost_tx_status.total_ns /
+				      cost_tx_status.calls : 0,
+	       (unsigned long long)cost_tx_status.max_ns);
+	printf("  BA sessions requested: %lu\n", rcsim_ba_sessions);
+
+	/* one line for scripts */
+	printf("\nsummary alg=%s frames=%zu trace_mbps=%.2f sim_mbps=%.2f "
+	       "trace_delivery=%.1f sim_delivery=%.1f get_rate_ns=%.1f "
+	       "tx_status_ns=%.1f\n", alg, n_events, mbps(&trace), mbps(&sim),
+	       pct(trace.mpdus_acked, trace.mpdus),
+	       pct(sim.mpdus_acked, sim.mpdus),
+	       cost_get_rate.calls ? (double)cost_get_rate.total_ns /
+				     cost_get_rate.calls : 0,
+	       cost_tx_status.calls ? (double)cost_tx_status.total_ns /
+				      cost_tx_status.calls : 0);
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: rcsim [options] [trace]\n"
+		"  -a <alg>   rate control algorithm (default minstrel_ht):");
+	rcsim_list_algs(stderr);
+	fprintf(stderr, "\n"
+		"  -r <n>     hw max_rates (default 4)\n"
+		"  -t <n>     hw max_rate_tries (default 10)\n"
+		"  -w <ms>    channel model window (default 100)\n"
+		"  -s <seed>  random seed (default 1)\n"
+		"  -n <n>     number of rates to list per station (default 8)\n"
+		"  -d         dump every simulated frame to stdout\n");
+}
+
+int main(int argc, char **argv)
+{
+	struct rate_control_ops *ops;
+	const char *alg = "minstrel_ht";
+	unsigned long seed = 1;
+	unsigned int top = 8;
+	bool dump = false, help = false;
+	FILE *f = stdin;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "a:r:t:w:s:n:dh")) != -1) {
+		switch (opt) {
+		case 'a':
+			alg = optarg;
+			break;
+		case 'r':
+			hw.max_rates = atoi(optarg);
+			hw.max_report_rates = hw.max_rates;
+			break;
+		case 't':
+			hw.max_rate_tries = atoi(optarg);
+			break;
+		case 'w':
+			window_us = atoi(optarg) * 1000;
+			break;
+		case 's':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			top = atoi(optarg);
+			break;
+		case 'd':
+			dump = true;
+			break;
+		default:
+			help = true;
+			break;
+		}
+	}
+
+	/*
+	 * The kernel side (sample tables) and the channel draw from separate
+	 * streams, so changing an algorithm's use of randomness does not
+	 * change the channel it sees.
+	 */
+	rcsim_seed_kernel(seed);
+	sim_rand_state = seed ^ 0x5851f42d4c957f2dULL;
+	if (!sim_rand_state)
+		sim_rand_state = 1;
+
+	rc80211_minstrel_init();
+	rc80211_minstrel_ht_init();
+	rc80211_pid_init();
+
+	ops = rcsim_find_alg(alg);
+	if (help || !ops || hw.max_rates < 1 || hw.max_rates > IEEE80211_TX_MAX_RATES ||
+	    !hw.max_rate_tries || !window_us) {
+		usage();
+		return 2;
+	}
+
+	if (optind < argc) {
+		f = fopen(argv[optind], "r");
+		if (!f) {
+			perror(argv[optind]);
+			return 1;
+		}
+	}
+
+	if (load_trace(f))
+		return 1;
+
+	calibrate_timer();
+
+	if (replay(ops, dump ? stdout : NULL)) {
+		fprintf(stderr, "rcsim: %s: out of memory\n", alg);
+		return 1;
+	}
+
+	report(alg, top);
+	return 0;
+}
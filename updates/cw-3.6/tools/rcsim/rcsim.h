@@ -0,0 +1,21 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef __RCSIM_H
+#define __RCSIM_H
+
+#include <stdio.h>
+#include <net/mac80211.h>
+
+extern unsigned long rcsim_ba_sessions;
+
+u64 rcsim_rand(u64 *state);
+void rcsim_seed_kernel(u64 seed);
+
+struct rate_control_ops *rcsim_find_alg(const char *name);
+void rcsim_list_algs(FILE *f);
+
+#endif /* __RCSIM_H */